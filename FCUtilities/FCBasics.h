@@ -4,20 +4,25 @@
 //
 
 @import UIKit;
-
-#define user_defaults_get_bool(key)   [[NSUserDefaults standardUserDefaults] boolForKey:key]
-#define user_defaults_get_int(key)    ((int) [[NSUserDefaults standardUserDefaults] integerForKey:key])
-#define user_defaults_get_double(key) [[NSUserDefaults standardUserDefaults] doubleForKey:key]
-#define user_defaults_get_string(key) fc_safeString([[NSUserDefaults standardUserDefaults] stringForKey:key])
-#define user_defaults_get_array(key)  [[NSUserDefaults standardUserDefaults] arrayForKey:key]
-#define user_defaults_get_object(key) [[NSUserDefaults standardUserDefaults] objectForKey:key]
-
-#define user_defaults_set_bool(key, b)   { [[NSUserDefaults standardUserDefaults] setBool:b    forKey:key]; [[NSUserDefaults standardUserDefaults] synchronize]; }
-#define user_defaults_set_int(key, i)    { [[NSUserDefaults standardUserDefaults] setInteger:i forKey:key]; [[NSUserDefaults standardUserDefaults] synchronize]; }
-#define user_defaults_set_double(key, d) { [[NSUserDefaults standardUserDefaults] setDouble:d  forKey:key]; [[NSUserDefaults standardUserDefaults] synchronize]; }
-#define user_defaults_set_string(key, s) { [[NSUserDefaults standardUserDefaults] setObject:s  forKey:key]; [[NSUserDefaults standardUserDefaults] synchronize]; }
-#define user_defaults_set_array(key, a)  { [[NSUserDefaults standardUserDefaults] setObject:a  forKey:key]; [[NSUserDefaults standardUserDefaults] synchronize]; }
-#define user_defaults_set_object(key, o) { [[NSUserDefaults standardUserDefaults] setObject:o  forKey:key]; [[NSUserDefaults standardUserDefaults] synchronize]; }
+#import "FCSettingsStore.h"
+
+// Backed by FCSettingsStore: sets are cached and written behind, so a burst of sets costs one write, not one synchronize each
+#define user_defaults_get_bool(key)   [FCSettingsStore.standardStore boolForKey:key]
+#define user_defaults_get_int(key)    ((int) [FCSettingsStore.standardStore integerForKey:key])
+#define user_defaults_get_double(key) [FCSettingsStore.standardStore doubleForKey:key]
+#define user_defaults_get_string(key) fc_safeString([FCSettingsStore.standardStore stringForKey:key])
+#define user_defaults_get_array(key)  [FCSettingsStore.standardStore arrayForKey:key]
+#define user_defaults_get_object(key) [FCSettingsStore.standardStore objectForKey:key]
+
+#define user_defaults_set_bool(key, b)   { [FCSettingsStore.standardStore setBool:b    forKey:key]; }
+#define user_defaults_set_int(key, i)    { [FCSettingsStore.standardStore setInteger:i forKey:key]; }
+#define user_defaults_set_double(key, d) { [FCSettingsStore.standardStore setDouble:d  forKey:key]; }
+#define user_defaults_set_string(key, s) { [FCSettingsStore.standardStore setObject:s  forKey:key]; }
+#define user_defaults_set_array(key, a)  { [FCSettingsStore.standardStore setObject:a  forKey:key]; }
+#define user_defaults_set_object(key, o) { [FCSettingsStore.standardStore setObject:o  forKey:key]; }
+
+// Writes pending user_defaults_set_* changes now, e.g. before handing off to an extension that reads the same defaults
+#define user_defaults_flush() [FCSettingsStore.standardStore flush]
 
 #define APP_DISPLAY_NAME    [NSBundle.mainBundle objectForInfoDictionaryKey:@"CFBundleDisplayName"]
 #define APP_VERSION     	[NSBundle.mainBundle objectForInfoDictionaryKey:@"CFBundleShortVersionString"]
@@ -42,6 +47,35 @@ inline __attribute__((always_inline)) NSString *fc_dictionaryValueToString(NSObj
 // If we're currently on the main thread, run block() sync, otherwise dispatch block() async to main thread.
 void fc_executeOnMainThread(void (^block)(void));
 
+// Batched alternative for high-volume updates, e.g. image deliveries during scrolling. Blocks from any thread go into
+//  a lock-free queue that the main thread drains once per run loop turn (in common modes, so also while tracking),
+//  highest priority first. Once a batch has run for the time budget, remaining default- and low-priority blocks wait
+//  for the next turn; high-priority blocks always run. Unlike fc_executeOnMainThread, blocks are queued even on main.
+typedef NS_ENUM(NSInteger, FCMainThreadPriority) {
+    FCMainThreadPriorityHigh = 0,
+    FCMainThreadPriorityDefault,
+    FCMainThreadPriorityLow,
+};
+
+void fc_executeOnMainThreadBatched(FCMainThreadPriority priority, void (^block)(void));
+
+// If a block with the same key (compared by identity) is still queued, it's dropped and only this one runs.
+//  Use a key private to the kind of update, such as the object being updated by a single owner. Retained until run.
+void fc_executeOnMainThreadCoalesced(id key, FCMainThreadPriority priority, void (^block)(void));
+
+typedef struct {
+    NSUInteger queueDepth;            // queued blocks not yet run or dropped, at the end of the last batch
+    NSUInteger lastBatchCount;        // blocks run by the last batch
+    CFTimeInterval lastBatchDuration; // seconds
+    CFTimeInterval maxBatchDuration;
+    NSUInteger totalRun;
+    NSUInteger totalCoalesced;        // dropped for a newer block with the same key
+} FCMainThreadBatchStatistics;
+
+FCMainThreadBatchStatistics fc_mainThreadBatchStatistics(void);
+void fc_setMainThreadBatchObserver(void (^observer)(FCMainThreadBatchStatistics statistics)); // called on main after each batch
+void fc_setMainThreadBatchTimeBudget(CFTimeInterval seconds); // default 0.004
+
 inline __attribute((always_inline)) uint64_t fc_random_int64(void)
 {
     uint64_t urandom;
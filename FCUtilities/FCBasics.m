@@ -8,6 +8,9 @@
 
 #import <Foundation/Foundation.h>
 #import "FCBasics.h"
+#import <QuartzCore/QuartzCore.h>
+#import <os/lock.h>
+#import <stdatomic.h>
 
 static dispatch_once_t fc_mainThreadOnceToken;
 void fc_executeOnMainThread(void (^block)(void))
@@ -23,3 +26,162 @@ void fc_executeOnMainThread(void (^block)(void))
     }
 }
 
+#pragma mark - Batched main-thread execution
+
+typedef struct FCMainThreadJob {
+    struct FCMainThreadJob *next;
+    void *block; // retained; NULL once superseded
+    void *key;   // retained, or NULL
+    FCMainThreadPriority priority;
+} FCMainThreadJob;
+
+#define FCMainThreadPriorityCount 3
+
+// Producers push onto a lock-free stack; the main thread takes the whole stack at once and reverses it, so there's no ABA
+static _Atomic(FCMainThreadJob *) fc_incomingJobs;
+static atomic_bool fc_drainScheduled;
+static atomic_long fc_queuedJobCount;
+
+// Main thread only
+static FCMainThreadJob *fc_pendingHead[FCMainThreadPriorityCount], *fc_pendingTail[FCMainThreadPriorityCount];
+static CFMutableDictionaryRef fc_pendingJobsByKey; // key pointer → latest queued job, by identity
+static CFTimeInterval fc_batchTimeBudget = 0.004;
+static void (^fc_batchObserver)(FCMainThreadBatchStatistics statistics);
+
+static os_unfair_lock fc_statisticsLock = OS_UNFAIR_LOCK_INIT;
+static FCMainThreadBatchStatistics fc_statistics;
+
+static void fc_drainMainThreadJobs(void);
+
+static void fc_scheduleMainThreadDrain(void)
+{
+    if (atomic_exchange(&fc_drainScheduled, true)) return; // one wakeup per batch, not per block
+    CFRunLoopRef mainRunLoop = CFRunLoopGetMain();
+    CFRunLoopPerformBlock(mainRunLoop, kCFRunLoopCommonModes, ^{ fc_drainMainThreadJobs(); });
+    CFRunLoopWakeUp(mainRunLoop);
+}
+
+static void fc_enqueueMainThreadJob(id key, FCMainThreadPriority priority, void (^block)(void))
+{
+    if (! block) return;
+    FCMainThreadJob *job = malloc(sizeof(FCMainThreadJob));
+    job->block = (__bridge_retained void *) [block copy];
+    job->key = key ? (__bridge_retained void *) key : NULL;
+    job->priority = (priority >= FCMainThreadPriorityHigh && priority <= FCMainThreadPriorityLow) ? priority : FCMainThreadPriorityDefault;
+
+    atomic_fetch_add(&fc_queuedJobCount, 1);
+    FCMainThreadJob *head = atomic_load_explicit(&fc_incomingJobs, memory_order_relaxed);
+    do {
+        job->next = head;
+    } while (! atomic_compare_exchange_weak_explicit(&fc_incomingJobs, &head, job, memory_order_release, memory_order_relaxed));
+
+    fc_scheduleMainThreadDrain();
+}
+
+void fc_executeOnMainThreadBatched(FCMainThreadPriority priority, void (^block)(void)) { fc_enqueueMainThreadJob(nil, priority, block); }
+void fc_executeOnMainThreadCoalesced(id key, FCMainThreadPriority priority, void (^block)(void)) { fc_enqueueMainThreadJob(key, priority, block); }
+
+static void fc_finishMainThreadJob(FCMainThreadJob *job)
+{
+    if (job->key) {
+        if (CFDictionaryGetValue(fc_pendingJobsByKey, job->key) == job) CFDictionaryRemoveValue(fc_pendingJobsByKey, job->key);
+        CFBridgingRelease(job->key);
+    }
+    free(job);
+}
+
+static void fc_drainMainThreadJobs(void)
+{
+    // Cleared first, so blocks submitted from here on schedule the next batch
+    atomic_store(&fc_drainScheduled, false);
+    if (! fc_pendingJobsByKey) fc_pendingJobsByKey = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+
+    FCMainThreadJob *incoming = atomic_exchange_explicit(&fc_incomingJobs, NULL, memory_order_acquire);
+    FCMainThreadJob *reversed = NULL;
+    while (incoming) {
+        FCMainThreadJob *next = incoming->next;
+        incoming->next = reversed;
+        reversed = incoming;
+        incoming = next;
+    }
+
+    NSUInteger coalesced = 0;
+    for (FCMainThreadJob *job = reversed, *next; job; job = next) {
+        next = job->next;
+        job->next = NULL;
+
+        if (job->key) {
+            FCMainThreadJob *superseded = (FCMainThreadJob *) CFDictionaryGetValue(fc_pendingJobsByKey, job->key);
+            if (superseded && superseded->block) {
+                CFBridgingRelease(superseded->block);
+                superseded->block = NULL;
+                coalesced++;
+            }
+            CFDictionarySetValue(fc_pendingJobsByKey, job->key, job);
+        }
+
+        if (fc_pendingTail[job->priority]) fc_pendingTail[job->priority]->next = job;
+        else fc_pendingHead[job->priority] = job;
+        fc_pendingTail[job->priority] = job;
+    }
+    if (coalesced) atomic_fetch_sub(&fc_queuedJobCount, (long) coalesced);
+
+    CFTimeInterval start = CACurrentMediaTime();
+    NSUInteger ran = 0;
+    BOOL overBudget = NO;
+    for (int lane = 0; lane < FCMainThreadPriorityCount && ! overBudget; lane++) {
+        FCMainThreadJob *job;
+        while ( (job = fc_pendingHead[lane]) ) {
+            if (lane != FCMainThreadPriorityHigh && ran && CACurrentMediaTime() - start > fc_batchTimeBudget) {
+                overBudget = YES;
+                break;
+            }
+
+            fc_pendingHead[lane] = job->next;
+            if (! fc_pendingHead[lane]) fc_pendingTail[lane] = NULL;
+
+            void (^block)(void) = job->block ? (__bridge_transfer void (^)(void)) job->block : nil;
+            job->block = NULL;
+            fc_finishMainThreadJob(job);
+            if (! block) continue;
+
+            atomic_fetch_sub(&fc_queuedJobCount, 1);
+            @autoreleasepool { block(); }
+            ran++;
+        }
+    }
+
+    if (overBudget) fc_scheduleMainThreadDrain();
+
+    CFTimeInterval duration = CACurrentMediaTime() - start;
+    os_unfair_lock_lock(&fc_statisticsLock);
+    fc_statistics.queueDepth = (NSUInteger) MAX(0L, atomic_load(&fc_queuedJobCount));
+    fc_statistics.lastBatchCount = ran;
+    fc_statistics.lastBatchDuration = duration;
+    fc_statistics.maxBatchDuration = MAX(fc_statistics.maxBatchDuration, duration);
+    fc_statistics.totalRun += ran;
+    fc_statistics.totalCoalesced += coalesced;
+    FCMainThreadBatchStatistics statistics = fc_statistics;
+    os_unfair_lock_unlock(&fc_statisticsLock);
+
+    if (fc_batchObserver) fc_batchObserver(statistics);
+}
+
+FCMainThreadBatchStatistics fc_mainThreadBatchStatistics(void)
+{
+    os_unfair_lock_lock(&fc_statisticsLock);
+    FCMainThreadBatchStatistics statistics = fc_statistics;
+    os_unfair_lock_unlock(&fc_statisticsLock);
+    return statistics;
+}
+
+void fc_setMainThreadBatchObserver(void (^observer)(FCMainThreadBatchStatistics statistics))
+{
+    void (^copiedObserver)(FCMainThreadBatchStatistics) = [observer copy];
+    fc_executeOnMainThread(^{ fc_batchObserver = copiedObserver; });
+}
+
+void fc_setMainThreadBatchTimeBudget(CFTimeInterval seconds)
+{
+    fc_executeOnMainThread(^{ fc_batchTimeBudget = MAX(0, seconds); });
+}
@@ -4,14 +4,40 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "FCDiskCache.h"
 
 @interface FCCache : NSObject
 
 - (id)objectForKey:(id)key;
 - (void)setObject:(id)obj forKey:(id)key;
+- (void)setObject:(id)obj forKey:(id)key cost:(NSUInteger)cost;
 - (void)removeObjectForKey:(id)key;
 - (void)removeAllObjects;
 
+// Batch operations take the cache's lock once for the whole batch instead of once per key.
+- (NSDictionary *)objectsForKeys:(NSArray *)keys; // only contains keys that were present
+- (void)setObjectsFromDictionary:(NSDictionary *)dictionary;
+- (void)removeObjectsForKeys:(NSArray *)keys;
+
+// When either limit is exceeded, least-recently-used objects are evicted until both are satisfied. 0 = no limit.
 @property (nonatomic) NSUInteger itemLimit;
+@property (nonatomic) NSUInteger totalCostLimit;
+
+// Running counters for tuning limits. Eviction counts only objects removed to satisfy limits.
+@property (nonatomic, readonly) NSUInteger hitCount;
+@property (nonatomic, readonly) NSUInteger missCount;
+@property (nonatomic, readonly) NSUInteger evictionCount;
+@property (nonatomic, readonly) NSUInteger totalCost;
+
+// Optional second tier. Every set is also written behind to disk, and objectForKey: misses fall back to it,
+//  so objects evicted from memory or dropped on memory warnings can come back without recomputing or refetching.
+// Only NSString keys are persisted. NSData values are stored as-is; set both blocks below to persist other objects.
+@property (nonatomic) FCDiskCache *diskCache;
+@property (nonatomic, copy) NSData *(^objectToDataBlock)(id object);
+@property (nonatomic, copy) id (^dataToObjectBlock)(NSData *data);
+@property (nonatomic, readonly) NSUInteger diskHitCount; // memory misses served from diskCache
+
+// Cost of objects promoted back into memory from diskCache, which have no caller-supplied cost. Default: the data's length.
+@property (nonatomic, copy) NSUInteger (^diskObjectCostBlock)(id object, NSData *data);
 
 @end
@@ -4,15 +4,39 @@
 //
 
 #import "FCCache.h"
-#ifdef TARGET_OS_IPHONE
+#if TARGET_OS_IPHONE
 @import UIKit;
 #endif
 
+// Doubly linked LRU list node, stored as the dictionary value so lookups and reordering are both O(1).
+// Next pointers are strong, prev pointers are unretained: the list head owns the chain, the dictionary owns every node.
+@interface FCCacheEntry : NSObject {
+@public
+    id key;
+    id object;
+    NSUInteger cost;
+    FCCacheEntry *next;
+    __unsafe_unretained FCCacheEntry *prev;
+}
+@end
+@implementation FCCacheEntry
+@end
+
+
 @interface FCCache () {
     NSUInteger limit;
+    NSUInteger costLimit;
+    NSUInteger totalCost;
+    NSUInteger hits, misses, evictions, diskHits;
+    NSUInteger removalGeneration; // bumped by explicit removals (not evictions), so a disk promotion can't resurrect a removed key
+    NSUInteger pendingDiskClears; // removeAllObjects calls not yet applied to diskCache
+    FCCacheEntry *head; // most recently used
+    __unsafe_unretained FCCacheEntry *tail; // least recently used
 }
 @property (nonatomic) NSMutableDictionary *backingStore;
 @property (nonatomic) dispatch_queue_t queue;
+@property (nonatomic) dispatch_queue_t diskQueue;
+@property (nonatomic) NSCountedSet *pendingDiskKeys; // keys with writes or removals not yet applied to diskCache; only touched on queue
 @end
 
 @implementation FCCache
@@ -21,52 +45,275 @@
 {
     if ( (self = [super init]) ) {
         self.backingStore = [NSMutableDictionary dictionary];
+        self.pendingDiskKeys = [NSCountedSet set];
 #if TARGET_OS_IPHONE && ! TARGET_OS_WATCH
-        [NSNotificationCenter.defaultCenter addObserver:self selector:@selector(removeAllObjects) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+        [NSNotificationCenter.defaultCenter addObserver:self selector:@selector(removeAllObjectsFromMemory) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
 #endif
-        self.queue = dispatch_queue_create("FCCache", DISPATCH_QUEUE_SERIAL); // compatible with concurrent as well via barriers
+        self.queue = dispatch_queue_create("FCCache", DISPATCH_QUEUE_SERIAL); // must stay serial: reads reorder the LRU list
+        self.diskQueue = dispatch_queue_create("FCCache-disk", DISPATCH_QUEUE_SERIAL); // serial to keep disk writes in order
     }
     return self;
 }
 
-- (void)dealloc { [NSNotificationCenter.defaultCenter removeObserver:self]; }
+- (void)dealloc
+{
+    [NSNotificationCenter.defaultCenter removeObserver:self];
+    [self _removeAllEntries];
+}
+
+#pragma mark - LRU list (call only on queue)
+
+- (void)_unlinkEntry:(FCCacheEntry *)entry
+{
+    FCCacheEntry *strongEntry = entry; // keep alive while its owning pointer is rewired
+    if (strongEntry->prev) strongEntry->prev->next = strongEntry->next; else head = strongEntry->next;
+    if (strongEntry->next) strongEntry->next->prev = strongEntry->prev; else tail = strongEntry->prev;
+    strongEntry->next = nil;
+    strongEntry->prev = nil;
+}
+
+- (void)_linkEntryAtHead:(FCCacheEntry *)entry
+{
+    entry->next = head;
+    entry->prev = nil;
+    if (head) head->prev = entry; else tail = entry;
+    head = entry;
+}
+
+- (void)_removeEntry:(FCCacheEntry *)entry
+{
+    FCCacheEntry *strongEntry = entry;
+    [self _unlinkEntry:strongEntry];
+    totalCost -= strongEntry->cost;
+    [_backingStore removeObjectForKey:strongEntry->key];
+}
 
-- (NSUInteger)itemLimit { return limit; }
+- (void)_evictToLimits
+{
+    while (tail && ((limit && _backingStore.count > limit) || (costLimit && totalCost > costLimit))) {
+        [self _removeEntry:tail];
+        evictions++;
+    }
+}
+
+- (void)_removeAllEntries
+{
+    removalGeneration++;
+    // Break the strong next-chain iteratively so a long list doesn't deallocate recursively
+    while (head) { FCCacheEntry *next = head->next; head->next = nil; head = next; }
+    tail = nil;
+    totalCost = 0;
+    [_backingStore removeAllObjects];
+}
+
+#pragma mark - Limits and counters
+
+// Setters apply asynchronously, but the queue is serial, so a getter on any thread sees its own earlier set
+- (NSUInteger)itemLimit { __block NSUInteger v; dispatch_sync(_queue, ^{ v = limit; }); return v; }
 
 - (void)setItemLimit:(NSUInteger)itemLimit
 {
-    limit = itemLimit;
-    dispatch_barrier_async(_queue, ^{
-        if (limit && _backingStore.count >= limit) [_backingStore removeAllObjects];
+    dispatch_async(_queue, ^{
+        limit = itemLimit;
+        [self _evictToLimits];
+    });
+}
+
+- (NSUInteger)totalCostLimit { __block NSUInteger v; dispatch_sync(_queue, ^{ v = costLimit; }); return v; }
+
+- (void)setTotalCostLimit:(NSUInteger)totalCostLimit
+{
+    dispatch_async(_queue, ^{
+        costLimit = totalCostLimit;
+        [self _evictToLimits];
     });
 }
 
+- (NSUInteger)hitCount { __block NSUInteger v; dispatch_sync(_queue, ^{ v = hits; }); return v; }
+- (NSUInteger)missCount { __block NSUInteger v; dispatch_sync(_queue, ^{ v = misses; }); return v; }
+- (NSUInteger)evictionCount { __block NSUInteger v; dispatch_sync(_queue, ^{ v = evictions; }); return v; }
+- (NSUInteger)totalCost { __block NSUInteger v; dispatch_sync(_queue, ^{ v = totalCost; }); return v; }
+- (NSUInteger)diskHitCount { __block NSUInteger v; dispatch_sync(_queue, ^{ v = diskHits; }); return v; }
+
+#pragma mark - Disk tier
+
+// Disk operations run in order on diskQueue, but reads go straight to diskCache, which is thread-safe, so they never wait
+//  behind an encode. Until an operation has been applied, its key (or, for a clear, every key) reads as a disk miss
+//  instead of returning data it's about to replace or remove.
+- (void)performDiskOperationForKey:(id)key block:(void (^)(FCDiskCache *disk))block
+{
+    FCDiskCache *disk = self.diskCache;
+    if (! disk) return;
+
+    NSString *diskKey = [key copy];
+    dispatch_async(_queue, ^{ if (diskKey) [_pendingDiskKeys addObject:diskKey]; else pendingDiskClears++; });
+    dispatch_async(_diskQueue, ^{
+        block(disk);
+        dispatch_async(_queue, ^{ if (diskKey) [_pendingDiskKeys removeObject:diskKey]; else pendingDiskClears--; });
+    });
+}
+
+- (void)writeObjectToDisk:(id)obj forKey:(id)key
+{
+    if (! self.diskCache || ! [key isKindOfClass:NSString.class]) return;
+    NSData *(^encoder)(id object) = self.objectToDataBlock;
+    if (! encoder && ! [obj isKindOfClass:NSData.class]) return;
+
+    [self performDiskOperationForKey:key block:^(FCDiskCache *disk) {
+        NSData *data = encoder ? encoder(obj) : (NSData *) obj;
+        if (data) [disk setData:data forKey:key]; else [disk removeDataForKey:key];
+    }];
+}
+
+- (id)objectFromDiskForKey:(id)key data:(NSData **)outData
+{
+    FCDiskCache *disk = self.diskCache;
+    if (! disk || ! [key isKindOfClass:NSString.class]) return nil;
+    id (^decoder)(NSData *data) = self.dataToObjectBlock;
+    if (! decoder && self.objectToDataBlock) return nil;
+
+    NSData *data = [disk dataForKey:key];
+    *outData = data;
+    return data ? (decoder ? decoder(data) : data) : nil;
+}
+
+#pragma mark - Access
+
+- (id)_objectForKey:(id)key
+{
+    FCCacheEntry *entry = [_backingStore objectForKey:key];
+    if (! entry) { misses++; return nil; }
+    hits++;
+    if (entry != head) {
+        [self _unlinkEntry:entry];
+        [self _linkEntryAtHead:entry];
+    }
+    return entry->object;
+}
+
+- (void)_setObject:(id)obj forKey:(id)key cost:(NSUInteger)cost
+{
+    FCCacheEntry *entry = [_backingStore objectForKey:key];
+    if (entry) {
+        totalCost -= entry->cost;
+        [self _unlinkEntry:entry];
+    } else {
+        entry = [FCCacheEntry new];
+        entry->key = [key conformsToProtocol:@protocol(NSCopying)] ? [key copy] : key;
+        [_backingStore setObject:entry forKey:entry->key];
+    }
+    entry->object = obj;
+    entry->cost = cost;
+    totalCost += cost;
+    [self _linkEntryAtHead:entry];
+}
+
 - (id)objectForKey:(id)key
 {
     if (! key) return nil;
     __block id value;
-    dispatch_sync(_queue, ^{ value = [_backingStore objectForKey:key]; });
+    __block NSUInteger generation;
+    __block BOOL diskPending;
+    dispatch_sync(_queue, ^{
+        value = [self _objectForKey:key];
+        generation = removalGeneration;
+        diskPending = pendingDiskClears || [_pendingDiskKeys containsObject:key];
+    });
+    if (value || diskPending || ! self.diskCache) return value;
+
+    // Decode outside the queue so other cache users aren't blocked on disk I/O, then promote back into memory
+    //  unless anything was removed meanwhile, since that removal may have been of this key
+    NSData *data;
+    value = [self objectFromDiskForKey:key data:&data];
+    if (value) {
+        NSUInteger (^costBlock)(id object, NSData *data) = self.diskObjectCostBlock;
+        NSUInteger cost = costBlock ? costBlock(value, data) : data.length;
+        dispatch_async(_queue, ^{
+            diskHits++;
+            if (generation == removalGeneration && ! [_backingStore objectForKey:key]) {
+                [self _setObject:value forKey:key cost:cost];
+                [self _evictToLimits];
+            }
+        });
+    }
     return value;
 }
 
-- (void)setObject:(id)obj forKey:(id)key
+- (void)setObject:(id)obj forKey:(id)key { [self setObject:obj forKey:key cost:0]; }
+
+- (void)setObject:(id)obj forKey:(id)key cost:(NSUInteger)cost
 {
     if (! obj || ! key) return;
-    dispatch_barrier_async(_queue, ^{
-        if (limit && _backingStore.count >= limit) [_backingStore removeAllObjects];
-        [_backingStore setObject:obj forKey:key];
+    dispatch_async(_queue, ^{
+        [self _setObject:obj forKey:key cost:cost];
+        [self _evictToLimits];
     });
+    [self writeObjectToDisk:obj forKey:key];
 }
 
 - (void)removeObjectForKey:(id)key
 {
     if (! key) return;
-    dispatch_barrier_async(_queue, ^{ [_backingStore removeObjectForKey:key]; });
+    dispatch_async(_queue, ^{
+        FCCacheEntry *entry = [_backingStore objectForKey:key];
+        if (entry) [self _removeEntry:entry];
+        removalGeneration++;
+    });
+
+    if ([key isKindOfClass:NSString.class]) [self performDiskOperationForKey:key block:^(FCDiskCache *disk) { [disk removeDataForKey:key]; }];
+}
+
+- (void)removeAllObjectsFromMemory
+{
+    dispatch_async(_queue, ^{ [self _removeAllEntries]; });
 }
 
 - (void)removeAllObjects
 {
-    dispatch_barrier_async(_queue, ^{ [_backingStore removeAllObjects]; });
+    [self removeAllObjectsFromMemory];
+    [self performDiskOperationForKey:nil block:^(FCDiskCache *disk) { [disk removeAllData]; }];
+}
+
+#pragma mark - Batches
+
+- (NSDictionary *)objectsForKeys:(NSArray *)keys
+{
+    NSMutableDictionary *found = [NSMutableDictionary dictionaryWithCapacity:keys.count];
+    dispatch_sync(_queue, ^{
+        for (id key in keys) {
+            id value = [self _objectForKey:key];
+            if (value) found[key] = value;
+        }
+    });
+    return [found copy];
+}
+
+- (void)setObjectsFromDictionary:(NSDictionary *)dictionary
+{
+    if (! dictionary.count) return;
+    NSDictionary *entries = [dictionary copy];
+    dispatch_async(_queue, ^{
+        [entries enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) { [self _setObject:obj forKey:key cost:0]; }];
+        [self _evictToLimits];
+    });
+    if (self.diskCache) [entries enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) { [self writeObjectToDisk:obj forKey:key]; }];
+}
+
+- (void)removeObjectsForKeys:(NSArray *)keys
+{
+    if (! keys.count) return;
+    NSArray *keysToRemove = [keys copy];
+    dispatch_async(_queue, ^{
+        for (id key in keysToRemove) {
+            FCCacheEntry *entry = [_backingStore objectForKey:key];
+            if (entry) [self _removeEntry:entry];
+        }
+        removalGeneration++;
+    });
+
+    for (id key in keysToRemove) {
+        if ([key isKindOfClass:NSString.class]) [self performDiskOperationForKey:key block:^(FCDiskCache *disk) { [disk removeDataForKey:key]; }];
+    }
 }
 
 @end
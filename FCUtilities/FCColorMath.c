@@ -0,0 +1,150 @@
+//
+//  FCColorMath.c
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+
+#include "FCColorMath.h"
+#include <math.h>
+
+static inline float FCClamp01(float v) { return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v); }
+
+// MARK: - HSB, matching -[UIColor getHue:saturation:brightness:alpha:] and +colorWithHue:saturation:brightness:alpha:
+
+static void FCColorGetHSB(FCColorRGBA c, float *hue, float *saturation, float *brightness)
+{
+    float max = fmaxf(c.r, fmaxf(c.g, c.b));
+    float min = fminf(c.r, fminf(c.g, c.b));
+    float delta = max - min;
+
+    *brightness = max;
+    *saturation = max > 0.0f ? delta / max : 0.0f;
+    if (delta <= 0.0f) { *hue = 0.0f; return; }
+
+    float h;
+    if (max == c.r)      h = (c.g - c.b) / delta;
+    else if (max == c.g) h = 2.0f + (c.b - c.r) / delta;
+    else                 h = 4.0f + (c.r - c.g) / delta;
+    h /= 6.0f;
+    *hue = h < 0.0f ? h + 1.0f : h;
+}
+
+static FCColorRGBA FCColorFromHSB(float hue, float saturation, float brightness, float alpha)
+{
+    FCColorRGBA c = { brightness, brightness, brightness, alpha };
+    if (saturation <= 0.0f) return c;
+
+    float h = hue * 6.0f;
+    if (h >= 6.0f) h = 0.0f;
+    int sector = (int) h;
+    float f = h - sector;
+    float p = brightness * (1.0f - saturation);
+    float q = brightness * (1.0f - saturation * f);
+    float t = brightness * (1.0f - saturation * (1.0f - f));
+
+    switch (sector) {
+        case 0:  c.r = brightness; c.g = t;          c.b = p;          break;
+        case 1:  c.r = q;          c.g = brightness; c.b = p;          break;
+        case 2:  c.r = p;          c.g = brightness; c.b = t;          break;
+        case 3:  c.r = p;          c.g = q;          c.b = brightness; break;
+        case 4:  c.r = t;          c.g = p;          c.b = brightness; break;
+        default: c.r = brightness; c.g = p;          c.b = q;          break;
+    }
+    return c;
+}
+
+// MARK: - APCA
+
+float FCColorAPCALuminance(FCColorRGBA c)
+{
+    return powf(c.r, 2.4f) * 0.2126729f + powf(c.g, 2.4f) * 0.7151522f + powf(c.b, 2.4f) * 0.0721750f;
+}
+
+// adaptation of https://stackoverflow.com/a/18903483/30480
+FCColorRGBA FCColorBlend(FCColorRGBA background, FCColorRGBA foreground)
+{
+    float beta = 1.0f - foreground.a;
+    return (FCColorRGBA) {
+        background.r * beta + foreground.r * foreground.a,
+        background.g * beta + foreground.g * foreground.a,
+        background.b * beta + foreground.b * foreground.a,
+        background.a
+    };
+}
+
+// adapted from https://github.com/Myndex/SAPC-APCA/blob/master/src/JS/SAPC_0_98G_4g_minimal.js
+static float FCColorAPCAContrastWithBackgroundLuminance(FCColorRGBA text, FCColorRGBA background, float backgroundY)
+{
+    float textY = FCColorAPCALuminance(FCColorBlend(background, text));
+
+    const float clampThreshold = 0.22f;
+    if (textY <= clampThreshold)       { textY += powf(clampThreshold - textY,       1.414f); }
+    if (backgroundY <= clampThreshold) { textY += powf(clampThreshold - backgroundY, 1.414f); }
+
+    if (fabsf(backgroundY - textY) < 0.0005f) return 0;
+
+    float sapc = backgroundY > textY ? powf(backgroundY, 0.56f) - powf(textY, 0.57f) : powf(backgroundY, 0.65f) - powf(textY, 0.62f);
+
+    if (sapc < 0.001f)    return 0;
+    if (sapc < 0.035991f) return sapc - sapc * 27.7847239587675f * 0.027f;
+    return sapc - 0.027f;
+}
+
+float FCColorAPCAContrast(FCColorRGBA text, FCColorRGBA background)
+{
+    return FCColorAPCAContrastWithBackgroundLuminance(text, background, FCColorAPCALuminance(background));
+}
+
+static FCColorRGBA FCColorWithMinimumAPCAContrastAgainstLuminance(FCColorRGBA color, FCColorRGBA background, float backgroundY, float minContrast, bool *outChanged)
+{
+    bool changed = false;
+    bool darken = backgroundY > FCColorAPCALuminance(color);
+    float lastContrast = 0.0f;
+    float contrast;
+    while ( (contrast = FCColorAPCAContrastWithBackgroundLuminance(color, background, backgroundY)) < minContrast) {
+        if (contrast == lastContrast) break; // not improving anymore; bail out
+
+        float hue, saturation, brightness;
+        FCColorGetHSB(color, &hue, &saturation, &brightness);
+        if (darken) {
+            brightness *= 0.975f;
+            saturation *= 1.1f;
+        } else {
+            brightness *= 1.05f;
+            saturation *= 0.9f;
+        }
+        color = FCColorFromHSB(FCClamp01(hue), FCClamp01(saturation), FCClamp01(brightness), FCClamp01(color.a));
+        changed = true;
+        lastContrast = contrast;
+    }
+
+    if (outChanged) *outChanged = changed;
+    return color;
+}
+
+FCColorRGBA FCColorWithMinimumAPCAContrast(FCColorRGBA color, FCColorRGBA background, float minContrast, bool *outChanged)
+{
+    return FCColorWithMinimumAPCAContrastAgainstLuminance(color, background, FCColorAPCALuminance(background), minContrast, outChanged);
+}
+
+// MARK: - Batches
+
+void FCColorApplyMinimumAPCAContrast(const float *colors, float *out, size_t count, FCColorRGBA background, float minContrast, bool *outChanged)
+{
+    float backgroundY = FCColorAPCALuminance(background);
+    for (size_t i = 0; i < count; i++) {
+        const float *in = colors + i * 4;
+        FCColorRGBA c = FCColorWithMinimumAPCAContrastAgainstLuminance((FCColorRGBA) { in[0], in[1], in[2], in[3] }, background, backgroundY, minContrast, outChanged ? outChanged + i : NULL);
+        float *o = out + i * 4;
+        o[0] = c.r; o[1] = c.g; o[2] = c.b; o[3] = c.a;
+    }
+}
+
+void FCColorBlendOverBackground(const float *colors, float *out, size_t count, FCColorRGBA background)
+{
+    for (size_t i = 0; i < count; i++) {
+        const float *in = colors + i * 4;
+        FCColorRGBA c = FCColorBlend(background, (FCColorRGBA) { in[0], in[1], in[2], in[3] });
+        float *o = out + i * 4;
+        o[0] = c.r; o[1] = c.g; o[2] = c.b; o[3] = c.a;
+    }
+}
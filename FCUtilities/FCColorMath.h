@@ -0,0 +1,48 @@
+//
+//  FCColorMath.h
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+// The APCA contrast and blending math behind UIColor+FCUtilities, in plain C floats with no allocations,
+//  so whole palettes can be converted in one pass. Portable: no Apple frameworks required.
+//
+// Colors are packed as 4 consecutive floats (R, G, B, A in 0-1, not premultiplied), so an array of
+//  n colors is simply float[n * 4].
+//
+
+#ifndef FCColorMath_h
+#define FCColorMath_h
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    float r, g, b, a;
+} FCColorRGBA;
+
+// "Y" from https://github.com/Myndex/SAPC-APCA/ (alpha is ignored)
+float FCColorAPCALuminance(FCColorRGBA color);
+
+// Composites foreground over background, keeping the background's alpha
+FCColorRGBA FCColorBlend(FCColorRGBA background, FCColorRGBA foreground);
+
+// APCA Lc of text (first blended over the background) against background. Positive only; 0 if too low to matter.
+float FCColorAPCAContrast(FCColorRGBA text, FCColorRGBA background);
+
+// Darkens or lightens color in HSB steps until it reaches minContrast against background, or stops improving.
+//  outChanged is set if any step was taken.
+FCColorRGBA FCColorWithMinimumAPCAContrast(FCColorRGBA color, FCColorRGBA background, float minContrast, bool *outChanged);
+
+// Batch forms over packed RGBA arrays of count colors. In-place operation (out == colors) is allowed.
+//  outChanged may be NULL, or an array of count flags.
+void FCColorApplyMinimumAPCAContrast(const float *colors, float *out, size_t count, FCColorRGBA background, float minContrast, bool *outChanged);
+void FCColorBlendOverBackground(const float *colors, float *out, size_t count, FCColorRGBA background);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -10,10 +10,17 @@
 @interface FCConcurrentMutableDictionary : NSObject
 
 @property (nonatomic, readonly) NSUInteger count;
+
+// Contents live in a persistent hash trie: a write copies only the O(log n) nodes on its key's path and publishes the new
+// root atomically. Reads never lock, and a snapshot is an immutable view of the current root, taken in O(1) at any size.
 @property (nonatomic, readonly) NSDictionary *dictionarySnapshot;
 
 + (instancetype)dictionary;
 
+// Splits keys by hash across stripeCount tries with their own write locks, so writes to different stripes run in parallel.
+// Better for multi-core, write-heavy workloads. dictionarySnapshot and count briefly lock every stripe: O(stripeCount).
++ (instancetype)stripedDictionaryWithStripeCount:(NSUInteger)stripeCount;
+
 - (id)objectForKey:(id)key;
 - (id)objectForKeyedSubscript:(id)key;
 - (void)setObject:(id)object forKey:(id<NSCopying>)key;
@@ -21,4 +28,12 @@
 - (void)removeObjectForKey:(id)key;
 - (void)removeAllObjects;
 
+// Batch operations take the write locks once for the whole batch; snapshots see all of its changes or none.
+- (NSDictionary *)objectsForKeys:(NSArray *)keys; // only contains keys that were present
+- (void)setObjectsFromDictionary:(NSDictionary *)dictionary;
+- (void)removeObjectsForKeys:(NSArray *)keys;
+
+// Runs synchronously with exclusive access. The dictionary passed to the block is only valid inside it.
+- (void)performBatchUpdates:(void (^)(NSMutableDictionary *dictionary))updates;
+
 @end
@@ -6,72 +6,507 @@
 //
 
 #import "FCConcurrentMutableDictionary.h"
+#import <pthread.h>
 
-@interface FCConcurrentMutableDictionary ()
-@property (nonatomic) NSMutableDictionary *backingStore;
-@property (nonatomic) dispatch_queue_t queue;
+#pragma mark - Persistent hash trie
+
+// Hash array mapped trie node. Never modified once published: updates copy the nodes on the path from the root
+//  and share everything else, so any root is a complete, immutable version of the contents.
+// Bitmap nodes consume 5 hash bits per level: slot pairs are (key, value) or (nil, child node), ordered by bit.
+// Collision nodes hold (key, value) pairs whose full 64-bit hashes are equal.
+@interface FCHashTrieNode : NSObject {
+@public
+    uint32_t bitmap;
+    uint32_t count; // slot pairs
+    BOOL collision;
+    uint64_t collisionHash;
+    NSUInteger size; // entries in the whole trie; only maintained on roots
+    __strong id *slots;
+}
 @end
 
-@implementation FCConcurrentMutableDictionary
+@implementation FCHashTrieNode
+- (void)dealloc
+{
+    for (uint32_t i = 0; i < count * 2; i++) slots[i] = nil;
+    free(slots);
+}
+@end
 
-+ (instancetype)dictionary { return [[self alloc] init]; }
+static inline uint64_t FCHashTrieHash(id key)
+{
+    // Many Foundation hashes are weak in their low bits (e.g. small NSNumbers), so mix before using them as trie indexes
+    uint64_t h = (uint64_t) [key hash] * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
+}
 
-- (instancetype)init
+static inline BOOL FCHashTrieKeysEqual(id a, id b) { return a == b || [a isEqual:b]; }
+
+static FCHashTrieNode *FCHashTrieNodeCreate(uint32_t bitmap, uint32_t count)
+{
+    FCHashTrieNode *node = [FCHashTrieNode new];
+    node->bitmap = bitmap;
+    node->count = count;
+    node->slots = (__strong id *) calloc(MAX(count, 1u) * 2, sizeof(id));
+    return node;
+}
+
+// Copy of node with `insert` empty slot pairs opened at pair index `at` (or, if insert is negative, pair `at` removed)
+static FCHashTrieNode *FCHashTrieNodeCopy(FCHashTrieNode *node, uint32_t bitmap, uint32_t at, int insert)
+{
+    FCHashTrieNode *copy = FCHashTrieNodeCreate(bitmap, (uint32_t) ((int) node->count + insert));
+    copy->collision = node->collision;
+    copy->collisionHash = node->collisionHash;
+    for (uint32_t src = 0, dst = 0; src < node->count; src++) {
+        if (src == at && insert < 0) continue;
+        if (src == at && insert > 0) dst += (uint32_t) insert;
+        copy->slots[dst * 2] = node->slots[src * 2];
+        copy->slots[dst * 2 + 1] = node->slots[src * 2 + 1];
+        dst++;
+    }
+    return copy;
+}
+
+static inline uint32_t FCHashTrieBit(uint64_t hash, unsigned shift) { return 1u << ((hash >> shift) & 31); }
+static inline uint32_t FCHashTrieIndex(uint32_t bitmap, uint32_t bit) { return (uint32_t) __builtin_popcount(bitmap & (bit - 1)); }
+
+static id FCHashTrieLookup(FCHashTrieNode *node, id key, uint64_t hash)
+{
+    for (unsigned shift = 0; node; shift += 5) {
+        if (node->collision) {
+            if (node->collisionHash != hash) return nil;
+            for (uint32_t i = 0; i < node->count; i++) if (FCHashTrieKeysEqual(node->slots[i * 2], key)) return node->slots[i * 2 + 1];
+            return nil;
+        }
+
+        uint32_t bit = FCHashTrieBit(hash, shift);
+        if (! (node->bitmap & bit)) return nil;
+        uint32_t i = FCHashTrieIndex(node->bitmap, bit);
+        id slotKey = node->slots[i * 2];
+        if (! slotKey) { node = node->slots[i * 2 + 1]; continue; }
+        return FCHashTrieKeysEqual(slotKey, key) ? node->slots[i * 2 + 1] : nil;
+    }
+    return nil;
+}
+
+// Smallest subtree at `shift` holding two entries with different keys
+static FCHashTrieNode *FCHashTrieMerge(unsigned shift, id key1, id value1, uint64_t hash1, id key2, id value2, uint64_t hash2)
+{
+    if (hash1 == hash2) {
+        FCHashTrieNode *node = FCHashTrieNodeCreate(0, 2);
+        node->collision = YES;
+        node->collisionHash = hash1;
+        node->slots[0] = key1; node->slots[1] = value1;
+        node->slots[2] = key2; node->slots[3] = value2;
+        return node;
+    }
+
+    uint32_t bit1 = FCHashTrieBit(hash1, shift), bit2 = FCHashTrieBit(hash2, shift);
+    if (bit1 == bit2) {
+        FCHashTrieNode *node = FCHashTrieNodeCreate(bit1, 1);
+        node->slots[1] = FCHashTrieMerge(shift + 5, key1, value1, hash1, key2, value2, hash2);
+        return node;
+    }
+
+    FCHashTrieNode *node = FCHashTrieNodeCreate(bit1 | bit2, 2);
+    uint32_t i1 = bit1 < bit2 ? 0 : 1;
+    node->slots[i1 * 2] = key1; node->slots[i1 * 2 + 1] = value1;
+    node->slots[(1 - i1) * 2] = key2; node->slots[(1 - i1) * 2 + 1] = value2;
+    return node;
+}
+
+// Returns node itself if nothing changed
+static FCHashTrieNode *FCHashTrieInsert(FCHashTrieNode *node, unsigned shift, id key, uint64_t hash, id value, BOOL *added)
+{
+    if (node->collision) {
+        if (node->collisionHash != hash) {
+            // A different hash reached this collision leaf: push the leaf down a level beside the new entry
+            FCHashTrieNode *parent = FCHashTrieNodeCreate(FCHashTrieBit(node->collisionHash, shift), 1);
+            parent->slots[1] = node;
+            return FCHashTrieInsert(parent, shift, key, hash, value, added);
+        }
+        for (uint32_t i = 0; i < node->count; i++) {
+            if (! FCHashTrieKeysEqual(node->slots[i * 2], key)) continue;
+            if (node->slots[i * 2 + 1] == value) return node;
+            FCHashTrieNode *copy = FCHashTrieNodeCopy(node, 0, 0, 0);
+            copy->slots[i * 2 + 1] = value;
+            return copy;
+        }
+        FCHashTrieNode *copy = FCHashTrieNodeCopy(node, 0, node->count, 1);
+        copy->slots[node->count * 2] = key;
+        copy->slots[node->count * 2 + 1] = value;
+        *added = YES;
+        return copy;
+    }
+
+    uint32_t bit = FCHashTrieBit(hash, shift);
+    uint32_t i = FCHashTrieIndex(node->bitmap, bit);
+    if (! (node->bitmap & bit)) {
+        FCHashTrieNode *copy = FCHashTrieNodeCopy(node, node->bitmap | bit, i, 1);
+        copy->slots[i * 2] = key;
+        copy->slots[i * 2 + 1] = value;
+        *added = YES;
+        return copy;
+    }
+
+    id slotKey = node->slots[i * 2], slotValue = node->slots[i * 2 + 1];
+    FCHashTrieNode *copy;
+    if (! slotKey) {
+        FCHashTrieNode *child = FCHashTrieInsert(slotValue, shift + 5, key, hash, value, added);
+        if (child == slotValue) return node;
+        copy = FCHashTrieNodeCopy(node, node->bitmap, 0, 0);
+        copy->slots[i * 2 + 1] = child;
+    } else if (FCHashTrieKeysEqual(slotKey, key)) {
+        if (slotValue == value) return node;
+        copy = FCHashTrieNodeCopy(node, node->bitmap, 0, 0);
+        copy->slots[i * 2 + 1] = value;
+    } else {
+        copy = FCHashTrieNodeCopy(node, node->bitmap, 0, 0);
+        copy->slots[i * 2] = nil;
+        copy->slots[i * 2 + 1] = FCHashTrieMerge(shift + 5, slotKey, slotValue, FCHashTrieHash(slotKey), key, value, hash);
+        *added = YES;
+    }
+    return copy;
+}
+
+// Returns node itself if the key wasn't present, or nil if the node would be empty
+static FCHashTrieNode *FCHashTrieRemove(FCHashTrieNode *node, unsigned shift, id key, uint64_t hash, BOOL *removed)
+{
+    if (node->collision) {
+        if (node->collisionHash != hash) return node;
+        for (uint32_t i = 0; i < node->count; i++) {
+            if (! FCHashTrieKeysEqual(node->slots[i * 2], key)) continue;
+            *removed = YES;
+            return node->count > 1 ? FCHashTrieNodeCopy(node, 0, i, -1) : nil;
+        }
+        return node;
+    }
+
+    uint32_t bit = FCHashTrieBit(hash, shift);
+    if (! (node->bitmap & bit)) return node;
+    uint32_t i = FCHashTrieIndex(node->bitmap, bit);
+    id slotKey = node->slots[i * 2], slotValue = node->slots[i * 2 + 1];
+
+    if (slotKey) {
+        if (! FCHashTrieKeysEqual(slotKey, key)) return node;
+        *removed = YES;
+        return node->count > 1 ? FCHashTrieNodeCopy(node, node->bitmap & ~bit, i, -1) : nil;
+    }
+
+    FCHashTrieNode *child = FCHashTrieRemove(slotValue, shift + 5, key, hash, removed);
+    if (child == slotValue) return node;
+    if (! child) return node->count > 1 ? FCHashTrieNodeCopy(node, node->bitmap & ~bit, i, -1) : nil;
+
+    FCHashTrieNode *copy = FCHashTrieNodeCopy(node, node->bitmap, 0, 0);
+    if (child->count == 1 && child->slots[0]) {
+        // Pull a lone remaining entry up into this node so removals don't leave chains of single-entry nodes
+        copy->slots[i * 2] = child->slots[0];
+        copy->slots[i * 2 + 1] = child->slots[1];
+    } else {
+        copy->slots[i * 2 + 1] = child;
+    }
+    return copy;
+}
+
+static FCHashTrieNode *FCHashTrieEmpty(void) { return FCHashTrieNodeCreate(0, 0); }
+
+static FCHashTrieNode *FCHashTrieRootSet(FCHashTrieNode *root, id key, uint64_t hash, id value)
+{
+    BOOL added = NO;
+    FCHashTrieNode *newRoot = FCHashTrieInsert(root, 0, key, hash, value, &added);
+    if (newRoot != root) newRoot->size = root->size + (added ? 1 : 0);
+    return newRoot;
+}
+
+static FCHashTrieNode *FCHashTrieRootRemove(FCHashTrieNode *root, id key, uint64_t hash)
+{
+    BOOL removed = NO;
+    FCHashTrieNode *newRoot = FCHashTrieRemove(root, 0, key, hash, &removed);
+    if (newRoot == root) return root;
+    if (! newRoot) return FCHashTrieEmpty();
+    newRoot->size = root->size - 1;
+    return newRoot;
+}
+
+// Depth-first over one or more roots. The roots array keeps every node alive, so the stack doesn't retain.
+@interface FCHashTrieKeyEnumerator : NSEnumerator {
+    NSArray<FCHashTrieNode *> *roots;
+    NSUInteger nextRoot;
+    int depth;
+    __unsafe_unretained FCHashTrieNode *stack[16]; // 13 bitmap levels cover 64 hash bits, plus a collision leaf
+    uint32_t positions[16];
+}
+- (instancetype)initWithRoots:(NSArray<FCHashTrieNode *> *)roots;
+@end
+
+@implementation FCHashTrieKeyEnumerator
+
+- (instancetype)initWithRoots:(NSArray<FCHashTrieNode *> *)r
 {
     if ( (self = [super init]) ) {
-        self.backingStore = [NSMutableDictionary dictionary];
-        self.queue = dispatch_queue_create("FCConcurrentMutableDictionary", DISPATCH_QUEUE_CONCURRENT);
+        roots = [r copy];
+        depth = -1;
     }
     return self;
 }
 
-- (NSDictionary *)dictionarySnapshot
+- (id)nextObject
+{
+    while (YES) {
+        if (depth < 0) {
+            if (nextRoot >= roots.count) return nil;
+            stack[0] = roots[nextRoot++];
+            positions[0] = 0;
+            depth = 0;
+        }
+
+        FCHashTrieNode *node = stack[depth];
+        uint32_t i = positions[depth];
+        if (i >= node->count) { depth--; continue; }
+        positions[depth] = i + 1;
+        id key = node->slots[i * 2];
+        if (key) return key;
+        stack[++depth] = node->slots[i * 2 + 1];
+        positions[depth] = 0;
+    }
+}
+
+@end
+
+static inline NSUInteger FCStripeIndex(uint64_t hash, NSUInteger stripeCount)
+{
+    // High bits, since the trie consumes the hash from the low end
+    return (NSUInteger) (((hash >> 32) * stripeCount) >> 32);
+}
+
+#pragma mark - Snapshots and batches
+
+// Immutable view of one version of every stripe's trie. Creating one doesn't copy any entries.
+@interface FCConcurrentMutableDictionarySnapshot : NSDictionary {
+@public
+    NSArray<FCHashTrieNode *> *roots;
+    NSUInteger size;
+}
+- (instancetype)initWithRoots:(NSArray<FCHashTrieNode *> *)roots;
+@end
+
+@implementation FCConcurrentMutableDictionarySnapshot
+
+- (instancetype)initWithRoots:(NSArray<FCHashTrieNode *> *)r
+{
+    if ( (self = [super init]) ) {
+        roots = r;
+        for (FCHashTrieNode *root in roots) size += root->size;
+    }
+    return self;
+}
+
+- (id)copyWithZone:(NSZone *)zone { return self; }
+- (NSUInteger)count { return size; }
+- (NSEnumerator *)keyEnumerator { return [[FCHashTrieKeyEnumerator alloc] initWithRoots:roots]; }
+
+- (id)objectForKey:(id)key
 {
-    __block NSDictionary *dict;
-    dispatch_sync(_queue, ^{ dict = [self.backingStore copy]; });
-    return dict;
+    if (! key) return nil;
+    uint64_t hash = FCHashTrieHash(key);
+    return FCHashTrieLookup(roots[FCStripeIndex(hash, roots.count)], key, hash);
+}
+
+@end
+
+// Presents the tries as one NSMutableDictionary during performBatchUpdates:, while the caller holds every write lock.
+// Changes build new roots privately; they're published together when the batch ends.
+@interface FCConcurrentMutableDictionaryBatch : NSMutableDictionary {
+@public
+    NSMutableArray<FCHashTrieNode *> *roots;
 }
+@end
+
+@implementation FCConcurrentMutableDictionaryBatch
+
+- (instancetype)init { return [super init]; }
+- (instancetype)initWithCapacity:(NSUInteger)numItems { return [self init]; }
 
 - (NSUInteger)count
 {
-    __block NSUInteger count;
-    dispatch_sync(_queue, ^{ count = _backingStore.count; });
+    NSUInteger count = 0;
+    for (FCHashTrieNode *root in roots) count += root->size;
     return count;
 }
 
+- (NSEnumerator *)keyEnumerator { return [[FCHashTrieKeyEnumerator alloc] initWithRoots:roots]; }
+
 - (id)objectForKey:(id)key
 {
-    __block id value;
-    dispatch_sync(_queue, ^{ value = [_backingStore objectForKey:key]; });
-    return value;
+    if (! key) return nil;
+    uint64_t hash = FCHashTrieHash(key);
+    return FCHashTrieLookup(roots[FCStripeIndex(hash, roots.count)], key, hash);
+}
+
+- (void)setObject:(id)object forKey:(id<NSCopying>)key
+{
+    if (! key) return;
+    if (! object) { [self removeObjectForKey:key]; return; }
+    uint64_t hash = FCHashTrieHash(key);
+    NSUInteger i = FCStripeIndex(hash, roots.count);
+    roots[i] = FCHashTrieRootSet(roots[i], [key copyWithZone:nil], hash, object);
 }
 
-- (id)objectForKeyedSubscript:(id)key
+- (void)removeObjectForKey:(id)key
 {
-    __block id value;
-    dispatch_sync(_queue, ^{ value = [_backingStore objectForKeyedSubscript:key]; });
-    return value;
+    if (! key) return;
+    uint64_t hash = FCHashTrieHash(key);
+    NSUInteger i = FCStripeIndex(hash, roots.count);
+    roots[i] = FCHashTrieRootRemove(roots[i], key, hash);
 }
 
-- (void)setObject:(id)object forKey:(id<NSCopying>)key
+- (void)removeAllObjects
+{
+    for (NSUInteger i = 0; i < roots.count; i++) roots[i] = FCHashTrieEmpty();
+}
+
+@end
+
+#pragma mark - Dictionary
+
+@interface FCConcurrentMutableDictionaryStripe : NSObject {
+@public
+    pthread_mutex_t writeLock; // serializes writers; readers never take it
+}
+@property (atomic) FCHashTrieNode *root;
+@end
+
+@implementation FCConcurrentMutableDictionaryStripe
+- (instancetype)init
+{
+    if ( (self = [super init]) ) {
+        pthread_mutex_init(&writeLock, NULL);
+        self.root = FCHashTrieEmpty();
+    }
+    return self;
+}
+- (void)dealloc { pthread_mutex_destroy(&writeLock); }
+@end
+
+@interface FCConcurrentMutableDictionary () {
+    NSArray<FCConcurrentMutableDictionaryStripe *> *stripes;
+}
+- (instancetype)initWithStripeCount:(NSUInteger)count;
+@end
+
+@implementation FCConcurrentMutableDictionary
+
++ (instancetype)dictionary { return [[self alloc] init]; }
+
++ (instancetype)stripedDictionaryWithStripeCount:(NSUInteger)stripeCount
+{
+    return [[self alloc] initWithStripeCount:stripeCount];
+}
+
+- (instancetype)init { return [self initWithStripeCount:1]; }
+
+- (instancetype)initWithStripeCount:(NSUInteger)count
 {
-    dispatch_barrier_async(_queue, ^{ [_backingStore setObject:object forKey:key]; });
+    if ( (self = [super init]) ) {
+        NSMutableArray *s = [NSMutableArray arrayWithCapacity:MAX((NSUInteger) 1, count)];
+        for (NSUInteger i = 0; i < MAX((NSUInteger) 1, count); i++) [s addObject:[FCConcurrentMutableDictionaryStripe new]];
+        stripes = [s copy];
+    }
+    return self;
 }
 
-- (void)setObject:(id)object forKeyedSubscript:(id<NSCopying>)key
+// Always in the same order, so concurrent whole-dictionary operations can't deadlock
+- (void)lockAllStripes { for (FCConcurrentMutableDictionaryStripe *stripe in stripes) pthread_mutex_lock(&stripe->writeLock); }
+- (void)unlockAllStripes { for (FCConcurrentMutableDictionaryStripe *stripe in stripes) pthread_mutex_unlock(&stripe->writeLock); }
+
+- (NSDictionary *)dictionarySnapshot
 {
-    dispatch_barrier_async(_queue, ^{ [_backingStore setObject:object forKeyedSubscript:key]; });
+    if (stripes.count == 1) return [[FCConcurrentMutableDictionarySnapshot alloc] initWithRoots:@[ stripes[0].root ]];
+
+    // Hold every write lock so the roots all come from a single moment
+    NSMutableArray<FCHashTrieNode *> *roots = [NSMutableArray arrayWithCapacity:stripes.count];
+    [self lockAllStripes];
+    for (FCConcurrentMutableDictionaryStripe *stripe in stripes) [roots addObject:stripe.root];
+    [self unlockAllStripes];
+    return [[FCConcurrentMutableDictionarySnapshot alloc] initWithRoots:roots];
 }
 
+#pragma mark - Access
+
+- (NSUInteger)count { return self.dictionarySnapshot.count; }
+
+- (id)objectForKey:(id)key
+{
+    if (! key) return nil;
+    uint64_t hash = FCHashTrieHash(key);
+    return FCHashTrieLookup(stripes[FCStripeIndex(hash, stripes.count)].root, key, hash);
+}
+
+- (id)objectForKeyedSubscript:(id)key { return [self objectForKey:key]; }
+
+- (void)setObject:(id)object forKey:(id<NSCopying>)key
+{
+    if (! key) return;
+    if (! object) { [self removeObjectForKey:key]; return; }
+    id keyCopy = [key copyWithZone:nil];
+    uint64_t hash = FCHashTrieHash(keyCopy);
+    FCConcurrentMutableDictionaryStripe *stripe = stripes[FCStripeIndex(hash, stripes.count)];
+    pthread_mutex_lock(&stripe->writeLock);
+    stripe.root = FCHashTrieRootSet(stripe.root, keyCopy, hash, object);
+    pthread_mutex_unlock(&stripe->writeLock);
+}
+
+- (void)setObject:(id)object forKeyedSubscript:(id<NSCopying>)key { [self setObject:object forKey:key]; }
+
 - (void)removeObjectForKey:(id)key
 {
-    dispatch_barrier_async(_queue, ^{ [_backingStore removeObjectForKey:key]; });
+    if (! key) return;
+    uint64_t hash = FCHashTrieHash(key);
+    FCConcurrentMutableDictionaryStripe *stripe = stripes[FCStripeIndex(hash, stripes.count)];
+    pthread_mutex_lock(&stripe->writeLock);
+    stripe.root = FCHashTrieRootRemove(stripe.root, key, hash);
+    pthread_mutex_unlock(&stripe->writeLock);
 }
 
-- (void)removeAllObjects
+- (void)removeAllObjects { [self performBatchUpdates:^(NSMutableDictionary *dictionary) { [dictionary removeAllObjects]; }]; }
+
+- (NSDictionary *)objectsForKeys:(NSArray *)keys
 {
-    dispatch_barrier_async(_queue, ^{ [_backingStore removeAllObjects]; });
+    NSMutableDictionary *found = [NSMutableDictionary dictionaryWithCapacity:keys.count];
+    NSDictionary *snapshot = self.dictionarySnapshot;
+    for (id key in keys) {
+        id value = [snapshot objectForKey:key];
+        if (value) found[key] = value;
+    }
+    return [found copy];
 }
 
+- (void)setObjectsFromDictionary:(NSDictionary *)dictionary
+{
+    if (! dictionary.count) return;
+    NSDictionary *entries = [dictionary copy];
+    [self performBatchUpdates:^(NSMutableDictionary *batch) { [batch addEntriesFromDictionary:entries]; }];
+}
+
+- (void)removeObjectsForKeys:(NSArray *)keys
+{
+    if (! keys.count) return;
+    NSArray *keysToRemove = [keys copy];
+    [self performBatchUpdates:^(NSMutableDictionary *batch) { [batch removeObjectsForKeys:keysToRemove]; }];
+}
+
+- (void)performBatchUpdates:(void (^)(NSMutableDictionary *dictionary))updates
+{
+    if (! updates) return;
+    FCConcurrentMutableDictionaryBatch *batch = [FCConcurrentMutableDictionaryBatch new];
+    [self lockAllStripes];
+    batch->roots = [NSMutableArray arrayWithCapacity:stripes.count];
+    for (FCConcurrentMutableDictionaryStripe *stripe in stripes) [batch->roots addObject:stripe.root];
+    updates(batch);
+    [stripes enumerateObjectsUsingBlock:^(FCConcurrentMutableDictionaryStripe *stripe, NSUInteger idx, BOOL *stop) {
+        if (stripe.root != batch->roots[idx]) stripe.root = batch->roots[idx];
+    }];
+    [self unlockAllStripes];
+}
 
 @end
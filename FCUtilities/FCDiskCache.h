@@ -0,0 +1,32 @@
+//
+//  FCDiskCache.h
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+// A persistent key-value store for cache data, kept in a single append-only log file at a plain POSIX path.
+//
+//  - Writes are buffered in memory and appended asynchronously (write-behind). Reads see pending writes immediately.
+//  - An in-memory index, rebuilt by scanning record headers on init, maps each key to its latest record.
+//  - Reads copy the record straight out of the log file and are checksum-validated. Corrupt records read as misses.
+//  - When the log grows past byteLimit, it's compacted: the newest live records that fit in 3/4 of it are rewritten.
+//  - The log itself is FCDiskLog, a plain-C core that also builds and is tested on Linux (see tests/).
+//
+
+#import <Foundation/Foundation.h>
+
+@interface FCDiskCache : NSObject
+
+- (instancetype)initWithPath:(NSString *)path byteLimit:(NSUInteger)byteLimit;
+
+- (NSData *)dataForKey:(NSString *)key;
+- (void)setData:(NSData *)data forKey:(NSString *)key;
+- (void)removeDataForKey:(NSString *)key;
+- (void)removeAllData;
+
+// Blocks until all pending writes have been appended and synced to disk.
+- (void)flush;
+
+@property (nonatomic, readonly) NSString *path;
+@property (nonatomic, readonly) NSUInteger byteLimit;
+@property (nonatomic, readonly) NSUInteger fileSize;
+
+@end
@@ -0,0 +1,139 @@
+//
+//  FCDiskCache.m
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+
+#import "FCDiskCache.h"
+#import "FCDiskLog.h"
+#import <pthread.h>
+
+@interface FCDiskCache () {
+    FCDiskLog *log;
+    pthread_mutex_t lock;
+    NSMutableDictionary<NSString *, id> *pending; // NSData or NSNull (removal), guarded by lock
+    BOOL writeScheduled; // guarded by lock
+}
+@property (nonatomic) NSString *path;
+@property (nonatomic) NSUInteger byteLimit;
+@property (nonatomic) dispatch_queue_t queue;
+@end
+
+@implementation FCDiskCache
+
+- (instancetype)initWithPath:(NSString *)path byteLimit:(NSUInteger)byteLimit
+{
+    if ( (self = [super init]) ) {
+        self.path = path;
+        self.byteLimit = byteLimit;
+        self.queue = dispatch_queue_create("FCDiskCache", DISPATCH_QUEUE_SERIAL);
+        pthread_mutex_init(&lock, NULL);
+        pending = [NSMutableDictionary dictionary];
+
+        log = FCDiskLogOpen(path.fileSystemRepresentation);
+        if (! log) return nil;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    FCDiskLogClose(log);
+    pthread_mutex_destroy(&lock);
+}
+
+- (NSUInteger)fileSize { return (NSUInteger) FCDiskLogFileSize(log); }
+
+#pragma mark - Access
+
+- (NSData *)dataForKey:(NSString *)key
+{
+    if (! key) return nil;
+
+    pthread_mutex_lock(&lock);
+    id pendingValue = pending[key];
+    pthread_mutex_unlock(&lock);
+    if (pendingValue) return pendingValue == NSNull.null ? nil : pendingValue;
+
+    NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+    const uint8_t *value;
+    uint32_t valueLength;
+    void *record = FCDiskLogRead(log, keyData.bytes, (uint32_t) keyData.length, &value, &valueLength);
+    if (! record) return nil;
+    return [[NSData alloc] initWithBytesNoCopy:(void *) value length:valueLength deallocator:^(void *bytes, NSUInteger length) { free(record); }];
+}
+
+- (void)setPendingValue:(id)value forKey:(NSString *)key
+{
+    pthread_mutex_lock(&lock);
+    pending[key] = value;
+    BOOL needsSchedule = ! writeScheduled;
+    writeScheduled = YES;
+    pthread_mutex_unlock(&lock);
+
+    if (needsSchedule) dispatch_async(_queue, ^{ [self writePendingValues]; });
+}
+
+- (void)setData:(NSData *)data forKey:(NSString *)key
+{
+    if (! key) return;
+    if (! data) { [self removeDataForKey:key]; return; }
+    [self setPendingValue:[data copy] forKey:key];
+}
+
+- (void)removeDataForKey:(NSString *)key
+{
+    if (! key) return;
+    [self setPendingValue:NSNull.null forKey:key];
+}
+
+- (void)removeAllData
+{
+    pthread_mutex_lock(&lock);
+    [pending removeAllObjects];
+    FCDiskLogClear(log);
+    pthread_mutex_unlock(&lock);
+}
+
+- (void)flush
+{
+    dispatch_sync(_queue, ^{ [self writePendingValues]; });
+}
+
+#pragma mark - Write-behind (call only on queue)
+
+- (void)writePendingValues
+{
+    // The log's generation is read with the batch, so a clear in between discards the batch instead of writing it to the new file
+    pthread_mutex_lock(&lock);
+    NSDictionary<NSString *, id> *batch = [pending copy];
+    uint64_t generation = FCDiskLogGeneration(log);
+    writeScheduled = NO;
+    pthread_mutex_unlock(&lock);
+    if (! batch.count) return;
+
+    NSMutableArray<NSData *> *keys = [NSMutableArray arrayWithCapacity:batch.count]; // keeps key bytes alive for the append
+    FCDiskLogEntry *entries = calloc(batch.count, sizeof(FCDiskLogEntry));
+    __block size_t count = 0;
+    [batch enumerateKeysAndObjectsUsingBlock:^(NSString *key, id value, BOOL *stop) {
+        NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+        NSData *valueData = value == NSNull.null ? nil : value;
+        [keys addObject:keyData];
+        entries[count++] = (FCDiskLogEntry) {
+            keyData.bytes, (uint32_t) keyData.length, valueData ? (valueData.bytes ?: "") : NULL, (uint32_t) valueData.length
+        };
+    }];
+    BOOL ok = FCDiskLogAppend(log, entries, count, generation);
+    free(entries);
+
+    // Keep anything that was replaced while we were writing
+    pthread_mutex_lock(&lock);
+    [batch enumerateKeysAndObjectsUsingBlock:^(NSString *key, id value, BOOL *stop) {
+        if (pending[key] == value) [pending removeObjectForKey:key];
+    }];
+    pthread_mutex_unlock(&lock);
+
+    // Leave room for appends after compacting
+    if (ok && _byteLimit && FCDiskLogFileSize(log) > _byteLimit) FCDiskLogCompact(log, (uint64_t) _byteLimit * 3 / 4);
+}
+
+@end
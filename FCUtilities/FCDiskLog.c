@@ -0,0 +1,499 @@
+//
+//  FCDiskLog.c
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+
+#include "FCDiskLog.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define FCDiskLogRecordMagic     0x46434443u // "FCDC"
+#define FCDiskLogTombstoneLength UINT32_MAX
+
+typedef struct {
+    uint32_t magic;
+    uint32_t keyLength;
+    uint32_t valueLength; // FCDiskLogTombstoneLength for a removal, which has no value bytes
+    uint32_t checksum;    // crc32 of key and value bytes
+} FCDiskLogRecordHeader;
+
+// Open-addressed, linear-probed, power-of-2 table from key bytes to the key's latest record
+typedef struct {
+    uint64_t hash; // 0 marks an empty slot
+    uint8_t *key;  // owned
+    uint32_t keyLength;
+    uint32_t valueLength;
+    uint64_t offset;
+} FCDiskLogIndexEntry;
+
+typedef struct {
+    FCDiskLogIndexEntry *entries;
+    size_t capacity;
+    size_t count;
+} FCDiskLogIndex;
+
+struct FCDiskLog {
+    char *path;
+    pthread_rwlock_t lock; // shared by readers; held exclusively to change anything below
+    int fd;
+    uint64_t fileLength;
+    uint64_t generation;
+    FCDiskLogIndex index;
+    int *retiredFDs; // replaced by clears, but possibly still in use by an append or compaction
+    size_t retiredCount;
+};
+
+#ifdef FC_DISK_LOG_TESTING
+void (*FCDiskLogCompactionWillCommit)(FCDiskLog *log);
+#endif
+
+// MARK: - Records
+
+static inline uint64_t FCDiskLogRecordLength(uint32_t keyLength, uint32_t valueLength)
+{
+    return sizeof(FCDiskLogRecordHeader) + (uint64_t) keyLength + (valueLength == FCDiskLogTombstoneLength ? 0 : valueLength);
+}
+
+static uint32_t FCDiskLogChecksum(const uint8_t *bytes, uint64_t length)
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+    while (length) {
+        uInt chunk = length > (1u << 30) ? (1u << 30) : (uInt) length;
+        crc = crc32(crc, bytes, chunk);
+        bytes += chunk;
+        length -= chunk;
+    }
+    return (uint32_t) crc;
+}
+
+static uint64_t FCDiskLogEncodeRecord(uint8_t *buffer, const FCDiskLogEntry *entry)
+{
+    FCDiskLogRecordHeader header = {
+        FCDiskLogRecordMagic, entry->keyLength, entry->value ? entry->valueLength : FCDiskLogTombstoneLength, 0
+    };
+    uint8_t *keyAndValue = buffer + sizeof(header);
+    memcpy(keyAndValue, entry->key, entry->keyLength);
+    if (entry->value) memcpy(keyAndValue + entry->keyLength, entry->value, entry->valueLength);
+    header.checksum = FCDiskLogChecksum(keyAndValue, (uint64_t) entry->keyLength + (entry->value ? entry->valueLength : 0));
+    memcpy(buffer, &header, sizeof(header));
+    return FCDiskLogRecordLength(header.keyLength, header.valueLength);
+}
+
+// record must hold at least a header's worth of bytes, and the whole record if the header's lengths match
+static bool FCDiskLogRecordIsValid(const uint8_t *record, uint32_t keyLength, uint32_t valueLength)
+{
+    FCDiskLogRecordHeader header;
+    memcpy(&header, record, sizeof(header));
+    if (header.magic != FCDiskLogRecordMagic || header.keyLength != keyLength || header.valueLength != valueLength) return false;
+    uint64_t length = (uint64_t) keyLength + (valueLength == FCDiskLogTombstoneLength ? 0 : valueLength);
+    return header.checksum == FCDiskLogChecksum(record + sizeof(header), length);
+}
+
+static bool FCDiskLogWriteAll(int fd, const uint8_t *bytes, uint64_t length, uint64_t offset)
+{
+    while (length) {
+        ssize_t written = pwrite(fd, bytes, (size_t) length, (off_t) offset);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        bytes += written;
+        length -= (uint64_t) written;
+        offset += (uint64_t) written;
+    }
+    return true;
+}
+
+static bool FCDiskLogReadAll(int fd, uint8_t *bytes, uint64_t length, uint64_t offset)
+{
+    while (length) {
+        ssize_t n = pread(fd, bytes, (size_t) length, (off_t) offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        bytes += n;
+        length -= (uint64_t) n;
+        offset += (uint64_t) n;
+    }
+    return true;
+}
+
+static char *FCDiskLogPathWithSuffix(const char *path, const char *suffix)
+{
+    size_t pathLength = strlen(path), suffixLength = strlen(suffix);
+    char *result = malloc(pathLength + suffixLength + 1);
+    if (result) {
+        memcpy(result, path, pathLength);
+        memcpy(result + pathLength, suffix, suffixLength + 1);
+    }
+    return result;
+}
+
+// MARK: - Index
+
+static uint64_t FCDiskLogHash(const void *key, uint32_t length)
+{
+    // FNV-1a
+    const uint8_t *bytes = key;
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (uint32_t i = 0; i < length; i++) hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+    return hash ? hash : 1;
+}
+
+static FCDiskLogIndexEntry *FCDiskLogIndexFind(FCDiskLogIndex *index, const void *key, uint32_t keyLength, uint64_t hash)
+{
+    if (! index->capacity) return NULL;
+    size_t mask = index->capacity - 1;
+    for (size_t i = hash & mask; index->entries[i].hash; i = (i + 1) & mask) {
+        FCDiskLogIndexEntry *entry = &index->entries[i];
+        if (entry->hash == hash && entry->keyLength == keyLength && 0 == memcmp(entry->key, key, keyLength)) return entry;
+    }
+    return NULL;
+}
+
+static bool FCDiskLogIndexGrow(FCDiskLogIndex *index)
+{
+    size_t capacity = index->capacity ? index->capacity * 2 : 64, mask = capacity - 1;
+    FCDiskLogIndexEntry *entries = calloc(capacity, sizeof(FCDiskLogIndexEntry));
+    if (! entries) return false;
+    for (size_t i = 0; i < index->capacity; i++) {
+        if (! index->entries[i].hash) continue;
+        size_t j = index->entries[i].hash & mask;
+        while (entries[j].hash) j = (j + 1) & mask;
+        entries[j] = index->entries[i];
+    }
+    free(index->entries);
+    index->entries = entries;
+    index->capacity = capacity;
+    return true;
+}
+
+// Failing to allocate leaves the key unindexed, so it reads as a miss
+static void FCDiskLogIndexSet(FCDiskLogIndex *index, const void *key, uint32_t keyLength, uint64_t hash, uint64_t offset, uint32_t valueLength)
+{
+    FCDiskLogIndexEntry *entry = FCDiskLogIndexFind(index, key, keyLength, hash);
+    if (! entry) {
+        if ((index->count + 1) * 4 > index->capacity * 3 && ! FCDiskLogIndexGrow(index)) return;
+        uint8_t *keyCopy = malloc(keyLength ? keyLength : 1);
+        if (! keyCopy) return;
+        memcpy(keyCopy, key, keyLength);
+
+        size_t mask = index->capacity - 1, i = hash & mask;
+        while (index->entries[i].hash) i = (i + 1) & mask;
+        entry = &index->entries[i];
+        entry->hash = hash;
+        entry->key = keyCopy;
+        entry->keyLength = keyLength;
+        index->count++;
+    }
+    entry->offset = offset;
+    entry->valueLength = valueLength;
+}
+
+static void FCDiskLogIndexRemove(FCDiskLogIndex *index, const void *key, uint32_t keyLength, uint64_t hash)
+{
+    FCDiskLogIndexEntry *entry = FCDiskLogIndexFind(index, key, keyLength, hash);
+    if (! entry) return;
+    free(entry->key);
+
+    // Backward-shift deletion: pull later entries of the probe run into the hole, unless that would move one before its home
+    size_t mask = index->capacity - 1, hole = (size_t) (entry - index->entries);
+    for (size_t i = (hole + 1) & mask; index->entries[i].hash; i = (i + 1) & mask) {
+        size_t home = index->entries[i].hash & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            index->entries[hole] = index->entries[i];
+            hole = i;
+        }
+    }
+    memset(&index->entries[hole], 0, sizeof(FCDiskLogIndexEntry));
+    index->count--;
+}
+
+static void FCDiskLogIndexFree(FCDiskLogIndex *index)
+{
+    for (size_t i = 0; i < index->capacity; i++) if (index->entries[i].hash) free(index->entries[i].key);
+    free(index->entries);
+    memset(index, 0, sizeof(FCDiskLogIndex));
+}
+
+// Indexes consecutive records from the start of bytes, returning the length of the intact prefix.
+//  Only headers and keys are read, so indexing a mapped file doesn't touch every value page.
+static uint64_t FCDiskLogIndexRecords(FCDiskLogIndex *index, const uint8_t *bytes, uint64_t size)
+{
+    uint64_t offset = 0;
+    while (offset + sizeof(FCDiskLogRecordHeader) <= size) {
+        FCDiskLogRecordHeader header;
+        memcpy(&header, bytes + offset, sizeof(header));
+        uint64_t recordLength = FCDiskLogRecordLength(header.keyLength, header.valueLength);
+        if (header.magic != FCDiskLogRecordMagic || offset + recordLength > size) break; // torn write at the tail
+
+        const uint8_t *key = bytes + offset + sizeof(header);
+        uint64_t hash = FCDiskLogHash(key, header.keyLength);
+        if (header.valueLength == FCDiskLogTombstoneLength) FCDiskLogIndexRemove(index, key, header.keyLength, hash);
+        else FCDiskLogIndexSet(index, key, header.keyLength, hash, offset, header.valueLength);
+        offset += recordLength;
+    }
+    return offset;
+}
+
+// MARK: - Log
+
+FCDiskLog *FCDiskLogOpen(const char *path)
+{
+    FCDiskLog *log = calloc(1, sizeof(FCDiskLog));
+    if (! log) return NULL;
+    log->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    log->path = strdup(path);
+    if (log->fd < 0 || ! log->path) {
+        int error = log->fd < 0 ? errno : ENOMEM;
+        if (log->fd >= 0) close(log->fd);
+        free(log->path);
+        free(log);
+        errno = error;
+        return NULL;
+    }
+    pthread_rwlock_init(&log->lock, NULL);
+
+    struct stat st;
+    if (0 == fstat(log->fd, &st) && st.st_size > 0) {
+        const uint8_t *bytes = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, log->fd, 0);
+        uint64_t intact = 0;
+        if (bytes != MAP_FAILED) {
+            intact = FCDiskLogIndexRecords(&log->index, bytes, (uint64_t) st.st_size);
+            munmap((void *) bytes, (size_t) st.st_size);
+        }
+        if (intact < (uint64_t) st.st_size && 0 != ftruncate(log->fd, (off_t) intact)) {
+            // Appending after garbage would make everything appended unreachable on the next open, so start over
+            FCDiskLogIndexFree(&log->index);
+            intact = 0;
+            if (0 != ftruncate(log->fd, 0)) { FCDiskLogClose(log); errno = EIO; return NULL; }
+        }
+        log->fileLength = intact;
+    }
+    return log;
+}
+
+void FCDiskLogClose(FCDiskLog *log)
+{
+    if (! log) return;
+    close(log->fd);
+    for (size_t i = 0; i < log->retiredCount; i++) close(log->retiredFDs[i]);
+    free(log->retiredFDs);
+    FCDiskLogIndexFree(&log->index);
+    pthread_rwlock_destroy(&log->lock);
+    free(log->path);
+    free(log);
+}
+
+uint64_t FCDiskLogFileSize(FCDiskLog *log)
+{
+    pthread_rwlock_rdlock(&log->lock);
+    uint64_t length = log->fileLength;
+    pthread_rwlock_unlock(&log->lock);
+    return length;
+}
+
+size_t FCDiskLogCount(FCDiskLog *log)
+{
+    pthread_rwlock_rdlock(&log->lock);
+    size_t count = log->index.count;
+    pthread_rwlock_unlock(&log->lock);
+    return count;
+}
+
+uint64_t FCDiskLogGeneration(FCDiskLog *log)
+{
+    pthread_rwlock_rdlock(&log->lock);
+    uint64_t generation = log->generation;
+    pthread_rwlock_unlock(&log->lock);
+    return generation;
+}
+
+void *FCDiskLogRead(FCDiskLog *log, const void *key, uint32_t keyLength, const uint8_t **value, uint32_t *valueLength)
+{
+    uint64_t hash = FCDiskLogHash(key, keyLength);
+    pthread_rwlock_rdlock(&log->lock);
+    FCDiskLogIndexEntry *entry = FCDiskLogIndexFind(&log->index, key, keyLength, hash);
+    uint32_t length = entry ? entry->valueLength : 0;
+    uint64_t recordLength = FCDiskLogRecordLength(keyLength, length);
+    uint8_t *record = entry ? malloc((size_t) recordLength) : NULL;
+    bool ok = record && FCDiskLogReadAll(log->fd, record, recordLength, entry->offset);
+    pthread_rwlock_unlock(&log->lock);
+
+    if (! ok || ! FCDiskLogRecordIsValid(record, keyLength, length) || 0 != memcmp(record + sizeof(FCDiskLogRecordHeader), key, keyLength)) {
+        free(record);
+        return NULL;
+    }
+    *value = record + sizeof(FCDiskLogRecordHeader) + keyLength;
+    *valueLength = length;
+    return record;
+}
+
+// Call only from an append or compaction, which the caller serializes: an earlier one may have been using these
+static void FCDiskLogCloseRetiredFiles(FCDiskLog *log)
+{
+    pthread_rwlock_wrlock(&log->lock);
+    for (size_t i = 0; i < log->retiredCount; i++) close(log->retiredFDs[i]);
+    log->retiredCount = 0;
+    pthread_rwlock_unlock(&log->lock);
+}
+
+bool FCDiskLogAppend(FCDiskLog *log, const FCDiskLogEntry *entries, size_t count, uint64_t generation)
+{
+    FCDiskLogCloseRetiredFiles(log);
+    if (! count) return true;
+
+    pthread_rwlock_rdlock(&log->lock);
+    bool current = generation == log->generation;
+    uint64_t start = log->fileLength;
+    int fd = log->fd; // a clear may retire it meanwhile, but it stays open until the next append or compaction
+    pthread_rwlock_unlock(&log->lock);
+    if (! current) return true;
+
+    // Coalesce the whole batch into one write
+    uint64_t length = 0;
+    for (size_t i = 0; i < count; i++) length += FCDiskLogRecordLength(entries[i].keyLength, entries[i].value ? entries[i].valueLength : FCDiskLogTombstoneLength);
+    uint8_t *buffer = malloc((size_t) length);
+    if (! buffer) return false;
+    for (size_t i = 0, position = 0; i < count; i++) position += FCDiskLogEncodeRecord(buffer + position, &entries[i]);
+    bool ok = FCDiskLogWriteAll(fd, buffer, length, start) && 0 == fsync(fd);
+    free(buffer);
+
+    pthread_rwlock_wrlock(&log->lock);
+    if (ok && generation == log->generation) {
+        uint64_t offset = start;
+        for (size_t i = 0; i < count; i++) {
+            const FCDiskLogEntry *entry = &entries[i];
+            uint64_t hash = FCDiskLogHash(entry->key, entry->keyLength);
+            if (entry->value) FCDiskLogIndexSet(&log->index, entry->key, entry->keyLength, hash, offset, entry->valueLength);
+            else FCDiskLogIndexRemove(&log->index, entry->key, entry->keyLength, hash);
+            offset += FCDiskLogRecordLength(entry->keyLength, entry->value ? entry->valueLength : FCDiskLogTombstoneLength);
+        }
+        log->fileLength = offset;
+    }
+    pthread_rwlock_unlock(&log->lock);
+    return ok;
+}
+
+typedef struct {
+    uint64_t offset;
+    uint32_t keyLength;
+    uint32_t valueLength;
+} FCDiskLogExtent;
+
+static int FCDiskLogCompareExtentsNewestFirst(const void *a, const void *b)
+{
+    uint64_t x = ((const FCDiskLogExtent *) a)->offset, y = ((const FCDiskLogExtent *) b)->offset;
+    return (x < y) - (x > y);
+}
+
+static int FCDiskLogCompareExtentsOldestFirst(const void *a, const void *b) { return FCDiskLogCompareExtentsNewestFirst(b, a); }
+
+bool FCDiskLogCompact(FCDiskLog *log, uint64_t byteBudget)
+{
+    FCDiskLogCloseRetiredFiles(log);
+
+    pthread_rwlock_rdlock(&log->lock);
+    uint64_t generation = log->generation;
+    int fd = log->fd; // as in FCDiskLogAppend, stays open even if a clear retires it
+    size_t count = 0;
+    FCDiskLogExtent *extents = malloc(sizeof(FCDiskLogExtent) * (log->index.count + 1));
+    for (size_t i = 0; extents && i < log->index.capacity; i++) {
+        FCDiskLogIndexEntry *entry = &log->index.entries[i];
+        if (entry->hash) extents[count++] = (FCDiskLogExtent) { entry->offset, entry->keyLength, entry->valueLength };
+    }
+    pthread_rwlock_unlock(&log->lock);
+    if (! extents) return false;
+
+    // Oldest records sit earliest in the log, so keep the newest that fit. Records too big to fit are skipped rather than
+    //  ending the scan, so one large value can't push out everything older.
+    qsort(extents, count, sizeof(FCDiskLogExtent), FCDiskLogCompareExtentsNewestFirst);
+    uint64_t used = 0;
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t length = FCDiskLogRecordLength(extents[i].keyLength, extents[i].valueLength);
+        if (used + length > byteBudget) continue;
+        used += length;
+        extents[kept++] = extents[i];
+    }
+    qsort(extents, kept, sizeof(FCDiskLogExtent), FCDiskLogCompareExtentsOldestFirst);
+
+    // Copy records verbatim, dropping any that no longer validate
+    uint8_t *buffer = malloc((size_t) (used ? used : 1));
+    uint64_t position = 0;
+    for (size_t i = 0; buffer && i < kept; i++) {
+        uint64_t length = FCDiskLogRecordLength(extents[i].keyLength, extents[i].valueLength);
+        if (FCDiskLogReadAll(fd, buffer + position, length, extents[i].offset) &&
+            FCDiskLogRecordIsValid(buffer + position, extents[i].keyLength, extents[i].valueLength)) position += length;
+    }
+    free(extents);
+    if (! buffer) return false;
+
+    char *tempPath = FCDiskLogPathWithSuffix(log->path, ".compacting");
+    int newFD = tempPath ? open(tempPath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1;
+    bool ok = newFD >= 0 && FCDiskLogWriteAll(newFD, buffer, position, 0) && 0 == fsync(newFD);
+    FCDiskLogIndex newIndex = { NULL, 0, 0 };
+    if (ok) FCDiskLogIndexRecords(&newIndex, buffer, position);
+    free(buffer);
+
+#ifdef FC_DISK_LOG_TESTING
+    if (ok && FCDiskLogCompactionWillCommit) FCDiskLogCompactionWillCommit(log);
+#endif
+
+    // The rename and the swap of index and descriptor are one critical section, so no reader can pair the new file
+    //  with old offsets. Appends are serialized with this, so nothing else is using the old descriptor.
+    pthread_rwlock_wrlock(&log->lock);
+    bool replaced = ok && generation == log->generation && 0 == rename(tempPath, log->path);
+    if (replaced) {
+        FCDiskLogIndexFree(&log->index);
+        log->index = newIndex;
+        close(log->fd);
+        log->fd = newFD;
+        log->fileLength = position;
+    }
+    pthread_rwlock_unlock(&log->lock);
+
+    if (! replaced) {
+        FCDiskLogIndexFree(&newIndex);
+        if (newFD >= 0) {
+            close(newFD);
+            unlink(tempPath);
+        }
+    }
+    free(tempPath);
+    return replaced;
+}
+
+void FCDiskLogClear(FCDiskLog *log)
+{
+    char *tempPath = FCDiskLogPathWithSuffix(log->path, ".clearing");
+
+    pthread_rwlock_wrlock(&log->lock);
+    log->generation++;
+    FCDiskLogIndexFree(&log->index);
+    log->fileLength = 0;
+
+    // Replaced, not truncated: a stale append landing in a truncated file could line up with new records and be
+    //  read back on the next open. The old descriptor is retired until the next append or compaction.
+    int newFD = tempPath ? open(tempPath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1;
+    int *retired = newFD >= 0 ? realloc(log->retiredFDs, sizeof(int) * (log->retiredCount + 1)) : NULL;
+    if (retired && 0 == rename(tempPath, log->path)) {
+        log->retiredFDs = retired;
+        log->retiredFDs[log->retiredCount++] = log->fd;
+        log->fd = newFD;
+    } else {
+        if (retired) log->retiredFDs = retired;
+        if (newFD >= 0) {
+            close(newFD);
+            unlink(tempPath);
+        }
+        if (0 != ftruncate(log->fd, 0)) { } // best effort, since the file couldn't be replaced
+    }
+    pthread_rwlock_unlock(&log->lock);
+    free(tempPath);
+}
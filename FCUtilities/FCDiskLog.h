@@ -0,0 +1,69 @@
+//
+//  FCDiskLog.h
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+// The storage behind FCDiskCache, in plain C on POSIX, usable without any Apple frameworks.
+//
+// An append-only log of records at a single path, with an in-memory index from each key to its latest record.
+//  Records are a 16-byte header (magic, key length, value length or UINT32_MAX for a removal, crc32 of key and value),
+//  then the key bytes, then the value bytes. Opening scans only headers and keys; a torn or garbled tail is truncated.
+//  Reads validate the header, key and crc32, and treat a record that fails as a miss.
+//
+// Appends and compactions must be serialized by the caller. Reads and clears may come from any thread at any time.
+//
+
+#ifndef FCDiskLog_h
+#define FCDiskLog_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct FCDiskLog FCDiskLog;
+
+// Returns NULL with errno set on failure
+FCDiskLog *FCDiskLogOpen(const char *path);
+void FCDiskLogClose(FCDiskLog *log);
+
+uint64_t FCDiskLogFileSize(FCDiskLog *log);
+size_t FCDiskLogCount(FCDiskLog *log); // keys with a live record
+
+// Returns a malloc'd copy of the key's record for the caller to free, with *value pointing to the value inside it,
+//  or NULL on a miss.
+void *FCDiskLogRead(FCDiskLog *log, const void *key, uint32_t keyLength, const uint8_t **value, uint32_t *valueLength);
+
+typedef struct {
+    const void *key;
+    uint32_t keyLength;
+    const void *value; // NULL removes the key
+    uint32_t valueLength;
+} FCDiskLogEntry;
+
+// Changes on every clear. Read it together with whatever state an append is built from.
+uint64_t FCDiskLogGeneration(FCDiskLog *log);
+
+// Appends entries with one write and fsync, later entries winning over earlier ones with the same key. If the log was
+//  cleared since generation was read, nothing is written and this returns true. Returns false if the write failed.
+bool FCDiskLogAppend(FCDiskLog *log, const FCDiskLogEntry *entries, size_t count, uint64_t generation);
+
+// Rewrites the newest live records that fit in byteBudget into a new file, which atomically replaces the log. Records
+//  too big to fit are skipped. Returns false, leaving the log as it was, if writing failed or the log was cleared meanwhile.
+bool FCDiskLogCompact(FCDiskLog *log, uint64_t byteBudget);
+
+// Replaces the log with an empty file. Appends and compactions in progress are discarded when they finish.
+void FCDiskLogClear(FCDiskLog *log);
+
+#ifdef FC_DISK_LOG_TESTING
+// Called by FCDiskLogCompact after it writes the new file and before it replaces the log, so tests can interleave a clear
+extern void (*FCDiskLogCompactionWillCommit)(FCDiskLog *log);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -23,6 +23,20 @@
 @property (nonatomic, weak) id target;
 @property (nonatomic) SEL action;
 
-@property (nonatomic, readonly) NSDictionary *lastMessage; // For optional conveniences only. Retention not guaranteed.
+@property (nonatomic, readonly) NSDictionary *lastMessage; // For optional conveniences only. Retention not guaranteed. In streaming mode, the last one delivered.
+
+// Streaming mode, for high message rates. Messages go into a memory-mapped ring buffer in the container (see FCPipeRing.h)
+//  instead of replacing one plist file, so none are lost when notifications coalesce. The action receives an NSArray of
+//  every NSDictionary message since the last call, in order. Messages sent while no receiver exists are not delivered.
+// If a receiver falls a whole ring behind, the oldest are dropped and counted in lostMessageCount.
+// Values may be property-list types or NSNull. Both sides of a pipe must use the same mode.
+- (instancetype)initStreamingWithAppGroupIdentifier:(NSString *)appGroupID remotePipeIdentifier:(NSString *)remotePipeID target:(__weak id)target action:(SEL)actionTakingNSArray;
+
+// Sends all messages with one notification. Returns NO, sending none, if the ring can't be opened or any message encodes
+//  to more than FCPipeRingMaximumMessageLength (256 KB). Raises NSInvalidArgumentException for unencodable values.
++ (BOOL)sendStreamingMessagesToAppGroupIdentifier:(NSString *)appGroupIdentifier pipeIdentifier:(NSString *)pipeIdentifier messages:(NSArray<NSDictionary *> *)messages;
+
+@property (nonatomic, readonly) BOOL streaming;
+@property (nonatomic, readonly) NSUInteger lostMessageCount;
 
 @end
@@ -4,12 +4,103 @@
 //
 
 #import "FCExtensionPipe.h"
+#import "FCPipeRing.h"
+#import <os/lock.h>
 #include <notify.h>
 
+#define FCExtensionPipeRingCapacity   (1u << 20)
+#define FCExtensionPipeMaximumDepth   64
+
+static BOOL FCExtensionPipeEncodeObject(FCPipeEncoder *encoder, id object, int depth)
+{
+    if (depth > FCExtensionPipeMaximumDepth) return NO;
+
+    if ([object isKindOfClass:NSString.class]) {
+        FCPipeEncodeString(encoder, [object UTF8String], [object lengthOfBytesUsingEncoding:NSUTF8StringEncoding]);
+    } else if ([object isKindOfClass:NSNumber.class]) {
+        if (CFGetTypeID((__bridge CFTypeRef) object) == CFBooleanGetTypeID()) FCPipeEncodeBool(encoder, [object boolValue]);
+        else if (CFNumberIsFloatType((__bridge CFNumberRef) object)) FCPipeEncodeDouble(encoder, [object doubleValue]);
+        else FCPipeEncodeInteger(encoder, [object longLongValue]);
+    } else if ([object isKindOfClass:NSDate.class]) {
+        FCPipeEncodeDate(encoder, [object timeIntervalSinceReferenceDate]);
+    } else if ([object isKindOfClass:NSData.class]) {
+        FCPipeEncodeData(encoder, [object bytes], [object length]);
+    } else if ([object isKindOfClass:NSArray.class]) {
+        FCPipeEncodeArrayStart(encoder, [object count]);
+        for (id element in object) if (! FCExtensionPipeEncodeObject(encoder, element, depth + 1)) return NO;
+    } else if ([object isKindOfClass:NSDictionary.class]) {
+        FCPipeEncodeDictionaryStart(encoder, [object count]);
+        for (id key in object) {
+            if (! FCExtensionPipeEncodeObject(encoder, key, depth + 1) || ! FCExtensionPipeEncodeObject(encoder, object[key], depth + 1)) return NO;
+        }
+    } else if (object == NSNull.null) {
+        FCPipeEncodeNull(encoder);
+    } else {
+        return NO;
+    }
+    return ! encoder->failed;
+}
+
+static id FCExtensionPipeDecodeObject(FCPipeDecoder *decoder, int depth)
+{
+    FCPipeValue value;
+    if (depth > FCExtensionPipeMaximumDepth || ! FCPipeDecodeNext(decoder, &value)) return nil;
+
+    switch (value.type) {
+        case FCPipeValueNull:    return NSNull.null;
+        case FCPipeValueBool:    return @(value.boolValue);
+        case FCPipeValueInteger: return @(value.integerValue);
+        case FCPipeValueDouble:  return @(value.doubleValue);
+        case FCPipeValueDate:    return [NSDate dateWithTimeIntervalSinceReferenceDate:value.doubleValue];
+        case FCPipeValueString:  return [[NSString alloc] initWithBytes:value.bytes.bytes length:value.bytes.length encoding:NSUTF8StringEncoding];
+        case FCPipeValueData:    return [NSData dataWithBytes:value.bytes.bytes length:value.bytes.length];
+
+        case FCPipeValueArray: {
+            NSMutableArray *array = [NSMutableArray arrayWithCapacity:value.count];
+            for (size_t i = 0; i < value.count; i++) {
+                id element = FCExtensionPipeDecodeObject(decoder, depth + 1);
+                if (! element) return nil;
+                [array addObject:element];
+            }
+            return array;
+        }
+
+        case FCPipeValueDictionary: {
+            NSMutableDictionary *dictionary = [NSMutableDictionary dictionaryWithCapacity:value.count];
+            for (size_t i = 0; i < value.count; i++) {
+                id key = FCExtensionPipeDecodeObject(decoder, depth + 1);
+                id object = key ? FCExtensionPipeDecodeObject(decoder, depth + 1) : nil;
+                if (! object || ! [key conformsToProtocol:@protocol(NSCopying)]) return nil;
+                dictionary[key] = object;
+            }
+            return dictionary;
+        }
+    }
+    return nil;
+}
+
+
+@interface FCExtensionPipe () {
+    FCPipeRing *ring;
+    FCPipeRingCursor cursor;
+    uint8_t *readBuffer;
+}
+@property (nonatomic) NSString *filename;
+@property (nonatomic) BOOL streaming;
+@property (nonatomic) NSUInteger lostMessageCount;
+@property (nonatomic) NSDictionary *lastStreamedMessage;
+- (void)deliverStreamedMessages;
+@end
+
 static void notificationCenterCallback(CFNotificationCenterRef center, void *observer, CFStringRef name, const void *object, CFDictionaryRef userInfo)
 {
     FCExtensionPipe *instance = (__bridge FCExtensionPipe *) observer;
     if (instance && [instance isKindOfClass:FCExtensionPipe.class]) {
+        if (instance.streaming) {
+            [instance deliverStreamedMessages];
+            return;
+        }
+
         __strong id target = instance.target;
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Warc-performSelector-leaks"
@@ -19,10 +110,6 @@ static void notificationCenterCallback(CFNotificationCenterRef center, void *obs
 }
 
 
-@interface FCExtensionPipe ()
-@property (nonatomic) NSString *filename;
-@end
-
 @implementation FCExtensionPipe
 
 - (instancetype)initWithAppGroupIdentifier:(NSString *)appGroupID remotePipeIdentifier:(NSString *)remotePipeID target:(__weak id)target action:(SEL)actionTakingNSDictionary
@@ -38,12 +125,65 @@ static void notificationCenterCallback(CFNotificationCenterRef center, void *obs
     return self;
 }
 
+- (instancetype)initStreamingWithAppGroupIdentifier:(NSString *)appGroupID remotePipeIdentifier:(NSString *)remotePipeID target:(__weak id)target action:(SEL)actionTakingNSArray
+{
+    if ( (self = [super init]) ) {
+        self.target = target;
+        self.action = actionTakingNSArray;
+        self.streaming = YES;
+        self.filename = [[self.class filenameForAppGroupIdentifier:appGroupID sourceIdentifier:remotePipeID] stringByAppendingPathExtension:@"ring"];
+
+        ring = FCPipeRingOpen(self.filename.fileSystemRepresentation, FCExtensionPipeRingCapacity);
+        if (! ring) return nil;
+        cursor = FCPipeRingNewestCursor(ring);
+        readBuffer = malloc(FCPipeRingMaximumMessageLength(ring));
+
+        CFStringRef cfStrID = (__bridge CFStringRef) [NSString stringWithFormat:@"%@.%@.ring", appGroupID, remotePipeID];
+        CFNotificationCenterAddObserver(CFNotificationCenterGetDarwinNotifyCenter(), (__bridge const void *) self, notificationCenterCallback, cfStrID, NULL, CFNotificationSuspensionBehaviorDeliverImmediately);
+    }
+    return self;
+}
+
 - (void)dealloc
 {
     CFNotificationCenterRemoveEveryObserver(CFNotificationCenterGetDarwinNotifyCenter(), (__bridge const void *) self);
+    FCPipeRingClose(ring);
+    free(readBuffer);
 }
 
-- (NSDictionary *)lastMessage { return [NSDictionary dictionaryWithContentsOfFile:self.filename]; }
+// One notification may stand for any number of messages, so this reads everything up to the writer's position
+- (void)deliverStreamedMessages
+{
+    NSMutableArray<NSDictionary *> *messages = [NSMutableArray array];
+    FCPipeRingReadResult result;
+    uint32_t length;
+    do {
+        uint32_t sequence = cursor.sequence;
+        result = FCPipeRingRead(ring, &cursor, readBuffer, &length);
+        if (result == FCPipeRingReadOverrun) {
+            self.lostMessageCount += cursor.sequence - sequence;
+        } else if (result == FCPipeRingReadMessage) {
+            FCPipeDecoder decoder = { readBuffer, length, 0 };
+            id message = FCExtensionPipeDecodeObject(&decoder, 0);
+            if ([message isKindOfClass:NSDictionary.class] && decoder.position == length) [messages addObject:message];
+            else self.lostMessageCount++;
+        }
+    } while (result == FCPipeRingReadMessage || result == FCPipeRingReadOverrun);
+
+    if (! messages.count) return;
+    self.lastStreamedMessage = messages.lastObject;
+    __strong id target = self.target;
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Warc-performSelector-leaks"
+    [target performSelector:self.action withObject:messages];
+#pragma clang diagnostic pop
+}
+
+- (NSDictionary *)lastMessage
+{
+    if (self.streaming) return self.lastStreamedMessage; // the file is a ring, not a plist
+    return [NSDictionary dictionaryWithContentsOfFile:self.filename];
+}
 
 + (NSString *)filenameForAppGroupIdentifier:(NSString *)appGroupID sourceIdentifier:(NSString *)s
 {
@@ -67,5 +207,62 @@ static void notificationCenterCallback(CFNotificationCenterRef center, void *obs
     return YES;
 }
 
-@end
++ (BOOL)sendStreamingMessagesToAppGroupIdentifier:(NSString *)appGroupID pipeIdentifier:(NSString *)pipeID messages:(NSArray<NSDictionary *> *)messages
+{
+    if (! messages.count) return YES;
 
+    // Rings stay mapped and the encoder's buffer stays allocated for the life of the process. The lock serializes
+    //  this process's threads, the ring's writer flock serializes processes (e.g. the app and several extensions).
+    static os_unfair_lock writerLock = OS_UNFAIR_LOCK_INIT;
+    static NSMutableDictionary<NSString *, NSValue *> *writerRings;
+    static FCPipeEncoder encoder;
+    NSString *filename = [[self filenameForAppGroupIdentifier:appGroupID sourceIdentifier:pipeID] stringByAppendingPathExtension:@"ring"];
+    NSUInteger messageCount = messages.count;
+    size_t *messageEnds = malloc(messageCount * sizeof(size_t));
+
+    os_unfair_lock_lock(&writerLock);
+    if (! writerRings) writerRings = [NSMutableDictionary dictionary];
+    FCPipeRing *ring = writerRings[filename].pointerValue;
+    if (! ring && (ring = FCPipeRingOpen(filename.fileSystemRepresentation, FCExtensionPipeRingCapacity))) {
+        writerRings[filename] = [NSValue valueWithPointer:ring];
+    }
+
+    // Everything is encoded and checked before anything is written, so a batch is sent whole or not at all
+    BOOL encoded = YES, fits = ring != NULL;
+    FCPipeEncoderReset(&encoder);
+    NSUInteger messageIndex = 0;
+    for (NSDictionary *message in messages) {
+        size_t start = encoder.length;
+        if (! [message isKindOfClass:NSDictionary.class] || ! FCExtensionPipeEncodeObject(&encoder, message, 0)) {
+            encoded = NO;
+            break;
+        }
+        if (ring && encoder.length - start > FCPipeRingMaximumMessageLength(ring)) fits = NO;
+        messageEnds[messageIndex++] = encoder.length;
+    }
+
+    if (encoded && fits && FCPipeRingLockWriter(ring)) {
+        size_t start = 0;
+        for (NSUInteger i = 0; i < messageCount; i++) {
+            FCPipeRingWrite(ring, encoder.bytes + start, (uint32_t) (messageEnds[i] - start));
+            start = messageEnds[i];
+        }
+        FCPipeRingUnlockWriter(ring);
+    } else {
+        fits = NO;
+    }
+    FCPipeEncoderReset(&encoder);
+    os_unfair_lock_unlock(&writerLock);
+    free(messageEnds);
+
+    if (! encoded) {
+        [[[NSException alloc] initWithName:NSInvalidArgumentException reason:@"FCExtensionPipe data error: message contains a value that isn't a property-list type or NSNull" userInfo:nil] raise];
+    }
+    if (! fits) return NO;
+
+    CFStringRef cfStrID = (__bridge CFStringRef) [NSString stringWithFormat:@"%@.%@.ring", appGroupID, pipeID];
+    CFNotificationCenterPostNotification(CFNotificationCenterGetDarwinNotifyCenter(), cfStrID, NULL, NULL, YES);
+    return YES;
+}
+
+@end
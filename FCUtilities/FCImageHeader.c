@@ -0,0 +1,207 @@
+//
+//  FCImageHeader.c
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+
+#include "FCImageHeader.h"
+#include <string.h>
+
+static inline uint16_t FCReadBE16(const uint8_t *p) { return (uint16_t) ((p[0] << 8) | p[1]); }
+static inline uint16_t FCReadLE16(const uint8_t *p) { return (uint16_t) (p[0] | (p[1] << 8)); }
+static inline uint32_t FCReadBE32(const uint8_t *p) { return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3]; }
+static inline uint32_t FCReadLE24(const uint8_t *p) { return p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16); }
+static inline uint32_t FCReadLE32(const uint8_t *p) { return FCReadLE24(p) | ((uint32_t) p[3] << 24); }
+
+// MARK: - JPEG
+
+static void FCJPEGReadDimensions(const uint8_t *bytes, size_t length, FCImageHeaderInfo *info)
+{
+    size_t i = 2;
+    while (i + 1 < length) {
+        if (bytes[i] != 0xFF) return; // lost sync: not a well-formed marker stream
+        while (i < length && bytes[i] == 0xFF) i++; // fill bytes
+        if (i >= length) return;
+
+        uint8_t marker = bytes[i++];
+        if (marker == 0xD8 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) continue; // standalone markers
+        if (marker == 0xD9 || marker == 0xDA) return; // end of image, start of scan: no frame header before it
+
+        if (i + 2 > length) return;
+        uint16_t segmentLength = FCReadBE16(bytes + i);
+        if (segmentLength < 2) return;
+
+        // SOF0-SOF15, except DHT (C4), JPG (C8) and DAC (CC), which share the range
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            if (i + 7 > length) return;
+            info->height = FCReadBE16(bytes + i + 3);
+            info->width = FCReadBE16(bytes + i + 5);
+            return;
+        }
+        i += segmentLength;
+    }
+}
+
+// MARK: - WebP
+
+static void FCWebPReadDimensions(const uint8_t *bytes, size_t length, FCImageHeaderInfo *info)
+{
+    if (length < 30) return;
+    const uint8_t *chunk = bytes + 12;
+
+    if (memcmp(chunk, "VP8 ", 4) == 0) {
+        // Lossy: keyframe start code, then 14-bit dimensions with 2-bit scale
+        if (chunk[11] != 0x9D || chunk[12] != 0x01 || chunk[13] != 0x2A) return;
+        info->width = FCReadLE16(chunk + 14) & 0x3FFF;
+        info->height = FCReadLE16(chunk + 16) & 0x3FFF;
+    } else if (memcmp(chunk, "VP8L", 4) == 0) {
+        // Lossless: signature byte, then 14-bit width-1 and height-1 packed little-endian
+        if (chunk[8] != 0x2F) return;
+        uint32_t bits = FCReadLE32(chunk + 9);
+        info->width = (bits & 0x3FFF) + 1;
+        info->height = ((bits >> 14) & 0x3FFF) + 1;
+    } else if (memcmp(chunk, "VP8X", 4) == 0) {
+        // Extended: 24-bit canvas width-1 and height-1
+        info->width = FCReadLE24(chunk + 12) + 1;
+        info->height = FCReadLE24(chunk + 15) + 1;
+    }
+}
+
+// MARK: - HEIF
+
+// Walks ISO base media boxes in [start, end), descending into meta → iprp → ipco and keeping the largest 'ispe' (image spatial extents).
+// The primary image is normally the largest; thumbnails and grid tiles have their own smaller ispe entries.
+static void FCHEIFScanBoxes(const uint8_t *bytes, size_t start, size_t end, int depth, FCImageHeaderInfo *info)
+{
+    if (depth > 4) return;
+    size_t i = start;
+    while (i + 8 <= end) {
+        uint64_t boxSize = FCReadBE32(bytes + i);
+        const uint8_t *type = bytes + i + 4;
+        size_t headerSize = 8;
+        if (boxSize == 1) {
+            if (i + 16 > end) return;
+            boxSize = ((uint64_t) FCReadBE32(bytes + i + 8) << 32) | FCReadBE32(bytes + i + 12);
+            headerSize = 16;
+        } else if (boxSize == 0) {
+            boxSize = end - i; // extends to end of enclosing box
+        }
+        if (boxSize < headerSize) return;
+
+        // Clamp to what we have: a truncated box can still contain the dimensions
+        size_t boxEnd = (boxSize > end - i) ? end : i + (size_t) boxSize;
+        size_t body = i + headerSize;
+
+        if (memcmp(type, "meta", 4) == 0) {
+            FCHEIFScanBoxes(bytes, body + 4, boxEnd, depth + 1, info); // full box: skip version and flags
+        } else if (memcmp(type, "iprp", 4) == 0) {
+            FCHEIFScanBoxes(bytes, body, boxEnd, depth + 1, info);
+        } else if (memcmp(type, "ipco", 4) == 0) {
+            // Only a complete ipco has them all; a partial one could end after a thumbnail's ispe, before the primary's
+            if (boxSize > end - i) return;
+            FCHEIFScanBoxes(bytes, body, boxEnd, depth + 1, info);
+        } else if (memcmp(type, "ispe", 4) == 0 && body + 12 <= boxEnd) {
+            uint32_t width = FCReadBE32(bytes + body + 4), height = FCReadBE32(bytes + body + 8);
+            if ((uint64_t) width * height > (uint64_t) info->width * info->height) {
+                info->width = width;
+                info->height = height;
+            }
+        } else if (depth == 0 && memcmp(type, "mdat", 4) == 0) {
+            return; // image data: all header boxes we want come before it in practice
+        }
+
+        if (boxEnd >= end) return;
+        i = boxEnd;
+    }
+}
+
+static bool FCHEIFBrandIsImage(const uint8_t *brand)
+{
+    static const char brands[][4] = { "heic", "heix", "heim", "heis", "hevc", "hevx", "hevm", "hevs", "mif1", "msf1", "avif", "avis" };
+    for (size_t i = 0; i < sizeof(brands) / sizeof(brands[0]); i++) {
+        if (memcmp(brand, brands[i], 4) == 0) return true;
+    }
+    return false;
+}
+
+static bool FCLooksLikeHEIF(const uint8_t *bytes, size_t length)
+{
+    if (length < 16 || memcmp(bytes + 4, "ftyp", 4) != 0) return false;
+    uint32_t ftypSize = FCReadBE32(bytes);
+    if (ftypSize < 16) return false;
+    if (FCHEIFBrandIsImage(bytes + 8)) return true;
+
+    // Major brand can be generic; check compatible brands
+    size_t end = ftypSize < length ? ftypSize : length;
+    for (size_t i = 16; i + 4 <= end; i += 4) {
+        if (FCHEIFBrandIsImage(bytes + i)) return true;
+    }
+    return false;
+}
+
+// MARK: - HTML
+
+static bool FCHasCaseInsensitivePrefix(const uint8_t *bytes, size_t length, const char *lowercasePrefix)
+{
+    size_t prefixLength = strlen(lowercasePrefix);
+    if (length < prefixLength) return false;
+    for (size_t i = 0; i < prefixLength; i++) {
+        uint8_t c = bytes[i];
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        if (c != (uint8_t) lowercasePrefix[i]) return false;
+    }
+    return true;
+}
+
+static bool FCLooksLikeHTML(const uint8_t *bytes, size_t length)
+{
+    size_t i = 0;
+    if (length >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF) i = 3; // UTF-8 BOM
+    while (i < length && (bytes[i] == ' ' || bytes[i] == '\t' || bytes[i] == '\r' || bytes[i] == '\n')) i++;
+    if (i >= length || bytes[i] != '<') return false;
+
+    const uint8_t *tag = bytes + i;
+    size_t remaining = length - i;
+    return (
+        FCHasCaseInsensitivePrefix(tag, remaining, "<!doctype html") ||
+        FCHasCaseInsensitivePrefix(tag, remaining, "<html") ||
+        FCHasCaseInsensitivePrefix(tag, remaining, "<head") ||
+        FCHasCaseInsensitivePrefix(tag, remaining, "<body")
+    );
+}
+
+// MARK: -
+
+FCImageFormat FCImageHeaderProbe(const uint8_t *bytes, size_t length, FCImageHeaderInfo *outInfo)
+{
+    FCImageHeaderInfo info = { FCImageFormatUnknown, 0, 0 };
+    if (! bytes) length = 0;
+
+    if (length >= 3 && bytes[0] == 0xFF && bytes[1] == 0xD8 && bytes[2] == 0xFF) {
+        info.format = FCImageFormatJPEG;
+        FCJPEGReadDimensions(bytes, length, &info);
+    } else if (length >= 8 && memcmp(bytes, "\x89PNG\r\n\x1A\n", 8) == 0) {
+        info.format = FCImageFormatPNG;
+        if (length >= 24 && memcmp(bytes + 12, "IHDR", 4) == 0) {
+            info.width = FCReadBE32(bytes + 16);
+            info.height = FCReadBE32(bytes + 20);
+        }
+    } else if (length >= 6 && (memcmp(bytes, "GIF87a", 6) == 0 || memcmp(bytes, "GIF89a", 6) == 0)) {
+        info.format = FCImageFormatGIF;
+        if (length >= 10) {
+            info.width = FCReadLE16(bytes + 6);
+            info.height = FCReadLE16(bytes + 8);
+        }
+    } else if (length >= 12 && memcmp(bytes, "RIFF", 4) == 0 && memcmp(bytes + 8, "WEBP", 4) == 0) {
+        info.format = FCImageFormatWebP;
+        FCWebPReadDimensions(bytes, length, &info);
+    } else if (FCLooksLikeHEIF(bytes, length)) {
+        info.format = FCImageFormatHEIF;
+        FCHEIFScanBoxes(bytes, 0, length, 0, &info);
+    } else if (FCLooksLikeHTML(bytes, length)) {
+        info.format = FCImageFormatHTML;
+    }
+
+    if (! info.width || ! info.height) info.width = info.height = 0;
+    if (outInfo) *outInfo = info;
+    return info.format;
+}
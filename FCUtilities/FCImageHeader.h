@@ -0,0 +1,52 @@
+//
+//  FCImageHeader.h
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+// Identifies image formats and reads pixel dimensions directly from header bytes, in plain C with no allocations,
+//  so payloads can be rejected before any ImageIO work. Portable: no Apple frameworks required.
+//
+// Dimensions are as stored, before any EXIF orientation is applied. Everything is bounds-checked against length,
+//  so it's safe on truncated or hostile input: unparseable headers just leave the dimensions at 0.
+//
+
+#ifndef FCImageHeader_h
+#define FCImageHeader_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    FCImageFormatUnknown = 0,
+    FCImageFormatJPEG,
+    FCImageFormatPNG,
+    FCImageFormatGIF,
+    FCImageFormatWebP,
+    FCImageFormatHEIF,  // HEIC, HEIF and AVIF, which share the ISO base media container
+    FCImageFormatHTML,  // usually an error or captive-portal page served in place of an image
+} FCImageFormat;
+
+typedef struct {
+    FCImageFormat format;
+    uint32_t width;     // 0 if not found
+    uint32_t height;
+} FCImageHeaderInfo;
+
+// Fills outInfo and returns its format. Most formats need only the first few dozen bytes; JPEG and HEIF
+//  dimensions can be further in, so pass as much of the data as is available.
+FCImageFormat FCImageHeaderProbe(const uint8_t *bytes, size_t length, FCImageHeaderInfo *outInfo);
+
+static inline bool FCImageFormatIsCommon(FCImageFormat format)
+{
+    return format == FCImageFormatJPEG || format == FCImageFormatPNG || format == FCImageFormatGIF;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
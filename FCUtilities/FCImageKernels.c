@@ -0,0 +1,209 @@
+//
+//  FCImageKernels.c
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+
+#include "FCImageKernels.h"
+#include <math.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FC_IMAGE_KERNELS_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FC_IMAGE_KERNELS_SSE2 1
+#endif
+
+// a * b / 255, exactly rounded
+static inline uint8_t FCMul255(unsigned a, unsigned b)
+{
+    unsigned t = a * b + 128;
+    return (uint8_t) ((t + (t >> 8)) >> 8);
+}
+
+#if FC_IMAGE_KERNELS_NEON
+static inline uint8x8_t FCMul255x8(uint8x8_t a, uint8x8_t b)
+{
+    uint16x8_t t = vmull_u8(a, b);
+    return vrshrn_n_u16(vrsraq_n_u16(t, t, 8), 8);
+}
+#elif FC_IMAGE_KERNELS_SSE2
+// Same rounding as FCMul255, on 16-bit lanes holding 8-bit values
+static inline __m128i FCMul255x8(__m128i a, __m128i b)
+{
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// Copies one 16-bit lane of each pixel to all four of its lanes
+#define FCBroadcastLane(v, lane) _mm_shufflehi_epi16(_mm_shufflelo_epi16((v), _MM_SHUFFLE(lane, lane, lane, lane)), _MM_SHUFFLE(lane, lane, lane, lane))
+#endif
+
+// MARK: - Fills
+
+static inline void FCFillAtopPixel(uint8_t *p, FCImageKernelColor c)
+{
+    unsigned da = p[3], inverseSourceAlpha = 255 - c.a;
+    unsigned r = FCMul255(c.r, da) + FCMul255(p[0], inverseSourceAlpha);
+    unsigned g = FCMul255(c.g, da) + FCMul255(p[1], inverseSourceAlpha);
+    unsigned b = FCMul255(c.b, da) + FCMul255(p[2], inverseSourceAlpha);
+    p[0] = (uint8_t) (r > da ? da : r);
+    p[1] = (uint8_t) (g > da ? da : g);
+    p[2] = (uint8_t) (b > da ? da : b);
+}
+
+void FCImageKernelFillAtop(uint8_t *pixels, size_t bytesPerRow, FCImageKernelRect rect, FCImageKernelColor color)
+{
+    for (size_t y = rect.y; y < rect.y + rect.height; y++) {
+        uint8_t *p = pixels + y * bytesPerRow + rect.x * 4;
+        size_t x = 0;
+#if FC_IMAGE_KERNELS_NEON
+        uint8x8_t cr = vdup_n_u8(color.r), cg = vdup_n_u8(color.g), cb = vdup_n_u8(color.b), inverseSourceAlpha = vdup_n_u8(255 - color.a);
+        for (; x + 8 <= rect.width; x += 8, p += 32) {
+            uint8x8x4_t px = vld4_u8(p);
+            uint8x8_t da = px.val[3];
+            px.val[0] = vmin_u8(vqadd_u8(FCMul255x8(cr, da), FCMul255x8(px.val[0], inverseSourceAlpha)), da);
+            px.val[1] = vmin_u8(vqadd_u8(FCMul255x8(cg, da), FCMul255x8(px.val[1], inverseSourceAlpha)), da);
+            px.val[2] = vmin_u8(vqadd_u8(FCMul255x8(cb, da), FCMul255x8(px.val[2], inverseSourceAlpha)), da);
+            vst4_u8(p, px);
+        }
+#elif FC_IMAGE_KERNELS_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i sourceColor = _mm_set_epi16(0, color.b, color.g, color.r, 0, color.b, color.g, color.r);
+        const __m128i inverseSourceAlpha = _mm_set1_epi16(255 - color.a);
+        const __m128i alphaLanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+        for (; x + 4 <= rect.width; x += 4, p += 16) {
+            __m128i px = _mm_loadu_si128((const __m128i *) p);
+            __m128i halves[2] = { _mm_unpacklo_epi8(px, zero), _mm_unpackhi_epi8(px, zero) };
+            for (int h = 0; h < 2; h++) {
+                __m128i da = FCBroadcastLane(halves[h], 3);
+                __m128i blended = _mm_min_epi16(_mm_add_epi16(FCMul255x8(sourceColor, da), FCMul255x8(halves[h], inverseSourceAlpha)), da);
+                halves[h] = _mm_or_si128(_mm_andnot_si128(alphaLanes, blended), _mm_and_si128(alphaLanes, halves[h]));
+            }
+            _mm_storeu_si128((__m128i *) p, _mm_packus_epi16(halves[0], halves[1]));
+        }
+#endif
+        for (; x < rect.width; x++, p += 4) FCFillAtopPixel(p, color);
+    }
+}
+
+void FCImageKernelFillBehind(uint8_t *pixels, size_t bytesPerRow, FCImageKernelRect rect, FCImageKernelColor color)
+{
+    // Premultiplied channels never exceed alpha, so dst + color × (1 - dst alpha) can't overflow
+    for (size_t y = rect.y; y < rect.y + rect.height; y++) {
+        uint8_t *p = pixels + y * bytesPerRow + rect.x * 4;
+        size_t x = 0;
+#if FC_IMAGE_KERNELS_NEON
+        uint8x8_t cr = vdup_n_u8(color.r), cg = vdup_n_u8(color.g), cb = vdup_n_u8(color.b), ca = vdup_n_u8(color.a);
+        for (; x + 8 <= rect.width; x += 8, p += 32) {
+            uint8x8x4_t px = vld4_u8(p);
+            uint8x8_t inverseDestinationAlpha = vmvn_u8(px.val[3]);
+            px.val[0] = vqadd_u8(px.val[0], FCMul255x8(cr, inverseDestinationAlpha));
+            px.val[1] = vqadd_u8(px.val[1], FCMul255x8(cg, inverseDestinationAlpha));
+            px.val[2] = vqadd_u8(px.val[2], FCMul255x8(cb, inverseDestinationAlpha));
+            px.val[3] = vqadd_u8(px.val[3], FCMul255x8(ca, inverseDestinationAlpha));
+            vst4_u8(p, px);
+        }
+#elif FC_IMAGE_KERNELS_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i sourceColor = _mm_set_epi16(color.a, color.b, color.g, color.r, color.a, color.b, color.g, color.r);
+        const __m128i ff = _mm_set1_epi16(255);
+        for (; x + 4 <= rect.width; x += 4, p += 16) {
+            __m128i px = _mm_loadu_si128((const __m128i *) p);
+            __m128i halves[2] = { _mm_unpacklo_epi8(px, zero), _mm_unpackhi_epi8(px, zero) };
+            for (int h = 0; h < 2; h++) {
+                __m128i inverseDestinationAlpha = _mm_sub_epi16(ff, FCBroadcastLane(halves[h], 3));
+                halves[h] = _mm_add_epi16(halves[h], FCMul255x8(sourceColor, inverseDestinationAlpha));
+            }
+            _mm_storeu_si128((__m128i *) p, _mm_packus_epi16(halves[0], halves[1]));
+        }
+#endif
+        for (; x < rect.width; x++, p += 4) {
+            unsigned inverseDestinationAlpha = 255 - p[3];
+            p[0] = (uint8_t) (p[0] + FCMul255(color.r, inverseDestinationAlpha));
+            p[1] = (uint8_t) (p[1] + FCMul255(color.g, inverseDestinationAlpha));
+            p[2] = (uint8_t) (p[2] + FCMul255(color.b, inverseDestinationAlpha));
+            p[3] = (uint8_t) (p[3] + FCMul255(color.a, inverseDestinationAlpha));
+        }
+    }
+}
+
+// MARK: - Desaturate
+
+// Luminance weights in 1/256ths, summing to 256 so white stays white
+enum { FCLumaR = 77, FCLumaG = 151, FCLumaB = 28 };
+
+void FCImageKernelDesaturate(uint8_t *pixels, size_t bytesPerRow, FCImageKernelRect rect)
+{
+    // Luminance is linear, so it applies to premultiplied values directly and never exceeds alpha
+    for (size_t y = rect.y; y < rect.y + rect.height; y++) {
+        uint8_t *p = pixels + y * bytesPerRow + rect.x * 4;
+        size_t x = 0;
+#if FC_IMAGE_KERNELS_NEON
+        for (; x + 8 <= rect.width; x += 8, p += 32) {
+            uint8x8x4_t px = vld4_u8(p);
+            uint16x8_t sum = vmull_u8(px.val[0], vdup_n_u8(FCLumaR));
+            sum = vmlal_u8(sum, px.val[1], vdup_n_u8(FCLumaG));
+            sum = vmlal_u8(sum, px.val[2], vdup_n_u8(FCLumaB));
+            uint8x8_t gray = vrshrn_n_u16(sum, 8);
+            px.val[0] = px.val[1] = px.val[2] = gray;
+            vst4_u8(p, px);
+        }
+#elif FC_IMAGE_KERNELS_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i alphaLanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+        for (; x + 4 <= rect.width; x += 4, p += 16) {
+            __m128i px = _mm_loadu_si128((const __m128i *) p);
+            __m128i halves[2] = { _mm_unpacklo_epi8(px, zero), _mm_unpackhi_epi8(px, zero) };
+            for (int h = 0; h < 2; h++) {
+                __m128i sum = _mm_mullo_epi16(FCBroadcastLane(halves[h], 0), _mm_set1_epi16(FCLumaR));
+                sum = _mm_add_epi16(sum, _mm_mullo_epi16(FCBroadcastLane(halves[h], 1), _mm_set1_epi16(FCLumaG)));
+                sum = _mm_add_epi16(sum, _mm_mullo_epi16(FCBroadcastLane(halves[h], 2), _mm_set1_epi16(FCLumaB)));
+                __m128i gray = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(128)), 8);
+                halves[h] = _mm_or_si128(_mm_andnot_si128(alphaLanes, gray), _mm_and_si128(alphaLanes, halves[h]));
+            }
+            _mm_storeu_si128((__m128i *) p, _mm_packus_epi16(halves[0], halves[1]));
+        }
+#endif
+        for (; x < rect.width; x++, p += 4) {
+            uint8_t gray = (uint8_t) ((p[0] * FCLumaR + p[1] * FCLumaG + p[2] * FCLumaB + 128) >> 8);
+            p[0] = p[1] = p[2] = gray;
+        }
+    }
+}
+
+// MARK: - Rounded corners
+
+void FCImageKernelRoundCorners(uint8_t *pixels, size_t bytesPerRow, FCImageKernelRect rect, double radius)
+{
+    double maxRadius = (rect.width < rect.height ? rect.width : rect.height) / 2.0;
+    if (radius > maxRadius) radius = maxRadius;
+    if (radius <= 0) return;
+
+    // Coverage depends only on the offset into the corner, so compute one corner's mask and mirror it to all four
+    size_t cornerSize = (size_t) ceil(radius);
+    for (size_t cy = 0; cy < cornerSize; cy++) {
+        double dy = radius - (cy + 0.5);
+        for (size_t cx = 0; cx < cornerSize; cx++) {
+            double dx = radius - (cx + 0.5);
+            if (dx <= 0 || dy <= 0) continue;
+
+            // Approximate area coverage by signed distance from the arc, over a one-pixel ramp
+            double coverage = radius - sqrt(dx * dx + dy * dy) + 0.5;
+            if (coverage >= 1) continue;
+            unsigned scale = coverage <= 0 ? 0 : (unsigned) (coverage * 255 + 0.5);
+
+            size_t xs[2] = { rect.x + cx, rect.x + rect.width - 1 - cx };
+            size_t ys[2] = { rect.y + cy, rect.y + rect.height - 1 - cy };
+            for (int i = 0; i < 2; i++) {
+                for (int j = 0; j < 2; j++) {
+                    uint8_t *p = pixels + ys[i] * bytesPerRow + xs[j] * 4;
+                    p[0] = FCMul255(p[0], scale);
+                    p[1] = FCMul255(p[1], scale);
+                    p[2] = FCMul255(p[2], scale);
+                    p[3] = FCMul255(p[3], scale);
+                }
+            }
+        }
+    }
+}
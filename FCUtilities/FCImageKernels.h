@@ -0,0 +1,45 @@
+//
+//  FCImageKernels.h
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+// In-place pixel kernels behind FCImageEffects, in plain C with NEON and SSE2 paths, usable without any Apple frameworks.
+//
+// All kernels work on premultiplied RGBA, 8 bits per channel in R, G, B, A byte order
+//  (kCGImageAlphaPremultipliedLast | kCGBitmapByteOrder32Big), touching only the given rect.
+//
+
+#ifndef FCImageKernels_h
+#define FCImageKernels_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    size_t x, y, width, height; // in pixels
+} FCImageKernelRect;
+
+typedef struct {
+    uint8_t r, g, b, a; // premultiplied
+} FCImageKernelColor;
+
+// Fills with color where the pixels are opaque, keeping their alpha (Porter-Duff source-atop), for tints and masks
+void FCImageKernelFillAtop(uint8_t *pixels, size_t bytesPerRow, FCImageKernelRect rect, FCImageKernelColor color);
+
+// Fills with color behind the existing pixels (Porter-Duff destination-over), for padding and backgrounds
+void FCImageKernelFillBehind(uint8_t *pixels, size_t bytesPerRow, FCImageKernelRect rect, FCImageKernelColor color);
+
+// Replaces color with its luminance (0.30 R + 0.59 G + 0.11 B, as Core Graphics' saturation blend uses), keeping alpha
+void FCImageKernelDesaturate(uint8_t *pixels, size_t bytesPerRow, FCImageKernelRect rect);
+
+// Clears outside a rounded rect with circular corners of the given radius in pixels, antialiased. Only the corners are touched.
+void FCImageKernelRoundCorners(uint8_t *pixels, size_t bytesPerRow, FCImageKernelRect rect, double radius);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -5,6 +5,16 @@
 
 #import <Foundation/Foundation.h>
 @import UIKit;
+@class FCDiskCache;
+
+// Running totals since launch, reported to the metrics handler.
+typedef struct {
+    int64_t memoryCacheHits;    // loads satisfied from the decoded-image cache without network or decode work
+    int64_t memoryCacheMisses;
+    int64_t coalescedLoads;     // loads that joined an in-flight download of the same URL instead of starting one
+    int64_t decodes;            // images decoded from downloaded data
+    int64_t diskCacheHits;      // memory-cache misses satisfied by the thumbnail disk cache
+} FCNetworkImageLoaderMetrics;
 
 @interface FCNetworkImageLoader : NSObject
 
@@ -18,10 +28,38 @@
 // Optional. Called after each completed request to report its data usage.
 + (void)setDataTransferHandler:(void (^ _Nullable)(int64_t totalBytesTransferred, int64_t cellularBytesTransferred))dataTransferHandler;
 
+// Optional. Called after each load is resolved from cache or network, from any queue.
++ (void)setMetricsHandler:(void (^ _Nullable)(FCNetworkImageLoaderMetrics metrics))metricsHandler;
+
+// Decoded images are kept in memory, costed by bitmap size, up to this many bytes. Default 50 MB. 0 = unlimited.
++ (void)setMemoryCacheByteLimit:(NSUInteger)byteLimit;
+
+// Optional. Images are decoded only as large as the image view needs in pixels. With a disk cache set, those pre-sized results
+//  (after the transformer, if it has a transformerIdentifier) are also stored there, keyed by URL, pixel size and transformer
+//  identifier, so later launches can skip both the download and the full-size decode.
++ (void)setThumbnailDiskCache:(FCDiskCache * _Nullable)diskCache;
+
+// Optional, default NO. Shows partial images while large downloads are still arriving, re-rendered a few times per second.
+// Partial images go only to loads without an imageTransformer; transformed loads still wait for the complete image.
++ (void)setProgressiveRenderingEnabled:(BOOL)enabled;
+
 + (void)loadImageAtURL:(NSURL * _Nonnull)url intoImageView:(UIImageView * _Nonnull)imageView placeholderImage:(UIImage * _Nullable)placeholder;
 + (void)loadImageAtURL:(NSURL * _Nonnull)url intoImageView:(UIImageView * _Nonnull)imageView placeholderImage:(UIImage * _Nullable)placeholder cachePolicy:(NSURLRequestCachePolicy)cachePolicy;
 + (void)loadImageAtURL:(NSURL * _Nonnull)url intoImageView:(UIImageView * _Nonnull)imageView placeholderImage:(UIImage * _Nullable)placeholder cachePolicy:(NSURLRequestCachePolicy)cachePolicy imageTransformer:(UIImage * _Nonnull (^ _Nullable)(UIImage * _Nonnull image, CGSize imageViewSize))imageTransformer;
 
+// Pass a transformerIdentifier that uniquely names what imageTransformer does to also cache its output per view size.
+// Without one, only the decoded source image is cached and the transformer runs again for each load.
++ (void)loadImageAtURL:(NSURL * _Nonnull)url intoImageView:(UIImageView * _Nonnull)imageView placeholderImage:(UIImage * _Nullable)placeholder cachePolicy:(NSURLRequestCachePolicy)cachePolicy imageTransformer:(UIImage * _Nonnull (^ _Nullable)(UIImage * _Nonnull image, CGSize imageViewSize))imageTransformer transformerIdentifier:(NSString * _Nullable)transformerIdentifier;
+
 + (void)cancelLoadForImageView:(UIImageView * _Nonnull)imageView;
 
+// Downloads and decodes into the memory cache ahead of display. Prefetches run after all visible loads
+//  and are promoted to visible priority if an image view requests the same URL.
++ (void)prefetchImagesAtURLs:(NSArray<NSURL *> * _Nonnull)urls;
++ (void)cancelPrefetchingForURLs:(NSArray<NSURL *> * _Nonnull)urls;
+
+// Limits on simultaneous work. Loads beyond these wait in a queue, visible before prefetch. Defaults: 6 downloads, 1 decode per CPU.
++ (void)setMaximumConcurrentDownloads:(NSUInteger)maxDownloads;
++ (void)setMaximumConcurrentDecodes:(NSUInteger)maxDecodes;
+
 @end
@@ -4,32 +4,123 @@
 //
 
 #import "FCNetworkImageLoader.h"
+#import "FCBasics.h"
 #import "UIImage+FCUtilities.h"
+#import "FCCache.h"
+#import "FCDiskCache.h"
+#import "FCImageHeader.h"
 #import <os/lock.h>
+#import <ImageIO/ImageIO.h>
 
 @interface UIImageView (FCNetworkImageLoader)
 @property (nonatomic, strong) NSURLSessionTask *fcNetworkImageLoader_downloadTask;
+@property (nonatomic, strong) NSURL *fcNetworkImageLoader_URL; // most recently requested, cleared on cancel
 @end
 
 #import <objc/runtime.h>
 @implementation UIImageView (FCNetworkImageLoader)
 @dynamic fcNetworkImageLoader_downloadTask;
+@dynamic fcNetworkImageLoader_URL;
 - (NSURLSessionTask *)fcNetworkImageLoader_downloadTask { return objc_getAssociatedObject(self, @selector(fcNetworkImageLoader_downloadTask)); }
 - (void)setFcNetworkImageLoader_downloadTask:(NSURLSessionTask *)downloadTask
 {
     objc_setAssociatedObject(self, @selector(fcNetworkImageLoader_downloadTask), downloadTask, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
 }
+- (NSURL *)fcNetworkImageLoader_URL { return objc_getAssociatedObject(self, @selector(fcNetworkImageLoader_URL)); }
+- (void)setFcNetworkImageLoader_URL:(NSURL *)URL
+{
+    objc_setAssociatedObject(self, @selector(fcNetworkImageLoader_URL), URL, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+}
+@end
+
+
+// What one image view wants done with a fetched image
+@interface FCNetworkImageLoaderRequest : NSObject
+@property (nonatomic, copy) UIImage *(^imageTransformer)(UIImage *image, CGSize imageViewSize);
+@property (nonatomic, copy) NSString *transformerIdentifier;
+@property (nonatomic) CGSize pixelSize; // image view bounds × display scale at request time
+@property (nonatomic) CGFloat scale;
+@end
+@implementation FCNetworkImageLoaderRequest
+@end
+
+// A decoded source image in the memory cache. Unless fullResolution, it was downsampled and only serves requests it covers.
+@interface FCNetworkImageLoaderDecodedImage : NSObject
+@property (nonatomic) UIImage *image;
+@property (nonatomic) BOOL fullResolution;
+@end
+@implementation FCNetworkImageLoaderDecodedImage
+@end
+
+typedef NS_ENUM(NSInteger, FCNetworkImageLoaderFetchState) {
+    FCNetworkImageLoaderFetchStateAwaitingDownload = 0,
+    FCNetworkImageLoaderFetchStateDownloading,
+    FCNetworkImageLoaderFetchStateAwaitingDecode,
+    FCNetworkImageLoaderFetchStateDecoding,
+    FCNetworkImageLoaderFetchStateFinished,
+};
+
+// One in-flight download and decode, shared by every image view waiting for its URL
+@interface FCNetworkImageLoaderFetch : NSObject
+@property (nonatomic) NSURL *url;
+@property (nonatomic) NSURLSessionDataTask *task;
+@property (nonatomic) NSMapTable<UIImageView *, FCNetworkImageLoaderRequest *> *requestsByImageView;
+@property (nonatomic) FCNetworkImageLoaderFetchState state;
+@property (nonatomic) BOOL prefetchRequested;
+@property (nonatomic) NSData *data; // held between download and decode
+@property (nonatomic, readonly) BOOL isVisible;
+
+// Accumulated on the session's serial delegate queue
+@property (nonatomic) NSMutableData *receivedData;
+
+// Progressive rendering. The image source is only touched by the one partial render allowed in flight.
+@property (nonatomic) CGImageSourceRef incrementalImageSource;
+@property (nonatomic) BOOL partialRenderInFlight; // guarded by writeLock
+@property (nonatomic) CFAbsoluteTime lastPartialRenderTime; // guarded by writeLock
 @end
+@implementation FCNetworkImageLoaderFetch
+- (BOOL)isVisible { return _requestsByImageView.keyEnumerator.nextObject != nil; }
+
+- (void)setIncrementalImageSource:(CGImageSourceRef)incrementalImageSource
+{
+    if (incrementalImageSource) CFRetain(incrementalImageSource);
+    if (_incrementalImageSource) CFRelease(_incrementalImageSource);
+    _incrementalImageSource = incrementalImageSource;
+}
+
+- (void)dealloc
+{
+    if (_incrementalImageSource) CFRelease(_incrementalImageSource);
+}
+@end
+
+// Minimum time between partial renders of one download
+static const CFTimeInterval FCNetworkImageLoaderPartialRenderInterval = 0.25;
+
 
 @interface FCNetworkImageLoader () <NSURLSessionDataDelegate> {
 @public
     os_unfair_lock writeLock;
+    FCNetworkImageLoaderMetrics metrics; // guarded by writeLock
+
+    // Scheduler state, guarded by writeLock
+    NSUInteger maximumConcurrentDownloads;
+    NSUInteger maximumConcurrentDecodes;
+    NSUInteger activeDownloadCount;
+    NSUInteger activeDecodeCount;
 }
 @property (nonatomic) NSURLSession *session;
 @property (nonatomic) dispatch_queue_t decodeQueue;
+@property (nonatomic) FCCache *imageCache;
+@property (nonatomic) FCDiskCache *thumbnailDiskCache;
+@property (nonatomic) BOOL progressiveRenderingEnabled;
+@property (nonatomic) NSMutableDictionary<NSURL *, FCNetworkImageLoaderFetch *> *fetchesByURL; // guarded by writeLock
+@property (nonatomic) NSMutableArray<FCNetworkImageLoaderFetch *> *pendingDownloads; // guarded by writeLock
+@property (nonatomic) NSMutableArray<FCNetworkImageLoaderFetch *> *pendingDecodes; // guarded by writeLock
 @property (nonatomic, copy) BOOL (^cellularPolicyHandler)(void);
 @property (nonatomic, copy) UIImage *(^fetchedImageDecoder)(NSData *imageData);
 @property (nonatomic, copy) void (^dataTransferHandler)(int64_t totalBytesTransferred, int64_t cellularBytesTransferred);
+@property (nonatomic, copy) void (^metricsHandler)(FCNetworkImageLoaderMetrics metrics);
 + (instancetype)sharedInstance;
 @end
 
@@ -58,12 +149,57 @@
     FCNetworkImageLoader.sharedInstance.dataTransferHandler = dataTransferHandler;
 }
 
++ (void)setMetricsHandler:(void (^)(FCNetworkImageLoaderMetrics metrics))metricsHandler
+{
+    FCNetworkImageLoader.sharedInstance.metricsHandler = metricsHandler;
+}
+
++ (void)setMemoryCacheByteLimit:(NSUInteger)byteLimit
+{
+    FCNetworkImageLoader.sharedInstance.imageCache.totalCostLimit = byteLimit;
+}
+
++ (void)setThumbnailDiskCache:(FCDiskCache *)diskCache
+{
+    FCNetworkImageLoader.sharedInstance.thumbnailDiskCache = diskCache;
+}
+
++ (void)setProgressiveRenderingEnabled:(BOOL)enabled
+{
+    FCNetworkImageLoader.sharedInstance.progressiveRenderingEnabled = enabled;
+}
+
++ (void)setMaximumConcurrentDownloads:(NSUInteger)maxDownloads
+{
+    FCNetworkImageLoader *loader = FCNetworkImageLoader.sharedInstance;
+    os_unfair_lock_lock((os_unfair_lock * _Nonnull) &(loader->writeLock));
+    loader->maximumConcurrentDownloads = MAX(1, maxDownloads);
+    [loader _startPendingWork];
+    os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &(loader->writeLock));
+}
+
++ (void)setMaximumConcurrentDecodes:(NSUInteger)maxDecodes
+{
+    FCNetworkImageLoader *loader = FCNetworkImageLoader.sharedInstance;
+    os_unfair_lock_lock((os_unfair_lock * _Nonnull) &(loader->writeLock));
+    loader->maximumConcurrentDecodes = MAX(1, maxDecodes);
+    [loader _startPendingWork];
+    os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &(loader->writeLock));
+}
+
 - (instancetype)init
 {
     if ( (self = [super init]) ) {
         writeLock = OS_UNFAIR_LOCK_INIT;
         self.decodeQueue = dispatch_queue_create("FCNetworkImageLoader-decode", DISPATCH_QUEUE_CONCURRENT);
         self.session = [NSURLSession sessionWithConfiguration:[NSURLSessionConfiguration defaultSessionConfiguration] delegate:self delegateQueue:nil];
+        self.fetchesByURL = [NSMutableDictionary dictionary];
+        self.pendingDownloads = [NSMutableArray array];
+        self.pendingDecodes = [NSMutableArray array];
+        maximumConcurrentDownloads = 6;
+        maximumConcurrentDecodes = MAX(1, NSProcessInfo.processInfo.activeProcessorCount);
+        self.imageCache = [FCCache new];
+        self.imageCache.totalCostLimit = 50 * 1024 * 1024;
     }
     return self;
 }
@@ -91,86 +227,625 @@
     if (self.dataTransferHandler) self.dataTransferHandler(bytesTransferred, cellularBytesTransferred);
 }
 
+// Call with writeLock held. Nil if the task was cancelled.
+- (FCNetworkImageLoaderFetch *)_fetchForTask:(NSURLSessionTask *)task
+{
+    FCNetworkImageLoaderFetch *fetch = _fetchesByURL[task.originalRequest.URL];
+    return fetch.task == task ? fetch : nil;
+}
+
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveData:(NSData *)data
+{
+    os_unfair_lock_lock((os_unfair_lock * _Nonnull) &writeLock);
+    FCNetworkImageLoaderFetch *fetch = [self _fetchForTask:dataTask];
+    os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &writeLock);
+    if (! fetch) return;
+
+    if (! fetch.receivedData) {
+        int64_t expectedLength = dataTask.countOfBytesExpectedToReceive;
+        fetch.receivedData = [NSMutableData dataWithCapacity:(NSUInteger) MIN(MAX(expectedLength, 0), 32 * 1024 * 1024)];
+    }
+    [fetch.receivedData appendData:data];
+
+    if (self.progressiveRenderingEnabled) [self _renderPartialImageForFetch:fetch];
+}
+
+- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didCompleteWithError:(NSError *)error
+{
+    os_unfair_lock_lock((os_unfair_lock * _Nonnull) &writeLock);
+    FCNetworkImageLoaderFetch *fetch = [self _fetchForTask:task];
+    os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &writeLock);
+
+    NSData *data = fetch.receivedData;
+    fetch.receivedData = nil;
+    [self _fetch:fetch didCompleteWithData:data response:task.response error:error];
+}
+
+#pragma mark - Memory cache and metrics
+
+static NSString *FCNetworkImageLoaderCacheKey(NSURL *url, NSString *transformerIdentifier, CGSize imageViewSize)
+{
+    if (! transformerIdentifier) return url.absoluteString;
+    return [NSString stringWithFormat:@"%@\n%@\n%.0fx%.0f", url.absoluteString, transformerIdentifier, imageViewSize.width, imageViewSize.height];
+}
+
+static NSUInteger FCNetworkImageLoaderImageCost(UIImage *image)
+{
+    CGImageRef cgImage = image.CGImage;
+    return cgImage ? CGImageGetBytesPerRow(cgImage) * CGImageGetHeight(cgImage) : 0;
+}
+
+static CGSize FCNetworkImageLoaderPixelSize(UIImageView *imageView, CGFloat *outScale)
+{
+    CGFloat scale = imageView.traitCollection.displayScale;
+    if (scale <= 0) scale = UIScreen.mainScreen.scale;
+    if (outScale) *outScale = scale;
+    CGSize size = imageView.bounds.size;
+    return CGSizeMake(ceil(size.width * scale), ceil(size.height * scale));
+}
+
+static BOOL FCNetworkImageLoaderImageCoversPixelSize(UIImage *image, CGSize pixelSize)
+{
+    CGImageRef cgImage = image.CGImage;
+    if (! cgImage) return NO;
+    // 1px tolerance for the downsampler's rounding of the short side
+    return CGImageGetWidth(cgImage) + 1 >= pixelSize.width && CGImageGetHeight(cgImage) + 1 >= pixelSize.height;
+}
+
+- (void)cacheImage:(UIImage *)image forKey:(NSString *)key
+{
+    if (image && key) [self.imageCache setObject:image forKey:key cost:FCNetworkImageLoaderImageCost(image)];
+}
+
+- (void)cacheSourceImage:(UIImage *)image forURL:(NSURL *)url fullResolution:(BOOL)fullResolution
+{
+    if (! image) return;
+    FCNetworkImageLoaderDecodedImage *decoded = [FCNetworkImageLoaderDecodedImage new];
+    decoded.image = image;
+    decoded.fullResolution = fullResolution;
+    [self.imageCache setObject:decoded forKey:FCNetworkImageLoaderCacheKey(url, nil, CGSizeZero) cost:FCNetworkImageLoaderImageCost(image)];
+}
+
+- (UIImage *)cachedSourceImageForURL:(NSURL *)url pixelSize:(CGSize)pixelSize
+{
+    FCNetworkImageLoaderDecodedImage *decoded = [self.imageCache objectForKey:FCNetworkImageLoaderCacheKey(url, nil, CGSizeZero)];
+    if (! decoded) return nil;
+    return (decoded.fullResolution || FCNetworkImageLoaderImageCoversPixelSize(decoded.image, pixelSize)) ? decoded.image : nil;
+}
+
+// Call with writeLock held. Returns a copy to report after unlocking.
+- (FCNetworkImageLoaderMetrics)updateMetrics:(void (^)(FCNetworkImageLoaderMetrics *m))updateBlock
+{
+    updateBlock(&metrics);
+    return metrics;
+}
+
+- (void)reportMetrics:(FCNetworkImageLoaderMetrics)m
+{
+    void (^handler)(FCNetworkImageLoaderMetrics) = self.metricsHandler;
+    if (handler) handler(m);
+}
+
+#pragma mark - Thumbnail disk cache
+
+static NSString *FCNetworkImageLoaderThumbnailKey(NSURL *url, NSString *transformerIdentifier, CGSize pixelSize)
+{
+    return [NSString stringWithFormat:@"%@\n%@\n%.0fx%.0f", url.absoluteString, transformerIdentifier ?: @"", pixelSize.width, pixelSize.height];
+}
+
+static NSData *FCNetworkImageLoaderThumbnailData(UIImage *image, CGSize pixelSize)
+{
+    CGImageRef cgImage = image.CGImage;
+    if (! cgImage) return nil;
+
+    CGFloat width = CGImageGetWidth(cgImage), height = CGImageGetHeight(cgImage);
+    CGImageAlphaInfo alphaInfo = CGImageGetAlphaInfo(cgImage);
+    BOOL opaque = (alphaInfo == kCGImageAlphaNone || alphaInfo == kCGImageAlphaNoneSkipFirst || alphaInfo == kCGImageAlphaNoneSkipLast);
+
+    CGFloat fillScale = MAX(pixelSize.width / width, pixelSize.height / height);
+    if (fillScale < 1) {
+        // Decoded for a bigger view or a prefetch: store only what covers this one
+        CGSize size = CGSizeMake(ceil(width * fillScale), ceil(height * fillScale));
+        UIGraphicsImageRendererFormat *format = [UIGraphicsImageRendererFormat preferredFormat];
+        format.scale = 1;
+        format.opaque = opaque;
+        image = [[[UIGraphicsImageRenderer alloc] initWithSize:size format:format] imageWithActions:^(UIGraphicsImageRendererContext *context) {
+            [[UIImage imageWithCGImage:cgImage] drawInRect:CGRectMake(0, 0, size.width, size.height)];
+        }];
+    }
+
+    return opaque ? UIImageJPEGRepresentation(image, 0.85) : UIImagePNGRepresentation(image);
+}
+
+- (BOOL)_canStoreThumbnailForRequest:(FCNetworkImageLoaderRequest *)request
+{
+    return self.thumbnailDiskCache && (! request.imageTransformer || request.transformerIdentifier) && request.pixelSize.width > 0 && request.pixelSize.height > 0;
+}
+
+- (void)_storeThumbnail:(UIImage *)image forURL:(NSURL *)url request:(FCNetworkImageLoaderRequest *)request
+{
+    if (! image || ! [self _canStoreThumbnailForRequest:request]) return;
+    FCDiskCache *diskCache = self.thumbnailDiskCache;
+    CGSize pixelSize = request.pixelSize;
+    NSString *key = FCNetworkImageLoaderThumbnailKey(url, request.transformerIdentifier, pixelSize);
+    dispatch_async(self.decodeQueue, dispatch_block_create_with_qos_class(DISPATCH_BLOCK_ENFORCE_QOS_CLASS, QOS_CLASS_UTILITY, 0, ^{
+        NSData *data = FCNetworkImageLoaderThumbnailData(image, pixelSize);
+        if (data) [diskCache setData:data forKey:key];
+    }));
+}
+
+// Reads the pre-sized thumbnail off the main queue, then either displays it or falls through to the network load.
+// The placeholder, if any, is already showing.
+- (void)_loadThumbnailAtURL:(NSURL *)url intoImageView:(UIImageView *)imageView cachePolicy:(NSURLRequestCachePolicy)cachePolicy request:(FCNetworkImageLoaderRequest *)request
+{
+    FCDiskCache *diskCache = self.thumbnailDiskCache;
+    NSString *key = FCNetworkImageLoaderThumbnailKey(url, request.transformerIdentifier, request.pixelSize);
+    CGSize imageViewSize = imageView.bounds.size;
+    __weak UIImageView *weakImageView = imageView;
+    dispatch_async(self.decodeQueue, dispatch_block_create_with_qos_class(DISPATCH_BLOCK_ENFORCE_QOS_CLASS, QOS_CLASS_USER_INITIATED, 0, ^{
+        NSData *data = [diskCache dataForKey:key];
+        UIImage *decoded = data ? [UIImage fc_decodedImageFromData:data] : nil;
+        UIImage *thumbnail = decoded.CGImage ? [UIImage imageWithCGImage:decoded.CGImage scale:request.scale orientation:UIImageOrientationUp] : nil;
+
+        fc_executeOnMainThreadBatched(FCMainThreadPriorityDefault, ^{
+            __strong UIImageView *strongImageView = weakImageView;
+            os_unfair_lock_lock((os_unfair_lock * _Nonnull) &writeLock);
+            BOOL current = strongImageView && [self _imageView:strongImageView isAwaitingURL:url] && ! strongImageView.fcNetworkImageLoader_downloadTask;
+            FCNetworkImageLoaderMetrics m = [self updateMetrics:^(FCNetworkImageLoaderMetrics *counts) { if (current && thumbnail) counts->diskCacheHits++; }];
+            os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &writeLock);
+            if (! current) return;
+
+            if (! thumbnail) {
+                [self _loadImageAtURL:url intoImageView:strongImageView placeholderImage:nil cachePolicy:cachePolicy imageTransformer:request.imageTransformer transformerIdentifier:request.transformerIdentifier checkThumbnailCache:NO];
+                return;
+            }
+
+            [self reportMetrics:m];
+            // Memory-cache it too, so reloads of this view (e.g. cell reuse) don't go back to disk every time
+            if (request.transformerIdentifier) [self cacheImage:thumbnail forKey:FCNetworkImageLoaderCacheKey(url, request.transformerIdentifier, imageViewSize)];
+            else [self cacheSourceImage:thumbnail forURL:url fullResolution:NO];
+            strongImageView.image = thumbnail;
+        });
+    }));
+}
+
+#pragma mark - Scheduling
+
+// Visible loads first, then prefetches, each in request order
+static FCNetworkImageLoaderFetch *FCNetworkImageLoaderDequeueFetch(NSMutableArray<FCNetworkImageLoaderFetch *> *queue)
+{
+    if (! queue.count) return nil;
+    NSUInteger index = [queue indexOfObjectPassingTest:^BOOL(FCNetworkImageLoaderFetch *fetch, NSUInteger idx, BOOL *stop) { return fetch.isVisible; }];
+    if (index == NSNotFound) index = 0;
+    FCNetworkImageLoaderFetch *fetch = queue[index];
+    [queue removeObjectAtIndex:index];
+    return fetch;
+}
+
+// Call with writeLock held. Creates a fetch and queues its download; the caller attaches requests, then calls _startPendingWork.
+- (FCNetworkImageLoaderFetch *)_enqueueFetchForURL:(NSURL *)url cachePolicy:(NSURLRequestCachePolicy)cachePolicy
+{
+    NSMutableURLRequest *req = [NSMutableURLRequest requestWithURL:url cachePolicy:cachePolicy timeoutInterval:30];
+    BOOL (^cellularHandler)(void) = self.cellularPolicyHandler;
+    if (cellularHandler) req.allowsCellularAccess = cellularHandler();
+
+    FCNetworkImageLoaderFetch *fetch = [FCNetworkImageLoaderFetch new];
+    fetch.url = url;
+    fetch.requestsByImageView = [NSMapTable weakToStrongObjectsMapTable];
+    fetch.task = [self.session dataTaskWithRequest:req]; // delegate-driven so data can be rendered as it arrives
+    _fetchesByURL[url] = fetch;
+    [_pendingDownloads addObject:fetch];
+    return fetch;
+}
+
+// Call with writeLock held. Starts queued downloads and decodes up to the concurrency limits.
+- (void)_startPendingWork
+{
+    FCNetworkImageLoaderFetch *fetch;
+    while (activeDownloadCount < maximumConcurrentDownloads && (fetch = FCNetworkImageLoaderDequeueFetch(_pendingDownloads))) {
+        activeDownloadCount++;
+        fetch.state = FCNetworkImageLoaderFetchStateDownloading;
+        fetch.task.priority = fetch.isVisible ? NSURLSessionTaskPriorityHigh : NSURLSessionTaskPriorityLow;
+        [fetch.task resume];
+    }
+
+    while (activeDecodeCount < maximumConcurrentDecodes && (fetch = FCNetworkImageLoaderDequeueFetch(_pendingDecodes))) {
+        activeDecodeCount++;
+        fetch.state = FCNetworkImageLoaderFetchStateDecoding;
+        [self _decodeFetch:fetch];
+    }
+}
+
+// Call with writeLock held. Abandons a fetch nobody is waiting for. A decode already running is left to finish and cache its result.
+- (void)_cancelFetch:(FCNetworkImageLoaderFetch *)fetch
+{
+    switch (fetch.state) {
+        case FCNetworkImageLoaderFetchStateAwaitingDownload:
+            [_pendingDownloads removeObjectIdenticalTo:fetch];
+            [fetch.task cancel];
+            break;
+        case FCNetworkImageLoaderFetchStateDownloading:
+            activeDownloadCount--;
+            [fetch.task cancel];
+            break;
+        case FCNetworkImageLoaderFetchStateAwaitingDecode:
+            [_pendingDecodes removeObjectIdenticalTo:fetch];
+            fetch.data = nil;
+            break;
+        case FCNetworkImageLoaderFetchStateDecoding:
+        case FCNetworkImageLoaderFetchStateFinished:
+            return;
+    }
+
+    fetch.state = FCNetworkImageLoaderFetchStateFinished;
+    if (_fetchesByURL[fetch.url] == fetch) [_fetchesByURL removeObjectForKey:fetch.url];
+    [self _startPendingWork];
+}
+
++ (void)prefetchImagesAtURLs:(NSArray<NSURL *> *)urls
+{
+    FCNetworkImageLoader *loader = FCNetworkImageLoader.sharedInstance;
+    NSMutableArray<NSURL *> *uncachedURLs = [NSMutableArray arrayWithCapacity:urls.count];
+    for (NSURL *url in urls) {
+        if (! [loader.imageCache objectForKey:FCNetworkImageLoaderCacheKey(url, nil, CGSizeZero)]) [uncachedURLs addObject:url];
+    }
+    if (! uncachedURLs.count) return;
+
+    os_unfair_lock_lock((os_unfair_lock * _Nonnull) &(loader->writeLock));
+    for (NSURL *url in uncachedURLs) {
+        FCNetworkImageLoaderFetch *fetch = loader.fetchesByURL[url] ?: [loader _enqueueFetchForURL:url cachePolicy:NSURLRequestUseProtocolCachePolicy];
+        fetch.prefetchRequested = YES;
+    }
+    [loader _startPendingWork];
+    os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &(loader->writeLock));
+}
+
++ (void)cancelPrefetchingForURLs:(NSArray<NSURL *> *)urls
+{
+    FCNetworkImageLoader *loader = FCNetworkImageLoader.sharedInstance;
+    os_unfair_lock_lock((os_unfair_lock * _Nonnull) &(loader->writeLock));
+    for (NSURL *url in urls) {
+        FCNetworkImageLoaderFetch *fetch = loader.fetchesByURL[url];
+        if (! fetch.prefetchRequested) continue;
+        fetch.prefetchRequested = NO;
+        if (! fetch.isVisible) [loader _cancelFetch:fetch];
+    }
+    os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &(loader->writeLock));
+}
+
+#pragma mark - Loading
 
 + (void)loadImageAtURL:(NSURL *)url intoImageView:(UIImageView *)imageView placeholderImage:(UIImage *)placeholder
 {
-    [self loadImageAtURL:url intoImageView:imageView placeholderImage:placeholder cachePolicy:NSURLRequestUseProtocolCachePolicy imageTransformer:nil];
+    [self loadImageAtURL:url intoImageView:imageView placeholderImage:placeholder cachePolicy:NSURLRequestUseProtocolCachePolicy imageTransformer:nil transformerIdentifier:nil];
 }
 
 + (void)loadImageAtURL:(NSURL *)url intoImageView:(UIImageView *)imageView placeholderImage:(UIImage *)placeholder cachePolicy:(NSURLRequestCachePolicy)cachePolicy
 {
-    [self loadImageAtURL:url intoImageView:imageView placeholderImage:placeholder cachePolicy:cachePolicy imageTransformer:nil];
+    [self loadImageAtURL:url intoImageView:imageView placeholderImage:placeholder cachePolicy:cachePolicy imageTransformer:nil transformerIdentifier:nil];
 }
 
 + (void)loadImageAtURL:(NSURL *)url intoImageView:(UIImageView *)imageView placeholderImage:(UIImage *)placeholder cachePolicy:(NSURLRequestCachePolicy)cachePolicy imageTransformer:(UIImage * _Nonnull (^ _Nullable)(UIImage * _Nonnull image, CGSize imageViewSize))imageTransformer
 {
-    [FCNetworkImageLoader.sharedInstance _loadImageAtURL:url intoImageView:imageView placeholderImage:placeholder cachePolicy:cachePolicy imageTransformer:imageTransformer];
+    [self loadImageAtURL:url intoImageView:imageView placeholderImage:placeholder cachePolicy:cachePolicy imageTransformer:imageTransformer transformerIdentifier:nil];
+}
+
++ (void)loadImageAtURL:(NSURL *)url intoImageView:(UIImageView *)imageView placeholderImage:(UIImage *)placeholder cachePolicy:(NSURLRequestCachePolicy)cachePolicy imageTransformer:(UIImage * _Nonnull (^ _Nullable)(UIImage * _Nonnull image, CGSize imageViewSize))imageTransformer transformerIdentifier:(NSString *)transformerIdentifier
+{
+    [FCNetworkImageLoader.sharedInstance _loadImageAtURL:url intoImageView:imageView placeholderImage:placeholder cachePolicy:cachePolicy imageTransformer:imageTransformer transformerIdentifier:(imageTransformer ? transformerIdentifier : nil) checkThumbnailCache:YES];
+}
+
+// Call with writeLock held. Stops the image view's current fetch, cancelling it if nothing else is waiting on it.
+- (void)_detachImageView:(UIImageView *)imageView
+{
+    NSURLSessionTask *task = imageView.fcNetworkImageLoader_downloadTask;
+    if (! task) return;
+    imageView.fcNetworkImageLoader_downloadTask = nil;
+
+    FCNetworkImageLoaderFetch *fetch = _fetchesByURL[task.originalRequest.URL];
+    if (! fetch || fetch.task != task) return;
+    [fetch.requestsByImageView removeObjectForKey:imageView];
+    if (fetch.isVisible) return;
+
+    if (! fetch.prefetchRequested) [self _cancelFetch:fetch];
+    else if (fetch.state == FCNetworkImageLoaderFetchStateDownloading) fetch.task.priority = NSURLSessionTaskPriorityLow;
 }
 
-- (void)_loadImageAtURL:(NSURL *)url intoImageView:(UIImageView *)imageView placeholderImage:(UIImage *)placeholder cachePolicy:(NSURLRequestCachePolicy)cachePolicy imageTransformer:(UIImage * _Nonnull (^ _Nullable)(UIImage * _Nonnull image, CGSize imageViewSize))imageTransformer
+// Call with writeLock held
+- (BOOL)_imageView:(UIImageView *)imageView isAwaitingURL:(NSURL *)url { return [imageView.fcNetworkImageLoader_URL isEqual:url]; }
+
+- (void)_loadImageAtURL:(NSURL *)url intoImageView:(UIImageView *)imageView placeholderImage:(UIImage *)placeholder cachePolicy:(NSURLRequestCachePolicy)cachePolicy imageTransformer:(UIImage * _Nonnull (^ _Nullable)(UIImage * _Nonnull image, CGSize imageViewSize))imageTransformer transformerIdentifier:(NSString *)transformerIdentifier checkThumbnailCache:(BOOL)checkThumbnailCache
 {
+    CGSize imageViewSize = imageView.bounds.size;
+    FCNetworkImageLoaderRequest *request = [FCNetworkImageLoaderRequest new];
+    request.imageTransformer = imageTransformer;
+    request.transformerIdentifier = transformerIdentifier;
+    CGFloat scale;
+    request.pixelSize = FCNetworkImageLoaderPixelSize(imageView, &scale);
+    request.scale = scale;
+
+    // Fastest path: the finished image is already in memory
+    UIImage *cachedImage = nil;
+    UIImage *cachedSourceImage = nil;
+    if (! imageTransformer) {
+        cachedImage = [self cachedSourceImageForURL:url pixelSize:request.pixelSize];
+    } else {
+        if (transformerIdentifier) cachedImage = [self.imageCache objectForKey:FCNetworkImageLoaderCacheKey(url, transformerIdentifier, imageViewSize)];
+        if (! cachedImage) cachedSourceImage = [self cachedSourceImageForURL:url pixelSize:request.pixelSize];
+    }
+
     os_unfair_lock_lock((os_unfair_lock * _Nonnull) &(writeLock));
-    
+
     NSURLSessionTask *alreadyDownloadingTask = imageView.fcNetworkImageLoader_downloadTask;
     BOOL alreadyDownloadingThisURL = alreadyDownloadingTask && [alreadyDownloadingTask.originalRequest.URL isEqual:url];
-    
-    if (alreadyDownloadingTask && ! alreadyDownloadingThisURL) {
-        [alreadyDownloadingTask cancel];
-        imageView.fcNetworkImageLoader_downloadTask = nil;
+    BOOL checkThumbnail = checkThumbnailCache && ! cachedImage && ! cachedSourceImage && ! alreadyDownloadingThisURL && [self _canStoreThumbnailForRequest:request];
+
+    if (alreadyDownloadingTask && (! alreadyDownloadingThisURL || cachedImage || cachedSourceImage)) {
+        [self _detachImageView:imageView];
+        alreadyDownloadingThisURL = NO;
     }
+    imageView.fcNetworkImageLoader_URL = url;
 
-    __weak typeof(self) weakSelf = self;
-    __weak UIImageView *weakImageView = imageView;
+    // A load continuing after a thumbnail-cache miss was already counted
+    FCNetworkImageLoaderMetrics m = [self updateMetrics:^(FCNetworkImageLoaderMetrics *counts) {
+        if (! checkThumbnailCache) return;
+        if (cachedImage || cachedSourceImage) counts->memoryCacheHits++; else counts->memoryCacheMisses++;
+    }];
+
+    if (cachedImage) {
+        os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &writeLock);
+        imageView.image = cachedImage;
+        [self reportMetrics:m];
+        return;
+    }
 
     if (placeholder && ! alreadyDownloadingThisURL) imageView.image = placeholder;
 
-    NSMutableURLRequest *req = [NSMutableURLRequest requestWithURL:url cachePolicy:cachePolicy timeoutInterval:30];
-    BOOL (^cellularHandler)(void) = FCNetworkImageLoader.sharedInstance.cellularPolicyHandler;
-    if (cellularHandler) req.allowsCellularAccess = cellularHandler();
+    if (cachedSourceImage) {
+        // Decoded source is cached, but this transform isn't: skip the network and decode, just transform
+        os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &writeLock);
+        [self reportMetrics:m];
+        [self _deliverImage:cachedSourceImage fromURL:url toImageView:imageView request:request imageViewSize:imageViewSize];
+        return;
+    }
 
-    NSURLSessionDataTask *task = [FCNetworkImageLoader.sharedInstance.session dataTaskWithRequest:req completionHandler:^(NSData * _Nullable data, NSURLResponse * _Nullable response, NSError * _Nullable error) {
-        dispatch_async(dispatch_get_main_queue(), ^{
-            CGSize imageViewSize = imageView.bounds.size;
+    if (checkThumbnail) {
+        os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &writeLock);
+        [self reportMetrics:m];
+        [self _loadThumbnailAtURL:url intoImageView:imageView cachePolicy:cachePolicy request:request];
+        return;
+    }
 
-            __strong typeof(self) strongSelf = weakSelf;
-            __strong UIImageView *strongImageView = weakImageView;
-            if (! strongSelf || ! strongImageView || ! data || ! response || error || ! [strongImageView.fcNetworkImageLoader_downloadTask.originalRequest.URL isEqual:url]) return;
-
-            NSHTTPURLResponse *http = [response isKindOfClass:[NSHTTPURLResponse class]] ? (NSHTTPURLResponse *)response : nil;
-            if (http && (http.statusCode < 200 || http.statusCode >= 300)) return;
-
-            NSString *mimeType = response.MIMEType.lowercaseString;
-            if ([mimeType hasPrefix:@"text/html"]) return;
-
-            dispatch_async(strongSelf.decodeQueue, ^{
-                UIImage *(^imageDecoder)(NSData *image) = FCNetworkImageLoader.sharedInstance.fetchedImageDecoder;
-                UIImage *image = imageDecoder ? imageDecoder(data) : [UIImage fc_decodedImageFromData:data];
-                if (! image) return;
-
-                os_unfair_lock_lock((os_unfair_lock * _Nonnull) &writeLock);
-                BOOL current = [strongImageView.fcNetworkImageLoader_downloadTask.originalRequest.URL isEqual:url];
-                os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &writeLock);
-                if (current) {
-                    UIImage *imageToDisplay = image;
-                    if (imageTransformer) imageToDisplay = imageTransformer(imageToDisplay, imageViewSize);
-                    dispatch_async(dispatch_get_main_queue(), ^{
-                        strongImageView.image = imageToDisplay;
-                    });
-                }
-            });
+    FCNetworkImageLoaderFetch *fetch = _fetchesByURL[url];
+    if (fetch) {
+        m = [self updateMetrics:^(FCNetworkImageLoaderMetrics *counts) { if (! alreadyDownloadingThisURL) counts->coalescedLoads++; }];
+    } else {
+        fetch = [self _enqueueFetchForURL:url cachePolicy:cachePolicy];
+    }
+
+    [fetch.requestsByImageView setObject:request forKey:imageView];
+    imageView.fcNetworkImageLoader_downloadTask = fetch.task;
+
+    // A prefetch bound to a view becomes visible: queued work now sorts ahead of prefetches, and a running download is bumped
+    if (fetch.state == FCNetworkImageLoaderFetchStateDownloading) fetch.task.priority = NSURLSessionTaskPriorityHigh;
+    [self _startPendingWork];
+    os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &writeLock);
+    [self reportMetrics:m];
+}
+
+- (void)_fetch:(FCNetworkImageLoaderFetch *)fetch didCompleteWithData:(NSData *)data response:(NSURLResponse *)response error:(NSError *)error
+{
+    if (! fetch) return;
+
+    BOOL decodable = data && response && ! error;
+    NSHTTPURLResponse *http = [response isKindOfClass:[NSHTTPURLResponse class]] ? (NSHTTPURLResponse *)response : nil;
+    if (http && (http.statusCode < 200 || http.statusCode >= 300)) decodable = NO;
+    if ([response.MIMEType.lowercaseString hasPrefix:@"text/html"]) decodable = NO;
+
+    os_unfair_lock_lock((os_unfair_lock * _Nonnull) &writeLock);
+    if (fetch.state != FCNetworkImageLoaderFetchStateDownloading) {
+        // Cancelled, and its download slot already released
+        os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &writeLock);
+        return;
+    }
+    activeDownloadCount--;
+
+    if (decodable) {
+        // Stays in fetchesByURL so loads arriving during the decode join it instead of downloading again
+        fetch.data = data;
+        fetch.state = FCNetworkImageLoaderFetchStateAwaitingDecode;
+        [_pendingDecodes addObject:fetch];
+    } else {
+        fetch.state = FCNetworkImageLoaderFetchStateFinished;
+        if (_fetchesByURL[fetch.url] == fetch) [_fetchesByURL removeObjectForKey:fetch.url];
+    }
+    [self _startPendingWork];
+    os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &writeLock);
+}
+
+// Call with writeLock held. The smallest decode covering every waiting image view, or CGSizeZero for full resolution.
+- (CGSize)_decodePixelSizeForFetch:(FCNetworkImageLoaderFetch *)fetch
+{
+    if (fetch.prefetchRequested) return CGSizeZero;
+    CGSize pixelSize = CGSizeZero;
+    for (FCNetworkImageLoaderRequest *request in fetch.requestsByImageView.objectEnumerator) {
+        if (request.pixelSize.width <= 0 || request.pixelSize.height <= 0) return CGSizeZero;
+        pixelSize = CGSizeMake(MAX(pixelSize.width, request.pixelSize.width), MAX(pixelSize.height, request.pixelSize.height));
+    }
+    return pixelSize;
+}
+
+// Call with writeLock held. Decodes once for every image view waiting on this URL.
+- (void)_decodeFetch:(FCNetworkImageLoaderFetch *)fetch
+{
+    NSData *data = fetch.data;
+    fetch.data = nil;
+    NSURL *url = fetch.url;
+    CGSize decodePixelSize = [self _decodePixelSizeForFetch:fetch];
+
+    dispatch_block_t decodeBlock = dispatch_block_create_with_qos_class(DISPATCH_BLOCK_ENFORCE_QOS_CLASS, fetch.isVisible ? QOS_CLASS_USER_INITIATED : QOS_CLASS_UTILITY, 0, ^{
+        UIImage *(^imageDecoder)(NSData *image) = self.fetchedImageDecoder;
+        UIImage *image = imageDecoder ? imageDecoder(data) : [UIImage fc_decodedImageFromData:data resizedToFillPixelSize:decodePixelSize];
+        // A downsampled decode always covers its target, so one that doesn't is the whole source
+        BOOL fullResolution = imageDecoder || decodePixelSize.width <= 0 || ! FCNetworkImageLoaderImageCoversPixelSize(image, decodePixelSize);
+        [self cacheSourceImage:image forURL:url fullResolution:fullResolution];
+
+        // Loads that find the fetch gone from here on will hit the cache instead
+        os_unfair_lock_lock((os_unfair_lock * _Nonnull) &writeLock);
+        activeDecodeCount--;
+        fetch.state = FCNetworkImageLoaderFetchStateFinished;
+        if (_fetchesByURL[url] == fetch) [_fetchesByURL removeObjectForKey:url];
+        [self _startPendingWork];
+        FCNetworkImageLoaderMetrics m = [self updateMetrics:^(FCNetworkImageLoaderMetrics *counts) { counts->decodes++; }];
+        os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &writeLock);
+        [self reportMetrics:m];
+        if (! image) return;
+
+        fc_executeOnMainThreadBatched(FCMainThreadPriorityDefault, ^{
+            os_unfair_lock_lock((os_unfair_lock * _Nonnull) &writeLock);
+            NSMutableArray<UIImageView *> *imageViews = [NSMutableArray array];
+            NSMutableArray<FCNetworkImageLoaderRequest *> *requests = [NSMutableArray array];
+            for (UIImageView *imageView in fetch.requestsByImageView.keyEnumerator.allObjects) {
+                if (imageView.fcNetworkImageLoader_downloadTask != fetch.task || ! [self _imageView:imageView isAwaitingURL:url]) continue;
+                [imageViews addObject:imageView];
+                [requests addObject:[fetch.requestsByImageView objectForKey:imageView]];
+                imageView.fcNetworkImageLoader_downloadTask = nil;
+            }
+            os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &writeLock);
+
+            [imageViews enumerateObjectsUsingBlock:^(UIImageView *imageView, NSUInteger idx, BOOL *stop) {
+                [self _deliverImage:image fromURL:url toImageView:imageView request:requests[idx] imageViewSize:imageView.bounds.size];
+            }];
         });
-    }];
-    imageView.fcNetworkImageLoader_downloadTask = task;
-    [task resume];
+    });
+    dispatch_async(self.decodeQueue, decodeBlock);
+}
+
+#pragma mark - Progressive rendering
+
+// Call with writeLock held. Partial renders only go to views without a transformer, which would be too costly to rerun per render.
+- (BOOL)_fetchHasProgressiveRequests:(FCNetworkImageLoaderFetch *)fetch
+{
+    for (FCNetworkImageLoaderRequest *request in fetch.requestsByImageView.objectEnumerator) {
+        if (! request.imageTransformer) return YES;
+    }
+    return NO;
+}
+
+static CGImageRef FCNetworkImageLoaderCreatePartialImage(CGImageSourceRef source, NSData *receivedSoFar, CGSize fillPixelSize)
+{
+    CGImageSourceStatus status = CGImageSourceGetStatusAtIndex(source, 0);
+    if (status != kCGImageStatusIncomplete && status != kCGImageStatusComplete) return NULL;
+
+    CGImageRef image = NULL;
+    FCImageHeaderInfo header;
+    if (fillPixelSize.width > 0 && fillPixelSize.height > 0 && FCImageHeaderProbe(receivedSoFar.bytes, receivedSoFar.length, &header) && header.width) {
+        double sourceWidth = header.width, sourceHeight = header.height;
+        double fillScale = MAX(fillPixelSize.width / sourceWidth, fillPixelSize.height / sourceHeight);
+        if (fillScale < 1) {
+            image = CGImageSourceCreateThumbnailAtIndex(source, 0, (__bridge CFDictionaryRef) @{
+                ((__bridge NSString *) kCGImageSourceCreateThumbnailFromImageAlways) : @YES,
+                ((__bridge NSString *) kCGImageSourceShouldCacheImmediately) : @YES,
+                ((__bridge NSString *) kCGImageSourceThumbnailMaxPixelSize) : @(ceil(MAX(sourceWidth, sourceHeight) * fillScale)),
+            });
+        }
+    }
+
+    // Not every format can thumbnail a partial image
+    if (! image) image = CGImageSourceCreateImageAtIndex(source, 0, (__bridge CFDictionaryRef) @{
+        ((__bridge NSString *) kCGImageSourceShouldCacheImmediately) : @YES,
+    });
+    return image;
+}
+
+// Call on the session's delegate queue. Renders what's been received so far, at most one render in flight and one per interval.
+- (void)_renderPartialImageForFetch:(FCNetworkImageLoaderFetch *)fetch
+{
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    os_unfair_lock_lock((os_unfair_lock * _Nonnull) &writeLock);
+    BOOL shouldRender = (
+        fetch.state == FCNetworkImageLoaderFetchStateDownloading && ! fetch.partialRenderInFlight &&
+        now - fetch.lastPartialRenderTime >= FCNetworkImageLoaderPartialRenderInterval && [self _fetchHasProgressiveRequests:fetch]
+    );
+    CGSize decodePixelSize = shouldRender ? [self _decodePixelSizeForFetch:fetch] : CGSizeZero;
+    if (shouldRender) fetch.partialRenderInFlight = YES;
     os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &writeLock);
+    if (! shouldRender) return;
+
+    NSData *receivedSoFar = [fetch.receivedData copy];
+    dispatch_async(self.decodeQueue, dispatch_block_create_with_qos_class(DISPATCH_BLOCK_ENFORCE_QOS_CLASS, QOS_CLASS_USER_INITIATED, 0, ^{
+        if (! fetch.incrementalImageSource) {
+            CGImageSourceRef source = CGImageSourceCreateIncremental(NULL);
+            fetch.incrementalImageSource = source;
+            if (source) CFRelease(source);
+        }
+
+        UIImage *partialImage = nil;
+        if (fetch.incrementalImageSource) {
+            CGImageSourceUpdateData(fetch.incrementalImageSource, (__bridge CFDataRef) receivedSoFar, false);
+            CGImageRef cgImage = FCNetworkImageLoaderCreatePartialImage(fetch.incrementalImageSource, receivedSoFar, decodePixelSize);
+            if (cgImage) {
+                partialImage = [UIImage imageWithCGImage:cgImage];
+                CFRelease(cgImage);
+            }
+        }
+
+        os_unfair_lock_lock((os_unfair_lock * _Nonnull) &writeLock);
+        fetch.partialRenderInFlight = NO;
+        fetch.lastPartialRenderTime = CFAbsoluteTimeGetCurrent();
+        os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &writeLock);
+        if (! partialImage) return;
+
+        // Only the newest partial render of a fetch is worth showing
+        fc_executeOnMainThreadCoalesced(fetch, FCMainThreadPriorityLow, ^{
+            // Same staleness rule as the final image. Its delivery clears the download task, so a late partial can't replace it.
+            os_unfair_lock_lock((os_unfair_lock * _Nonnull) &writeLock);
+            NSMutableArray<UIImageView *> *imageViews = [NSMutableArray array];
+            for (UIImageView *imageView in fetch.requestsByImageView.keyEnumerator.allObjects) {
+                if (imageView.fcNetworkImageLoader_downloadTask != fetch.task || ! [self _imageView:imageView isAwaitingURL:fetch.url]) continue;
+                if ([fetch.requestsByImageView objectForKey:imageView].imageTransformer) continue;
+                [imageViews addObject:imageView];
+            }
+            os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &writeLock);
+
+            for (UIImageView *imageView in imageViews) imageView.image = partialImage;
+        });
+    }));
+}
+
+// Call on the main queue
+- (void)_deliverImage:(UIImage *)image fromURL:(NSURL *)url toImageView:(UIImageView *)imageView request:(FCNetworkImageLoaderRequest *)request imageViewSize:(CGSize)imageViewSize
+{
+    if (! request.imageTransformer) {
+        imageView.image = image;
+        [self _storeThumbnail:image forURL:url request:request];
+        return;
+    }
+
+    __weak UIImageView *weakImageView = imageView;
+    dispatch_async(self.decodeQueue, ^{
+        UIImage *imageToDisplay = request.imageTransformer(image, imageViewSize);
+        if (request.transformerIdentifier) [self cacheImage:imageToDisplay forKey:FCNetworkImageLoaderCacheKey(url, request.transformerIdentifier, imageViewSize)];
+
+        fc_executeOnMainThreadBatched(FCMainThreadPriorityDefault, ^{
+            __strong UIImageView *strongImageView = weakImageView;
+            os_unfair_lock_lock((os_unfair_lock * _Nonnull) &writeLock);
+            BOOL current = strongImageView && [self _imageView:strongImageView isAwaitingURL:url];
+            os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &writeLock);
+            if (current) strongImageView.image = imageToDisplay;
+        });
+
+        [self _storeThumbnail:imageToDisplay forURL:url request:request];
+    });
 }
 
 + (void)cancelLoadForImageView:(UIImageView *)imageView
 {
-    os_unfair_lock_lock((os_unfair_lock * _Nonnull) &(FCNetworkImageLoader.sharedInstance->writeLock));
-    NSURLSessionTask *existingTask = imageView.fcNetworkImageLoader_downloadTask;
-    if (existingTask) { [existingTask cancel]; imageView.fcNetworkImageLoader_downloadTask = nil; }
-    os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &(FCNetworkImageLoader.sharedInstance->writeLock));
+    FCNetworkImageLoader *loader = FCNetworkImageLoader.sharedInstance;
+    os_unfair_lock_lock((os_unfair_lock * _Nonnull) &(loader->writeLock));
+    [loader _detachImageView:imageView];
+    imageView.fcNetworkImageLoader_URL = nil;
+    os_unfair_lock_unlock((os_unfair_lock * _Nonnull) &(loader->writeLock));
 }
 
 @end
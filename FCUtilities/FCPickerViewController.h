@@ -9,6 +9,10 @@
 
 - (instancetype)initWithTitle:(NSString *)title items:(NSArray *)items itemLabelBlock:(NSString *(^)(id item))itemLabelBlock pickedBlock:(void (^)(NSUInteger idx))pickedBlock currentSelection:(NSUInteger)currentSelection;
 
+// Adds a search field that filters items by label, ignoring case and diacritics. Set before the view loads.
+// Labels are computed once on a background queue, so itemLabelBlock must be safe to call from any thread.
+@property (nonatomic) BOOL searchEnabled;
+
 // Subclasses may override these to e.g. customize appearance or register a different cell class
 - (void)configureTableView:(UITableView *)tableView withCellReuseIdentifier:(NSString *)cellReuseIdentifier;
 - (void)configureCell:(UITableViewCell *)cell withItem:(id)item;
@@ -22,15 +22,30 @@
 
 #define kCellReuseIdentifier @"FCPickerCell"
 
-@interface FCPickerViewController () {
+static NSString *FCPickerDefaultLabel(id item)
+{
+    return [item isKindOfClass:NSString.class] ? (NSString *) item : [item description];
+}
+
+static NSString *FCPickerFoldedString(NSString *string)
+{
+    return [string stringByFoldingWithOptions:NSCaseInsensitiveSearch | NSDiacriticInsensitiveSearch locale:nil];
+}
+
+@interface FCPickerViewController () <UISearchResultsUpdating> {
     NSUInteger _currentSelection;
-    NSArray<NSArray *> *itemsBySection;
-    NSArray *allItems;
+    NSArray *allItems; // without section breaks, so row positions map directly to the indexes passed to pickedBlock
     NSArray *sectionTitles;
-    NSIndexPath *indexPathOfSelectedCell;
+    NSUInteger *sectionStarts; // index into allItems of each section's first row, plus a final entry of allItems.count
+
+    NSArray<NSString *> *foldedLabels; // nil until built
+    NSString *filterQuery; // folded; nil when not filtering
+    NSUInteger *filteredIndexes;
+    NSUInteger filteredCount;
 }
 @property (nonatomic, copy) NSString *(^itemLabelBlock)(id item);
 @property (nonatomic, copy) void (^pickedBlock)(NSUInteger idx);
+@property (nonatomic) UISearchController *searchController;
 @end
 
 @implementation FCPickerViewController
@@ -39,24 +54,27 @@
 {
     if ( (self = [super initWithStyle:UITableViewStyleInsetGrouped]) ) {
     
-        NSMutableArray *filteredItems = [NSMutableArray array];
-        NSMutableArray *sections = [NSMutableArray array];
-        NSMutableArray *currentSection = [NSMutableArray array];
+        NSMutableArray *filteredItems = [NSMutableArray arrayWithCapacity:items.count];
         NSMutableArray *titlesBySection = [NSMutableArray arrayWithObject:@""];
-        [sections addObject:currentSection];
+        NSMutableData *starts = [NSMutableData data];
+        NSUInteger start = 0;
+        [starts appendBytes:&start length:sizeof(start)];
         for (id item in items) {
             if ([item isKindOfClass:FCPickerViewSectionBreak.class]) {
-                currentSection = [NSMutableArray array];
-                [sections addObject:currentSection];
+                start = filteredItems.count;
+                [starts appendBytes:&start length:sizeof(start)];
                 [titlesBySection addObject:((FCPickerViewSectionBreak *) item).title ?: @""];
             } else {
                 [filteredItems addObject:item];
-                [currentSection addObject:item];
             }
         }
+        start = filteredItems.count;
+        [starts appendBytes:&start length:sizeof(start)];
+
         allItems = [filteredItems copy];
-        itemsBySection = [sections copy];
         sectionTitles = [titlesBySection copy];
+        sectionStarts = malloc(starts.length);
+        memcpy(sectionStarts, starts.bytes, starts.length);
 
         self.title = title;
         self.itemLabelBlock = itemLabelBlock;
@@ -66,11 +84,27 @@
     return self;
 }
 
+- (void)dealloc
+{
+    free(sectionStarts);
+    free(filteredIndexes);
+}
+
 - (void)viewDidLoad
 {
     [super viewDidLoad];
     [self.tableView registerClass:UITableViewCell.class forCellReuseIdentifier:kCellReuseIdentifier];
     [self configureTableView:self.tableView withCellReuseIdentifier:kCellReuseIdentifier];
+
+    if (self.searchEnabled) {
+        self.searchController = [[UISearchController alloc] initWithSearchResultsController:nil];
+        self.searchController.searchResultsUpdater = self;
+        self.searchController.obscuresBackgroundDuringPresentation = NO;
+        self.navigationItem.searchController = self.searchController;
+        self.navigationItem.hidesSearchBarWhenScrolling = NO;
+        self.definesPresentationContext = YES;
+        [self buildSearchIndex];
+    }
 }
 
 // For subclass overriding
@@ -81,7 +115,7 @@
 // For subclass overriding
 - (void)configureCell:(UITableViewCell *)cell withItem:(id)item
 {
-    cell.textLabel.text = self.itemLabelBlock ? self.itemLabelBlock(item) : ([item isKindOfClass:NSString.class] ? (NSString *) item : [item description]);
+    cell.textLabel.text = self.itemLabelBlock ? self.itemLabelBlock(item) : FCPickerDefaultLabel(item);
 }
 
 // For subclass overriding
@@ -90,6 +124,66 @@
     return nil;
 }
 
+#pragma mark - Search
+
+- (void)buildSearchIndex
+{
+    NSArray *items = allItems;
+    NSString *(^itemLabelBlock)(id item) = self.itemLabelBlock;
+    __weak typeof(self) weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        NSMutableArray<NSString *> *labels = [NSMutableArray arrayWithCapacity:items.count];
+        for (id item in items) {
+            @autoreleasepool {
+                NSString *label = itemLabelBlock ? itemLabelBlock(item) : FCPickerDefaultLabel(item);
+                [labels addObject:FCPickerFoldedString(label ?: @"")];
+            }
+        }
+
+        dispatch_async(dispatch_get_main_queue(), ^{
+            __strong typeof(self) strongSelf = weakSelf;
+            if (! strongSelf) return;
+            strongSelf->foldedLabels = [labels copy];
+            [strongSelf updateSearchResultsForSearchController:strongSelf.searchController];
+        });
+    });
+}
+
+- (void)updateSearchResultsForSearchController:(UISearchController *)searchController
+{
+    NSString *query = [searchController.searchBar.text stringByTrimmingCharactersInSet:NSCharacterSet.whitespaceCharacterSet];
+    NSString *folded = query.length ? FCPickerFoldedString(query) : nil;
+    if (! foldedLabels) return; // applied when the index finishes building
+    if (folded == filterQuery || [folded isEqualToString:filterQuery]) return;
+
+    if (! folded) {
+        filterQuery = nil;
+        [self.tableView reloadData];
+        return;
+    }
+
+    // Typing more can only narrow the matches, so only the previous matches need to be checked
+    BOOL narrowing = filterQuery && [folded rangeOfString:filterQuery options:NSLiteralSearch].location != NSNotFound;
+    NSUInteger candidateCount = narrowing ? filteredCount : allItems.count;
+    NSUInteger *matches = malloc(MAX((NSUInteger) 1, candidateCount) * sizeof(NSUInteger));
+    NSUInteger matchCount = 0;
+    for (NSUInteger i = 0; i < candidateCount; i++) {
+        NSUInteger idx = narrowing ? filteredIndexes[i] : i;
+        if ([foldedLabels[idx] rangeOfString:folded options:NSLiteralSearch].location != NSNotFound) matches[matchCount++] = idx;
+    }
+
+    free(filteredIndexes);
+    filteredIndexes = matches;
+    filteredCount = matchCount;
+    filterQuery = folded;
+    [self.tableView reloadData];
+}
+
+- (NSUInteger)itemIndexForIndexPath:(NSIndexPath *)indexPath
+{
+    return filterQuery ? filteredIndexes[indexPath.row] : sectionStarts[indexPath.section] + indexPath.row;
+}
+
 #pragma mark - Table view data source
 
 - (CGFloat)tableView:(UITableView *)tableView heightForHeaderInSection:(NSInteger)section
@@ -99,7 +193,7 @@
 
 - (UIView *)tableView:(UITableView *)tableView viewForHeaderInSection:(NSInteger)section
 {
-    NSString *titleStr = sectionTitles[section];
+    NSString *titleStr = filterQuery ? nil : sectionTitles[section];
     if (! titleStr.length) return nil;
     
     CGFloat tableWidth = tableView.bounds.size.width;
@@ -109,23 +203,19 @@
 }
 
 
-- (NSInteger)numberOfSectionsInTableView:(UITableView *)tableView { return itemsBySection.count; }
+- (NSInteger)numberOfSectionsInTableView:(UITableView *)tableView { return filterQuery ? 1 : sectionTitles.count; }
 
-- (NSInteger)tableView:(UITableView *)tableView numberOfRowsInSection:(NSInteger)section { return itemsBySection[section].count; }
+- (NSInteger)tableView:(UITableView *)tableView numberOfRowsInSection:(NSInteger)section
+{
+    return filterQuery ? filteredCount : sectionStarts[section + 1] - sectionStarts[section];
+}
 
 - (UITableViewCell *)tableView:(UITableView *)tableView cellForRowAtIndexPath:(NSIndexPath *)indexPath
 {
     UITableViewCell *cell = [tableView dequeueReusableCellWithIdentifier:kCellReuseIdentifier forIndexPath:indexPath];
-    id item = itemsBySection[indexPath.section][indexPath.row];
-    [self configureCell:cell withItem:item];
-    
-    if ([allItems indexOfObject:item] == _currentSelection) {
-        cell.accessoryType = UITableViewCellAccessoryCheckmark;
-        indexPathOfSelectedCell = [indexPath copy];
-    } else {
-        cell.accessoryType = UITableViewCellAccessoryNone;
-    }
-    
+    NSUInteger idx = [self itemIndexForIndexPath:indexPath];
+    [self configureCell:cell withItem:allItems[idx]];
+    cell.accessoryType = idx == _currentSelection ? UITableViewCellAccessoryCheckmark : UITableViewCellAccessoryNone;
     return cell;
 }
 
@@ -133,17 +223,21 @@
 
 - (void)tableView:(UITableView *)tableView didSelectRowAtIndexPath:(NSIndexPath *)indexPath
 {
-    if ([indexPath isEqual:indexPathOfSelectedCell]) {
+    NSUInteger idx = [self itemIndexForIndexPath:indexPath];
+    if (idx == _currentSelection) {
         [tableView deselectRowAtIndexPath:indexPath animated:YES];
         return;
     }
     
-    [tableView cellForRowAtIndexPath:indexPathOfSelectedCell].accessoryType = UITableViewCellAccessoryNone;
-    [tableView cellForRowAtIndexPath:indexPath].accessoryType = UITableViewCellAccessoryCheckmark;
-    indexPathOfSelectedCell = indexPath;
+    _currentSelection = idx;
+    for (NSIndexPath *visibleIndexPath in tableView.indexPathsForVisibleRows) {
+        BOOL selected = [self itemIndexForIndexPath:visibleIndexPath] == idx;
+        [tableView cellForRowAtIndexPath:visibleIndexPath].accessoryType = selected ? UITableViewCellAccessoryCheckmark : UITableViewCellAccessoryNone;
+    }
     
     dispatch_async(dispatch_get_main_queue(), ^(void){
-        self.pickedBlock([allItems indexOfObject:itemsBySection[indexPath.section][indexPath.row]]);
+        self.pickedBlock(idx);
+        self.searchController.active = NO;
         [self.navigationController popViewControllerAnimated:YES];
     });
 }
@@ -0,0 +1,425 @@
+//
+//  FCPipeRing.c
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+
+#include "FCPipeRing.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FCPipeRingMagic            0x46435052u // "FCPR"
+#define FCPipeRingVersion          1
+#define FCPipeRingMinimumCapacity  4096u
+#define FCPipeRingMaximumCapacity  (1u << 30)
+#define FCPipeRingPaddingLength    UINT32_MAX // record header length that skips to the start of the buffer
+#define FCPipeRingRecordHeaderSize 8u
+
+// Offsets and sequence numbers are 32 bits, wrapping, packed in one word so each end can be read as a consistent pair.
+//  The tail is the oldest record still intact; the writer moves it forward before reusing space.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t reserved;
+    uint8_t padding0[48];
+    _Atomic uint64_t head; // (sequence << 32) | offset of the next record
+    uint8_t padding1[56];
+    _Atomic uint64_t tail;
+    uint8_t padding2[56];
+} FCPipeRingHeader;
+
+typedef struct {
+    uint32_t length;
+    uint32_t sequence;
+} FCPipeRingRecordHeader;
+
+struct FCPipeRing {
+    FCPipeRingHeader *header;
+    uint8_t *data;
+    size_t mappedLength;
+    uint32_t capacity;
+    uint32_t mask;
+    int fd; // kept open for FCPipeRingLockWriter
+};
+
+static inline uint64_t FCPipeRingPack(uint32_t offset, uint32_t sequence) { return ((uint64_t) sequence << 32) | offset; }
+static inline uint32_t FCPipeRingOffset(uint64_t packed) { return (uint32_t) packed; }
+static inline uint32_t FCPipeRingSequence(uint64_t packed) { return (uint32_t) (packed >> 32); }
+static inline uint32_t FCPipeRingAlign(uint32_t length) { return (length + 7u) & ~7u; }
+
+FCPipeRing *FCPipeRingOpen(const char *path, uint32_t capacity)
+{
+    if (capacity < FCPipeRingMinimumCapacity) capacity = FCPipeRingMinimumCapacity;
+    if (capacity > FCPipeRingMaximumCapacity) capacity = FCPipeRingMaximumCapacity;
+    uint32_t roundedCapacity = FCPipeRingMinimumCapacity;
+    while (roundedCapacity < capacity) roundedCapacity <<= 1;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return NULL;
+
+    // Locked while creating, so a reader and the writer starting together agree on one header
+    int error = 0;
+    FCPipeRingHeader *header = MAP_FAILED;
+    size_t mappedLength = 0;
+    struct stat info;
+    if (flock(fd, LOCK_EX) != 0 || fstat(fd, &info) != 0) {
+        error = errno;
+    } else {
+        bool creating = (size_t) info.st_size < sizeof(FCPipeRingHeader);
+        if (creating) {
+            mappedLength = sizeof(FCPipeRingHeader) + roundedCapacity;
+            if (ftruncate(fd, (off_t) mappedLength) != 0) error = errno;
+        } else {
+            FCPipeRingHeader existing;
+            if (pread(fd, &existing, sizeof(existing), 0) != (ssize_t) sizeof(existing)) error = errno ? errno : EIO;
+            else if (existing.magic != FCPipeRingMagic || existing.version != FCPipeRingVersion ||
+                existing.capacity < FCPipeRingMinimumCapacity || existing.capacity > FCPipeRingMaximumCapacity ||
+                (existing.capacity & (existing.capacity - 1)) ||
+                (size_t) info.st_size < sizeof(FCPipeRingHeader) + existing.capacity
+            ) error = EINVAL;
+            else mappedLength = sizeof(FCPipeRingHeader) + existing.capacity;
+        }
+
+        if (! error) {
+            header = mmap(NULL, mappedLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (header == MAP_FAILED) error = errno;
+            else if (creating) {
+                atomic_store(&header->head, 0);
+                atomic_store(&header->tail, 0);
+                header->version = FCPipeRingVersion;
+                header->capacity = roundedCapacity;
+                atomic_thread_fence(memory_order_release);
+                header->magic = FCPipeRingMagic;
+            }
+        }
+        flock(fd, LOCK_UN);
+    }
+
+    FCPipeRing *ring = error ? NULL : malloc(sizeof(FCPipeRing));
+    if (! ring) {
+        if (header != MAP_FAILED) munmap(header, mappedLength);
+        close(fd);
+        errno = error ? error : ENOMEM;
+        return NULL;
+    }
+
+    ring->header = header;
+    ring->data = (uint8_t *) header + sizeof(FCPipeRingHeader);
+    ring->mappedLength = mappedLength;
+    ring->capacity = header->capacity;
+    ring->mask = ring->capacity - 1;
+    ring->fd = fd;
+    return ring;
+}
+
+void FCPipeRingClose(FCPipeRing *ring)
+{
+    if (! ring) return;
+    munmap(ring->header, ring->mappedLength);
+    close(ring->fd);
+    free(ring);
+}
+
+uint32_t FCPipeRingMaximumMessageLength(FCPipeRing *ring) { return ring->capacity / 4; }
+
+static inline FCPipeRingRecordHeader FCPipeRingRecordHeaderAt(FCPipeRing *ring, uint32_t offset)
+{
+    FCPipeRingRecordHeader record;
+    memcpy(&record, ring->data + (offset & ring->mask), sizeof(record));
+    return record;
+}
+
+// The offset just past the record at offset, whether it's a message or padding
+static inline uint32_t FCPipeRingRecordEnd(FCPipeRing *ring, uint32_t offset, FCPipeRingRecordHeader record)
+{
+    if (record.length == FCPipeRingPaddingLength) return offset + (ring->capacity - (offset & ring->mask));
+    return offset + FCPipeRingRecordHeaderSize + FCPipeRingAlign(record.length);
+}
+
+// MARK: - Writing
+
+bool FCPipeRingWrite(FCPipeRing *ring, const void *bytes, uint32_t length)
+{
+    if (length > FCPipeRingMaximumMessageLength(ring)) return false;
+
+    uint64_t head = atomic_load_explicit(&ring->header->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&ring->header->tail, memory_order_relaxed);
+    uint32_t headOffset = FCPipeRingOffset(head), sequence = FCPipeRingSequence(head);
+    uint32_t tailOffset = FCPipeRingOffset(tail), tailSequence = FCPipeRingSequence(tail);
+
+    // Records never wrap: one that wouldn't fit before the end is preceded by padding up to it
+    uint32_t recordLength = FCPipeRingRecordHeaderSize + FCPipeRingAlign(length);
+    uint32_t contiguous = ring->capacity - (headOffset & ring->mask);
+    uint32_t paddingLength = recordLength > contiguous ? contiguous : 0;
+    uint32_t totalLength = paddingLength + recordLength;
+
+    // Retire the oldest records until there's room, and publish that before their space is overwritten
+    bool tailMoved = false;
+    while (ring->capacity - (headOffset - tailOffset) < totalLength) {
+        FCPipeRingRecordHeader record = FCPipeRingRecordHeaderAt(ring, tailOffset);
+        if (record.length != FCPipeRingPaddingLength) tailSequence++;
+        tailOffset = FCPipeRingRecordEnd(ring, tailOffset, record);
+        tailMoved = true;
+    }
+    if (tailMoved) {
+        atomic_store_explicit(&ring->header->tail, FCPipeRingPack(tailOffset, tailSequence), memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+    }
+
+    if (paddingLength) {
+        FCPipeRingRecordHeader padding = { FCPipeRingPaddingLength, sequence };
+        memcpy(ring->data + (headOffset & ring->mask), &padding, sizeof(padding));
+        headOffset += paddingLength;
+    }
+
+    FCPipeRingRecordHeader record = { length, sequence };
+    uint8_t *destination = ring->data + (headOffset & ring->mask);
+    memcpy(destination, &record, sizeof(record));
+    if (length) memcpy(destination + FCPipeRingRecordHeaderSize, bytes, length);
+
+    atomic_store_explicit(&ring->header->head, FCPipeRingPack(headOffset + recordLength, sequence + 1), memory_order_release);
+    return true;
+}
+
+bool FCPipeRingLockWriter(FCPipeRing *ring)
+{
+    int result;
+    do { result = flock(ring->fd, LOCK_EX); } while (result != 0 && errno == EINTR);
+    return result == 0;
+}
+
+void FCPipeRingUnlockWriter(FCPipeRing *ring) { flock(ring->fd, LOCK_UN); }
+
+// MARK: - Reading
+
+FCPipeRingCursor FCPipeRingNewestCursor(FCPipeRing *ring)
+{
+    uint64_t head = atomic_load_explicit(&ring->header->head, memory_order_acquire);
+    return (FCPipeRingCursor) { FCPipeRingOffset(head), FCPipeRingSequence(head) };
+}
+
+FCPipeRingCursor FCPipeRingOldestCursor(FCPipeRing *ring)
+{
+    uint64_t tail = atomic_load_explicit(&ring->header->tail, memory_order_acquire);
+    return (FCPipeRingCursor) { FCPipeRingOffset(tail), FCPipeRingSequence(tail) };
+}
+
+// Whether the writer has retired the record at cursor, so its bytes may have been overwritten
+static inline bool FCPipeRingCursorIsOverrun(FCPipeRingCursor cursor, uint64_t tail)
+{
+    return (int32_t) (FCPipeRingSequence(tail) - cursor.sequence) > 0 || (int32_t) (FCPipeRingOffset(tail) - cursor.offset) > 0;
+}
+
+FCPipeRingReadResult FCPipeRingRead(FCPipeRing *ring, FCPipeRingCursor *cursor, void *buffer, uint32_t *length)
+{
+    for (;;) {
+        uint64_t head = atomic_load_explicit(&ring->header->head, memory_order_acquire);
+        if (cursor->offset == FCPipeRingOffset(head)) return FCPipeRingReadEmpty;
+
+        uint64_t tail = atomic_load_explicit(&ring->header->tail, memory_order_acquire);
+        if (FCPipeRingCursorIsOverrun(*cursor, tail)) {
+            *cursor = (FCPipeRingCursor) { FCPipeRingOffset(tail), FCPipeRingSequence(tail) };
+            return FCPipeRingReadOverrun;
+        }
+
+        // Copy first, then make sure the writer hadn't started reusing the space, as with a seqlock
+        FCPipeRingRecordHeader record = FCPipeRingRecordHeaderAt(ring, cursor->offset);
+        bool valid = record.length == FCPipeRingPaddingLength || (record.length <= FCPipeRingMaximumMessageLength(ring) && record.sequence == cursor->sequence);
+        if (valid && record.length != FCPipeRingPaddingLength && record.length) {
+            memcpy(buffer, ring->data + (cursor->offset & ring->mask) + FCPipeRingRecordHeaderSize, record.length);
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        tail = atomic_load_explicit(&ring->header->tail, memory_order_relaxed);
+        if (FCPipeRingCursorIsOverrun(*cursor, tail)) {
+            *cursor = (FCPipeRingCursor) { FCPipeRingOffset(tail), FCPipeRingSequence(tail) };
+            return FCPipeRingReadOverrun;
+        }
+
+        if (! valid || (int32_t) (FCPipeRingOffset(head) - cursor->offset) < 0) {
+            *cursor = FCPipeRingNewestCursor(ring);
+            return FCPipeRingReadCorrupt;
+        }
+
+        cursor->offset = FCPipeRingRecordEnd(ring, cursor->offset, record);
+        if (record.length == FCPipeRingPaddingLength) continue;
+
+        cursor->sequence++;
+        *length = record.length;
+        return FCPipeRingReadMessage;
+    }
+}
+
+// MARK: - Encoding
+
+enum {
+    FCPipeTagNull = 0,
+    FCPipeTagFalse,
+    FCPipeTagTrue,
+    FCPipeTagInteger,
+    FCPipeTagDouble,
+    FCPipeTagDate,
+    FCPipeTagString,
+    FCPipeTagData,
+    FCPipeTagArray,
+    FCPipeTagDictionary,
+};
+
+void FCPipeEncoderReset(FCPipeEncoder *encoder)
+{
+    encoder->length = 0;
+    encoder->failed = false;
+}
+
+void FCPipeEncoderFree(FCPipeEncoder *encoder)
+{
+    free(encoder->bytes);
+    *encoder = (FCPipeEncoder) { 0 };
+}
+
+static uint8_t *FCPipeEncoderReserve(FCPipeEncoder *encoder, size_t length)
+{
+    if (encoder->failed) return NULL;
+    if (length > encoder->capacity - encoder->length) {
+        size_t capacity = encoder->capacity ? encoder->capacity : 256;
+        while (capacity - encoder->length < length) {
+            if (capacity > SIZE_MAX / 2) { encoder->failed = true; return NULL; }
+            capacity *= 2;
+        }
+        uint8_t *bytes = realloc(encoder->bytes, capacity);
+        if (! bytes) { encoder->failed = true; return NULL; }
+        encoder->bytes = bytes;
+        encoder->capacity = capacity;
+    }
+    uint8_t *destination = encoder->bytes + encoder->length;
+    encoder->length += length;
+    return destination;
+}
+
+static void FCPipeEncodeTagAndVarint(FCPipeEncoder *encoder, uint8_t tag, uint64_t value)
+{
+    uint8_t *destination = FCPipeEncoderReserve(encoder, 11);
+    if (! destination) return;
+    size_t length = 0;
+    destination[length++] = tag;
+    while (value >= 0x80) {
+        destination[length++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    destination[length++] = (uint8_t) value;
+    encoder->length -= 11 - length;
+}
+
+static void FCPipeEncodeTagAndFloat(FCPipeEncoder *encoder, uint8_t tag, double value)
+{
+    uint8_t *destination = FCPipeEncoderReserve(encoder, 9);
+    if (! destination) return;
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    destination[0] = tag;
+    for (int i = 0; i < 8; i++) destination[1 + i] = (uint8_t) (bits >> (8 * i));
+}
+
+static void FCPipeEncodeTagAndBytes(FCPipeEncoder *encoder, uint8_t tag, const void *bytes, size_t length)
+{
+    FCPipeEncodeTagAndVarint(encoder, tag, length);
+    uint8_t *destination = FCPipeEncoderReserve(encoder, length);
+    if (destination && length) memcpy(destination, bytes, length);
+}
+
+static void FCPipeEncodeTag(FCPipeEncoder *encoder, uint8_t tag)
+{
+    uint8_t *destination = FCPipeEncoderReserve(encoder, 1);
+    if (destination) *destination = tag;
+}
+
+void FCPipeEncodeNull(FCPipeEncoder *encoder) { FCPipeEncodeTag(encoder, FCPipeTagNull); }
+void FCPipeEncodeBool(FCPipeEncoder *encoder, bool value) { FCPipeEncodeTag(encoder, value ? FCPipeTagTrue : FCPipeTagFalse); }
+void FCPipeEncodeInteger(FCPipeEncoder *encoder, int64_t value) { FCPipeEncodeTagAndVarint(encoder, FCPipeTagInteger, ((uint64_t) value << 1) ^ (uint64_t) (value >> 63)); }
+void FCPipeEncodeDouble(FCPipeEncoder *encoder, double value) { FCPipeEncodeTagAndFloat(encoder, FCPipeTagDouble, value); }
+void FCPipeEncodeDate(FCPipeEncoder *encoder, double secondsSince2001) { FCPipeEncodeTagAndFloat(encoder, FCPipeTagDate, secondsSince2001); }
+void FCPipeEncodeString(FCPipeEncoder *encoder, const char *utf8, size_t length) { FCPipeEncodeTagAndBytes(encoder, FCPipeTagString, utf8, length); }
+void FCPipeEncodeData(FCPipeEncoder *encoder, const void *bytes, size_t length) { FCPipeEncodeTagAndBytes(encoder, FCPipeTagData, bytes, length); }
+void FCPipeEncodeArrayStart(FCPipeEncoder *encoder, size_t count) { FCPipeEncodeTagAndVarint(encoder, FCPipeTagArray, count); }
+void FCPipeEncodeDictionaryStart(FCPipeEncoder *encoder, size_t count) { FCPipeEncodeTagAndVarint(encoder, FCPipeTagDictionary, count); }
+
+// MARK: - Decoding
+
+static bool FCPipeDecodeVarint(FCPipeDecoder *decoder, uint64_t *value)
+{
+    uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (decoder->position >= decoder->length) return false;
+        uint8_t byte = decoder->bytes[decoder->position++];
+        result |= (uint64_t) (byte & 0x7F) << shift;
+        if (! (byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool FCPipeDecodeFloat(FCPipeDecoder *decoder, double *value)
+{
+    if (decoder->length - decoder->position < 8) return false;
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; i++) bits |= (uint64_t) decoder->bytes[decoder->position + i] << (8 * i);
+    decoder->position += 8;
+    memcpy(value, &bits, sizeof(bits));
+    return true;
+}
+
+bool FCPipeDecodeNext(FCPipeDecoder *decoder, FCPipeValue *value)
+{
+    if (decoder->position >= decoder->length) return false;
+    uint8_t tag = decoder->bytes[decoder->position++];
+    uint64_t number;
+    size_t remaining;
+
+    switch (tag) {
+        case FCPipeTagNull:  value->type = FCPipeValueNull; return true;
+        case FCPipeTagFalse: value->type = FCPipeValueBool; value->boolValue = false; return true;
+        case FCPipeTagTrue:  value->type = FCPipeValueBool; value->boolValue = true; return true;
+
+        case FCPipeTagInteger:
+            if (! FCPipeDecodeVarint(decoder, &number)) return false;
+            value->type = FCPipeValueInteger;
+            value->integerValue = (int64_t) (number >> 1) ^ -(int64_t) (number & 1);
+            return true;
+
+        case FCPipeTagDouble:
+        case FCPipeTagDate:
+            value->type = tag == FCPipeTagDate ? FCPipeValueDate : FCPipeValueDouble;
+            return FCPipeDecodeFloat(decoder, &value->doubleValue);
+
+        case FCPipeTagString:
+        case FCPipeTagData:
+            if (! FCPipeDecodeVarint(decoder, &number) || number > decoder->length - decoder->position) return false;
+            value->type = tag == FCPipeTagString ? FCPipeValueString : FCPipeValueData;
+            value->bytes.bytes = decoder->bytes + decoder->position;
+            value->bytes.length = (size_t) number;
+            decoder->position += (size_t) number;
+            return true;
+
+        case FCPipeTagArray:
+        case FCPipeTagDictionary:
+            // Every value takes at least one byte, which bounds any honest count
+            if (! FCPipeDecodeVarint(decoder, &number)) return false;
+            remaining = decoder->length - decoder->position;
+            if (tag == FCPipeTagArray ? number > remaining : number > remaining / 2) return false;
+            value->type = tag == FCPipeTagArray ? FCPipeValueArray : FCPipeValueDictionary;
+            value->count = (size_t) number;
+            return true;
+
+        default:
+            return false;
+    }
+}
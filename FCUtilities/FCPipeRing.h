@@ -0,0 +1,123 @@
+//
+//  FCPipeRing.h
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+// The shared-memory transport behind FCExtensionPipe's streaming mode, in plain C on POSIX, usable without any Apple frameworks.
+//
+// A ring buffer in a memory-mapped file that one writer process streams messages into and any number of reader processes
+//  follow, each with its own cursor. The writer never waits for readers: when the ring is full, it overwrites the oldest
+//  messages, and readers that were still behind find out through their cursor's sequence number.
+//
+// Records are a 4-byte length and the low 32 bits of a sequence number, then the payload, padded to 8 bytes.
+//
+
+#ifndef FCPipeRing_h
+#define FCPipeRing_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct FCPipeRing FCPipeRing;
+
+// Maps path, creating it with capacity bytes of message space if it doesn't exist yet (rounded up to a power of 2,
+//  between 4 KB and 1 GB). An existing ring keeps its own capacity. Returns NULL with errno set on failure.
+FCPipeRing *FCPipeRingOpen(const char *path, uint32_t capacity);
+void FCPipeRingClose(FCPipeRing *ring);
+uint32_t FCPipeRingMaximumMessageLength(FCPipeRing *ring); // a quarter of the capacity
+
+// Only one thread in one process may write to a ring at a time. Returns false if length exceeds the maximum.
+bool FCPipeRingWrite(FCPipeRing *ring, const void *bytes, uint32_t length);
+
+// Exclusive flock on the ring file, for processes that may write concurrently. The lock belongs to the ring's open file,
+//  not the calling thread, so threads sharing one FCPipeRing must also serialize among themselves.
+bool FCPipeRingLockWriter(FCPipeRing *ring);
+void FCPipeRingUnlockWriter(FCPipeRing *ring);
+
+typedef struct {
+    uint32_t offset;
+    uint32_t sequence; // of the next message to read
+} FCPipeRingCursor;
+
+FCPipeRingCursor FCPipeRingNewestCursor(FCPipeRing *ring); // reads only messages written from now on
+FCPipeRingCursor FCPipeRingOldestCursor(FCPipeRing *ring); // reads every message still in the ring
+
+typedef enum {
+    FCPipeRingReadMessage = 0, // copied into buffer and the cursor advanced
+    FCPipeRingReadEmpty,       // no new messages
+    FCPipeRingReadOverrun,     // the writer overwrote unread messages. Cursor moved to the oldest; its sequence shows how many were lost.
+    FCPipeRingReadCorrupt,     // the ring's contents are invalid. Cursor moved to the newest message.
+} FCPipeRingReadResult;
+
+// buffer must hold FCPipeRingMaximumMessageLength(ring) bytes
+FCPipeRingReadResult FCPipeRingRead(FCPipeRing *ring, FCPipeRingCursor *cursor, void *buffer, uint32_t *length);
+
+
+// Compact self-describing encoding for messages: a tag byte per value, varint lengths and counts, zigzag varint integers,
+//  little-endian doubles. Dictionaries are a count of pairs, each a key value then a value.
+
+typedef enum {
+    FCPipeValueNull = 0,
+    FCPipeValueBool,
+    FCPipeValueInteger,
+    FCPipeValueDouble,
+    FCPipeValueDate,       // seconds since 2001-01-01 UTC, as a double
+    FCPipeValueString,     // UTF-8, not NUL-terminated
+    FCPipeValueData,
+    FCPipeValueArray,      // followed by count values
+    FCPipeValueDictionary, // followed by count key-value pairs
+} FCPipeValueType;
+
+typedef struct {
+    uint8_t *bytes; // owned, grown as needed
+    size_t length;
+    size_t capacity;
+    bool failed; // allocation failed; the encoding is unusable until reset
+} FCPipeEncoder;
+
+void FCPipeEncoderReset(FCPipeEncoder *encoder); // keeps the allocation for reuse
+void FCPipeEncoderFree(FCPipeEncoder *encoder);
+
+void FCPipeEncodeNull(FCPipeEncoder *encoder);
+void FCPipeEncodeBool(FCPipeEncoder *encoder, bool value);
+void FCPipeEncodeInteger(FCPipeEncoder *encoder, int64_t value);
+void FCPipeEncodeDouble(FCPipeEncoder *encoder, double value);
+void FCPipeEncodeDate(FCPipeEncoder *encoder, double secondsSince2001);
+void FCPipeEncodeString(FCPipeEncoder *encoder, const char *utf8, size_t length);
+void FCPipeEncodeData(FCPipeEncoder *encoder, const void *bytes, size_t length);
+void FCPipeEncodeArrayStart(FCPipeEncoder *encoder, size_t count);
+void FCPipeEncodeDictionaryStart(FCPipeEncoder *encoder, size_t count);
+
+typedef struct {
+    FCPipeValueType type;
+    union {
+        bool boolValue;
+        int64_t integerValue;
+        double doubleValue; // doubles and dates
+        struct {
+            const uint8_t *bytes; // points into the decoded buffer
+            size_t length;
+        } bytes;            // strings and data
+        size_t count;       // arrays and dictionaries
+    };
+} FCPipeValue;
+
+typedef struct {
+    const uint8_t *bytes;
+    size_t length;
+    size_t position;
+} FCPipeDecoder;
+
+// Reads values in encoding order. Returns false at the end of the input or if it's malformed.
+//  Container counts are checked against the remaining input, so they're safe to preallocate for.
+bool FCPipeDecodeNext(FCPipeDecoder *decoder, FCPipeValue *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
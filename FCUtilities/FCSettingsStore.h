@@ -0,0 +1,46 @@
+//
+//  FCSettingsStore.h
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+// Write-behind layer over NSUserDefaults, used by the user_defaults_* macros in FCBasics.h.
+//
+// Sets update an in-memory cache immediately and mark the key dirty. Dirty keys are written to the user defaults
+//  together, once per writeDelay, on a background queue. The defaults are never asked to synchronize: they persist
+//  atomically by themselves once written. Pending writes are flushed when the app enters the background or terminates.
+// Reads see pending writes right away. Code reading NSUserDefaults directly may see old values until the next flush.
+//
+
+#import <Foundation/Foundation.h>
+
+@interface FCSettingsStore : NSObject
+
++ (instancetype)standardStore; // NSUserDefaults.standardUserDefaults
+- (instancetype)initWithUserDefaults:(NSUserDefaults *)userDefaults;
+
+@property (nonatomic, readonly) NSUserDefaults *userDefaults;
+@property (nonatomic) NSTimeInterval writeDelay; // default 0.25 seconds
+
+// Conversions match NSUserDefaults: numbers and strings both read as BOOL/NSInteger/double, numbers read as strings
+- (id)objectForKey:(NSString *)key;
+- (BOOL)boolForKey:(NSString *)key;
+- (NSInteger)integerForKey:(NSString *)key;
+- (double)doubleForKey:(NSString *)key;
+- (NSString *)stringForKey:(NSString *)key;
+- (NSArray *)arrayForKey:(NSString *)key;
+
+// Values must be property-list types, as for NSUserDefaults; anything else raises NSInvalidArgumentException.
+- (void)setObject:(id)value forKey:(NSString *)key; // nil removes. Mutable values are copied.
+- (void)setBool:(BOOL)value forKey:(NSString *)key;
+- (void)setInteger:(NSInteger)value forKey:(NSString *)key;
+- (void)setDouble:(double)value forKey:(NSString *)key;
+- (void)removeObjectForKey:(NSString *)key;
+
+// Sets many keys with one lock and one scheduled write. NSNull values remove their keys.
+- (void)setValuesFromDictionary:(NSDictionary<NSString *, id> *)dictionary;
+
+@property (nonatomic, readonly) NSUInteger pendingWriteCount;
+
+// Writes all pending changes to the user defaults before returning
+- (void)flush;
+
+@end
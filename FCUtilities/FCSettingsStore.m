@@ -0,0 +1,201 @@
+//
+//  FCSettingsStore.m
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+
+#import "FCSettingsStore.h"
+#import <os/lock.h>
+#if TARGET_OS_IPHONE && ! TARGET_OS_WATCH
+@import UIKit;
+#endif
+
+static const void * const FCSettingsStoreWriteQueueKey = &FCSettingsStoreWriteQueueKey;
+
+@interface FCSettingsStore () {
+    os_unfair_lock lock;
+    NSMutableDictionary<NSString *, id> *cachedValues; // read-through, present values only: registered defaults may change misses
+    NSMutableDictionary<NSString *, id> *dirtyValues;  // not yet written, NSNull for removals
+    uint64_t generation; // incremented on every change, so a slow cache fill can't overwrite a newer value
+    BOOL writeScheduled;
+}
+@property (nonatomic) NSUserDefaults *userDefaults;
+@property (nonatomic) dispatch_queue_t writeQueue;
+@end
+
+@implementation FCSettingsStore
+
++ (instancetype)standardStore
+{
+    static FCSettingsStore *store;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{ store = [[self alloc] initWithUserDefaults:NSUserDefaults.standardUserDefaults]; });
+    return store;
+}
+
+- (instancetype)init { return [self initWithUserDefaults:NSUserDefaults.standardUserDefaults]; }
+
+- (instancetype)initWithUserDefaults:(NSUserDefaults *)userDefaults
+{
+    if ( (self = [super init]) ) {
+        lock = OS_UNFAIR_LOCK_INIT;
+        cachedValues = [NSMutableDictionary dictionary];
+        dirtyValues = [NSMutableDictionary dictionary];
+        self.userDefaults = userDefaults ?: NSUserDefaults.standardUserDefaults;
+        self.writeDelay = 0.25;
+        self.writeQueue = dispatch_queue_create("FCSettingsStore", dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0));
+        dispatch_queue_set_specific(self.writeQueue, FCSettingsStoreWriteQueueKey, (__bridge void *) self, NULL);
+
+        [NSNotificationCenter.defaultCenter addObserver:self selector:@selector(userDefaultsDidChange:) name:NSUserDefaultsDidChangeNotification object:self.userDefaults];
+#if TARGET_OS_IPHONE && ! TARGET_OS_WATCH
+        [NSNotificationCenter.defaultCenter addObserver:self selector:@selector(flush) name:UIApplicationDidEnterBackgroundNotification object:nil];
+        [NSNotificationCenter.defaultCenter addObserver:self selector:@selector(flush) name:UIApplicationWillTerminateNotification object:nil];
+#endif
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [NSNotificationCenter.defaultCenter removeObserver:self];
+}
+
+// Changes made elsewhere in the process invalidate the read cache. Our own writes, posted from the write queue, don't.
+- (void)userDefaultsDidChange:(NSNotification *)notification
+{
+    if (dispatch_get_specific(FCSettingsStoreWriteQueueKey) == (__bridge void *) self) return;
+    os_unfair_lock_lock(&lock);
+    generation++;
+    [cachedValues removeAllObjects];
+    os_unfair_lock_unlock(&lock);
+}
+
+#pragma mark - Reading
+
+- (id)objectForKey:(NSString *)key
+{
+    if (! key) return nil;
+    os_unfair_lock_lock(&lock);
+    id value = dirtyValues[key] ?: cachedValues[key];
+    uint64_t readGeneration = generation;
+    os_unfair_lock_unlock(&lock);
+    if (value) return value == NSNull.null ? nil : value;
+
+    value = [self.userDefaults objectForKey:key];
+    if (value) {
+        os_unfair_lock_lock(&lock);
+        if (generation == readGeneration) cachedValues[key] = value;
+        os_unfair_lock_unlock(&lock);
+    }
+    return value;
+}
+
+- (BOOL)boolForKey:(NSString *)key
+{
+    id value = [self objectForKey:key];
+    return [value isKindOfClass:NSNumber.class] || [value isKindOfClass:NSString.class] ? [value boolValue] : NO;
+}
+
+- (NSInteger)integerForKey:(NSString *)key
+{
+    id value = [self objectForKey:key];
+    return [value isKindOfClass:NSNumber.class] || [value isKindOfClass:NSString.class] ? [value integerValue] : 0;
+}
+
+- (double)doubleForKey:(NSString *)key
+{
+    id value = [self objectForKey:key];
+    return [value isKindOfClass:NSNumber.class] || [value isKindOfClass:NSString.class] ? [value doubleValue] : 0;
+}
+
+- (NSString *)stringForKey:(NSString *)key
+{
+    id value = [self objectForKey:key];
+    if ([value isKindOfClass:NSString.class]) return value;
+    return [value isKindOfClass:NSNumber.class] ? [value stringValue] : nil;
+}
+
+- (NSArray *)arrayForKey:(NSString *)key
+{
+    id value = [self objectForKey:key];
+    return [value isKindOfClass:NSArray.class] ? value : nil;
+}
+
+#pragma mark - Writing
+
+- (void)setObject:(id)value forKey:(NSString *)key
+{
+    if (! key) return;
+    [self setValuesFromDictionary:@{ key : value ?: NSNull.null }];
+}
+
+- (void)setBool:(BOOL)value forKey:(NSString *)key { [self setObject:@(value) forKey:key]; }
+- (void)setInteger:(NSInteger)value forKey:(NSString *)key { [self setObject:@(value) forKey:key]; }
+- (void)setDouble:(double)value forKey:(NSString *)key { [self setObject:@(value) forKey:key]; }
+- (void)removeObjectForKey:(NSString *)key { [self setObject:nil forKey:key]; }
+
+- (void)setValuesFromDictionary:(NSDictionary<NSString *, id> *)dictionary
+{
+    if (! dictionary.count) return;
+    // Rejected here, on the caller's stack, instead of by NSUserDefaults later on the write queue
+    NSMutableDictionary *copiedValues = [NSMutableDictionary dictionaryWithCapacity:dictionary.count];
+    [dictionary enumerateKeysAndObjectsUsingBlock:^(NSString *key, id value, BOOL *stop) {
+        if (! [key isKindOfClass:NSString.class] || (value != NSNull.null && ! [NSPropertyListSerialization propertyList:value isValidForFormat:NSPropertyListBinaryFormat_v1_0])) {
+            [[NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"FCSettingsStore: %@ for key %@ is not a property-list value", [value class], key] userInfo:nil] raise];
+        }
+        copiedValues[key] = [value conformsToProtocol:@protocol(NSCopying)] ? [value copy] : value;
+    }];
+
+    os_unfair_lock_lock(&lock);
+    generation++;
+    [copiedValues enumerateKeysAndObjectsUsingBlock:^(NSString *key, id value, BOOL *stop) {
+        dirtyValues[key] = value;
+        if (value == NSNull.null) [cachedValues removeObjectForKey:key];
+        else cachedValues[key] = value;
+    }];
+    BOOL scheduleWrite = ! writeScheduled;
+    writeScheduled = YES;
+    os_unfair_lock_unlock(&lock);
+
+    if (scheduleWrite) {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t) (self.writeDelay * NSEC_PER_SEC)), self.writeQueue, ^{ [self _writeDirtyValues]; });
+    }
+}
+
+- (NSUInteger)pendingWriteCount
+{
+    os_unfair_lock_lock(&lock);
+    NSUInteger count = dirtyValues.count;
+    os_unfair_lock_unlock(&lock);
+    return count;
+}
+
+- (void)flush
+{
+    if (dispatch_get_specific(FCSettingsStoreWriteQueueKey) == (__bridge void *) self) [self _writeDirtyValues];
+    else dispatch_sync(self.writeQueue, ^{ [self _writeDirtyValues]; });
+}
+
+// Call only on writeQueue
+- (void)_writeDirtyValues
+{
+    os_unfair_lock_lock(&lock);
+    writeScheduled = NO; // sets from here on schedule the next write
+    NSDictionary *pendingValues = dirtyValues.count ? [dirtyValues copy] : nil;
+    os_unfair_lock_unlock(&lock);
+    if (! pendingValues) return;
+
+    NSUserDefaults *userDefaults = self.userDefaults;
+    [pendingValues enumerateKeysAndObjectsUsingBlock:^(NSString *key, id value, BOOL *stop) {
+        if (value == NSNull.null) [userDefaults removeObjectForKey:key];
+        else [userDefaults setObject:value forKey:key];
+    }];
+
+    // Keys stay dirty until written, so reads never fall through to an old value. Keys set again meanwhile stay dirty.
+    os_unfair_lock_lock(&lock);
+    [pendingValues enumerateKeysAndObjectsUsingBlock:^(NSString *key, id value, BOOL *stop) {
+        if (dirtyValues[key] == value) [dirtyValues removeObjectForKey:key];
+    }];
+    os_unfair_lock_unlock(&lock);
+}
+
+@end
@@ -0,0 +1,389 @@
+//
+//  FCWorkQueue.c
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+
+#include "FCWorkQueue.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <pthread/qos.h>
+#endif
+
+#define FCWorkLocalPoolLimit  256   // job nodes cached per worker before half are returned to the global pool
+#define FCWorkGlobalPoolLimit 4096  // beyond this, finished nodes are freed
+
+typedef struct FCWorkJob {
+    struct FCWorkJob *next; // in free lists
+    FCWorkFunction function;
+    void *context;
+    FCWorkGroup *group;
+} FCWorkJob;
+
+typedef struct {
+    FCWorkJob **slots;
+    size_t capacity; // power of 2
+    size_t head, tail;
+} FCWorkRing;
+
+typedef struct {
+    FCWorkQueue *queue;
+    unsigned index;
+    pthread_t thread;
+
+    pthread_mutex_t lock; // guards lanes
+    FCWorkRing lanes[FCWorkPriorityCount];
+    atomic_size_t laneCounts[FCWorkPriorityCount]; // read without the lock to skip empty lanes
+
+    // Owner-only
+    FCWorkJob *freeJobs;
+    unsigned freeCount;
+    int currentLane;
+} FCWorkWorker;
+
+struct FCWorkQueue {
+    FCWorkWorker *workers;
+    unsigned workerCount;
+    atomic_uint nextWorker;
+
+    atomic_long pendingJobs; // queued, not yet taken
+    atomic_int idleWorkers;
+    atomic_bool stopping;
+    pthread_mutex_t idleLock;
+    pthread_cond_t idleCond;
+
+    pthread_mutex_t poolLock;
+    FCWorkJob *pool;
+    unsigned poolCount;
+};
+
+struct FCWorkGroup {
+    atomic_long references;
+    atomic_long pending;
+    atomic_bool cancelled;
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+};
+
+static _Thread_local FCWorkWorker *FCCurrentWorker;
+
+// MARK: - Rings
+
+static void FCWorkRingPush(FCWorkRing *ring, FCWorkJob *job)
+{
+    if (ring->tail - ring->head == ring->capacity) {
+        size_t capacity = ring->capacity ? ring->capacity * 2 : 64;
+        FCWorkJob **slots = malloc(capacity * sizeof(FCWorkJob *));
+        for (size_t i = ring->head; i < ring->tail; i++) slots[i - ring->head] = ring->slots[i & (ring->capacity - 1)];
+        free(ring->slots);
+        ring->tail -= ring->head;
+        ring->head = 0;
+        ring->slots = slots;
+        ring->capacity = capacity;
+    }
+    ring->slots[ring->tail++ & (ring->capacity - 1)] = job;
+}
+
+static FCWorkJob *FCWorkRingTake(FCWorkRing *ring)
+{
+    if (ring->head == ring->tail) return NULL;
+    return ring->slots[ring->head++ & (ring->capacity - 1)];
+}
+
+// MARK: - Job pool
+
+static FCWorkJob *FCWorkJobAcquire(FCWorkQueue *queue, FCWorkWorker *worker)
+{
+    FCWorkJob *job = NULL;
+    if (worker && worker->freeJobs) {
+        job = worker->freeJobs;
+        worker->freeJobs = job->next;
+        worker->freeCount--;
+        return job;
+    }
+
+    pthread_mutex_lock(&queue->poolLock);
+    if ( (job = queue->pool) ) {
+        queue->pool = job->next;
+        queue->poolCount--;
+    }
+    pthread_mutex_unlock(&queue->poolLock);
+    return job ?: malloc(sizeof(FCWorkJob));
+}
+
+static void FCWorkJobRelinquish(FCWorkQueue *queue, FCWorkWorker *worker, FCWorkJob *job)
+{
+    job->next = worker->freeJobs;
+    worker->freeJobs = job;
+    if (++worker->freeCount < FCWorkLocalPoolLimit) return;
+
+    // Hand half back in one batch, so submitters on non-worker threads can reuse them
+    FCWorkJob *batch = worker->freeJobs, *last = batch;
+    for (unsigned i = 1; i < FCWorkLocalPoolLimit / 2; i++) last = last->next;
+    worker->freeJobs = last->next;
+    worker->freeCount -= FCWorkLocalPoolLimit / 2;
+
+    pthread_mutex_lock(&queue->poolLock);
+    if (queue->poolCount < FCWorkGlobalPoolLimit) {
+        last->next = queue->pool;
+        queue->pool = batch;
+        queue->poolCount += FCWorkLocalPoolLimit / 2;
+        batch = NULL;
+    }
+    pthread_mutex_unlock(&queue->poolLock);
+
+    while (batch) {
+        FCWorkJob *next = (batch == last) ? NULL : batch->next;
+        free(batch);
+        batch = next;
+    }
+}
+
+// MARK: - Groups
+
+FCWorkGroup *FCWorkGroupCreate(void)
+{
+    FCWorkGroup *group = calloc(1, sizeof(FCWorkGroup));
+    atomic_init(&group->references, 1);
+    pthread_mutex_init(&group->lock, NULL);
+    pthread_cond_init(&group->finished, NULL);
+    return group;
+}
+
+void FCWorkGroupRetain(FCWorkGroup *group) { atomic_fetch_add_explicit(&group->references, 1, memory_order_relaxed); }
+
+void FCWorkGroupRelease(FCWorkGroup *group)
+{
+    if (atomic_fetch_sub_explicit(&group->references, 1, memory_order_acq_rel) != 1) return;
+    pthread_mutex_destroy(&group->lock);
+    pthread_cond_destroy(&group->finished);
+    free(group);
+}
+
+void FCWorkGroupCancel(FCWorkGroup *group) { atomic_store(&group->cancelled, true); }
+bool FCWorkGroupIsCancelled(FCWorkGroup *group) { return atomic_load(&group->cancelled); }
+
+static void FCWorkGroupLeave(FCWorkGroup *group)
+{
+    if (atomic_fetch_sub(&group->pending, 1) == 1) {
+        pthread_mutex_lock(&group->lock);
+        pthread_cond_broadcast(&group->finished);
+        pthread_mutex_unlock(&group->lock);
+    }
+}
+
+// MARK: - Scheduling
+
+static FCWorkJob *FCWorkWorkerTake(FCWorkWorker *worker, int lane)
+{
+    if (! atomic_load_explicit(&worker->laneCounts[lane], memory_order_relaxed)) return NULL;
+    pthread_mutex_lock(&worker->lock);
+    FCWorkJob *job = FCWorkRingTake(&worker->lanes[lane]);
+    if (job) atomic_fetch_sub_explicit(&worker->laneCounts[lane], 1, memory_order_relaxed);
+    pthread_mutex_unlock(&worker->lock);
+    return job;
+}
+
+// Own queue first, then steal, one lane at a time from the highest priority down
+static FCWorkJob *FCWorkQueueFindJob(FCWorkQueue *queue, FCWorkWorker *worker, int *outLane)
+{
+    unsigned start = worker ? worker->index : atomic_load_explicit(&queue->nextWorker, memory_order_relaxed) % queue->workerCount;
+    for (int lane = 0; lane < FCWorkPriorityCount; lane++) {
+        for (unsigned i = 0; i < queue->workerCount; i++) {
+            FCWorkJob *job = FCWorkWorkerTake(&queue->workers[(start + i) % queue->workerCount], lane);
+            if (job) {
+                atomic_fetch_sub(&queue->pendingJobs, 1);
+                *outLane = lane;
+                return job;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Only changes the thread's QoS when the lane differs from the last job's, since it's a system call
+static void FCWorkWorkerSetLane(FCWorkWorker *worker, int lane)
+{
+    if (worker->currentLane == lane) return;
+#ifdef __APPLE__
+    static const qos_class_t laneQoS[FCWorkPriorityCount] = { QOS_CLASS_USER_INITIATED, QOS_CLASS_DEFAULT, QOS_CLASS_UTILITY };
+    pthread_set_qos_class_self_np(laneQoS[lane], 0);
+#endif
+    worker->currentLane = lane;
+}
+
+static void FCWorkQueueRunJob(FCWorkQueue *queue, FCWorkWorker *worker, FCWorkJob *job, int lane)
+{
+    FCWorkWorkerSetLane(worker, lane);
+
+    FCWorkGroup *group = job->group;
+    job->function(job->context, group && atomic_load_explicit(&group->cancelled, memory_order_relaxed));
+    FCWorkJobRelinquish(queue, worker, job);
+
+    if (group) {
+        FCWorkGroupLeave(group);
+        FCWorkGroupRelease(group);
+    }
+}
+
+static void *FCWorkWorkerMain(void *argument)
+{
+    FCWorkWorker *worker = argument;
+    FCWorkQueue *queue = worker->queue;
+    FCCurrentWorker = worker;
+
+    while (true) {
+        int lane;
+        FCWorkJob *job = FCWorkQueueFindJob(queue, worker, &lane);
+        if (job) {
+            FCWorkQueueRunJob(queue, worker, job, lane);
+            continue;
+        }
+        if (atomic_load(&queue->stopping) && ! atomic_load(&queue->pendingJobs)) break;
+
+        // idleWorkers and pendingJobs are each written before the other is read (seq_cst), so a submitter either
+        //  sees this worker idle and signals, or this worker sees its job and doesn't sleep
+        pthread_mutex_lock(&queue->idleLock);
+        atomic_fetch_add(&queue->idleWorkers, 1);
+        while (! atomic_load(&queue->pendingJobs) && ! atomic_load(&queue->stopping)) pthread_cond_wait(&queue->idleCond, &queue->idleLock);
+        atomic_fetch_sub(&queue->idleWorkers, 1);
+        pthread_mutex_unlock(&queue->idleLock);
+    }
+
+    while (worker->freeJobs) {
+        FCWorkJob *next = worker->freeJobs->next;
+        free(worker->freeJobs);
+        worker->freeJobs = next;
+    }
+    return NULL;
+}
+
+// MARK: -
+
+FCWorkQueue *FCWorkQueueCreate(unsigned workerCount)
+{
+    if (! workerCount) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        workerCount = online > 0 ? (unsigned) online : 1;
+    }
+
+    FCWorkQueue *queue = calloc(1, sizeof(FCWorkQueue));
+    queue->workerCount = workerCount;
+    queue->workers = calloc(workerCount, sizeof(FCWorkWorker));
+    pthread_mutex_init(&queue->idleLock, NULL);
+    pthread_cond_init(&queue->idleCond, NULL);
+    pthread_mutex_init(&queue->poolLock, NULL);
+
+    for (unsigned i = 0; i < workerCount; i++) {
+        FCWorkWorker *worker = &queue->workers[i];
+        worker->queue = queue;
+        worker->index = i;
+        worker->currentLane = -1;
+        pthread_mutex_init(&worker->lock, NULL);
+    }
+
+    // Started only once every worker exists, since they steal from each other
+    for (unsigned i = 0; i < workerCount; i++) {
+        pthread_attr_t attributes;
+        pthread_attr_init(&attributes);
+#ifdef __APPLE__
+        pthread_attr_set_qos_class_np(&attributes, QOS_CLASS_DEFAULT, 0);
+#endif
+        pthread_create(&queue->workers[i].thread, &attributes, FCWorkWorkerMain, &queue->workers[i]);
+        pthread_attr_destroy(&attributes);
+    }
+    return queue;
+}
+
+void FCWorkQueueDestroy(FCWorkQueue *queue)
+{
+    pthread_mutex_lock(&queue->idleLock);
+    atomic_store(&queue->stopping, true);
+    pthread_cond_broadcast(&queue->idleCond);
+    pthread_mutex_unlock(&queue->idleLock);
+
+    for (unsigned i = 0; i < queue->workerCount; i++) pthread_join(queue->workers[i].thread, NULL);
+
+    for (unsigned i = 0; i < queue->workerCount; i++) {
+        FCWorkWorker *worker = &queue->workers[i];
+        for (int lane = 0; lane < FCWorkPriorityCount; lane++) free(worker->lanes[lane].slots);
+        pthread_mutex_destroy(&worker->lock);
+    }
+    while (queue->pool) {
+        FCWorkJob *next = queue->pool->next;
+        free(queue->pool);
+        queue->pool = next;
+    }
+
+    pthread_mutex_destroy(&queue->idleLock);
+    pthread_cond_destroy(&queue->idleCond);
+    pthread_mutex_destroy(&queue->poolLock);
+    free(queue->workers);
+    free(queue);
+}
+
+bool FCWorkQueueIsCurrentThreadWorker(FCWorkQueue *queue) { return FCCurrentWorker && FCCurrentWorker->queue == queue; }
+
+void FCWorkQueueSubmit(FCWorkQueue *queue, FCWorkPriority priority, FCWorkGroup *group, FCWorkFunction function, void *context)
+{
+    if (priority < 0 || priority >= FCWorkPriorityCount) priority = FCWorkPriorityDefault;
+    FCWorkWorker *current = FCWorkQueueIsCurrentThreadWorker(queue) ? FCCurrentWorker : NULL;
+
+    FCWorkJob *job = FCWorkJobAcquire(queue, current);
+    job->function = function;
+    job->context = context;
+    job->group = group;
+    if (group) {
+        FCWorkGroupRetain(group);
+        atomic_fetch_add(&group->pending, 1);
+    }
+
+    FCWorkWorker *target = current ?: &queue->workers[atomic_fetch_add_explicit(&queue->nextWorker, 1, memory_order_relaxed) % queue->workerCount];
+    pthread_mutex_lock(&target->lock);
+    FCWorkRingPush(&target->lanes[priority], job);
+    atomic_fetch_add_explicit(&target->laneCounts[priority], 1, memory_order_relaxed);
+    pthread_mutex_unlock(&target->lock);
+
+    atomic_fetch_add(&queue->pendingJobs, 1);
+    if (atomic_load(&queue->idleWorkers) > 0) {
+        pthread_mutex_lock(&queue->idleLock);
+        pthread_cond_signal(&queue->idleCond);
+        pthread_mutex_unlock(&queue->idleLock);
+    }
+}
+
+void FCWorkGroupWait(FCWorkGroup *group)
+{
+    FCWorkWorker *worker = FCCurrentWorker;
+    if (worker) {
+        // Blocking a worker could starve the very jobs being waited on, so help run them instead
+        while (atomic_load(&group->pending) > 0) {
+            int lane;
+            FCWorkJob *job = FCWorkQueueFindJob(worker->queue, worker, &lane);
+            if (job) {
+                int waitingLane = worker->currentLane;
+                FCWorkQueueRunJob(worker->queue, worker, job, lane);
+                if (waitingLane >= 0) FCWorkWorkerSetLane(worker, waitingLane);
+                continue;
+            }
+
+            // Nothing to run: the remaining jobs are running elsewhere
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += 1000000;
+            if (deadline.tv_nsec >= 1000000000) { deadline.tv_sec++; deadline.tv_nsec -= 1000000000; }
+            pthread_mutex_lock(&group->lock);
+            if (atomic_load(&group->pending) > 0) pthread_cond_timedwait(&group->finished, &group->lock, &deadline);
+            pthread_mutex_unlock(&group->lock);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&group->lock);
+    while (atomic_load(&group->pending) > 0) pthread_cond_wait(&group->finished, &group->lock);
+    pthread_mutex_unlock(&group->lock);
+}
@@ -0,0 +1,57 @@
+//
+//  FCWorkQueue.h
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+// The work-stealing scheduler behind FCExecutor, in plain C on pthreads, for very large numbers of tiny jobs.
+//  Portable: no Apple frameworks required (QoS is applied on Apple platforms only).
+//
+// Each worker thread has its own FIFO queue per priority lane. Jobs submitted from a worker go to its own queue,
+//  others are spread round-robin; idle workers steal from the others, always taking the highest-priority lane first.
+//  Job nodes are pooled (per worker, then globally), so steady-state submission doesn't hit malloc.
+//
+
+#ifndef FCWorkQueue_h
+#define FCWorkQueue_h
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct FCWorkQueue FCWorkQueue;
+typedef struct FCWorkGroup FCWorkGroup;
+
+typedef enum {
+    FCWorkPriorityHigh = 0, // QOS_CLASS_USER_INITIATED
+    FCWorkPriorityDefault,  // QOS_CLASS_DEFAULT
+    FCWorkPriorityLow,      // QOS_CLASS_UTILITY
+    FCWorkPriorityCount
+} FCWorkPriority;
+
+// Always called exactly once per job, so context can be released. cancelled is true if the job's group was
+//  cancelled before it started, in which case the function should only clean up.
+typedef void (*FCWorkFunction)(void *context, bool cancelled);
+
+FCWorkQueue *FCWorkQueueCreate(unsigned workerCount); // 0 = one per online CPU
+// Runs all queued jobs, then stops and joins the workers. Must not be called from one of the queue's own jobs.
+void FCWorkQueueDestroy(FCWorkQueue *queue);
+bool FCWorkQueueIsCurrentThreadWorker(FCWorkQueue *queue);
+
+// group may be NULL
+void FCWorkQueueSubmit(FCWorkQueue *queue, FCWorkPriority priority, FCWorkGroup *group, FCWorkFunction function, void *context);
+
+// A cancellation token and completion barrier for any number of jobs. Reference-counted: queued jobs hold a reference.
+FCWorkGroup *FCWorkGroupCreate(void);
+void FCWorkGroupRetain(FCWorkGroup *group);
+void FCWorkGroupRelease(FCWorkGroup *group);
+void FCWorkGroupCancel(FCWorkGroup *group);
+bool FCWorkGroupIsCancelled(FCWorkGroup *group);
+// Blocks until every job submitted with group has finished. Called from a worker, it runs queued jobs while waiting.
+void FCWorkGroupWait(FCWorkGroup *group);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
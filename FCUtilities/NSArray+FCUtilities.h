@@ -12,6 +12,17 @@
 - (id)fc_randomObject;
 - (id)fc_safeObjectAtIndex:(NSUInteger)idx;
 
+// Concurrent variants for large arrays with expensive blocks, which must be thread-safe. The array is split into
+//  chunks of chunkSize objects (0 = automatic) run across all cores at the caller's QoS; results keep the original order.
+//  Each chunk writes only its own slice of the output, so there are no locks. Blocks must not return nil.
+- (NSArray *)fc_concurrentMap:(id (^)(id obj))newObjectFromObjectBlock;
+- (NSArray *)fc_concurrentMap:(id (^)(id obj))newObjectFromObjectBlock chunkSize:(NSUInteger)chunkSize;
+- (NSArray *)fc_concurrentFilter:(BOOL (^)(id obj))keepBlock;
+- (NSArray *)fc_concurrentFilter:(BOOL (^)(id obj))keepBlock chunkSize:(NSUInteger)chunkSize;
+
+// Stable (equal objects keep their relative order) and concurrent
+- (NSArray *)fc_concurrentSortedArrayUsingComparator:(NSComparator)comparator;
+
 @end
 
 
@@ -5,6 +5,14 @@
 
 #import "NSArray+FCUtilities.h"
 
+// Small enough chunks that uneven block costs still balance across cores, large enough to amortize dispatch overhead
+static NSUInteger FCConcurrentChunkSize(NSUInteger count, NSUInteger requestedChunkSize)
+{
+    if (requestedChunkSize) return requestedChunkSize;
+    NSUInteger chunks = NSProcessInfo.processInfo.activeProcessorCount * 4;
+    return MAX((NSUInteger) 1, (count + chunks - 1) / chunks);
+}
+
 @implementation NSArray (FCUtilities)
 
 - (NSArray *)fc_filteredArrayUsingBlock:(BOOL (^)(id obj, NSUInteger idx, BOOL *stop))keepBlock
@@ -19,6 +27,72 @@
     return outArray;
 }
 
+- (NSArray *)fc_concurrentMap:(id (^)(id obj))newObjectFromObjectBlock
+{
+    return [self fc_concurrentMap:newObjectFromObjectBlock chunkSize:0];
+}
+
+- (NSArray *)fc_concurrentMap:(id (^)(id obj))newObjectFromObjectBlock chunkSize:(NSUInteger)chunkSize
+{
+    NSUInteger count = self.count;
+    chunkSize = FCConcurrentChunkSize(count, chunkSize);
+    if (count <= chunkSize) return [self fc_arrayWithCorrespondingObjectsFromBlock:newObjectFromObjectBlock];
+
+    // self retains the inputs for the duration; each output slot is written by exactly one chunk
+    __unsafe_unretained id *objects = (__unsafe_unretained id *) malloc(count * sizeof(id));
+    [self getObjects:objects range:NSMakeRange(0, count)];
+    __strong id *results = (__strong id *) calloc(count, sizeof(id));
+
+    dispatch_apply((count + chunkSize - 1) / chunkSize, dispatch_get_global_queue(qos_class_self(), 0), ^(size_t chunk) {
+        NSUInteger end = MIN(count, (chunk + 1) * chunkSize);
+        for (NSUInteger i = chunk * chunkSize; i < end; i++) {
+            @autoreleasepool { results[i] = newObjectFromObjectBlock(objects[i]); }
+        }
+    });
+
+    NSArray *outArray = [NSArray arrayWithObjects:results count:count];
+    for (NSUInteger i = 0; i < count; i++) results[i] = nil;
+    free(results);
+    free(objects);
+    return outArray;
+}
+
+- (NSArray *)fc_concurrentFilter:(BOOL (^)(id obj))keepBlock
+{
+    return [self fc_concurrentFilter:keepBlock chunkSize:0];
+}
+
+- (NSArray *)fc_concurrentFilter:(BOOL (^)(id obj))keepBlock chunkSize:(NSUInteger)chunkSize
+{
+    NSUInteger count = self.count;
+    chunkSize = FCConcurrentChunkSize(count, chunkSize);
+    if (count <= chunkSize) return [self fc_filteredArrayUsingBlock:^BOOL(id obj, NSUInteger idx, BOOL *stop) { return keepBlock(obj); }];
+
+    __unsafe_unretained id *objects = (__unsafe_unretained id *) malloc(count * sizeof(id));
+    [self getObjects:objects range:NSMakeRange(0, count)];
+    BOOL *keep = malloc(count * sizeof(BOOL));
+
+    dispatch_apply((count + chunkSize - 1) / chunkSize, dispatch_get_global_queue(qos_class_self(), 0), ^(size_t chunk) {
+        NSUInteger end = MIN(count, (chunk + 1) * chunkSize);
+        for (NSUInteger i = chunk * chunkSize; i < end; i++) {
+            @autoreleasepool { keep[i] = keepBlock(objects[i]); }
+        }
+    });
+
+    // Compact in place, in order
+    NSUInteger kept = 0;
+    for (NSUInteger i = 0; i < count; i++) if (keep[i]) objects[kept++] = objects[i];
+    NSArray *outArray = [NSArray arrayWithObjects:objects count:kept];
+    free(keep);
+    free(objects);
+    return outArray;
+}
+
+- (NSArray *)fc_concurrentSortedArrayUsingComparator:(NSComparator)comparator
+{
+    return [self sortedArrayWithOptions:NSSortConcurrent | NSSortStable usingComparator:comparator];
+}
+
 - (id)fc_randomObject
 {
     if (! self.count) return nil;
@@ -8,13 +8,53 @@
 @import Security;
 // Also requires libz to be linked, but "@import libz;" doesn't work, presumably because it's not a full-fledged framework
 
+typedef NS_ENUM(NSInteger, FCZlibFormat) {
+    FCZlibFormatZlib = 0,
+    FCZlibFormatGzip,
+    FCZlibFormatRaw, // no header, such as PHP's gzdeflate() output
+    FCZlibFormatAutomatic, // inflating only: accepts zlib or gzip headers
+};
+
+// Incremental compressor/decompressor for feeding data in chunks, e.g. from an NSInputStream or NSURLSession data callbacks.
+// Memory use is bounded by outputChunkSize: output is emitted into one reused buffer, so the bytes passed to
+//  outputHandler are only valid during that call. Not thread-safe; feed each instance from one queue at a time.
+@interface FCZlibStream : NSObject
+
+- (instancetype)initDeflatingWithFormat:(FCZlibFormat)format level:(int)level; // level: 0-9, or -1 for zlib's default
+- (instancetype)initInflatingWithFormat:(FCZlibFormat)format;
+
+@property (nonatomic) NSUInteger outputChunkSize; // default 64 KB. Set before the first chunk.
+@property (nonatomic, readonly) BOOL finished; // inflating: end of compressed stream reached. Deflating: finish called.
+
+// Each returns NO on a compression or data error, after which the stream can't be used.
+- (BOOL)processBytes:(const void *)bytes length:(NSUInteger)length outputHandler:(void (^)(const void *bytes, NSUInteger length))outputHandler;
+- (BOOL)processData:(NSData *)data outputHandler:(void (^)(const void *bytes, NSUInteger length))outputHandler;
+- (BOOL)processInputStream:(NSInputStream *)inputStream outputHandler:(void (^)(const void *bytes, NSUInteger length))outputHandler; // reads to the end, then finishes
+
+// Flushes remaining output. When inflating, returns NO if the compressed stream was truncated.
+- (BOOL)finishWithOutputHandler:(void (^)(const void *bytes, NSUInteger length))outputHandler;
+
+@end
+
+
 @interface NSData (FCUtilities)
 
 + (NSData *)fc_randomDataWithLength:(NSUInteger)length;
 - (NSData *)fc_deflatedData;
+- (NSData *)fc_deflatedDataWithFormat:(FCZlibFormat)format level:(int)level;
+
+// Splits large input into blocks and compresses them on up to maxConcurrency cores (0 = all active cores).
+// Output is a single standard stream that fc_inflatedDataWithHeader: reads. Ratio is within ~1% of the serial path,
+//  because each block is primed with the previous 32 KB as its dictionary. Small inputs fall back to the serial path.
+- (NSData *)fc_deflatedDataWithFormat:(FCZlibFormat)format level:(int)level maxConcurrency:(NSUInteger)maxConcurrency;
 - (NSData *)fc_inflatedDataWithHeader:(BOOL)headerPresent; // pass NO for raw deflate data without a gzip header, such as PHP's gzdeflate() output
 - (NSString *)fc_stringValue;
-- (NSString *)fc_hexString;
-- (NSString *)fc_URLSafeBase64EncodedString;
+- (NSString *)fc_hexString; // lowercase
+- (NSString *)fc_uppercaseHexString;
+- (NSString *)fc_URLSafeBase64EncodedString; // unpadded
+
+// Return nil for malformed input. Base64 decoding also accepts the standard alphabet and padding.
++ (NSData *)fc_dataFromHexString:(NSString *)hexString;
++ (NSData *)fc_dataFromURLSafeBase64String:(NSString *)base64String;
 
 @end
@@ -5,7 +5,137 @@
 
 #import "NSData+FCUtilities.h"
 #import <zlib.h>
+#import <stdatomic.h>
 #import <CommonCrypto/CommonDigest.h>
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#import <arm_neon.h>
+#elif defined(__SSSE3__)
+#import <tmmintrin.h>
+#endif
+
+#pragma mark - Hex and base64 codecs
+
+// Table-driven, writing straight into one preallocated ASCII buffer. Hex encoding is vectorized on arm64 (NEON) and SSSE3.
+
+static const char kFCHexDigitsLower[16] = "0123456789abcdef";
+static const char kFCHexDigitsUpper[16] = "0123456789ABCDEF";
+static const char kFCURLSafeBase64Alphabet[64] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// Writes exactly 2 * length bytes
+static void FCHexEncode(const uint8_t *in, size_t length, char *out, int uppercase)
+{
+    const char *digits = uppercase ? kFCHexDigitsUpper : kFCHexDigitsLower;
+    size_t i = 0;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    uint8x16_t table = vld1q_u8((const uint8_t *) digits);
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t v = vld1q_u8(in + i);
+        uint8x16x2_t pair = { { vqtbl1q_u8(table, vshrq_n_u8(v, 4)), vqtbl1q_u8(table, vandq_u8(v, vdupq_n_u8(0x0f))) } };
+        vst2q_u8((uint8_t *) out + 2 * i, pair); // interleaves high/low digits
+    }
+#elif defined(__SSSE3__)
+    __m128i table = _mm_loadu_si128((const __m128i *) digits);
+    __m128i mask = _mm_set1_epi8(0x0f);
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (in + i));
+        __m128i hi = _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+        __m128i lo = _mm_shuffle_epi8(table, _mm_and_si128(v, mask));
+        _mm_storeu_si128((__m128i *) (out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *) (out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+#endif
+    for (; i < length; i++) {
+        out[2 * i] = digits[in[i] >> 4];
+        out[2 * i + 1] = digits[in[i] & 0x0f];
+    }
+}
+
+static int FCHexDigitValue(uint8_t c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// Returns 0 on invalid input. out must hold length / 2 bytes.
+static int FCHexDecode(const uint8_t *in, size_t length, uint8_t *out)
+{
+    if (length % 2) return 0;
+    for (size_t i = 0; i < length; i += 2) {
+        int hi = FCHexDigitValue(in[i]), lo = FCHexDigitValue(in[i + 1]);
+        if (hi < 0 || lo < 0) return 0;
+        out[i / 2] = (uint8_t) ((hi << 4) | lo);
+    }
+    return 1;
+}
+
+static size_t FCURLSafeBase64EncodedLength(size_t length) { return (length / 3) * 4 + ((length % 3) ? (length % 3) + 1 : 0); }
+
+// Unpadded, writes exactly FCURLSafeBase64EncodedLength(length) bytes
+static void FCURLSafeBase64Encode(const uint8_t *in, size_t length, char *out)
+{
+    const char *a = kFCURLSafeBase64Alphabet;
+    size_t i = 0;
+    for (; i + 3 <= length; i += 3) {
+        uint32_t n = ((uint32_t) in[i] << 16) | ((uint32_t) in[i + 1] << 8) | in[i + 2];
+        *out++ = a[n >> 18];
+        *out++ = a[(n >> 12) & 63];
+        *out++ = a[(n >> 6) & 63];
+        *out++ = a[n & 63];
+    }
+    size_t remaining = length - i;
+    if (remaining) {
+        uint32_t n = (uint32_t) in[i] << 16;
+        if (remaining == 2) n |= (uint32_t) in[i + 1] << 8;
+        *out++ = a[n >> 18];
+        *out++ = a[(n >> 12) & 63];
+        if (remaining == 2) *out++ = a[(n >> 6) & 63];
+    }
+}
+
+static int FCBase64DigitValue(uint8_t c)
+{
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '-' || c == '+') return 62;
+    if (c == '_' || c == '/') return 63;
+    return -1;
+}
+
+// Accepts URL-safe or standard alphabets, with or without padding. Returns decoded length, or -1 if invalid.
+// out must hold (length / 4 + 1) * 3 bytes.
+static long FCURLSafeBase64Decode(const uint8_t *in, size_t length, uint8_t *out)
+{
+    while (length && in[length - 1] == '=') length--;
+    if (length % 4 == 1) return -1;
+
+    size_t o = 0, i = 0;
+    for (; i + 4 <= length; i += 4) {
+        int a = FCBase64DigitValue(in[i]), b = FCBase64DigitValue(in[i + 1]), c = FCBase64DigitValue(in[i + 2]), d = FCBase64DigitValue(in[i + 3]);
+        if ((a | b | c | d) < 0) return -1;
+        uint32_t n = ((uint32_t) a << 18) | ((uint32_t) b << 12) | ((uint32_t) c << 6) | (uint32_t) d;
+        out[o++] = (uint8_t) (n >> 16);
+        out[o++] = (uint8_t) (n >> 8);
+        out[o++] = (uint8_t) n;
+    }
+    size_t remaining = length - i;
+    if (remaining) {
+        int a = FCBase64DigitValue(in[i]), b = FCBase64DigitValue(in[i + 1]), c = remaining == 3 ? FCBase64DigitValue(in[i + 2]) : 0;
+        if ((a | b | c) < 0) return -1;
+        uint32_t n = ((uint32_t) a << 18) | ((uint32_t) b << 12) | ((uint32_t) c << 6);
+        out[o++] = (uint8_t) (n >> 16);
+        if (remaining == 3) out[o++] = (uint8_t) (n >> 8);
+    }
+    return (long) o;
+}
+
+static NSString *FCNewASCIIString(char *buffer, size_t length)
+{
+    return [[NSString alloc] initWithBytesNoCopy:buffer length:length encoding:NSASCIIStringEncoding freeWhenDone:YES];
+}
+
 
 @implementation NSData (FCUtilities)
 
@@ -23,81 +153,301 @@
 
 - (NSString *)fc_hexString
 {
-	NSMutableString *stringBuffer = [NSMutableString stringWithCapacity:([self length] * 2)];	
-    const unsigned char *dataBuffer = [self bytes];
-    int i;
-    for (i = 0; i < [self length]; ++i) {
-        [stringBuffer appendFormat:@"%02lx", (unsigned long)dataBuffer[i]];
-	}
-    return [stringBuffer copy];
+    char *buffer = malloc(self.length * 2 + 1);
+    FCHexEncode(self.bytes, self.length, buffer, 0);
+    return FCNewASCIIString(buffer, self.length * 2);
+}
+
+- (NSString *)fc_uppercaseHexString
+{
+    char *buffer = malloc(self.length * 2 + 1);
+    FCHexEncode(self.bytes, self.length, buffer, 1);
+    return FCNewASCIIString(buffer, self.length * 2);
 }
 
 - (NSString *)fc_URLSafeBase64EncodedString
 {
-    NSString *str = [self base64EncodedStringWithOptions:0];
-    str = [str stringByReplacingOccurrencesOfString:@"+" withString:@"-"];
-    str = [str stringByReplacingOccurrencesOfString:@"/" withString:@"_"];
-    str = [str stringByReplacingOccurrencesOfString:@"=" withString:@""];
-    return str;
+    size_t length = FCURLSafeBase64EncodedLength(self.length);
+    char *buffer = malloc(length + 1);
+    FCURLSafeBase64Encode(self.bytes, self.length, buffer);
+    return FCNewASCIIString(buffer, length);
 }
 
-// Deflate functions adapted from:
-// http://code.google.com/p/google-toolbox-for-mac/source/browse/trunk/Foundation/GTMNSData%2Bzlib.m?r=5
++ (NSData *)fc_dataFromHexString:(NSString *)hexString
+{
+    const char *chars = hexString.UTF8String;
+    if (! chars) return nil;
+    size_t length = strlen(chars);
+    NSMutableData *data = [NSMutableData dataWithLength:length / 2];
+    return FCHexDecode((const uint8_t *) chars, length, data.mutableBytes) ? data : nil;
+}
+
++ (NSData *)fc_dataFromURLSafeBase64String:(NSString *)base64String
+{
+    const char *chars = base64String.UTF8String;
+    if (! chars) return nil;
+    size_t length = strlen(chars);
+    NSMutableData *data = [NSMutableData dataWithLength:(length / 4 + 1) * 3];
+    long decodedLength = FCURLSafeBase64Decode((const uint8_t *) chars, length, data.mutableBytes);
+    if (decodedLength < 0) return nil;
+    data.length = (NSUInteger) decodedLength;
+    return data;
+}
 
 - (NSData *)fc_deflatedData
+{
+    return [self fc_deflatedDataWithFormat:FCZlibFormatZlib level:-1];
+}
+
+- (NSData *)fc_deflatedDataWithFormat:(FCZlibFormat)format level:(int)level
+{
+    FCZlibStream *stream = [[FCZlibStream alloc] initDeflatingWithFormat:format level:level];
+    NSMutableData *result = [NSMutableData dataWithCapacity:(self.length / 4 + 64)];
+    void (^append)(const void *, NSUInteger) = ^(const void *bytes, NSUInteger length) { [result appendBytes:bytes length:length]; };
+    if (! stream || ! [stream processData:self outputHandler:append] || ! [stream finishWithOutputHandler:append]) return nil;
+    return result;
+}
+
+#define kFCParallelDeflateBlockSize (128 * 1024)
+#define kFCParallelDeflateDictionarySize 32768
+
+// Raw-deflates one block of the input: primed with the preceding 32 KB, and ended with a sync flush so blocks
+//  concatenate into one valid stream. Only the last block is finished with the final-block bit.
+static BOOL FCDeflateParallelBlock(const unsigned char *input, NSUInteger start, NSUInteger length, BOOL last, int level, NSMutableData *output)
 {
     z_stream strm;
     bzero(&strm, sizeof(z_stream));
-    strm.avail_in = (unsigned int) self.length;
-    strm.next_in = (unsigned char *) self.bytes;
-    if (Z_OK != deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15, 8, Z_DEFAULT_STRATEGY)) return nil;
+    if (Z_OK != deflateInit2(&strm, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY)) return NO;
 
-    NSMutableData *result = [NSMutableData dataWithCapacity:(self.length / 10)];
-    unsigned char output[1024];
-    int retCode;
-    do {
-        strm.avail_out = 1024;
-        strm.next_out = output;
-        retCode = deflate(&strm, Z_FINISH);
-        if ( (retCode != Z_OK) && (retCode != Z_STREAM_END) ) {
-            deflateEnd(&strm);
-            return nil;
-        }
+    NSUInteger dictionaryLength = MIN(start, (NSUInteger) kFCParallelDeflateDictionarySize);
+    if (dictionaryLength && Z_OK != deflateSetDictionary(&strm, input + start - dictionaryLength, (uInt) dictionaryLength)) {
+        deflateEnd(&strm);
+        return NO;
+    }
 
-        unsigned gotBack = 1024 - strm.avail_out;
-        if (gotBack > 0) [result appendBytes:output length:gotBack];
-    } while (retCode == Z_OK);
+    strm.next_in = (unsigned char *) input + start;
+    strm.avail_in = (uInt) length;
+    output.length = deflateBound(&strm, (uLong) length) + 16;
+    strm.next_out = output.mutableBytes;
+    strm.avail_out = (uInt) output.length;
 
+    int ret = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+    BOOL ok = (last ? ret == Z_STREAM_END : ret == Z_OK) && strm.avail_in == 0 && strm.avail_out > 0;
+    output.length = output.length - strm.avail_out;
     deflateEnd(&strm);
+    return ok;
+}
+
+- (NSData *)fc_deflatedDataWithFormat:(FCZlibFormat)format level:(int)level maxConcurrency:(NSUInteger)maxConcurrency
+{
+    if (! maxConcurrency) maxConcurrency = NSProcessInfo.processInfo.activeProcessorCount;
+    NSUInteger blockCount = (self.length + kFCParallelDeflateBlockSize - 1) / kFCParallelDeflateBlockSize;
+    if (maxConcurrency < 2 || blockCount < 2 || format == FCZlibFormatAutomatic) return [self fc_deflatedDataWithFormat:format level:level];
+
+    NSData *input = [self copy]; // contiguous and immutable while workers read it
+    const unsigned char *bytes = input.bytes;
+    NSUInteger totalLength = input.length;
+
+    NSMutableArray<NSMutableData *> *blocks = [NSMutableArray arrayWithCapacity:blockCount];
+    for (NSUInteger i = 0; i < blockCount; i++) [blocks addObject:[NSMutableData data]];
+    uLong *checksums = calloc(blockCount, sizeof(uLong));
+    atomic_bool failed = false, *sharedFailed = &failed; // dispatch_apply is synchronous, so workers can share the stack flag
+
+    // Each worker takes every Nth block, so concurrency is capped without a semaphore
+    NSUInteger workers = MIN(maxConcurrency, blockCount);
+    dispatch_apply(workers, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^(size_t worker) {
+        for (NSUInteger i = worker; i < blockCount && ! atomic_load_explicit(sharedFailed, memory_order_relaxed); i += workers) {
+            NSUInteger start = i * kFCParallelDeflateBlockSize;
+            NSUInteger length = MIN((NSUInteger) kFCParallelDeflateBlockSize, totalLength - start);
+            if (! FCDeflateParallelBlock(bytes, start, length, i == blockCount - 1, level, blocks[i])) atomic_store_explicit(sharedFailed, true, memory_order_relaxed);
+            checksums[i] = format == FCZlibFormatGzip ? crc32(crc32(0L, Z_NULL, 0), bytes + start, (uInt) length) : adler32(adler32(0L, Z_NULL, 0), bytes + start, (uInt) length);
+        }
+    });
+
+    uLong checksum = checksums[0];
+    for (NSUInteger i = 1; i < blockCount; i++) {
+        z_off_t length = (z_off_t) MIN((NSUInteger) kFCParallelDeflateBlockSize, totalLength - i * kFCParallelDeflateBlockSize);
+        checksum = format == FCZlibFormatGzip ? crc32_combine(checksum, checksums[i], length) : adler32_combine(checksum, checksums[i], length);
+    }
+    free(checksums);
+    if (atomic_load(&failed)) return nil;
+
+    NSUInteger compressedLength = 0;
+    for (NSData *block in blocks) compressedLength += block.length;
+    NSMutableData *result = [NSMutableData dataWithCapacity:compressedLength + 18];
+
+    if (format == FCZlibFormatGzip) {
+        const unsigned char header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+        [result appendBytes:header length:sizeof(header)];
+    } else if (format == FCZlibFormatZlib) {
+        int levelFlags = level == -1 || level == 6 ? 2 : (level < 2 ? 0 : (level < 6 ? 1 : 3));
+        unsigned char header[2] = { 0x78, (unsigned char) (levelFlags << 6) };
+        header[1] += 31 - ((header[0] * 256 + header[1]) % 31);
+        [result appendBytes:header length:sizeof(header)];
+    }
+
+    for (NSData *block in blocks) [result appendData:block];
+
+    if (format == FCZlibFormatGzip) {
+        uint32_t crc = (uint32_t) checksum, size = (uint32_t) totalLength;
+        const unsigned char trailer[8] = {
+            crc & 0xff, (crc >> 8) & 0xff, (crc >> 16) & 0xff, (crc >> 24) & 0xff,
+            size & 0xff, (size >> 8) & 0xff, (size >> 16) & 0xff, (size >> 24) & 0xff,
+        };
+        [result appendBytes:trailer length:sizeof(trailer)];
+    } else if (format == FCZlibFormatZlib) {
+        uint32_t adler = (uint32_t) checksum;
+        const unsigned char trailer[4] = { (adler >> 24) & 0xff, (adler >> 16) & 0xff, (adler >> 8) & 0xff, adler & 0xff };
+        [result appendBytes:trailer length:sizeof(trailer)];
+    }
+
     return result;
 }
 
 - (NSData *)fc_inflatedDataWithHeader:(BOOL)headerPresent
 {
-	z_stream strm;
-	bzero(&strm, sizeof(z_stream));
-	strm.avail_in = (int) self.length;
-	strm.next_in = (unsigned char *) self.bytes;
-	if (Z_OK != inflateInit2(&strm, (headerPresent ? 47 : -MAX_WBITS))) return nil;
-
-	NSMutableData *result = [NSMutableData dataWithCapacity:(self.length * 2)];
-	unsigned char output[1024];
-	int retCode;
-	do {
-		strm.avail_out = 1024;
-		strm.next_out = output;
-		retCode = inflate(&strm, Z_NO_FLUSH);
-		if ((retCode != Z_OK) && (retCode != Z_STREAM_END)) {
-			inflateEnd(&strm);
-			return nil;
-		}
-
-		unsigned gotBack = 1024 - strm.avail_out;
-		if (gotBack > 0) [result appendBytes:output length:gotBack];
-	} while (retCode == Z_OK);
-    
-	inflateEnd(&strm);
-	return result;
+    FCZlibStream *stream = [[FCZlibStream alloc] initInflatingWithFormat:(headerPresent ? FCZlibFormatAutomatic : FCZlibFormatRaw)];
+    NSMutableData *result = [NSMutableData dataWithCapacity:(self.length * 4)];
+    void (^append)(const void *, NSUInteger) = ^(const void *bytes, NSUInteger length) { [result appendBytes:bytes length:length]; };
+    if (! stream || ! [stream processData:self outputHandler:append] || ! [stream finishWithOutputHandler:append]) return nil;
+    return result;
+}
+
+@end
+
+
+// Originally adapted from:
+// http://code.google.com/p/google-toolbox-for-mac/source/browse/trunk/Foundation/GTMNSData%2Bzlib.m?r=5
+
+@interface FCZlibStream () {
+    z_stream strm;
+    BOOL deflating;
+    BOOL initialized;
+    BOOL failed;
+    NSMutableData *outputBuffer;
+}
+@property (nonatomic) BOOL finished;
+@end
+
+@implementation FCZlibStream
+
+static int FCZlibWindowBits(FCZlibFormat format)
+{
+    switch (format) {
+        case FCZlibFormatGzip:      return MAX_WBITS + 16;
+        case FCZlibFormatRaw:       return -MAX_WBITS;
+        case FCZlibFormatAutomatic: return MAX_WBITS + 32;
+        default:                    return MAX_WBITS;
+    }
+}
+
+- (instancetype)initDeflatingWithFormat:(FCZlibFormat)format level:(int)level
+{
+    if (format == FCZlibFormatAutomatic) return nil;
+    if ( (self = [super init]) ) {
+        deflating = YES;
+        _outputChunkSize = 65536;
+        if (Z_OK != deflateInit2(&strm, level, Z_DEFLATED, FCZlibWindowBits(format), 8, Z_DEFAULT_STRATEGY)) return nil;
+        initialized = YES;
+    }
+    return self;
+}
+
+- (instancetype)initInflatingWithFormat:(FCZlibFormat)format
+{
+    if ( (self = [super init]) ) {
+        _outputChunkSize = 65536;
+        if (Z_OK != inflateInit2(&strm, FCZlibWindowBits(format))) return nil;
+        initialized = YES;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    if (! initialized) return;
+    if (deflating) deflateEnd(&strm); else inflateEnd(&strm);
+}
+
+- (BOOL)runWithFlush:(int)flush outputHandler:(void (^)(const void *bytes, NSUInteger length))outputHandler
+{
+    if (! outputBuffer) outputBuffer = [NSMutableData dataWithLength:MAX((NSUInteger) 1024, _outputChunkSize)];
+    unsigned char *out = outputBuffer.mutableBytes;
+    uInt capacity = (uInt) MIN(outputBuffer.length, (NSUInteger) UINT_MAX);
+
+    int ret;
+    do {
+        strm.next_out = out;
+        strm.avail_out = capacity;
+        ret = deflating ? deflate(&strm, flush) : inflate(&strm, Z_NO_FLUSH);
+        if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR || ret == Z_NEED_DICT) {
+            failed = YES;
+            return NO;
+        }
+
+        NSUInteger produced = capacity - strm.avail_out;
+        if (produced && outputHandler) outputHandler(out, produced);
+        if (ret == Z_STREAM_END) { self.finished = YES; break; }
+        if (ret == Z_BUF_ERROR) break; // no progress possible until more input arrives
+    } while (strm.avail_out == 0 || (deflating && flush == Z_FINISH));
+
+    return YES;
+}
+
+- (BOOL)processBytes:(const void *)bytes length:(NSUInteger)length outputHandler:(void (^)(const void *bytes, NSUInteger length))outputHandler
+{
+    if (failed || (deflating && _finished)) return NO;
+
+    const unsigned char *input = bytes;
+    while (length && ! _finished) {
+        uInt chunk = (uInt) MIN(length, (NSUInteger) UINT_MAX);
+        strm.next_in = (unsigned char *) input;
+        strm.avail_in = chunk;
+        if (! [self runWithFlush:Z_NO_FLUSH outputHandler:outputHandler]) return NO;
+        NSUInteger consumed = chunk - strm.avail_in;
+        input += consumed;
+        length -= consumed;
+        if (! consumed) break;
+    }
+    // Inflating: bytes after the end of the compressed stream are ignored, as before
+    return YES;
+}
+
+- (BOOL)processData:(NSData *)data outputHandler:(void (^)(const void *bytes, NSUInteger length))outputHandler
+{
+    __block BOOL ok = YES;
+    [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+        if (! (ok = [self processBytes:bytes length:byteRange.length outputHandler:outputHandler])) *stop = YES;
+    }];
+    return ok;
+}
+
+- (BOOL)processInputStream:(NSInputStream *)inputStream outputHandler:(void (^)(const void *bytes, NSUInteger length))outputHandler
+{
+    uint8_t buffer[16384];
+    BOOL openedHere = inputStream.streamStatus == NSStreamStatusNotOpen;
+    if (openedHere) [inputStream open];
+
+    BOOL ok = YES;
+    NSInteger bytesRead;
+    while (ok && (bytesRead = [inputStream read:buffer maxLength:sizeof(buffer)]) > 0) {
+        ok = [self processBytes:buffer length:(NSUInteger) bytesRead outputHandler:outputHandler];
+    }
+    if (bytesRead < 0) ok = NO;
+
+    if (openedHere) [inputStream close];
+    return ok && [self finishWithOutputHandler:outputHandler];
+}
+
+- (BOOL)finishWithOutputHandler:(void (^)(const void *bytes, NSUInteger length))outputHandler
+{
+    if (failed) return NO;
+    if (! deflating) return _finished;
+    if (_finished) return YES;
+
+    strm.next_in = Z_NULL;
+    strm.avail_in = 0;
+    return [self runWithFlush:Z_FINISH outputHandler:outputHandler] && _finished;
 }
 
 @end
@@ -16,6 +16,40 @@
 @end
 
 
+typedef NS_ENUM(NSInteger, FCExecutorPriority) {
+    FCExecutorPriorityHigh = 0, // QOS_CLASS_USER_INITIATED
+    FCExecutorPriorityDefault,  // QOS_CLASS_DEFAULT
+    FCExecutorPriorityLow,      // QOS_CLASS_UTILITY
+};
+
+// Cancellation token and completion barrier for any number of FCExecutor blocks.
+@interface FCExecutorGroup : NSObject
+
+- (void)cancel; // blocks that haven't started yet are skipped
+@property (nonatomic, readonly, getter=isCancelled) BOOL cancelled;
+
+// Called from inside an FCExecutor block, runs other queued blocks while waiting instead of blocking a worker
+- (void)waitUntilFinished;
+
+@end
+
+// A lightweight alternative to NSOperationQueue + FCBlockOperation for very many tiny blocks, without
+//  per-operation objects or KVO: work-stealing workers with priority lanes and pooled job nodes (see FCWorkQueue.h).
+// Blocks may run concurrently and in any order across workers; within a lane, each worker runs them FIFO.
+@interface FCExecutor : NSObject
+
++ (instancetype)sharedExecutor; // one worker per active core
+- (instancetype)initWithWorkerCount:(NSUInteger)workerCount; // 0 = one per active core
+
+- (void)addBlock:(void (^)(void))block;
+- (void)addBlock:(void (^)(void))block priority:(FCExecutorPriority)priority group:(FCExecutorGroup *)group; // group may be nil
+
+// Equivalent to -[NSOperationQueue fc_addOperationWithBlock:waitUntilFinished:]
+- (void)addBlock:(void (^)(void))block waitUntilFinished:(BOOL)wait;
+
+@end
+
+
 @interface NSOperationQueue (FCUtilities)
 
 - (void)fc_addOperationWithBlock:(void (^)(void))block waitUntilFinished:(BOOL)wait;
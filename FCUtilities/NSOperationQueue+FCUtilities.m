@@ -7,6 +7,7 @@
 //
 
 #import "NSOperationQueue+FCUtilities.h"
+#import "FCWorkQueue.h"
 
 @interface FCBlockOperation ()
 @property (nonatomic, copy) void (^block)(void);
@@ -24,6 +25,98 @@
 @end
 
 
+@interface FCExecutorGroup () {
+@public
+    FCWorkGroup *group;
+}
+@end
+
+@implementation FCExecutorGroup
+
+- (instancetype)init
+{
+    if ( (self = [super init]) ) {
+        group = FCWorkGroupCreate();
+    }
+    return self;
+}
+
+- (void)dealloc { FCWorkGroupRelease(group); } // queued blocks hold their own references
+
+- (void)cancel { FCWorkGroupCancel(group); }
+- (BOOL)isCancelled { return FCWorkGroupIsCancelled(group); }
+- (void)waitUntilFinished { FCWorkGroupWait(group); }
+
+@end
+
+
+static void FCExecutorRunBlock(void *context, bool cancelled)
+{
+    @autoreleasepool {
+        void (^block)(void) = (__bridge_transfer void (^)(void)) context;
+        if (! cancelled) block();
+    }
+}
+
+@interface FCExecutor () {
+    FCWorkQueue *queue;
+}
+@end
+
+@implementation FCExecutor
+
++ (instancetype)sharedExecutor
+{
+    static FCExecutor *executor;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{ executor = [[self alloc] initWithWorkerCount:0]; });
+    return executor;
+}
+
+- (instancetype)init { return [self initWithWorkerCount:0]; }
+
+- (instancetype)initWithWorkerCount:(NSUInteger)workerCount
+{
+    if ( (self = [super init]) ) {
+        queue = FCWorkQueueCreate((unsigned) (workerCount ?: NSProcessInfo.processInfo.activeProcessorCount));
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    // Destroying joins the workers, so it can't happen on one of them
+    FCWorkQueue *q = queue;
+    if (FCWorkQueueIsCurrentThreadWorker(q)) {
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{ FCWorkQueueDestroy(q); });
+    } else {
+        FCWorkQueueDestroy(q);
+    }
+}
+
+- (void)addBlock:(void (^)(void))block { [self addBlock:block priority:FCExecutorPriorityDefault group:nil]; }
+
+- (void)addBlock:(void (^)(void))block priority:(FCExecutorPriority)priority group:(FCExecutorGroup *)group
+{
+    if (! block) return;
+    FCWorkQueueSubmit(queue, (FCWorkPriority) priority, group ? group->group : NULL, FCExecutorRunBlock, (__bridge_retained void *) [block copy]);
+}
+
+- (void)addBlock:(void (^)(void))block waitUntilFinished:(BOOL)wait
+{
+    if (! wait) {
+        [self addBlock:block];
+        return;
+    }
+
+    FCExecutorGroup *group = [FCExecutorGroup new];
+    [self addBlock:block priority:FCExecutorPriorityDefault group:group];
+    [group waitUntilFinished];
+}
+
+@end
+
+
 @implementation NSOperationQueue (FCUtilities)
 
 - (void)fc_addOperationWithBlock:(void (^)(void))block waitUntilFinished:(BOOL)wait
@@ -5,6 +5,17 @@
 
 #import <Foundation/Foundation.h>
 
+// One stage for -fc_stringByApplyingReplacementStages:. The block returns the replacement for each match (nil = remove it).
+// Read capture groups lazily with [source substringWithRange:[match rangeAtIndex:n]] only as needed.
+@interface FCRegexReplacementStage : NSObject
+
++ (instancetype)stageWithRegex:(NSRegularExpression *)regex replacementBlock:(NSString *(^)(NSTextCheckingResult *match, NSString *source))replacementBlock;
+@property (nonatomic, readonly) NSRegularExpression *regex;
+@property (nonatomic, readonly) NSString *(^replacementBlock)(NSTextCheckingResult *match, NSString *source);
+
+@end
+
+
 @interface NSString (FCUtilities)
 
 - (NSString *)fc_URLEncodedString;
@@ -23,9 +34,17 @@
 - (NSString *)fc_HTMLEncodedString;
 - (NSString *)fc_hexString;
 - (NSString *)fc_URLSafeBase64EncodedString;
+- (NSData *)fc_dataFromHexString;
+- (NSData *)fc_dataFromURLSafeBase64String;
 
 - (NSString *)fc_stringWithNormalizedWhitespace;
 
+// captureGroups[0] is the whole match; groups that didn't participate are @"". Substrings are only created when accessed.
 - (NSString *)fc_stringByReplacingMatches:(NSRegularExpression *)regex usingBlock:(NSString *(^)(NSTextCheckingResult *match, NSArray<NSString *> *captureGroups))replacementBlock;
 
+// Runs several regex stages over the original string in one forward pass, building the output once.
+// All stages match against the original text (not each other's output). Where matches overlap, the one that starts
+//  first wins, with ties going to the earlier stage, and the other match is skipped.
+- (NSString *)fc_stringByApplyingReplacementStages:(NSArray<FCRegexReplacementStage *> *)stages;
+
 @end
@@ -4,15 +4,105 @@
 //
 
 #import "NSString+FCUtilities.h"
+#import "NSData+FCUtilities.h"
 #import <CommonCrypto/CommonDigest.h>
 
+// Single-pass transforms over the UTF-16 buffer: one output allocation, static lookup tables, ASCII checked without method calls.
+
+// Borrows the string's internal UTF-16 storage when available, otherwise copies it into *outBuffer (caller frees).
+static const unichar *FCStringCharacters(NSString *str, NSUInteger length, unichar **outBuffer)
+{
+    *outBuffer = NULL;
+    const unichar *chars = CFStringGetCharactersPtr((__bridge CFStringRef) str);
+    if (chars) return chars;
+    *outBuffer = malloc(MAX((NSUInteger) 1, length) * sizeof(unichar));
+    [str getCharacters:*outBuffer range:NSMakeRange(0, length)];
+    return *outBuffer;
+}
+
+static inline BOOL FCIsWhitespaceOrNewline(unichar c, NSCharacterSet *nonASCIISet)
+{
+    if (c < 0x80) return c == ' ' || (c >= 0x09 && c <= 0x0D);
+    return [nonASCIISet characterIsMember:c];
+}
+
+// Capture groups for fc_stringByReplacingMatches:usingBlock:, creating each substring only when it's accessed
+@interface FCLazyCaptureGroupArray : NSArray {
+    NSString *source;
+    NSTextCheckingResult *match;
+}
+- (instancetype)initWithSource:(NSString *)source match:(NSTextCheckingResult *)match;
+@end
+
+@implementation FCLazyCaptureGroupArray
+
+- (instancetype)initWithSource:(NSString *)sourceString match:(NSTextCheckingResult *)result
+{
+    if ( (self = [super init]) ) {
+        source = sourceString;
+        match = result;
+    }
+    return self;
+}
+
+- (NSUInteger)count { return match.numberOfRanges; }
+
+- (id)objectAtIndex:(NSUInteger)idx
+{
+    if (idx >= match.numberOfRanges) [NSException raise:NSRangeException format:@"index %lu beyond bounds [0 .. %lu]", (unsigned long) idx, (unsigned long) match.numberOfRanges];
+    NSRange captureRange = [match rangeAtIndex:idx];
+    return captureRange.location == NSNotFound ? @"" : [source substringWithRange:captureRange];
+}
+
+@end
+
+
 @implementation NSString (FCUtilities)
 
 - (NSString *)fc_URLEncodedString
 {
-    NSMutableCharacterSet *allowedCharacters = [[NSCharacterSet URLQueryAllowedCharacterSet] mutableCopy];
-    [allowedCharacters removeCharactersInString:@"?=&+:;@/$!'()\",*"];
-    return [self stringByAddingPercentEncodingWithAllowedCharacters:allowedCharacters];
+    // Equivalent to URLQueryAllowedCharacterSet minus "?=&+:;@/$!'()\",*", which leaves only the RFC 3986 unreserved characters
+    static BOOL allowed[128];
+    static NSCharacterSet *allowedCharacters;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSMutableCharacterSet *set = [[NSCharacterSet URLQueryAllowedCharacterSet] mutableCopy];
+        [set removeCharactersInString:@"?=&+:;@/$!'()\",*"];
+        allowedCharacters = [set copy];
+        for (unichar c = 0; c < 128; c++) allowed[c] = [allowedCharacters characterIsMember:c];
+    });
+
+    // Transcode to UTF-8 through a stack buffer, so there's no intermediate copy of the string
+    static const char hexDigits[16] = "0123456789ABCDEF";
+    NSUInteger length = self.length;
+    size_t capacity = length * 3 + 16, o = 0;
+    char *out = malloc(capacity);
+    unsigned char utf8[1024];
+    NSRange remaining = NSMakeRange(0, length);
+    while (remaining.length) {
+        NSUInteger used = 0;
+        if (! [self getBytes:utf8 maxLength:sizeof(utf8) usedLength:&used encoding:NSUTF8StringEncoding options:0 range:remaining remainingRange:&remaining] || ! used) {
+            // Unpaired surrogates etc.: defer to Foundation's behavior
+            free(out);
+            return [self stringByAddingPercentEncodingWithAllowedCharacters:allowedCharacters];
+        }
+
+        if (o + used * 3 > capacity) {
+            capacity = MAX(capacity * 2, o + used * 3);
+            out = realloc(out, capacity);
+        }
+        for (NSUInteger i = 0; i < used; i++) {
+            unsigned char c = utf8[i];
+            if (c < 128 && allowed[c]) {
+                out[o++] = (char) c;
+            } else {
+                out[o++] = '%';
+                out[o++] = hexDigits[c >> 4];
+                out[o++] = hexDigits[c & 0x0f];
+            }
+        }
+    }
+    return [[NSString alloc] initWithBytesNoCopy:out length:o encoding:NSASCIIStringEncoding freeWhenDone:YES];
 }
 
 - (NSString *)fc_HTMLEncodedString
@@ -23,27 +113,68 @@
 	CFRelease(cs);
 	return str;
 #else
-    NSString *h = [self stringByReplacingOccurrencesOfString:@"&" withString:@"&amp;"];
-    h = [h stringByReplacingOccurrencesOfString:@"\"" withString:@"&quot;"];
-    h = [h stringByReplacingOccurrencesOfString:@"<" withString:@"&lt;"];
-    h = [h stringByReplacingOccurrencesOfString:@">" withString:@"&gt;"];
-    return h;
+    NSUInteger length = self.length;
+    unichar *copiedChars;
+    const unichar *chars = FCStringCharacters(self, length, &copiedChars);
+
+    // First pass only measures, so the output is allocated once at its exact size
+    NSUInteger outLength = length;
+    for (NSUInteger i = 0; i < length; i++) {
+        switch (chars[i]) {
+            case '&': outLength += 4; break; // &amp;
+            case '"': outLength += 5; break; // &quot;
+            case '<': case '>': outLength += 3; break; // &lt; &gt;
+        }
+    }
+    if (outLength == length) {
+        free(copiedChars);
+        return [self copy];
+    }
+
+    unichar *out = malloc(outLength * sizeof(unichar));
+    NSUInteger o = 0;
+    for (NSUInteger i = 0; i < length; i++) {
+        unichar c = chars[i];
+        const char *entity = NULL;
+        switch (c) {
+            case '&': entity = "&amp;"; break;
+            case '"': entity = "&quot;"; break;
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+        }
+        if (entity) while (*entity) out[o++] = (unichar) *entity++;
+        else out[o++] = c;
+    }
+    free(copiedChars);
+    return [[NSString alloc] initWithCharactersNoCopy:out length:outLength freeWhenDone:YES];
 #endif
 }
 
 - (NSString *)fc_stringWithNormalizedWhitespace
 {
+    // Collapses each run of whitespace/newlines to one space and trims both ends, as the former NSScanner version did
     NSCharacterSet *whitespaceSet = NSCharacterSet.whitespaceAndNewlineCharacterSet;
-    NSMutableString *outputString = [NSMutableString string];
-    NSScanner *scanner = [[NSScanner alloc] initWithString:self];
-    while (! scanner.isAtEnd) {
-        NSString *segment = NULL;
-        [scanner scanUpToCharactersFromSet:whitespaceSet intoString:&segment];
-        [scanner scanCharactersFromSet:whitespaceSet intoString:NULL];
-        if (segment) { [outputString appendString:segment]; [outputString appendString:@" "]; }
+    NSUInteger length = self.length;
+    if (! length) return @"";
+
+    unichar *copiedChars;
+    const unichar *chars = FCStringCharacters(self, length, &copiedChars);
+    unichar *out = malloc(length * sizeof(unichar));
+    NSUInteger o = 0;
+    BOOL pendingSpace = NO;
+    for (NSUInteger i = 0; i < length; i++) {
+        unichar c = chars[i];
+        if (FCIsWhitespaceOrNewline(c, whitespaceSet)) {
+            pendingSpace = o > 0;
+        } else {
+            if (pendingSpace) { out[o++] = ' '; pendingSpace = NO; }
+            out[o++] = c;
+        }
     }
-    
-    return [outputString stringByTrimmingCharactersInSet:whitespaceSet];
+    free(copiedChars);
+
+    if (! o) { free(out); return @""; }
+    return [[NSString alloc] initWithCharactersNoCopy:out length:o freeWhenDone:YES];
 }
 
 - (NSString *)fc_summarizeToLength:(int)length withEllipsis:(BOOL)ellipsis
@@ -107,42 +238,102 @@
 
 - (NSString *)fc_hexString
 {
-    const char *utf8 = [self UTF8String];
-    NSMutableString *hex = [NSMutableString string];
-    while ( *utf8 ) [hex appendFormat:@"%02X" , *utf8++ & 0x00FF];
-    return [NSString stringWithFormat:@"%@", hex];
+    // Uppercase hex of the UTF-8 bytes, up to the first NUL
+    const char *utf8 = self.UTF8String;
+    return [[NSData dataWithBytesNoCopy:(void *) utf8 length:strlen(utf8) freeWhenDone:NO] fc_uppercaseHexString];
 }
 
 - (NSString *)fc_URLSafeBase64EncodedString
 {
-    NSString *str = [[self dataUsingEncoding:NSUTF8StringEncoding] base64EncodedStringWithOptions:0];
-    str = [str stringByReplacingOccurrencesOfString:@"+" withString:@"-"];
-    str = [str stringByReplacingOccurrencesOfString:@"/" withString:@"_"];
-    str = [str stringByReplacingOccurrencesOfString:@"=" withString:@""];
-    return str;
+    return [[self dataUsingEncoding:NSUTF8StringEncoding] fc_URLSafeBase64EncodedString];
 }
 
+- (NSData *)fc_dataFromHexString { return [NSData fc_dataFromHexString:self]; }
+
+- (NSData *)fc_dataFromURLSafeBase64String { return [NSData fc_dataFromURLSafeBase64String:self]; }
+
 - (NSString *)fc_stringByReplacingMatches:(NSRegularExpression *)regex usingBlock:(NSString *(^)(NSTextCheckingResult *match, NSArray<NSString *> *captureGroups))replacementBlock
 {
     if (! replacementBlock) return self;
-    
-    NSUInteger numCaptureGroups = regex.numberOfCaptureGroups;
-    NSMutableString *mutableString = [self mutableCopy];
-    NSInteger offset = 0;
-    for (NSTextCheckingResult *result in [regex matchesInString:self options:0 range:NSMakeRange(0, self.length)]) {
-        NSMutableArray<NSString *> *captureGroups = [NSMutableArray arrayWithCapacity:numCaptureGroups + 1];
-        for (NSUInteger g = 0; g <= numCaptureGroups; g++) {
-            NSRange captureRange = [result rangeAtIndex:g];
-            captureGroups[g] = captureRange.location == NSNotFound ? @"" : [self substringWithRange:captureRange];
-        }
-        
+
+    // Built forward in one pass: unchanged spans are appended straight from the source buffer, so there's no
+    //  tail-shifting per match and no substring allocation unless the block reads a capture group.
+    NSUInteger length = self.length;
+    unichar *copiedChars;
+    const unichar *chars = FCStringCharacters(self, length, &copiedChars);
+    NSMutableString *output = [NSMutableString stringWithCapacity:length];
+    __block NSUInteger cursor = 0;
+    [regex enumerateMatchesInString:self options:0 range:NSMakeRange(0, length) usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
         NSRange resultRange = result.range;
-        resultRange.location += offset;
-        NSString *replacement = replacementBlock(result, captureGroups);
-        [mutableString replaceCharactersInRange:resultRange withString:replacement];
-        offset += (replacement.length - resultRange.length);
+        CFStringAppendCharacters((__bridge CFMutableStringRef) output, chars + cursor, (CFIndex) (resultRange.location - cursor));
+        NSString *replacement = replacementBlock(result, [[FCLazyCaptureGroupArray alloc] initWithSource:self match:result]);
+        if (replacement) [output appendString:replacement];
+        cursor = NSMaxRange(resultRange);
+    }];
+    CFStringAppendCharacters((__bridge CFMutableStringRef) output, chars + cursor, (CFIndex) (length - cursor));
+    free(copiedChars);
+    return output;
+}
+
+- (NSString *)fc_stringByApplyingReplacementStages:(NSArray<FCRegexReplacementStage *> *)stages
+{
+    NSUInteger stageCount = stages.count, length = self.length;
+    if (! stageCount) return self;
+
+    unichar *copiedChars;
+    const unichar *chars = FCStringCharacters(self, length, &copiedChars);
+    NSMutableString *output = [NSMutableString stringWithCapacity:length];
+
+    // Transparent, non-anchoring bounds so lookbehinds and ^/$ behave as if each stage were matching the whole string
+    NSMatchingOptions options = NSMatchingWithTransparentBounds | NSMatchingWithoutAnchoringBounds;
+    NSMutableArray *nextMatches = [NSMutableArray arrayWithCapacity:stageCount];
+    for (FCRegexReplacementStage *stage in stages) {
+        [nextMatches addObject:[stage.regex firstMatchInString:self options:options range:NSMakeRange(0, length)] ?: NSNull.null];
     }
-    return mutableString;
+
+    NSUInteger cursor = 0, searchStart = 0;
+    while (YES) {
+        // Refresh stages whose pending match was overlapped or consumed, then take the earliest match
+        NSInteger winner = -1;
+        NSRange winningRange = NSMakeRange(NSNotFound, 0);
+        for (NSUInteger i = 0; i < stageCount; i++) {
+            NSTextCheckingResult *match = nextMatches[i];
+            if ((id) match == NSNull.null) continue;
+            if (match.range.location < searchStart) {
+                match = searchStart <= length ? [stages[i].regex firstMatchInString:self options:options range:NSMakeRange(searchStart, length - searchStart)] : nil;
+                nextMatches[i] = match ?: NSNull.null;
+                if (! match) continue;
+            }
+            if (match.range.location < winningRange.location) {
+                winner = (NSInteger) i;
+                winningRange = match.range;
+            }
+        }
+        if (winner < 0) break;
+
+        CFStringAppendCharacters((__bridge CFMutableStringRef) output, chars + cursor, (CFIndex) (winningRange.location - cursor));
+        NSString *replacement = stages[(NSUInteger) winner].replacementBlock(nextMatches[(NSUInteger) winner], self);
+        if (replacement) [output appendString:replacement];
+        cursor = NSMaxRange(winningRange);
+        searchStart = winningRange.length ? cursor : cursor + 1; // step past empty matches
+    }
+
+    CFStringAppendCharacters((__bridge CFMutableStringRef) output, chars + cursor, (CFIndex) (length - cursor));
+    free(copiedChars);
+    return output;
+}
+
+@end
+
+
+@implementation FCRegexReplacementStage
+
++ (instancetype)stageWithRegex:(NSRegularExpression *)regex replacementBlock:(NSString *(^)(NSTextCheckingResult *match, NSString *source))replacementBlock
+{
+    FCRegexReplacementStage *stage = [self new];
+    stage->_regex = regex;
+    stage->_replacementBlock = [replacementBlock copy];
+    return stage;
 }
 
 @end
@@ -8,8 +8,48 @@
 
 #import <Foundation/Foundation.h>
 
+// A query string parsed in one pass over its UTF-8 bytes. Only item ranges are stored; keys and values
+//  are percent-decoded when accessed. Items keep their order, repeated keys are all kept, and a value
+//  runs to the next '&', so it may contain '='. Items with empty keys are skipped.
+// Like -[NSString stringByRemovingPercentEncoding], '+' is not treated as a space. Malformed escapes are returned as-is.
+@interface FCURLQuery : NSObject
+
++ (instancetype)queryWithURL:(NSURL *)url;
++ (instancetype)queryWithPercentEncodedString:(NSString *)query; // without the leading '?'
+
+@property (nonatomic, readonly) NSUInteger count;
+- (NSString *)keyAtIndex:(NSUInteger)index;
+- (NSString *)valueAtIndex:(NSUInteger)index; // @"" if the item has no '='
+
+// Raw, still-encoded byte ranges within UTF8Bytes, for callers that can work without decoding
+@property (nonatomic, readonly) const char *UTF8Bytes;
+- (NSRange)keyRangeAtIndex:(NSUInteger)index;
+- (NSRange)valueRangeAtIndex:(NSUInteger)index;
+
+// Keys are matched against the encoded bytes directly, so only the returned values are decoded.
+- (NSString *)firstValueForKey:(NSString *)key;
+- (NSArray<NSString *> *)valuesForKey:(NSString *)key;
+
+- (NSDictionary<NSString *, NSString *> *)dictionary; // for repeated keys, the last value wins
+
+@end
+
+// Builds a percent-encoded query into a single growing buffer. Everything but RFC 3986 unreserved characters is
+//  escaped in keys and values, the same as -[NSString fc_URLEncodedString].
+@interface FCURLQueryBuilder : NSObject
+
+- (void)addValue:(NSString *)value forKey:(NSString *)key; // nil value adds the bare key
+- (void)addEntriesFromDictionary:(NSDictionary<NSString *, NSString *> *)dictionary; // in sorted key order, for stable output
+
+@property (nonatomic, readonly) NSString *queryString; // without the leading '?'
+- (NSURL *)URLByReplacingQueryOfURL:(NSURL *)url;
+
+@end
+
+
 @interface NSURL (FCUtilities)
 
-- (NSDictionary *)fc_queryComponents;
+- (NSDictionary *)fc_queryComponents; // see FCURLQuery; for repeated keys, the last value wins
+- (FCURLQuery *)fc_query;
 
 @end
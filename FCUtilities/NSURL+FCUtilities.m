@@ -8,26 +8,322 @@
 
 #import "NSURL+FCUtilities.h"
 
-@implementation NSURL (FCUtilities)
+typedef struct {
+    uint32_t keyStart, keyLength;
+    uint32_t valueStart, valueLength;
+} FCURLQueryItemRange;
+
+static inline int FCURLHexValue(uint8_t c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static inline BOOL FCURLIsUnreserved(uint8_t c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+// One pass: each '&'-separated item splits at its first '='. Returns the item count; items must have room for every '&' + 1.
+static size_t FCURLQueryScan(const char *bytes, size_t length, FCURLQueryItemRange *items)
+{
+    size_t count = 0, start = 0;
+    while (start < length) {
+        const char *amp = memchr(bytes + start, '&', length - start);
+        size_t end = amp ? (size_t) (amp - bytes) : length;
+        const char *eq = memchr(bytes + start, '=', end - start);
+        size_t keyEnd = eq ? (size_t) (eq - bytes) : end;
+
+        if (keyEnd > start) {
+            FCURLQueryItemRange *item = &items[count++];
+            item->keyStart = (uint32_t) start;
+            item->keyLength = (uint32_t) (keyEnd - start);
+            item->valueStart = (uint32_t) (eq ? keyEnd + 1 : end);
+            item->valueLength = (uint32_t) (eq ? end - keyEnd - 1 : 0);
+        }
+        start = end + 1;
+    }
+    return count;
+}
+
+// Decodes into out, which must hold length bytes. Returns the decoded length, or -1 for a malformed escape.
+static ssize_t FCURLPercentDecode(const char *in, size_t length, char *out)
+{
+    size_t o = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (in[i] != '%') { out[o++] = in[i]; continue; }
+        int hi, lo;
+        if (i + 2 >= length || (hi = FCURLHexValue(in[i + 1])) < 0 || (lo = FCURLHexValue(in[i + 2])) < 0) return -1;
+        out[o++] = (char) ((hi << 4) | lo);
+        i += 2;
+    }
+    return (ssize_t) o;
+}
+
+static NSString *FCURLDecodedString(const char *bytes, size_t length)
+{
+    NSString *decoded = nil;
+    if (! memchr(bytes, '%', length)) {
+        decoded = [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+    } else {
+        char stackBuffer[256];
+        char *buffer = length <= sizeof(stackBuffer) ? stackBuffer : malloc(length);
+        ssize_t decodedLength = FCURLPercentDecode(bytes, length, buffer);
+        if (decodedLength >= 0) decoded = [[NSString alloc] initWithBytes:buffer length:decodedLength encoding:NSUTF8StringEncoding];
+        if (buffer != stackBuffer) free(buffer);
+    }
+
+    // Malformed escapes or invalid UTF-8: return the raw text rather than nil
+    return decoded ?: [[NSString alloc] initWithBytes:bytes length:length encoding:NSISOLatin1StringEncoding];
+}
+
+// Compares encoded bytes against plain UTF-8 without decoding into a buffer
+static BOOL FCURLEncodedBytesEqual(const char *encoded, size_t length, const char *plain, size_t plainLength)
+{
+    size_t i = 0, j = 0;
+    while (i < length) {
+        uint8_t c = encoded[i];
+        if (c == '%') {
+            int hi, lo;
+            if (i + 2 >= length || (hi = FCURLHexValue(encoded[i + 1])) < 0 || (lo = FCURLHexValue(encoded[i + 2])) < 0) {
+                // Malformed escape, so the whole string decodes as itself
+                return length == plainLength && 0 == memcmp(encoded, plain, length);
+            }
+            c = (uint8_t) ((hi << 4) | lo);
+            i += 3;
+        } else {
+            i++;
+        }
+        if (j >= plainLength || (uint8_t) plain[j++] != c) return NO;
+    }
+    return j == plainLength;
+}
+
+// Borrows the string's UTF-8 bytes when CoreFoundation has them, else copies into buffer, else an autoreleased copy.
+//  NULL for a nil string, which callers treat as not found.
+static const char *FCURLUTF8Bytes(NSString *string, char *buffer, size_t bufferSize, size_t *outLength)
+{
+    *outLength = 0;
+    if (! string) return NULL;
+    const char *bytes = CFStringGetCStringPtr((__bridge CFStringRef) string, kCFStringEncodingUTF8);
+    if (! bytes && [string getCString:buffer maxLength:bufferSize encoding:NSUTF8StringEncoding]) bytes = buffer;
+    if (! bytes) bytes = string.UTF8String;
+    *outLength = bytes ? strlen(bytes) : 0;
+    return bytes;
+}
+
+@interface FCURLQuery () {
+    NSString *backingString; // owns bytes when they're borrowed from it
+    char *ownedBytes;
+    const char *bytes;
+    FCURLQueryItemRange *items;
+    NSUInteger count;
+}
+@end
+
+@implementation FCURLQuery
+
+- (instancetype)initWithBytes:(const char *)b length:(size_t)length owned:(BOOL)owned backingString:(NSString *)string
+{
+    if ( (self = [super init]) ) {
+        backingString = string;
+        bytes = b ?: "";
+        if (owned) ownedBytes = (char *) b;
 
-- (NSDictionary *)fc_queryComponents
-{
-    NSString *query = self.query;
-    if (! query || ! query.length) return @{ };
-    
-    NSMutableDictionary *decoded = [NSMutableDictionary dictionary];
-    for (NSString *pair in [query componentsSeparatedByString:@"&"]) {
-        NSArray<NSString *> *parts = [pair componentsSeparatedByString:@"="];
-        if (! parts.count || ! [parts.firstObject length]) continue;
-        
-        if (parts.count == 1) {
-            decoded[parts[0].stringByRemovingPercentEncoding] = @"";
-        } else if (parts.count == 2) {
-            decoded[parts[0].stringByRemovingPercentEncoding] = parts[1].stringByRemovingPercentEncoding;
+        if (length) {
+            size_t capacity = 1;
+            for (const char *p = bytes; (p = memchr(p, '&', length - (p - bytes))); p++) capacity++;
+            items = malloc(capacity * sizeof(FCURLQueryItemRange));
+            count = FCURLQueryScan(bytes, length, items);
         }
     }
+    return self;
+}
+
+- (void)dealloc
+{
+    free(ownedBytes);
+    free(items);
+}
+
++ (instancetype)queryWithURL:(NSURL *)url
+{
+    NSURL *absoluteURL = url.absoluteURL; // keeps a temporary for relative URLs alive while its bytes are read
+    CFURLRef cfURL = (__bridge CFURLRef) absoluteURL;
+    CFRange range = cfURL ? CFURLGetByteRangeForComponent(cfURL, kCFURLComponentQuery, NULL) : CFRangeMake(kCFNotFound, 0);
+    if (range.location == kCFNotFound || range.length <= 0) return [[self alloc] initWithBytes:NULL length:0 owned:NO backingString:nil];
 
-    return decoded;
+    // One copy of the URL's bytes, trimmed in place to the query
+    CFIndex urlLength = CFURLGetBytes(cfURL, NULL, 0);
+    char *b = malloc(urlLength + 1);
+    CFURLGetBytes(cfURL, (UInt8 *) b, urlLength);
+    memmove(b, b + range.location, range.length);
+    b[range.length] = '\0';
+    return [[self alloc] initWithBytes:b length:range.length owned:YES backingString:nil];
 }
 
++ (instancetype)queryWithPercentEncodedString:(NSString *)query
+{
+    if (! query) return [[self alloc] initWithBytes:NULL length:0 owned:NO backingString:nil];
+
+    // Borrowed bytes must outlive any change to the caller's string: copying is free unless it's mutable
+    query = [query copy];
+    NSUInteger length = [query lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    const char *b = CFStringGetCStringPtr((__bridge CFStringRef) query, kCFStringEncodingUTF8);
+    if (b) return [[self alloc] initWithBytes:b length:length owned:NO backingString:query];
+
+    char *owned = malloc(length + 1);
+    if (! [query getCString:owned maxLength:length + 1 encoding:NSUTF8StringEncoding]) { free(owned); owned = NULL; length = 0; }
+    return [[self alloc] initWithBytes:owned length:length owned:YES backingString:nil];
+}
+
+- (NSUInteger)count { return count; }
+- (const char *)UTF8Bytes { return bytes; }
+
+- (NSRange)keyRangeAtIndex:(NSUInteger)index
+{
+    if (index >= count) [[NSException exceptionWithName:NSRangeException reason:@"Query item index out of bounds" userInfo:nil] raise];
+    return NSMakeRange(items[index].keyStart, items[index].keyLength);
+}
+
+- (NSRange)valueRangeAtIndex:(NSUInteger)index
+{
+    if (index >= count) [[NSException exceptionWithName:NSRangeException reason:@"Query item index out of bounds" userInfo:nil] raise];
+    return NSMakeRange(items[index].valueStart, items[index].valueLength);
+}
+
+- (NSString *)keyAtIndex:(NSUInteger)index
+{
+    NSRange r = [self keyRangeAtIndex:index];
+    return FCURLDecodedString(bytes + r.location, r.length);
+}
+
+- (NSString *)valueAtIndex:(NSUInteger)index
+{
+    NSRange r = [self valueRangeAtIndex:index];
+    return FCURLDecodedString(bytes + r.location, r.length);
+}
+
+- (void)enumerateValuesForKey:(NSString *)key usingBlock:(void (^)(NSUInteger index, BOOL *stop))block
+{
+    char buffer[256];
+    size_t keyLength;
+    const char *keyBytes = FCURLUTF8Bytes(key, buffer, sizeof(buffer), &keyLength);
+    if (! keyBytes) return;
+
+    BOOL stop = NO;
+    for (NSUInteger i = 0; i < count && ! stop; i++) {
+        if (FCURLEncodedBytesEqual(bytes + items[i].keyStart, items[i].keyLength, keyBytes, keyLength)) block(i, &stop);
+    }
+}
+
+- (NSString *)firstValueForKey:(NSString *)key
+{
+    __block NSString *value = nil;
+    [self enumerateValuesForKey:key usingBlock:^(NSUInteger index, BOOL *stop) {
+        value = [self valueAtIndex:index];
+        *stop = YES;
+    }];
+    return value;
+}
+
+- (NSArray<NSString *> *)valuesForKey:(NSString *)key
+{
+    NSMutableArray *values = [NSMutableArray array];
+    [self enumerateValuesForKey:key usingBlock:^(NSUInteger index, BOOL *stop) {
+        [values addObject:[self valueAtIndex:index]];
+    }];
+    return values;
+}
+
+- (NSDictionary<NSString *, NSString *> *)dictionary
+{
+    NSMutableDictionary *dictionary = [NSMutableDictionary dictionaryWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) dictionary[[self keyAtIndex:i]] = [self valueAtIndex:i];
+    return dictionary;
+}
+
+@end
+
+
+@interface FCURLQueryBuilder () {
+    char *buffer;
+    size_t length;
+    size_t capacity;
+}
+@end
+
+@implementation FCURLQueryBuilder
+
+- (void)dealloc { free(buffer); }
+
+- (void)reserve:(size_t)additional
+{
+    if (length + additional <= capacity) return;
+    capacity = MAX(capacity * 2, length + additional);
+    buffer = realloc(buffer, capacity);
+}
+
+- (void)appendEncodedString:(NSString *)string
+{
+    char stackBuffer[256];
+    size_t utf8Length;
+    const char *utf8 = FCURLUTF8Bytes(string, stackBuffer, sizeof(stackBuffer), &utf8Length);
+    if (! utf8) return;
+
+    static const char hexDigits[16] = "0123456789ABCDEF";
+    [self reserve:utf8Length * 3];
+    for (size_t i = 0; i < utf8Length; i++) {
+        uint8_t c = utf8[i];
+        if (FCURLIsUnreserved(c)) {
+            buffer[length++] = (char) c;
+        } else {
+            buffer[length++] = '%';
+            buffer[length++] = hexDigits[c >> 4];
+            buffer[length++] = hexDigits[c & 0x0f];
+        }
+    }
+}
+
+- (void)addValue:(NSString *)value forKey:(NSString *)key
+{
+    if (! key.length) return;
+    [self reserve:2];
+    if (length) buffer[length++] = '&';
+    [self appendEncodedString:key];
+    if (value) {
+        [self reserve:1];
+        buffer[length++] = '=';
+        [self appendEncodedString:value];
+    }
+}
+
+- (void)addEntriesFromDictionary:(NSDictionary<NSString *, NSString *> *)dictionary
+{
+    for (NSString *key in [dictionary.allKeys sortedArrayUsingSelector:@selector(compare:)]) [self addValue:dictionary[key] forKey:key];
+}
+
+- (NSString *)queryString
+{
+    return length ? [[NSString alloc] initWithBytes:buffer length:length encoding:NSASCIIStringEncoding] : @"";
+}
+
+- (NSURL *)URLByReplacingQueryOfURL:(NSURL *)url
+{
+    NSURLComponents *components = [NSURLComponents componentsWithURL:url resolvingAgainstBaseURL:YES];
+    components.percentEncodedQuery = length ? self.queryString : nil;
+    return components.URL;
+}
+
+@end
+
+
+@implementation NSURL (FCUtilities)
+
+- (FCURLQuery *)fc_query { return [FCURLQuery queryWithURL:self]; }
+
+- (NSDictionary *)fc_queryComponents { return self.fc_query.dictionary; }
+
 @end
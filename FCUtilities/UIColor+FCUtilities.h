@@ -28,6 +28,12 @@
 - (CGFloat)fc_apcaContrastAgainstBackgroundColor:(UIColor * _Nonnull)backgroundColor;
 - (UIColor * _Nonnull)fc_colorWithMinimumAPCAContrast:(CGFloat)minContrast againstBackgroundColor:(UIColor * _Nonnull)backgroundColor changed:(out BOOL * _Nullable)outColorDidChange;
 
+// Adjusts a whole palette in one pass (see FCColorMath.h). Colors that need no change are returned as-is.
++ (NSArray<UIColor *> * _Nonnull)fc_colors:(NSArray<UIColor *> * _Nonnull)colors withMinimumAPCAContrast:(CGFloat)minContrast againstBackgroundColor:(UIColor * _Nonnull)backgroundColor;
+
+// Blends, contrast adjustments and fc_colorFromIdentifier:theme: results are cached by their inputs' RGBA (and theme),
+//  so the returned instances may be shared between callers.
+
 #ifdef SUPPORT_DUMPING_COLOR_VALUES
 #if TARGET_OS_IOS
 + (void)fc_dumpSystemColorValues;
@@ -40,6 +46,8 @@
 //  but hard-coded so they can be used on platforms such as watchOS that lack these color constants,
 //  and to easily provide overridable theme settings (e.g. dark app theme while OS is in light mode)
 //  while still using the standard system colors.
+//
+// Values come from a static table, and each name/theme pair returns the same shared UIColor instance every time.
 
 // An alternative to UIUserInterfaceStyle that defaults to "light" and is available on all platforms
 typedef NS_ENUM(NSInteger, FCUserInterfaceStyle) {
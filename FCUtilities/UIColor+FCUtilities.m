@@ -4,75 +4,320 @@
 //
 
 #import "UIColor+FCUtilities.h"
+#import "FCColorMath.h"
+#import "FCCache.h"
 #import <objc/runtime.h>
+#import <xlocale.h>
 
 static void *UIColorFCUtilitiesIdentifierKey = &UIColorFCUtilitiesIdentifierKey;
+static void *UIColorFCUtilitiesSharedKey = &UIColorFCUtilitiesSharedKey;
+
+// Marks interned and cached instances, which fc_withSystemName: must not modify because every caller gets the same one
+static UIColor *FCColorMarkShared(UIColor *color)
+{
+    objc_setAssociatedObject(color, UIColorFCUtilitiesSharedKey, @YES, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    return color;
+}
+
+typedef NS_ENUM(uint8_t, FCColorDerivationKind) {
+    FCColorDerivationKindContrast = 1,
+    FCColorDerivationKindBlend,
+    FCColorDerivationKindIdentifier,
+};
+
+// Derived colors are cached by their inputs' resolved RGBA, so repeated theme switches and cell configurations
+//  skip the math, the UIColor allocations and the NSScanner parsing entirely.
+@interface FCColorDerivationKey : NSObject <NSCopying> {
+@public
+    FCColorDerivationKind kind;
+    FCUserInterfaceStyle theme;
+    float values[9];
+    NSString *string;
+}
+@end
+
+@implementation FCColorDerivationKey
+- (id)copyWithZone:(NSZone *)zone { return self; }
+
+- (NSUInteger)hash
+{
+    NSUInteger h = kind * 31 + (NSUInteger) theme;
+    for (int i = 0; i < 9; i++) {
+        uint32_t bits;
+        memcpy(&bits, &values[i], sizeof(bits));
+        h = h * 1000003 ^ bits;
+    }
+    return string ? h ^ string.hash : h;
+}
+
+- (BOOL)isEqual:(FCColorDerivationKey *)other
+{
+    if (! [other isKindOfClass:FCColorDerivationKey.class]) return NO;
+    return kind == other->kind && theme == other->theme && 0 == memcmp(values, other->values, sizeof(values)) && (string == other->string || [string isEqualToString:other->string]);
+}
+@end
+
+static FCCache *FCColorDerivationCache(void)
+{
+    static FCCache *cache;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cache = [FCCache new];
+        cache.itemLimit = 4096;
+    });
+    return cache;
+}
+
+static FCColorDerivationKey *FCColorDerivationKeyMake(FCColorDerivationKind kind, FCColorRGBA a, FCColorRGBA b, float extra)
+{
+    FCColorDerivationKey *key = [FCColorDerivationKey new];
+    key->kind = kind;
+    float values[9] = { a.r, a.g, a.b, a.a, b.r, b.g, b.b, b.a, extra };
+    memcpy(key->values, values, sizeof(values));
+    return key;
+}
+
+static BOOL FCColorGetRGBA(UIColor *color, FCColorRGBA *outRGBA)
+{
+    CGFloat r, g, b, a;
+    if (! [color fc_getRed:&r green:&g blue:&b alpha:&a]) return NO;
+    *outRGBA = (FCColorRGBA) { r, g, b, a };
+    return YES;
+}
+
+static inline UIColor *FCColorFromRGBA(FCColorRGBA c) { return [UIColor colorWithRed:c.r green:c.g blue:c.b alpha:c.a]; }
+
+#pragma mark - System color table
+
+// Perfect hash of the system color names: FNV-1a from FCSystemColorHashSeed, top FCSystemColorTableBits bits as the slot.
+//  fc_dumpSystemColorValues searches for a collision-free seed when regenerating the table.
+#define FCSystemColorTableBits 7
+#define FCSystemColorTableSize (1 << FCSystemColorTableBits)
+
+typedef struct {
+    const char *name;
+    float light[4];
+    float dark[4];
+} FCSystemColorEntry;
+
+static inline uint32_t FCSystemColorHash(const char *bytes, size_t length, uint32_t seed)
+{
+    uint32_t hash = seed;
+    for (size_t i = 0; i < length; i++) hash = (hash ^ (uint8_t) bytes[i]) * 16777619u;
+    return hash >> (32 - FCSystemColorTableBits);
+}
+
+// Generated by SUPPORT_DUMPING_COLOR_VALUES
+#define FCSystemColorHashSeed 0x811ca119u
+static const FCSystemColorEntry FCSystemColorTable[FCSystemColorTableSize] = {
+    [1] = { "systemGray5Color", { 0.898039f, 0.898039f, 0.917647f, 1.000000f }, { 0.172549f, 0.172549f, 0.180392f, 1.000000f } },
+    [3] = { "secondarySystemFillColor", { 0.470588f, 0.470588f, 0.501961f, 0.160000f }, { 0.470588f, 0.470588f, 0.501961f, 0.320000f } },
+    [8] = { "placeholderTextColor", { 0.235294f, 0.235294f, 0.262745f, 0.300000f }, { 0.921569f, 0.921569f, 0.960784f, 0.300000f } },
+    [11] = { "systemYellowColor", { 1.000000f, 0.800000f, 0.000000f, 1.000000f }, { 1.000000f, 0.839216f, 0.039216f, 1.000000f } },
+    [16] = { "systemBlueColor", { 0.000000f, 0.478431f, 1.000000f, 1.000000f }, { 0.039216f, 0.517647f, 1.000000f, 1.000000f } },
+    [20] = { "systemIndigoColor", { 0.345098f, 0.337255f, 0.839216f, 1.000000f }, { 0.368627f, 0.360784f, 0.901961f, 1.000000f } },
+    [21] = { "tertiarySystemBackgroundColor", { 1.000000f, 1.000000f, 1.000000f, 1.000000f }, { 0.172549f, 0.172549f, 0.180392f, 1.000000f } },
+    [28] = { "systemGrayColor", { 0.556863f, 0.556863f, 0.576471f, 1.000000f }, { 0.556863f, 0.556863f, 0.576471f, 1.000000f } },
+    [32] = { "tertiarySystemFillColor", { 0.462745f, 0.462745f, 0.501961f, 0.120000f }, { 0.462745f, 0.462745f, 0.501961f, 0.240000f } },
+    [33] = { "labelColor", { 0.000000f, 0.000000f, 0.000000f, 1.000000f }, { 1.000000f, 1.000000f, 1.000000f, 1.000000f } },
+    [36] = { "systemTealColor", { 0.188235f, 0.690196f, 0.780392f, 1.000000f }, { 0.250980f, 0.784314f, 0.878431f, 1.000000f } },
+    [37] = { "systemGroupedBackgroundColor", { 0.949020f, 0.949020f, 0.968627f, 1.000000f }, { 0.000000f, 0.000000f, 0.000000f, 1.000000f } },
+    [40] = { "secondarySystemBackgroundColor", { 0.949020f, 0.949020f, 0.968627f, 1.000000f }, { 0.109804f, 0.109804f, 0.117647f, 1.000000f } },
+    [41] = { "systemPinkColor", { 1.000000f, 0.176471f, 0.333333f, 1.000000f }, { 1.000000f, 0.215686f, 0.372549f, 1.000000f } },
+    [46] = { "systemGray4Color", { 0.819608f, 0.819608f, 0.839216f, 1.000000f }, { 0.227451f, 0.227451f, 0.235294f, 1.000000f } },
+    [52] = { "tertiaryLabelColor", { 0.235294f, 0.235294f, 0.262745f, 0.300000f }, { 0.921569f, 0.921569f, 0.960784f, 0.300000f } },
+    [56] = { "quaternarySystemFillColor", { 0.454902f, 0.454902f, 0.501961f, 0.080000f }, { 0.462745f, 0.462745f, 0.501961f, 0.180000f } },
+    [57] = { "systemFillColor", { 0.470588f, 0.470588f, 0.501961f, 0.200000f }, { 0.470588f, 0.470588f, 0.501961f, 0.360000f } },
+    [62] = { "opaqueSeparatorColor", { 0.776471f, 0.776471f, 0.784314f, 1.000000f }, { 0.219608f, 0.219608f, 0.227451f, 1.000000f } },
+    [63] = { "secondarySystemGroupedBackgroundColor", { 1.000000f, 1.000000f, 1.000000f, 1.000000f }, { 0.109804f, 0.109804f, 0.117647f, 1.000000f } },
+    [66] = { "systemGray2Color", { 0.682353f, 0.682353f, 0.698039f, 1.000000f }, { 0.388235f, 0.388235f, 0.400000f, 1.000000f } },
+    [68] = { "systemRedColor", { 1.000000f, 0.231373f, 0.188235f, 1.000000f }, { 1.000000f, 0.270588f, 0.227451f, 1.000000f } },
+    [71] = { "systemBackgroundColor", { 1.000000f, 1.000000f, 1.000000f, 1.000000f }, { 0.000000f, 0.000000f, 0.000000f, 1.000000f } },
+    [72] = { "quaternaryLabelColor", { 0.235294f, 0.235294f, 0.262745f, 0.180000f }, { 0.921569f, 0.921569f, 0.960784f, 0.160000f } },
+    [75] = { "systemPurpleColor", { 0.686275f, 0.321569f, 0.870588f, 1.000000f }, { 0.749020f, 0.352941f, 0.949020f, 1.000000f } },
+    [76] = { "systemGray3Color", { 0.780392f, 0.780392f, 0.800000f, 1.000000f }, { 0.282353f, 0.282353f, 0.290196f, 1.000000f } },
+    [92] = { "systemMintColor", { 0.000000f, 0.780392f, 0.745098f, 1.000000f }, { 0.388235f, 0.901961f, 0.886275f, 1.000000f } },
+    [93] = { "secondaryLabelColor", { 0.235294f, 0.235294f, 0.262745f, 0.600000f }, { 0.921569f, 0.921569f, 0.960784f, 0.600000f } },
+    [96] = { "tertiarySystemGroupedBackgroundColor", { 0.949020f, 0.949020f, 0.968627f, 1.000000f }, { 0.172549f, 0.172549f, 0.180392f, 1.000000f } },
+    [97] = { "systemCyanColor", { 0.196078f, 0.678431f, 0.901961f, 1.000000f }, { 0.392157f, 0.823529f, 1.000000f, 1.000000f } },
+    [100] = { "systemBrownColor", { 0.635294f, 0.517647f, 0.368627f, 1.000000f }, { 0.674510f, 0.556863f, 0.407843f, 1.000000f } },
+    [101] = { "separatorColor", { 0.235294f, 0.235294f, 0.262745f, 0.290000f }, { 0.329412f, 0.329412f, 0.345098f, 0.600000f } },
+    [108] = { "systemOrangeColor", { 1.000000f, 0.584314f, 0.000000f, 1.000000f }, { 1.000000f, 0.623529f, 0.039216f, 1.000000f } },
+    [110] = { "systemGreenColor", { 0.203922f, 0.780392f, 0.349020f, 1.000000f }, { 0.188235f, 0.819608f, 0.345098f, 1.000000f } },
+    [114] = { "systemGray6Color", { 0.949020f, 0.949020f, 0.968627f, 1.000000f }, { 0.109804f, 0.109804f, 0.117647f, 1.000000f } },
+    [120] = { "linkColor", { 0.000000f, 0.478431f, 1.000000f, 1.000000f }, { 0.035294f, 0.517647f, 1.000000f, 1.000000f } },
+};
+
+// Interned on first use, so system color lookups never allocate
+static UIColor *FCSystemColors[FCSystemColorTableSize][2];
+static NSString *FCSystemColorIdentifiers[FCSystemColorTableSize];
+
+static NSString *FCColorIdentifierComponents(FCUserInterfaceStyle theme, const float rgba[4])
+{
+    char buffer[96];
+    snprintf_l(buffer, sizeof(buffer), NULL, "#%d:%g,%g,%g,%g", (int) theme, rgba[0], rgba[1], rgba[2], rgba[3]);
+    return @(buffer);
+}
+
+static void FCSystemColorsInitialize(void)
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        for (size_t slot = 0; slot < FCSystemColorTableSize; slot++) {
+            const FCSystemColorEntry *entry = &FCSystemColorTable[slot];
+            if (! entry->name) continue;
+            NSString *name = @(entry->name);
+            FCSystemColors[slot][FCUserInterfaceStyleLight] = FCColorMarkShared([[UIColor colorWithRed:entry->light[0] green:entry->light[1] blue:entry->light[2] alpha:entry->light[3]] fc_withSystemName:name]);
+            FCSystemColors[slot][FCUserInterfaceStyleDark] = FCColorMarkShared([[UIColor colorWithRed:entry->dark[0] green:entry->dark[1] blue:entry->dark[2] alpha:entry->dark[3]] fc_withSystemName:name]);
+            FCSystemColorIdentifiers[slot] = [NSString stringWithFormat:@"%@%@%@", name,
+                FCColorIdentifierComponents(FCUserInterfaceStyleLight, entry->light), FCColorIdentifierComponents(FCUserInterfaceStyleDark, entry->dark)
+            ];
+        }
+    });
+}
+
+static inline UIColor *FCSystemColorAtSlot(size_t slot, FCUserInterfaceStyle theme)
+{
+    FCSystemColorsInitialize();
+    return FCSystemColors[slot][theme == FCUserInterfaceStyleDark ? FCUserInterfaceStyleDark : FCUserInterfaceStyleLight];
+}
+
+static NSInteger FCSystemColorSlotForName(const char *bytes, size_t length)
+{
+    size_t slot = FCSystemColorHash(bytes, length, FCSystemColorHashSeed);
+    const char *name = FCSystemColorTable[slot].name;
+    return (name && strlen(name) == length && 0 == memcmp(name, bytes, length)) ? (NSInteger) slot : -1;
+}
+
+// Borrows the string's UTF-8 bytes when CoreFoundation has them, else copies into buffer. Only unusually long strings allocate.
+static const char *FCColorUTF8String(NSString *string, char *buffer, size_t bufferSize)
+{
+    const char *cString = CFStringGetCStringPtr((__bridge CFStringRef) string, kCFStringEncodingUTF8);
+    if (cString) return cString;
+    if ([string getCString:buffer maxLength:bufferSize encoding:NSUTF8StringEncoding]) return buffer;
+    return string.UTF8String;
+}
+
+static NSInteger FCSystemColorSlotForNameString(NSString *name)
+{
+    char buffer[64];
+    const char *bytes = FCColorUTF8String(name, buffer, sizeof(buffer));
+    return bytes ? FCSystemColorSlotForName(bytes, strlen(bytes)) : -1;
+}
+
+// Parses the "#t:r,g,b,a…" sequence that follows the name without allocating, skipping ',' and ':' between fields
+//  as the original NSScanner implementation did. Later entries win.
+static BOOL FCColorIdentifierParseComponents(const char *p, FCUserInterfaceStyle theme, FCColorRGBA *outColor)
+{
+    BOOL hasExact = NO, hasLight = NO, hasAny = NO;
+    FCColorRGBA exact, light, any;
+
+    while (true) {
+        p += strspn(p, ",:");
+        if (*p != '#') break;
+        p += strspn(p + 1, ",:") + 1;
+
+        char *end;
+        long themeID = strtol_l(p, &end, 10, NULL);
+        if (end == p) continue;
+        p = end;
+
+        float c[4];
+        int i;
+        for (i = 0; i < 4; i++) {
+            p += strspn(p, ",:");
+            c[i] = strtof_l(p, &end, NULL);
+            if (end == p) break;
+            p = end;
+        }
+        if (i < 4) continue;
+
+        FCColorRGBA color = { c[0], c[1], c[2], c[3] };
+        if (themeID == theme) { exact = color; hasExact = YES; }
+        if (themeID == FCUserInterfaceStyleLight) { light = color; hasLight = YES; }
+        any = color;
+        hasAny = YES;
+    }
+
+    // Fall back to light if the exact theme isn't present, then to any theme present
+    if (hasExact) *outColor = exact;
+    else if (hasLight) *outColor = light;
+    else if (hasAny) *outColor = any;
+    return hasExact || hasLight || hasAny;
+}
 
 @implementation UIColor (FCUtilities)
 
 - (UIColor * _Nonnull)fc_withSystemName:(NSString * _Nullable)string
 {
-    objc_setAssociatedObject(self, UIColorFCUtilitiesIdentifierKey, string, OBJC_ASSOCIATION_COPY);
-    return self;
+    // Shared instances get a tagged copy, so renaming one caller's color can't change every other caller's identifier
+    UIColor *color = objc_getAssociatedObject(self, UIColorFCUtilitiesSharedKey) ? [UIColor colorWithCGColor:self.CGColor] : self;
+    objc_setAssociatedObject(color, UIColorFCUtilitiesIdentifierKey, string, OBJC_ASSOCIATION_COPY);
+    return color;
 }
 
 - (NSString * _Nullable)fc_colorIdentifier
 {
-    NSMutableDictionary<NSNumber *, UIColor *> *colorsToRepresentAsRGBA = [NSMutableDictionary dictionary];
-
     NSString *systemName = (NSString *) objc_getAssociatedObject(self, UIColorFCUtilitiesIdentifierKey);
     if (systemName) {
-        NSArray<NSNumber *> *validThemeValues = @[
-            @(FCUserInterfaceStyleLight),
-            @(FCUserInterfaceStyleDark),
-        ];
-        
-        for (NSNumber *themeNum in validThemeValues) {
-            UIColor *c = [self.class fc_systemColorWithName:systemName theme:themeNum.integerValue];
-            if (c) colorsToRepresentAsRGBA[themeNum] = c;
+        NSInteger slot = FCSystemColorSlotForNameString(systemName);
+        if (slot >= 0) {
+            FCSystemColorsInitialize();
+            return FCSystemColorIdentifiers[slot];
         }
     }
-    if (! colorsToRepresentAsRGBA.count) colorsToRepresentAsRGBA[@(FCUserInterfaceStyleLight)] = self;
-
-    __block BOOL hasAnyComponents = NO;
-    NSMutableString *idStr = (systemName ?: @"").mutableCopy;
-    [colorsToRepresentAsRGBA enumerateKeysAndObjectsUsingBlock:^(NSNumber *themeNum, UIColor *color, BOOL *stop) {
-        CGFloat r, g, b, a;
-        if (! [color fc_getRed:&r green:&g blue:&b alpha:&a]) return;
-        hasAnyComponents = YES;
-        [idStr appendFormat:@"#%d:%g,%g,%g,%g", themeNum.intValue, r, g, b, a];
-    }];
 
-    return hasAnyComponents ? idStr : nil;
+    CGFloat r, g, b, a;
+    if (! [self fc_getRed:&r green:&g blue:&b alpha:&a]) return nil;
+
+    char components[96];
+    snprintf_l(components, sizeof(components), NULL, "#%d:%g,%g,%g,%g", (int) FCUserInterfaceStyleLight, r, g, b, a);
+    return systemName ? [systemName stringByAppendingFormat:@"%s", components] : @(components);
 }
 
 + (UIColor * _Nullable)fc_colorFromIdentifier:(NSString * _Nullable)string theme:(FCUserInterfaceStyle)theme
 {
     if (! string) return nil;
-    
-    NSScanner *scanner = [NSScanner scannerWithString:string];
-    scanner.charactersToBeSkipped = [NSCharacterSet characterSetWithCharactersInString:@",:"];
-    NSString *systemName = NULL;
 
-    if ([scanner scanCharactersFromSet:NSCharacterSet.alphanumericCharacterSet intoString:&systemName] && systemName.length > 0) {
-        UIColor *systemColor = [self fc_systemColorWithName:systemName theme:theme];
-        if (systemColor) return systemColor;
+    FCColorDerivationKey *key = [FCColorDerivationKey new];
+    key->kind = FCColorDerivationKindIdentifier;
+    key->theme = theme;
+    key->string = [string copy];
+
+    FCCache *cache = FCColorDerivationCache();
+    id cached = [cache objectForKey:key];
+    if (! cached) {
+        UIColor *parsed = [self _fc_parseColorFromIdentifier:key->string theme:theme];
+        cached = parsed ? FCColorMarkShared(parsed) : NSNull.null;
+        [cache setObject:cached forKey:key];
     }
-    
-    // If it's not a recognized system color, fall back to RGBA values
-    NSMutableDictionary<NSNumber *, UIColor *> *colorsByTheme = [NSMutableDictionary dictionary];
-    while ([scanner scanString:@"#" intoString:NULL]) {
-        NSInteger themeID;
-        float r = 0, g = 0, b = 0, a = 0;
-        if ([scanner scanInteger:&themeID] && [scanner scanFloat:&r] && [scanner scanFloat:&g] && [scanner scanFloat:&b] && [scanner scanFloat:&a]) {
-            colorsByTheme[@(themeID)] = [UIColor colorWithRed:r green:g blue:b alpha:a];
-        }
+    return cached == NSNull.null ? nil : cached;
+}
+
++ (UIColor * _Nullable)_fc_parseColorFromIdentifier:(NSString *)string theme:(FCUserInterfaceStyle)theme
+{
+    char buffer[256];
+    const char *bytes = FCColorUTF8String(string, buffer, sizeof(buffer));
+    if (! bytes) return nil;
+
+    const char *name = bytes + strspn(bytes, ",:");
+    size_t nameLength = 0;
+    while (true) {
+        uint8_t c = name[nameLength];
+        if (! ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80)) break; // NSCharacterSet.alphanumericCharacterSet, approximately
+        nameLength++;
     }
-    
-    UIColor *colorInTheme = colorsByTheme[@(theme)];
-    if (! colorInTheme) colorInTheme = colorsByTheme[@(FCUserInterfaceStyleLight)]; // Fall back to light if color exact theme isn't present
-    if (! colorInTheme) colorInTheme = colorsByTheme.allValues.firstObject; // If exact theme AND light theme aren't set, fall back to any theme present
-    return colorInTheme ? [colorInTheme fc_withSystemName:systemName] : nil;
+
+    NSInteger slot = nameLength ? FCSystemColorSlotForName(name, nameLength) : -1;
+    if (slot >= 0) return FCSystemColorAtSlot(slot, theme);
+
+    // If it's not a recognized system color, fall back to RGBA values
+    FCColorRGBA c;
+    if (! FCColorIdentifierParseComponents(name + nameLength, theme, &c)) return nil;
+
+    UIColor *color = FCColorFromRGBA(c);
+    if (nameLength) color = [color fc_withSystemName:[[NSString alloc] initWithBytes:name length:nameLength encoding:NSUTF8StringEncoding]];
+    return color;
 }
 
 - (BOOL)fc_getRed:(CGFloat *)red green:(CGFloat *)green blue:(CGFloat *)blue alpha:(CGFloat *)alpha {
@@ -120,54 +365,71 @@ static void *UIColorFCUtilitiesIdentifierKey = &UIColorFCUtilitiesIdentifierKey;
 
 - (CGFloat)fc_apcaLuminance /* "Y" from https://github.com/Myndex/SAPC-APCA/ and https://www.w3.org/WAI/GL/task-forces/silver/wiki/Visual_Contrast_of_Text_Subgroup/APCA_model */
 {
-    CGFloat r, g, b, a;
-    [self fc_getRed:&r green:&g blue:&b alpha:&a];
-    return powf(r / 1.0f, 2.4f) * 0.2126729f + powf(g / 1.0f, 2.4f) * 0.7151522f + powf(b / 1.0f, 2.4f) * 0.0721750f;
+    FCColorRGBA c = { 0, 0, 0, 0 };
+    FCColorGetRGBA(self, &c);
+    return FCColorAPCALuminance(c);
 }
 
 - (CGFloat)fc_apcaContrastAgainstBackgroundColor:(UIColor *)backgroundColor
 {
-    UIColor *textColor = [self fc_opaqueColorByBlendingWithBackgroundColor:backgroundColor];
-    CGFloat textY = textColor.fc_apcaLuminance;
-    CGFloat backgroundY = backgroundColor.fc_apcaLuminance;
-
-    // adapted from https://github.com/Myndex/SAPC-APCA/blob/master/src/JS/SAPC_0_98G_4g_minimal.js
-
-    const CGFloat clampThreshold = 0.22f;
-    if (textY <= clampThreshold)       { textY += powf(clampThreshold - textY,       1.414f); }
-    if (backgroundY <= clampThreshold) { textY += powf(clampThreshold - backgroundY, 1.414f); }
-
-    if (ABS(backgroundY - textY) < 0.0005f) return 0;
-    
-    CGFloat sapc = backgroundY > textY ? powf(backgroundY, 0.56f) - powf(textY, 0.57f) : powf(backgroundY, 0.65f) - powf(textY, 0.62f);
-
-    if (sapc < 0.001f)    return 0;
-    if (sapc < 0.035991f) return sapc - sapc * 27.7847239587675f * 0.027f;
-    return sapc - 0.027f;
+    FCColorRGBA text, background;
+    if (! FCColorGetRGBA(self, &text) || ! FCColorGetRGBA(backgroundColor, &background)) return 0;
+    return FCColorAPCAContrast(text, background);
 }
 
 - (UIColor * _Nonnull)fc_colorWithMinimumAPCAContrast:(CGFloat)minContrast againstBackgroundColor:(UIColor *)backgroundColor changed:(out BOOL *)outColorDidChange
 {
     if (outColorDidChange) *outColorDidChange = NO;
-    BOOL adjustmentDirectionDarken = (backgroundColor.fc_apcaLuminance > self.fc_apcaLuminance);
-    UIColor *color = self;
-    CGFloat lastContrast = 0.0f;
-    CGFloat contrast;
-    while ( (contrast = [color fc_apcaContrastAgainstBackgroundColor:backgroundColor]) < minContrast) {
-        if (contrast == lastContrast) { /* not improving anymore; bail out */ return color; }
-        color = [color fc_colorByModifyingHSBA:^(CGFloat * _Nonnull hue, CGFloat * _Nonnull saturation, CGFloat * _Nonnull brightness, CGFloat * _Nonnull alpha) {
-            if (adjustmentDirectionDarken) {
-                *brightness *= 0.975f;
-                *saturation *= 1.1f;
-            } else {
-                *brightness *= 1.05f;
-                *saturation *= 0.9f;
-            }
-        }];
-        if (outColorDidChange) *outColorDidChange = YES;
-        lastContrast = contrast;
+    FCColorRGBA color, background;
+    if (! FCColorGetRGBA(self, &color) || ! FCColorGetRGBA(backgroundColor, &background)) return self;
+
+    // Cached value is the adjusted color, or NSNull if no adjustment was needed
+    FCColorDerivationKey *key = FCColorDerivationKeyMake(FCColorDerivationKindContrast, color, background, minContrast);
+    FCCache *cache = FCColorDerivationCache();
+    id cached = [cache objectForKey:key];
+    if (! cached) {
+        bool changed;
+        FCColorRGBA adjusted = FCColorWithMinimumAPCAContrast(color, background, minContrast, &changed);
+        cached = changed ? FCColorMarkShared(FCColorFromRGBA(adjusted)) : NSNull.null;
+        [cache setObject:cached forKey:key];
     }
-    return color;
+
+    if (cached == NSNull.null) return self;
+    if (outColorDidChange) *outColorDidChange = YES;
+    return cached;
+}
+
++ (NSArray<UIColor *> * _Nonnull)fc_colors:(NSArray<UIColor *> * _Nonnull)colors withMinimumAPCAContrast:(CGFloat)minContrast againstBackgroundColor:(UIColor * _Nonnull)backgroundColor
+{
+    FCColorRGBA background;
+    if (! colors.count || ! FCColorGetRGBA(backgroundColor, &background)) return colors;
+
+    NSUInteger count = colors.count;
+    float *packed = malloc(count * 4 * sizeof(float));
+    bool *decomposable = malloc(count * sizeof(bool));
+    bool *changed = malloc(count * sizeof(bool));
+    for (NSUInteger i = 0; i < count; i++) {
+        FCColorRGBA c = { 0, 0, 0, 0 };
+        decomposable[i] = FCColorGetRGBA(colors[i], &c);
+        memcpy(packed + i * 4, &c, sizeof(float) * 4);
+    }
+
+    FCColorApplyMinimumAPCAContrast(packed, packed, count, background, minContrast, changed);
+
+    NSMutableArray<UIColor *> *results = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        if (decomposable[i] && changed[i]) {
+            const float *c = packed + i * 4;
+            [results addObject:[UIColor colorWithRed:c[0] green:c[1] blue:c[2] alpha:c[3]]];
+        } else {
+            [results addObject:colors[i]];
+        }
+    }
+
+    free(packed);
+    free(decomposable);
+    free(changed);
+    return results;
 }
 
 - (NSString *)fc_CSSColor
@@ -193,21 +455,19 @@ static void *UIColorFCUtilitiesIdentifierKey = &UIColorFCUtilitiesIdentifierKey;
     return [backgroundColor fc_colorByBlendingWithColor:self];
 }
 
-// adaptation of https://stackoverflow.com/a/18903483/30480
 - (UIColor *)fc_colorByBlendingWithColor:(UIColor *)color2
 {
-    CGFloat r1, g1, b1, a1, r2, g2, b2, a2;
-
-    if (! [self fc_getRed:&r1 green:&g1 blue:&b1 alpha:&a1]) return nil;
-    if (! [color2 fc_getRed:&r2 green:&g2 blue:&b2 alpha:&a2]) return nil;
-
-    CGFloat beta = 1.0f - a2;
-    
-    CGFloat r = r1 * beta + r2 * a2;
-    CGFloat g = g1 * beta + g2 * a2;
-    CGFloat b = b1 * beta + b2 * a2;
-    //CGFloat a = a1 * beta + a2 * a2;
-    return [UIColor colorWithRed:r green:g blue:b alpha:a1];
+    FCColorRGBA background, foreground;
+    if (! FCColorGetRGBA(self, &background) || ! FCColorGetRGBA(color2, &foreground)) return nil;
+
+    FCColorDerivationKey *key = FCColorDerivationKeyMake(FCColorDerivationKindBlend, background, foreground, 0);
+    FCCache *cache = FCColorDerivationCache();
+    UIColor *blended = [cache objectForKey:key];
+    if (! blended) {
+        blended = FCColorMarkShared(FCColorFromRGBA(FCColorBlend(background, foreground)));
+        [cache setObject:blended forKey:key];
+    }
+    return blended;
 }
 
 #ifdef SUPPORT_DUMPING_COLOR_VALUES
@@ -244,29 +504,57 @@ static void *UIColorFCUtilitiesIdentifierKey = &UIColorFCUtilitiesIdentifierKey;
     }
     free(methods);
     
-    NSMutableString *byNameMethodBody = @"".mutableCopy;
+    NSMutableArray<NSString *> *names = [NSMutableArray array];
+    NSMutableArray<NSArray<NSNumber *> *> *lightValues = [NSMutableArray array];
+    NSMutableArray<NSArray<NSNumber *> *> *darkValues = [NSMutableArray array];
 
     for (NSString *name in systemColorMethodNames) {
         UIColor *color = [UIColor performSelector:NSSelectorFromString(name)];
         if (! [color isKindOfClass:UIColor.class]) continue;
 
-        [hFile appendFormat:@"+ (UIColor * _Nonnull)fc_%@WithTheme:(FCUserInterfaceStyle)theme;\n", name];
-
         CGFloat darkR, darkG, darkB, darkA, lightR, lightG, lightB, lightA;
         UIColor *darkColor = [color resolvedColorWithTraitCollection:[UITraitCollection traitCollectionWithUserInterfaceStyle:UIUserInterfaceStyleDark]];
         UIColor *lightColor = [color resolvedColorWithTraitCollection:[UITraitCollection traitCollectionWithUserInterfaceStyle:UIUserInterfaceStyleLight]];
         if (! [darkColor fc_getRed:&darkR green:&darkG blue:&darkB alpha:&darkA] || ! [lightColor fc_getRed:&lightR green:&lightG blue:&lightB alpha:&lightA]) continue;
 
-        [cFile appendFormat:@"+ (UIColor * _Nonnull)fc_%@WithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:%0.6ff green:%0.6ff blue:%0.6ff alpha:%0.6ff] : [UIColor colorWithRed:%0.6ff green:%0.6ff blue:%0.6ff alpha:%0.6ff]) fc_withSystemName:@\"%@\"]; }\n", name, darkR, darkG, darkB, darkA, lightR, lightG, lightB, lightA, name];
-        
-        [byNameMethodBody appendFormat:@"    if ([name isEqualToString:@\"%@\"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:%0.6ff green:%0.6ff blue:%0.6ff alpha:%0.6ff] : [UIColor colorWithRed:%0.6ff green:%0.6ff blue:%0.6ff alpha:%0.6ff]) fc_withSystemName:@\"%@\"]; }\n", name, darkR, darkG, darkB, darkA, lightR, lightG, lightB, lightA, name];
-        
+        [hFile appendFormat:@"+ (UIColor * _Nonnull)fc_%@WithTheme:(FCUserInterfaceStyle)theme;\n", name];
+        [names addObject:name];
+        [lightValues addObject:@[ @(lightR), @(lightG), @(lightB), @(lightA) ]];
+        [darkValues addObject:@[ @(darkR), @(darkG), @(darkB), @(darkA) ]];
+
         [swiftUIFile appendFormat:@"    static func %@(_ scheme: ColorScheme) -> Color { scheme == .dark ? Color(red: %g, green: %g, blue: %g, opacity: %g) : Color(red: %g, green: %g, blue: %g, opacity: %g) }\n",
             [name fc_substringBefore:@"Color" fromEnd:YES], darkR, darkG, darkB, darkA, lightR, lightG, lightB, lightA
         ];
     }
-    
-    [cFile appendFormat:@"\n+ (UIColor * _Nullable)fc_systemColorWithName:(NSString * _Nonnull)name theme:(FCUserInterfaceStyle)theme {\n%@\n    return nil;\n}\n", byNameMethodBody];
+
+    // Find a seed that gives every name its own slot
+    uint32_t seed = 0x811C9DC5; // FNV-1a offset basis
+    NSMutableArray<NSNumber *> *slots = [NSMutableArray array];
+    while (true) {
+        [slots removeAllObjects];
+        NSMutableIndexSet *used = [NSMutableIndexSet indexSet];
+        for (NSString *name in names) {
+            NSUInteger slot = FCSystemColorHash(name.UTF8String, strlen(name.UTF8String), seed);
+            if ([used containsIndex:slot]) break;
+            [used addIndex:slot];
+            [slots addObject:@(slot)];
+        }
+        if (slots.count == names.count) break;
+        if (++seed == 0x811C9DC5) [[NSException exceptionWithName:@"ColorDumpFailed" reason:@"No perfect hash seed; increase FCSystemColorTableBits" userInfo:nil] raise];
+    }
+
+    NSMutableArray<NSString *> *tableRows = [NSMutableArray array];
+    NSMutableString *methodsFile = @"".mutableCopy;
+    [names enumerateObjectsUsingBlock:^(NSString *name, NSUInteger i, BOOL *stop) {
+        NSArray<NSNumber *> *l = lightValues[i], *d = darkValues[i];
+        [tableRows addObject:[NSString stringWithFormat:@"    [%@] = { \"%@\", { %0.6ff, %0.6ff, %0.6ff, %0.6ff }, { %0.6ff, %0.6ff, %0.6ff, %0.6ff } },\n", slots[i], name,
+            l[0].doubleValue, l[1].doubleValue, l[2].doubleValue, l[3].doubleValue, d[0].doubleValue, d[1].doubleValue, d[2].doubleValue, d[3].doubleValue
+        ]];
+        [methodsFile appendFormat:@"+ (UIColor * _Nonnull)fc_%@WithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(%@, theme); }\n", name, slots[i]];
+    }];
+    [tableRows sortUsingComparator:^NSComparisonResult(NSString *a, NSString *b) { return [a compare:b options:NSNumericSearch]; }];
+
+    [cFile appendFormat:@"#define FCSystemColorHashSeed 0x%xu\nstatic const FCSystemColorEntry FCSystemColorTable[FCSystemColorTableSize] = {\n%@};\n\n%@", seed, [tableRows componentsJoinedByString:@""], methodsFile];
 
     [swiftUIFile appendString:@"}\n"];
 
@@ -284,82 +572,47 @@ static void *UIColorFCUtilitiesIdentifierKey = &UIColorFCUtilitiesIdentifierKey;
 #endif
 
 // Generated by SUPPORT_DUMPING_COLOR_VALUES
-+ (UIColor * _Nonnull)fc_systemRedColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:1.000000f green:0.270588f blue:0.227451f alpha:1.000000f] : [UIColor colorWithRed:1.000000f green:0.231373f blue:0.188235f alpha:1.000000f]) fc_withSystemName:@"systemRedColor"]; }
-+ (UIColor * _Nonnull)fc_systemGreenColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.188235f green:0.819608f blue:0.345098f alpha:1.000000f] : [UIColor colorWithRed:0.203922f green:0.780392f blue:0.349020f alpha:1.000000f]) fc_withSystemName:@"systemGreenColor"]; }
-+ (UIColor * _Nonnull)fc_systemBlueColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.039216f green:0.517647f blue:1.000000f alpha:1.000000f] : [UIColor colorWithRed:0.000000f green:0.478431f blue:1.000000f alpha:1.000000f]) fc_withSystemName:@"systemBlueColor"]; }
-+ (UIColor * _Nonnull)fc_labelColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:1.000000f green:1.000000f blue:1.000000f alpha:1.000000f] : [UIColor colorWithRed:0.000000f green:0.000000f blue:0.000000f alpha:1.000000f]) fc_withSystemName:@"labelColor"]; }
-+ (UIColor * _Nonnull)fc_systemGrayColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.556863f green:0.556863f blue:0.576471f alpha:1.000000f] : [UIColor colorWithRed:0.556863f green:0.556863f blue:0.576471f alpha:1.000000f]) fc_withSystemName:@"systemGrayColor"]; }
-+ (UIColor * _Nonnull)fc_systemBackgroundColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.000000f green:0.000000f blue:0.000000f alpha:1.000000f] : [UIColor colorWithRed:1.000000f green:1.000000f blue:1.000000f alpha:1.000000f]) fc_withSystemName:@"systemBackgroundColor"]; }
-+ (UIColor * _Nonnull)fc_secondarySystemGroupedBackgroundColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.109804f green:0.109804f blue:0.117647f alpha:1.000000f] : [UIColor colorWithRed:1.000000f green:1.000000f blue:1.000000f alpha:1.000000f]) fc_withSystemName:@"secondarySystemGroupedBackgroundColor"]; }
-+ (UIColor * _Nonnull)fc_secondaryLabelColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.921569f green:0.921569f blue:0.960784f alpha:0.600000f] : [UIColor colorWithRed:0.235294f green:0.235294f blue:0.262745f alpha:0.600000f]) fc_withSystemName:@"secondaryLabelColor"]; }
-+ (UIColor * _Nonnull)fc_separatorColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.329412f green:0.329412f blue:0.345098f alpha:0.600000f] : [UIColor colorWithRed:0.235294f green:0.235294f blue:0.262745f alpha:0.290000f]) fc_withSystemName:@"separatorColor"]; }
-+ (UIColor * _Nonnull)fc_linkColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.035294f green:0.517647f blue:1.000000f alpha:1.000000f] : [UIColor colorWithRed:0.000000f green:0.478431f blue:1.000000f alpha:1.000000f]) fc_withSystemName:@"linkColor"]; }
-+ (UIColor * _Nonnull)fc_tertiarySystemFillColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.462745f green:0.462745f blue:0.501961f alpha:0.240000f] : [UIColor colorWithRed:0.462745f green:0.462745f blue:0.501961f alpha:0.120000f]) fc_withSystemName:@"tertiarySystemFillColor"]; }
-+ (UIColor * _Nonnull)fc_systemFillColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.470588f green:0.470588f blue:0.501961f alpha:0.360000f] : [UIColor colorWithRed:0.470588f green:0.470588f blue:0.501961f alpha:0.200000f]) fc_withSystemName:@"systemFillColor"]; }
-+ (UIColor * _Nonnull)fc_secondarySystemFillColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.470588f green:0.470588f blue:0.501961f alpha:0.320000f] : [UIColor colorWithRed:0.470588f green:0.470588f blue:0.501961f alpha:0.160000f]) fc_withSystemName:@"secondarySystemFillColor"]; }
-+ (UIColor * _Nonnull)fc_secondarySystemBackgroundColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.109804f green:0.109804f blue:0.117647f alpha:1.000000f] : [UIColor colorWithRed:0.949020f green:0.949020f blue:0.968627f alpha:1.000000f]) fc_withSystemName:@"secondarySystemBackgroundColor"]; }
-+ (UIColor * _Nonnull)fc_tertiarySystemBackgroundColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.172549f green:0.172549f blue:0.180392f alpha:1.000000f] : [UIColor colorWithRed:1.000000f green:1.000000f blue:1.000000f alpha:1.000000f]) fc_withSystemName:@"tertiarySystemBackgroundColor"]; }
-+ (UIColor * _Nonnull)fc_systemGroupedBackgroundColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.000000f green:0.000000f blue:0.000000f alpha:1.000000f] : [UIColor colorWithRed:0.949020f green:0.949020f blue:0.968627f alpha:1.000000f]) fc_withSystemName:@"systemGroupedBackgroundColor"]; }
-+ (UIColor * _Nonnull)fc_tertiarySystemGroupedBackgroundColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.172549f green:0.172549f blue:0.180392f alpha:1.000000f] : [UIColor colorWithRed:0.949020f green:0.949020f blue:0.968627f alpha:1.000000f]) fc_withSystemName:@"tertiarySystemGroupedBackgroundColor"]; }
-+ (UIColor * _Nonnull)fc_systemOrangeColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:1.000000f green:0.623529f blue:0.039216f alpha:1.000000f] : [UIColor colorWithRed:1.000000f green:0.584314f blue:0.000000f alpha:1.000000f]) fc_withSystemName:@"systemOrangeColor"]; }
-+ (UIColor * _Nonnull)fc_tertiaryLabelColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.921569f green:0.921569f blue:0.960784f alpha:0.300000f] : [UIColor colorWithRed:0.235294f green:0.235294f blue:0.262745f alpha:0.300000f]) fc_withSystemName:@"tertiaryLabelColor"]; }
-+ (UIColor * _Nonnull)fc_systemYellowColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:1.000000f green:0.839216f blue:0.039216f alpha:1.000000f] : [UIColor colorWithRed:1.000000f green:0.800000f blue:0.000000f alpha:1.000000f]) fc_withSystemName:@"systemYellowColor"]; }
-+ (UIColor * _Nonnull)fc_systemPinkColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:1.000000f green:0.215686f blue:0.372549f alpha:1.000000f] : [UIColor colorWithRed:1.000000f green:0.176471f blue:0.333333f alpha:1.000000f]) fc_withSystemName:@"systemPinkColor"]; }
-+ (UIColor * _Nonnull)fc_systemMintColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.388235f green:0.901961f blue:0.886275f alpha:1.000000f] : [UIColor colorWithRed:0.000000f green:0.780392f blue:0.745098f alpha:1.000000f]) fc_withSystemName:@"systemMintColor"]; }
-+ (UIColor * _Nonnull)fc_systemCyanColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.392157f green:0.823529f blue:1.000000f alpha:1.000000f] : [UIColor colorWithRed:0.196078f green:0.678431f blue:0.901961f alpha:1.000000f]) fc_withSystemName:@"systemCyanColor"]; }
-+ (UIColor * _Nonnull)fc_systemTealColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.250980f green:0.784314f blue:0.878431f alpha:1.000000f] : [UIColor colorWithRed:0.188235f green:0.690196f blue:0.780392f alpha:1.000000f]) fc_withSystemName:@"systemTealColor"]; }
-+ (UIColor * _Nonnull)fc_systemPurpleColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.749020f green:0.352941f blue:0.949020f alpha:1.000000f] : [UIColor colorWithRed:0.686275f green:0.321569f blue:0.870588f alpha:1.000000f]) fc_withSystemName:@"systemPurpleColor"]; }
-+ (UIColor * _Nonnull)fc_systemIndigoColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.368627f green:0.360784f blue:0.901961f alpha:1.000000f] : [UIColor colorWithRed:0.345098f green:0.337255f blue:0.839216f alpha:1.000000f]) fc_withSystemName:@"systemIndigoColor"]; }
-+ (UIColor * _Nonnull)fc_systemBrownColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.674510f green:0.556863f blue:0.407843f alpha:1.000000f] : [UIColor colorWithRed:0.635294f green:0.517647f blue:0.368627f alpha:1.000000f]) fc_withSystemName:@"systemBrownColor"]; }
-+ (UIColor * _Nonnull)fc_quaternaryLabelColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.921569f green:0.921569f blue:0.960784f alpha:0.160000f] : [UIColor colorWithRed:0.235294f green:0.235294f blue:0.262745f alpha:0.180000f]) fc_withSystemName:@"quaternaryLabelColor"]; }
-+ (UIColor * _Nonnull)fc_placeholderTextColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.921569f green:0.921569f blue:0.960784f alpha:0.300000f] : [UIColor colorWithRed:0.235294f green:0.235294f blue:0.262745f alpha:0.300000f]) fc_withSystemName:@"placeholderTextColor"]; }
-+ (UIColor * _Nonnull)fc_opaqueSeparatorColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.219608f green:0.219608f blue:0.227451f alpha:1.000000f] : [UIColor colorWithRed:0.776471f green:0.776471f blue:0.784314f alpha:1.000000f]) fc_withSystemName:@"opaqueSeparatorColor"]; }
-+ (UIColor * _Nonnull)fc_quaternarySystemFillColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.462745f green:0.462745f blue:0.501961f alpha:0.180000f] : [UIColor colorWithRed:0.454902f green:0.454902f blue:0.501961f alpha:0.080000f]) fc_withSystemName:@"quaternarySystemFillColor"]; }
-+ (UIColor * _Nonnull)fc_systemGray2ColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.388235f green:0.388235f blue:0.400000f alpha:1.000000f] : [UIColor colorWithRed:0.682353f green:0.682353f blue:0.698039f alpha:1.000000f]) fc_withSystemName:@"systemGray2Color"]; }
-+ (UIColor * _Nonnull)fc_systemGray3ColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.282353f green:0.282353f blue:0.290196f alpha:1.000000f] : [UIColor colorWithRed:0.780392f green:0.780392f blue:0.800000f alpha:1.000000f]) fc_withSystemName:@"systemGray3Color"]; }
-+ (UIColor * _Nonnull)fc_systemGray4ColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.227451f green:0.227451f blue:0.235294f alpha:1.000000f] : [UIColor colorWithRed:0.819608f green:0.819608f blue:0.839216f alpha:1.000000f]) fc_withSystemName:@"systemGray4Color"]; }
-+ (UIColor * _Nonnull)fc_systemGray5ColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.172549f green:0.172549f blue:0.180392f alpha:1.000000f] : [UIColor colorWithRed:0.898039f green:0.898039f blue:0.917647f alpha:1.000000f]) fc_withSystemName:@"systemGray5Color"]; }
-+ (UIColor * _Nonnull)fc_systemGray6ColorWithTheme:(FCUserInterfaceStyle)theme { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.109804f green:0.109804f blue:0.117647f alpha:1.000000f] : [UIColor colorWithRed:0.949020f green:0.949020f blue:0.968627f alpha:1.000000f]) fc_withSystemName:@"systemGray6Color"]; }
-
-+ (UIColor * _Nullable)fc_systemColorWithName:(NSString * _Nonnull)name theme:(FCUserInterfaceStyle)theme {
-    if ([name isEqualToString:@"systemRedColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:1.000000f green:0.270588f blue:0.227451f alpha:1.000000f] : [UIColor colorWithRed:1.000000f green:0.231373f blue:0.188235f alpha:1.000000f]) fc_withSystemName:@"systemRedColor"]; }
-    if ([name isEqualToString:@"systemGreenColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.188235f green:0.819608f blue:0.345098f alpha:1.000000f] : [UIColor colorWithRed:0.203922f green:0.780392f blue:0.349020f alpha:1.000000f]) fc_withSystemName:@"systemGreenColor"]; }
-    if ([name isEqualToString:@"systemBlueColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.039216f green:0.517647f blue:1.000000f alpha:1.000000f] : [UIColor colorWithRed:0.000000f green:0.478431f blue:1.000000f alpha:1.000000f]) fc_withSystemName:@"systemBlueColor"]; }
-    if ([name isEqualToString:@"labelColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:1.000000f green:1.000000f blue:1.000000f alpha:1.000000f] : [UIColor colorWithRed:0.000000f green:0.000000f blue:0.000000f alpha:1.000000f]) fc_withSystemName:@"labelColor"]; }
-    if ([name isEqualToString:@"systemGrayColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.556863f green:0.556863f blue:0.576471f alpha:1.000000f] : [UIColor colorWithRed:0.556863f green:0.556863f blue:0.576471f alpha:1.000000f]) fc_withSystemName:@"systemGrayColor"]; }
-    if ([name isEqualToString:@"systemBackgroundColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.000000f green:0.000000f blue:0.000000f alpha:1.000000f] : [UIColor colorWithRed:1.000000f green:1.000000f blue:1.000000f alpha:1.000000f]) fc_withSystemName:@"systemBackgroundColor"]; }
-    if ([name isEqualToString:@"secondarySystemGroupedBackgroundColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.109804f green:0.109804f blue:0.117647f alpha:1.000000f] : [UIColor colorWithRed:1.000000f green:1.000000f blue:1.000000f alpha:1.000000f]) fc_withSystemName:@"secondarySystemGroupedBackgroundColor"]; }
-    if ([name isEqualToString:@"secondaryLabelColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.921569f green:0.921569f blue:0.960784f alpha:0.600000f] : [UIColor colorWithRed:0.235294f green:0.235294f blue:0.262745f alpha:0.600000f]) fc_withSystemName:@"secondaryLabelColor"]; }
-    if ([name isEqualToString:@"separatorColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.329412f green:0.329412f blue:0.345098f alpha:0.600000f] : [UIColor colorWithRed:0.235294f green:0.235294f blue:0.262745f alpha:0.290000f]) fc_withSystemName:@"separatorColor"]; }
-    if ([name isEqualToString:@"linkColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.035294f green:0.517647f blue:1.000000f alpha:1.000000f] : [UIColor colorWithRed:0.000000f green:0.478431f blue:1.000000f alpha:1.000000f]) fc_withSystemName:@"linkColor"]; }
-    if ([name isEqualToString:@"tertiarySystemFillColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.462745f green:0.462745f blue:0.501961f alpha:0.240000f] : [UIColor colorWithRed:0.462745f green:0.462745f blue:0.501961f alpha:0.120000f]) fc_withSystemName:@"tertiarySystemFillColor"]; }
-    if ([name isEqualToString:@"systemFillColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.470588f green:0.470588f blue:0.501961f alpha:0.360000f] : [UIColor colorWithRed:0.470588f green:0.470588f blue:0.501961f alpha:0.200000f]) fc_withSystemName:@"systemFillColor"]; }
-    if ([name isEqualToString:@"secondarySystemFillColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.470588f green:0.470588f blue:0.501961f alpha:0.320000f] : [UIColor colorWithRed:0.470588f green:0.470588f blue:0.501961f alpha:0.160000f]) fc_withSystemName:@"secondarySystemFillColor"]; }
-    if ([name isEqualToString:@"secondarySystemBackgroundColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.109804f green:0.109804f blue:0.117647f alpha:1.000000f] : [UIColor colorWithRed:0.949020f green:0.949020f blue:0.968627f alpha:1.000000f]) fc_withSystemName:@"secondarySystemBackgroundColor"]; }
-    if ([name isEqualToString:@"tertiarySystemBackgroundColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.172549f green:0.172549f blue:0.180392f alpha:1.000000f] : [UIColor colorWithRed:1.000000f green:1.000000f blue:1.000000f alpha:1.000000f]) fc_withSystemName:@"tertiarySystemBackgroundColor"]; }
-    if ([name isEqualToString:@"systemGroupedBackgroundColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.000000f green:0.000000f blue:0.000000f alpha:1.000000f] : [UIColor colorWithRed:0.949020f green:0.949020f blue:0.968627f alpha:1.000000f]) fc_withSystemName:@"systemGroupedBackgroundColor"]; }
-    if ([name isEqualToString:@"tertiarySystemGroupedBackgroundColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.172549f green:0.172549f blue:0.180392f alpha:1.000000f] : [UIColor colorWithRed:0.949020f green:0.949020f blue:0.968627f alpha:1.000000f]) fc_withSystemName:@"tertiarySystemGroupedBackgroundColor"]; }
-    if ([name isEqualToString:@"systemOrangeColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:1.000000f green:0.623529f blue:0.039216f alpha:1.000000f] : [UIColor colorWithRed:1.000000f green:0.584314f blue:0.000000f alpha:1.000000f]) fc_withSystemName:@"systemOrangeColor"]; }
-    if ([name isEqualToString:@"tertiaryLabelColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.921569f green:0.921569f blue:0.960784f alpha:0.300000f] : [UIColor colorWithRed:0.235294f green:0.235294f blue:0.262745f alpha:0.300000f]) fc_withSystemName:@"tertiaryLabelColor"]; }
-    if ([name isEqualToString:@"systemYellowColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:1.000000f green:0.839216f blue:0.039216f alpha:1.000000f] : [UIColor colorWithRed:1.000000f green:0.800000f blue:0.000000f alpha:1.000000f]) fc_withSystemName:@"systemYellowColor"]; }
-    if ([name isEqualToString:@"systemPinkColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:1.000000f green:0.215686f blue:0.372549f alpha:1.000000f] : [UIColor colorWithRed:1.000000f green:0.176471f blue:0.333333f alpha:1.000000f]) fc_withSystemName:@"systemPinkColor"]; }
-    if ([name isEqualToString:@"systemMintColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.388235f green:0.901961f blue:0.886275f alpha:1.000000f] : [UIColor colorWithRed:0.000000f green:0.780392f blue:0.745098f alpha:1.000000f]) fc_withSystemName:@"systemMintColor"]; }
-    if ([name isEqualToString:@"systemCyanColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.392157f green:0.823529f blue:1.000000f alpha:1.000000f] : [UIColor colorWithRed:0.196078f green:0.678431f blue:0.901961f alpha:1.000000f]) fc_withSystemName:@"systemCyanColor"]; }
-    if ([name isEqualToString:@"systemTealColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.250980f green:0.784314f blue:0.878431f alpha:1.000000f] : [UIColor colorWithRed:0.188235f green:0.690196f blue:0.780392f alpha:1.000000f]) fc_withSystemName:@"systemTealColor"]; }
-    if ([name isEqualToString:@"systemPurpleColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.749020f green:0.352941f blue:0.949020f alpha:1.000000f] : [UIColor colorWithRed:0.686275f green:0.321569f blue:0.870588f alpha:1.000000f]) fc_withSystemName:@"systemPurpleColor"]; }
-    if ([name isEqualToString:@"systemIndigoColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.368627f green:0.360784f blue:0.901961f alpha:1.000000f] : [UIColor colorWithRed:0.345098f green:0.337255f blue:0.839216f alpha:1.000000f]) fc_withSystemName:@"systemIndigoColor"]; }
-    if ([name isEqualToString:@"systemBrownColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.674510f green:0.556863f blue:0.407843f alpha:1.000000f] : [UIColor colorWithRed:0.635294f green:0.517647f blue:0.368627f alpha:1.000000f]) fc_withSystemName:@"systemBrownColor"]; }
-    if ([name isEqualToString:@"quaternaryLabelColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.921569f green:0.921569f blue:0.960784f alpha:0.160000f] : [UIColor colorWithRed:0.235294f green:0.235294f blue:0.262745f alpha:0.180000f]) fc_withSystemName:@"quaternaryLabelColor"]; }
-    if ([name isEqualToString:@"placeholderTextColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.921569f green:0.921569f blue:0.960784f alpha:0.300000f] : [UIColor colorWithRed:0.235294f green:0.235294f blue:0.262745f alpha:0.300000f]) fc_withSystemName:@"placeholderTextColor"]; }
-    if ([name isEqualToString:@"opaqueSeparatorColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.219608f green:0.219608f blue:0.227451f alpha:1.000000f] : [UIColor colorWithRed:0.776471f green:0.776471f blue:0.784314f alpha:1.000000f]) fc_withSystemName:@"opaqueSeparatorColor"]; }
-    if ([name isEqualToString:@"quaternarySystemFillColor"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.462745f green:0.462745f blue:0.501961f alpha:0.180000f] : [UIColor colorWithRed:0.454902f green:0.454902f blue:0.501961f alpha:0.080000f]) fc_withSystemName:@"quaternarySystemFillColor"]; }
-    if ([name isEqualToString:@"systemGray2Color"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.388235f green:0.388235f blue:0.400000f alpha:1.000000f] : [UIColor colorWithRed:0.682353f green:0.682353f blue:0.698039f alpha:1.000000f]) fc_withSystemName:@"systemGray2Color"]; }
-    if ([name isEqualToString:@"systemGray3Color"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.282353f green:0.282353f blue:0.290196f alpha:1.000000f] : [UIColor colorWithRed:0.780392f green:0.780392f blue:0.800000f alpha:1.000000f]) fc_withSystemName:@"systemGray3Color"]; }
-    if ([name isEqualToString:@"systemGray4Color"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.227451f green:0.227451f blue:0.235294f alpha:1.000000f] : [UIColor colorWithRed:0.819608f green:0.819608f blue:0.839216f alpha:1.000000f]) fc_withSystemName:@"systemGray4Color"]; }
-    if ([name isEqualToString:@"systemGray5Color"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.172549f green:0.172549f blue:0.180392f alpha:1.000000f] : [UIColor colorWithRed:0.898039f green:0.898039f blue:0.917647f alpha:1.000000f]) fc_withSystemName:@"systemGray5Color"]; }
-    if ([name isEqualToString:@"systemGray6Color"]) { return [(theme == FCUserInterfaceStyleDark ? [UIColor colorWithRed:0.109804f green:0.109804f blue:0.117647f alpha:1.000000f] : [UIColor colorWithRed:0.949020f green:0.949020f blue:0.968627f alpha:1.000000f]) fc_withSystemName:@"systemGray6Color"]; }
-
-    return nil;
++ (UIColor * _Nonnull)fc_systemRedColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(68, theme); }
++ (UIColor * _Nonnull)fc_systemGreenColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(110, theme); }
++ (UIColor * _Nonnull)fc_systemBlueColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(16, theme); }
++ (UIColor * _Nonnull)fc_labelColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(33, theme); }
++ (UIColor * _Nonnull)fc_systemGrayColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(28, theme); }
++ (UIColor * _Nonnull)fc_systemBackgroundColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(71, theme); }
++ (UIColor * _Nonnull)fc_secondarySystemGroupedBackgroundColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(63, theme); }
++ (UIColor * _Nonnull)fc_secondaryLabelColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(93, theme); }
++ (UIColor * _Nonnull)fc_separatorColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(101, theme); }
++ (UIColor * _Nonnull)fc_linkColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(120, theme); }
++ (UIColor * _Nonnull)fc_tertiarySystemFillColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(32, theme); }
++ (UIColor * _Nonnull)fc_systemFillColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(57, theme); }
++ (UIColor * _Nonnull)fc_secondarySystemFillColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(3, theme); }
++ (UIColor * _Nonnull)fc_secondarySystemBackgroundColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(40, theme); }
++ (UIColor * _Nonnull)fc_tertiarySystemBackgroundColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(21, theme); }
++ (UIColor * _Nonnull)fc_systemGroupedBackgroundColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(37, theme); }
++ (UIColor * _Nonnull)fc_tertiarySystemGroupedBackgroundColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(96, theme); }
++ (UIColor * _Nonnull)fc_systemOrangeColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(108, theme); }
++ (UIColor * _Nonnull)fc_tertiaryLabelColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(52, theme); }
++ (UIColor * _Nonnull)fc_systemYellowColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(11, theme); }
++ (UIColor * _Nonnull)fc_systemPinkColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(41, theme); }
++ (UIColor * _Nonnull)fc_systemMintColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(92, theme); }
++ (UIColor * _Nonnull)fc_systemCyanColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(97, theme); }
++ (UIColor * _Nonnull)fc_systemTealColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(36, theme); }
++ (UIColor * _Nonnull)fc_systemPurpleColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(75, theme); }
++ (UIColor * _Nonnull)fc_systemIndigoColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(20, theme); }
++ (UIColor * _Nonnull)fc_systemBrownColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(100, theme); }
++ (UIColor * _Nonnull)fc_quaternaryLabelColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(72, theme); }
++ (UIColor * _Nonnull)fc_placeholderTextColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(8, theme); }
++ (UIColor * _Nonnull)fc_opaqueSeparatorColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(62, theme); }
++ (UIColor * _Nonnull)fc_quaternarySystemFillColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(56, theme); }
++ (UIColor * _Nonnull)fc_systemGray2ColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(66, theme); }
++ (UIColor * _Nonnull)fc_systemGray3ColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(76, theme); }
++ (UIColor * _Nonnull)fc_systemGray4ColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(46, theme); }
++ (UIColor * _Nonnull)fc_systemGray5ColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(1, theme); }
++ (UIColor * _Nonnull)fc_systemGray6ColorWithTheme:(FCUserInterfaceStyle)theme { return FCSystemColorAtSlot(114, theme); }
+
++ (UIColor * _Nullable)fc_systemColorWithName:(NSString * _Nonnull)name theme:(FCUserInterfaceStyle)theme
+{
+    NSInteger slot = FCSystemColorSlotForNameString(name);
+    return slot >= 0 ? FCSystemColorAtSlot(slot, theme) : nil;
 }
 
 @end
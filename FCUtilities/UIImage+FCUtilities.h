@@ -6,11 +6,28 @@
 #import <UIKit/UIKit.h>
 #import <QuartzCore/QuartzCore.h>
 
+// A chain of effects, rendered in one pass into one bitmap that becomes the output image without a copy, instead of a graphics context per effect.
+// Each step applies to everything rendered before it. Safe to build and apply on any queue.
+//
+//   [image fc_imageByApplyingEffects:[[FCImageEffects.effects desaturated] roundedWithCornerRadius:8]]
+//
+@interface FCImageEffects : NSObject
++ (instancetype _Nonnull)effects;
+
+// Each appends a step and returns the receiver
+- (FCImageEffects * _Nonnull)tintedWithColor:(UIColor * _Nonnull)color;                                     // same as fc_tintedImageUsingColor:
+- (FCImageEffects * _Nonnull)desaturated;                                                                   // same as fc_desaturatedImage
+- (FCImageEffects * _Nonnull)roundedWithCornerRadius:(CGFloat)cornerRadius;                                 // same as fc_imageWithJonyIveRoundedCornerRadius:
+- (FCImageEffects * _Nonnull)paddedWithColor:(UIColor * _Nonnull)color insets:(UIEdgeInsets)insets;         // same as fc_imagePaddedWithColor:insets:
+@end
+
 @interface UIImage (FCUtilities)
 
 // Decoding and resizing image data, usable from any thread or queue
 + (UIImage * _Nullable)fc_decodedImageFromData:(NSData * _Nonnull)data;
 + (UIImage * _Nullable)fc_decodedImageFromData:(NSData * _Nonnull)data resizedToMaxOutputDimension:(int)outputDimension;
+// Downsampled to the smallest size that covers pixelSize in both dimensions (e.g. for aspect-fill), never upscaled
++ (UIImage * _Nullable)fc_decodedImageFromData:(NSData * _Nonnull)data resizedToFillPixelSize:(CGSize)pixelSize;
 + (UIImage * _Nullable)fc_decodedImageFromData:(NSData * _Nonnull)data resizedToMaxOutputDimension:(int)outputDimension maxSourceBytes:(int)maxSourceBytes maxSourceDimension:(int)maxSourceDimension onlyIfCommonSourceFormat:(BOOL)onlyIfCommonSourceFormat;
 
 // Masked images are resource images that you provide in black (or any color) on a transparent background.
@@ -29,7 +46,9 @@
 + (UIImage * _Nonnull)fc_solidColorImageWithSize:(CGSize)size color:(UIColor * _Nonnull)solidColor;
 + (UIImage * _Nonnull)fc_solidColorImageWithSize:(CGSize)size scale:(CGFloat)scale color:(UIColor * _Nonnull)solidColor;
 
-// Basic effects
+// Basic effects. To apply several, FCImageEffects is faster than chaining these.
+
+- (UIImage * _Nonnull)fc_imageByApplyingEffects:(FCImageEffects * _Nonnull)effects;
 
 - (UIImage * _Nonnull)fc_desaturatedImage;
 - (UIImage * _Nonnull)fc_tintedImageUsingColor:(UIColor * _Nonnull)tintColor;
@@ -4,90 +4,168 @@
 //
 
 #import "UIImage+FCUtilities.h"
-@import UniformTypeIdentifiers;
+#import "FCImageHeader.h"
+#import "FCImageKernels.h"
+
+typedef NS_ENUM(NSInteger, FCImageEffectType) {
+    FCImageEffectTypeTint = 0,
+    FCImageEffectTypeDesaturate,
+    FCImageEffectTypeRoundCorners,
+    FCImageEffectTypePad,
+};
+
+@interface FCImageEffectStep : NSObject {
+@public
+    FCImageEffectType type;
+    FCImageKernelColor color;
+    CGFloat cornerRadius;
+    UIEdgeInsets insets;
+}
+@end
+@implementation FCImageEffectStep
+@end
 
-@implementation UIImage (FCUtilities)
+@interface FCImageEffects ()
+@property (nonatomic) NSMutableArray<FCImageEffectStep *> *steps;
+@end
 
-static BOOL FCDataLooksLikeHTMLDocument(NSData *data) {
-    if (data.length < 4) return NO;
+@implementation FCImageEffects
 
-    const unsigned char *bytes = data.bytes;
-    NSUInteger i = 0;
-    while (i < data.length) {
-        unsigned char c = bytes[i];
-        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
-            i++;
-            continue;
-        }
-        break;
++ (instancetype)effects { return [self new]; }
+
+- (instancetype)init
+{
+    if ( (self = [super init]) ) {
+        _steps = [NSMutableArray array];
     }
-    if (i >= data.length || bytes[i] != '<') return NO;
-
-    NSUInteger probeLen = MIN((NSUInteger)64, data.length - i);
-    NSData *probeData = [NSData dataWithBytes:&bytes[i] length:probeLen];
-    NSString *probe = [[NSString alloc] initWithData:probeData encoding:NSASCIIStringEncoding].lowercaseString;
-    if (! probe.length) return NO;
-
-    return (
-        [probe hasPrefix:@"<!doctype html"] ||
-        [probe hasPrefix:@"<html"] ||
-        [probe hasPrefix:@"<head"] ||
-        [probe hasPrefix:@"<body"]
-    );
+    return self;
 }
 
-+ (UIImage * _Nullable)fc_decodedImageFromData:(NSData * _Nonnull)data
+static FCImageKernelColor FCImageKernelColorFromColor(UIColor *color)
 {
-    return [self fc_decodedImageFromData:data resizedToMaxOutputDimension:0 maxSourceBytes:0 maxSourceDimension:0 onlyIfCommonSourceFormat:NO];
+    CGFloat r = 0, g = 0, b = 0, a = 0;
+    if (! [color getRed:&r green:&g blue:&b alpha:&a]) {
+        CGFloat white = 0;
+        if ([color getWhite:&white alpha:&a]) r = g = b = white;
+    }
+
+    // Extended-range components are clamped, as drawing into an 8-bit sRGB context would
+    a = MAX(0, MIN(1, a));
+    return (FCImageKernelColor) {
+        (uint8_t) lround(MAX(0, MIN(1, r)) * a * 255), (uint8_t) lround(MAX(0, MIN(1, g)) * a * 255),
+        (uint8_t) lround(MAX(0, MIN(1, b)) * a * 255), (uint8_t) lround(a * 255)
+    };
 }
 
-+ (UIImage * _Nullable)fc_decodedImageFromData:(NSData * _Nonnull)data resizedToMaxOutputDimension:(int)outputDimension
+- (FCImageEffectStep *)appendStepOfType:(FCImageEffectType)type
 {
-    return [self fc_decodedImageFromData:data resizedToMaxOutputDimension:outputDimension maxSourceBytes:0 maxSourceDimension:0 onlyIfCommonSourceFormat:NO];
+    FCImageEffectStep *step = [FCImageEffectStep new];
+    step->type = type;
+    [_steps addObject:step];
+    return step;
 }
-+ (UIImage * _Nullable)fc_decodedImageFromData:(NSData * _Nonnull)data resizedToMaxOutputDimension:(int)outputDimension maxSourceBytes:(int)maxSourceBytes maxSourceDimension:(int)maxSourceDimension onlyIfCommonSourceFormat:(BOOL)onlyIfCommonSourceFormat
+
+- (FCImageEffects *)tintedWithColor:(UIColor *)color
+{
+    [self appendStepOfType:FCImageEffectTypeTint]->color = FCImageKernelColorFromColor(color);
+    return self;
+}
+
+- (FCImageEffects *)desaturated
+{
+    [self appendStepOfType:FCImageEffectTypeDesaturate];
+    return self;
+}
+
+- (FCImageEffects *)roundedWithCornerRadius:(CGFloat)cornerRadius
+{
+    [self appendStepOfType:FCImageEffectTypeRoundCorners]->cornerRadius = cornerRadius;
+    return self;
+}
+
+- (FCImageEffects *)paddedWithColor:(UIColor *)color insets:(UIEdgeInsets)insets
+{
+    // Only ever adds size to the image, doesn't remove it
+    FCImageEffectStep *step = [self appendStepOfType:FCImageEffectTypePad];
+    step->color = FCImageKernelColorFromColor(color);
+    step->insets = UIEdgeInsetsMake(ABS(insets.top), ABS(insets.left), ABS(insets.bottom), ABS(insets.right));
+    return self;
+}
+
+@end
+
+
+static FCImageKernelRect FCImageKernelRectFromRect(CGRect rect, CGFloat scale, size_t width, size_t height)
+{
+    size_t minX = (size_t) MIN(width, MAX(0, round(CGRectGetMinX(rect) * scale)));
+    size_t minY = (size_t) MIN(height, MAX(0, round(CGRectGetMinY(rect) * scale)));
+    size_t maxX = (size_t) MIN(width, MAX(minX, round(CGRectGetMaxX(rect) * scale)));
+    size_t maxY = (size_t) MIN(height, MAX(minY, round(CGRectGetMaxY(rect) * scale)));
+    return (FCImageKernelRect) { minX, minY, maxX - minX, maxY - minY };
+}
+
+
+@implementation UIImage (FCUtilities)
+
+static UIImage *FCDecodedImageFromData(NSData *data, int outputDimension, CGSize fillPixelSize, int maxSourceBytes, int maxSourceDimension, BOOL onlyIfCommonSourceFormat)
 {
     if (! data.length) return nil;
     if (maxSourceBytes > 0 && data.length > maxSourceBytes) return nil;
-    if (FCDataLooksLikeHTMLDocument(data)) return nil;
+
+    // Reject non-images, unwanted formats and oversized images from the header bytes alone, before any ImageIO work
+    FCImageHeaderInfo header;
+    FCImageFormat format = FCImageHeaderProbe(data.bytes, data.length, &header);
+    if (format == FCImageFormatHTML) return nil;
+    if (onlyIfCommonSourceFormat && ! FCImageFormatIsCommon(format)) return nil; // avoid huge CPU/RAM usage of more-obscure, less-optimized formats like JPEG 2000
+    if (maxSourceDimension > 0 && ((int64_t) header.width > maxSourceDimension || (int64_t) header.height > maxSourceDimension)) return nil;
 
     CGImageSourceRef imageSource = CGImageSourceCreateWithData((__bridge CFDataRef) data, (__bridge CFDictionaryRef) @{
         ((__bridge NSString *) kCGImageSourceShouldCache) : @NO
     });
     if (! imageSource) return nil;
 
-    if (onlyIfCommonSourceFormat) {
-        // JPEG and PNG only to avoid huge CPU/RAM usage when using more-obscure, less-optimized formats like JPEG 2000
-        CFStringRef uti = CGImageSourceGetType(imageSource);
-        UTType *utt = uti ? [UTType typeWithIdentifier:(__bridge NSString * _Nonnull)(uti)] : nil;
-        if (! utt || (
-            ! [utt conformsToType:UTTypeJPEG] &&
-            ! [utt conformsToType:UTTypePNG] &&
-            ! [utt conformsToType:UTTypeGIF]
+    int sourceWidth = (int) MIN(header.width, INT_MAX);
+    int sourceHeight = (int) MIN(header.height, INT_MAX);
+    int orientation = 0; // EXIF, from ImageIO's properties; 0 until read
+    BOOL needsSourceDimensions = maxSourceDimension > 0 || outputDimension > 0 || (fillPixelSize.width > 0 && fillPixelSize.height > 0);
+    if (needsSourceDimensions && ! sourceWidth) {
+        // Header not parseable here (unusual format or layout): fall back to ImageIO's properties
+        CFDictionaryRef dictRef = CGImageSourceCopyPropertiesAtIndex(imageSource, 0, NULL);
+        if (! dictRef) {
+            CFRelease(imageSource);
+            return nil;
+        }
+
+        NSDictionary *dict = (__bridge NSDictionary *)dictRef;
+        sourceWidth = [dict[(__bridge NSString *) kCGImagePropertyPixelWidth] intValue];
+        sourceHeight = [dict[(__bridge NSString *) kCGImagePropertyPixelHeight] intValue];
+        orientation = MAX(1, [dict[(__bridge NSString *) kCGImagePropertyOrientation] intValue]);
+        CFRelease(dictRef);
+
+        if (maxSourceDimension > 0 && (
+            sourceWidth <= 0 || sourceHeight <= 0 || sourceWidth > maxSourceDimension || sourceHeight > maxSourceDimension
         )) {
             CFRelease(imageSource);
             return nil;
         }
     }
 
-    CFDictionaryRef dictRef = CGImageSourceCopyPropertiesAtIndex(imageSource, 0, NULL);
-    if (! dictRef) {
-        CFRelease(imageSource);
-        return nil;
-    }
-    
-    NSDictionary *dict = (__bridge NSDictionary *)dictRef;
-    int sourceWidth = [dict[(__bridge NSString *) kCGImagePropertyPixelWidth] intValue];
-    int sourceHeight = [dict[(__bridge NSString *) kCGImagePropertyPixelHeight] intValue];
-    CFRelease(dictRef);
-
-    if (maxSourceDimension > 0 && (
-        sourceWidth <= 0 || sourceHeight <= 0 || sourceWidth > maxSourceDimension || sourceHeight > maxSourceDimension
-    )) {
-        CFRelease(imageSource);
-        return nil;
+    if (fillPixelSize.width > 0 && fillPixelSize.height > 0 && sourceWidth > 0 && sourceHeight > 0) {
+        // The thumbnail is created with its EXIF transform applied, so for orientations 5-8 (quarter turns) the stored
+        //  width becomes the displayed height. Header dimensions are as stored, so fetch the orientation if we don't have it.
+        if (! orientation) {
+            CFDictionaryRef dictRef = CGImageSourceCopyPropertiesAtIndex(imageSource, 0, NULL);
+            orientation = dictRef ? MAX(1, [((__bridge NSDictionary *) dictRef)[(__bridge NSString *) kCGImagePropertyOrientation] intValue]) : 1;
+            if (dictRef) CFRelease(dictRef);
+        }
+        BOOL quarterTurn = orientation >= 5 && orientation <= 8;
+        int displayedWidth = quarterTurn ? sourceHeight : sourceWidth, displayedHeight = quarterTurn ? sourceWidth : sourceHeight;
+
+        // Smallest output that still covers fillPixelSize in both dimensions, expressed as a long-side limit
+        double fillScale = MAX(fillPixelSize.width / displayedWidth, fillPixelSize.height / displayedHeight);
+        outputDimension = (int) ceil(MAX(displayedWidth, displayedHeight) * fillScale);
     }
-    
+
     CGImageRef decodedImage;
     UIImage *outputImage = nil;
     if (outputDimension > 0 && MAX(sourceWidth, sourceHeight) > outputDimension) {
@@ -112,6 +190,26 @@ static BOOL FCDataLooksLikeHTMLDocument(NSData *data) {
     return outputImage;
 }
 
++ (UIImage * _Nullable)fc_decodedImageFromData:(NSData * _Nonnull)data
+{
+    return [self fc_decodedImageFromData:data resizedToMaxOutputDimension:0 maxSourceBytes:0 maxSourceDimension:0 onlyIfCommonSourceFormat:NO];
+}
+
++ (UIImage * _Nullable)fc_decodedImageFromData:(NSData * _Nonnull)data resizedToMaxOutputDimension:(int)outputDimension
+{
+    return [self fc_decodedImageFromData:data resizedToMaxOutputDimension:outputDimension maxSourceBytes:0 maxSourceDimension:0 onlyIfCommonSourceFormat:NO];
+}
+
++ (UIImage * _Nullable)fc_decodedImageFromData:(NSData * _Nonnull)data resizedToFillPixelSize:(CGSize)pixelSize
+{
+    return FCDecodedImageFromData(data, 0, pixelSize, 0, 0, NO);
+}
+
++ (UIImage * _Nullable)fc_decodedImageFromData:(NSData * _Nonnull)data resizedToMaxOutputDimension:(int)outputDimension maxSourceBytes:(int)maxSourceBytes maxSourceDimension:(int)maxSourceDimension onlyIfCommonSourceFormat:(BOOL)onlyIfCommonSourceFormat
+{
+    return FCDecodedImageFromData(data, outputDimension, CGSizeZero, maxSourceBytes, maxSourceDimension, onlyIfCommonSourceFormat);
+}
+
 + (UIImage *)fc_stretchableImageWithSolidColor:(UIColor *)solidColor
 {
     UIGraphicsBeginImageContext(CGSizeMake(1, 1));
@@ -145,59 +243,89 @@ static BOOL FCDataLooksLikeHTMLDocument(NSData *data) {
     return drawnImage;
 }
 
+- (UIImage *)fc_imageByApplyingEffects:(FCImageEffects *)effects
+{
+    CGSize size = self.size;
+    CGFloat scale = self.scale;
+    if (size.width <= 0 || size.height <= 0 || ! effects.steps.count) return self;
+
+    // Padding grows the canvas: find its final size and where the image starts within it
+    UIEdgeInsets totalInsets = UIEdgeInsetsZero;
+    for (FCImageEffectStep *step in effects.steps) {
+        if (step->type != FCImageEffectTypePad) continue;
+        totalInsets = UIEdgeInsetsMake(totalInsets.top + step->insets.top, totalInsets.left + step->insets.left, totalInsets.bottom + step->insets.bottom, totalInsets.right + step->insets.right);
+    }
+    CGRect contentRect = CGRectMake(totalInsets.left, totalInsets.top, size.width, size.height);
+    size_t width = (size_t) ceil((size.width + totalInsets.left + totalInsets.right) * scale);
+    size_t height = (size_t) ceil((size.height + totalInsets.top + totalInsets.bottom) * scale);
+    size_t bytesPerRow = (width * 4 + 63) & ~(size_t) 63;
+
+    // Rendered in place and then handed to the output image as-is, so each render allocates and writes its bitmap once
+    NSMutableData *bitmap = [NSMutableData dataWithLength:bytesPerRow * height];
+    if (! bitmap) return self;
+    uint8_t *pixels = bitmap.mutableBytes;
+
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    CGContextRef ctx = CGBitmapContextCreate(pixels, width, height, 8, bytesPerRow, colorSpace, kCGImageAlphaPremultipliedLast | kCGBitmapByteOrder32Big);
+    if (! ctx) {
+        CGColorSpaceRelease(colorSpace);
+        return self;
+    }
+
+    // The only Core Graphics work: one draw of the source, in top-left-origin points to match the buffer's row order
+    CGContextTranslateCTM(ctx, 0, height);
+    CGContextScaleCTM(ctx, scale, -scale);
+    UIGraphicsPushContext(ctx);
+    [self drawInRect:contentRect];
+    UIGraphicsPopContext();
+    CGContextRelease(ctx);
+
+    for (FCImageEffectStep *step in effects.steps) {
+        if (step->type == FCImageEffectTypePad) {
+            contentRect = CGRectMake(
+                contentRect.origin.x - step->insets.left, contentRect.origin.y - step->insets.top,
+                contentRect.size.width + step->insets.left + step->insets.right, contentRect.size.height + step->insets.top + step->insets.bottom
+            );
+        }
+
+        FCImageKernelRect rect = FCImageKernelRectFromRect(contentRect, scale, width, height);
+        switch (step->type) {
+            case FCImageEffectTypeTint:         FCImageKernelFillAtop(pixels, bytesPerRow, rect, step->color); break;
+            case FCImageEffectTypeDesaturate:   FCImageKernelDesaturate(pixels, bytesPerRow, rect); break;
+            case FCImageEffectTypeRoundCorners: FCImageKernelRoundCorners(pixels, bytesPerRow, rect, step->cornerRadius * scale); break;
+            case FCImageEffectTypePad:          FCImageKernelFillBehind(pixels, bytesPerRow, rect, step->color); break;
+        }
+    }
+
+    CGDataProviderRef provider = CGDataProviderCreateWithCFData((__bridge CFDataRef) bitmap);
+    CGImageRef cgImage = CGImageCreate(width, height, 8, 32, bytesPerRow, colorSpace, kCGImageAlphaPremultipliedLast | kCGBitmapByteOrder32Big, provider, NULL, false, kCGRenderingIntentDefault);
+    CGDataProviderRelease(provider);
+    CGColorSpaceRelease(colorSpace);
+    if (! cgImage) return self;
+
+    UIImage *result = [UIImage imageWithCGImage:cgImage scale:scale orientation:UIImageOrientationUp];
+    CGImageRelease(cgImage);
+    return result;
+}
+
 - (UIImage *)fc_maskedImageWithColor:(UIColor *)color
 {
-    CGRect rect = CGRectMake(0, 0, self.size.width, self.size.height);
-    UIGraphicsBeginImageContextWithOptions(rect.size, NO, self.scale);
-    CGContextRef c = UIGraphicsGetCurrentContext();
-    [self drawInRect:rect];
-    CGContextSetFillColorWithColor(c, [color CGColor]);
-    CGContextSetBlendMode(c, kCGBlendModeSourceAtop);
-    CGContextFillRect(c, rect);
-    UIImage *result = UIGraphicsGetImageFromCurrentImageContext();
-    UIGraphicsEndImageContext();
-	return result;
+    return [self fc_imageByApplyingEffects:[FCImageEffects.effects tintedWithColor:color]];
 }
 
 + (UIImage *)fc_maskedImageNamed:(NSString *)name color:(UIColor *)color
 {
-    UIImage *image = [UIImage imageNamed:name];
-    CGRect rect = CGRectMake(0, 0, image.size.width, image.size.height);
-    UIGraphicsBeginImageContextWithOptions(rect.size, NO, image.scale);
-    CGContextRef c = UIGraphicsGetCurrentContext();
-    [image drawInRect:rect];
-    CGContextSetFillColorWithColor(c, [color CGColor]);
-    CGContextSetBlendMode(c, kCGBlendModeSourceAtop);
-    CGContextFillRect(c, rect);
-    UIImage *result = UIGraphicsGetImageFromCurrentImageContext();
-    UIGraphicsEndImageContext();
-	return result;
+    return [[UIImage imageNamed:name] fc_maskedImageWithColor:color];
 }
 
 - (UIImage *)fc_desaturatedImage
 {
-    CGRect rect = CGRectMake(0, 0, self.size.width, self.size.height);
-    UIGraphicsBeginImageContextWithOptions(rect.size, NO, self.scale);
-    CGContextRef c = UIGraphicsGetCurrentContext();
-    [self drawInRect:rect];
-    CGContextSetFillColorWithColor(c, [UIColor blackColor].CGColor);
-    CGContextSetBlendMode(c, kCGBlendModeSaturation);
-    CGContextFillRect(c, rect);
-    UIImage *result = UIGraphicsGetImageFromCurrentImageContext();
-    UIGraphicsEndImageContext();
-	return result;
+    return [self fc_imageByApplyingEffects:[FCImageEffects.effects desaturated]];
 }
 
 - (UIImage *)fc_tintedImageUsingColor:(UIColor *)tintColor
 {
-    UIGraphicsBeginImageContextWithOptions(self.size, NO, self.scale);
-    CGRect drawRect = CGRectMake(0, 0, self.size.width, self.size.height);
-    [self drawInRect:drawRect];
-    [tintColor set];
-    UIRectFillUsingBlendMode(drawRect, kCGBlendModeSourceAtop);
-    UIImage *tintedImage = UIGraphicsGetImageFromCurrentImageContext();
-    UIGraphicsEndImageContext();
-    return [UIImage imageWithCGImage:tintedImage.CGImage scale:self.scale orientation:UIImageOrientationUp];
+    return [self fc_imageByApplyingEffects:[FCImageEffects.effects tintedWithColor:tintColor]];
 }
 
 + (UIImage *)fc_imageWithSize:(CGSize)size drawing:(void (^)(void))drawingCommands
@@ -235,13 +363,7 @@ static BOOL FCDataLooksLikeHTMLDocument(NSData *data) {
 
 - (UIImage *)fc_imageWithJonyIveRoundedCornerRadius:(CGFloat)cornerRadius
 {
-    CGRect rect = CGRectMake(0, 0, self.size.width, self.size.height);
-    UIGraphicsBeginImageContextWithOptions(rect.size, NO, self.scale);
-    [[UIBezierPath bezierPathWithRoundedRect:rect byRoundingCorners:UIRectCornerAllCorners cornerRadii:CGSizeMake(cornerRadius, cornerRadius)] addClip];
-    [self drawInRect:rect];
-    UIImage *result = UIGraphicsGetImageFromCurrentImageContext();
-    UIGraphicsEndImageContext();
-	return result;
+    return [self fc_imageByApplyingEffects:[FCImageEffects.effects roundedWithCornerRadius:cornerRadius]];
 }
 
 - (UIImage *)fc_imageWithJonyIveRoundedCornerRadius:(CGFloat)borderCornerRadius borderColor:(UIColor *)borderColor borderWidth:(CGFloat)borderWidth
@@ -280,20 +402,7 @@ static BOOL FCDataLooksLikeHTMLDocument(NSData *data) {
 
 - (UIImage * _Nonnull)fc_imagePaddedWithColor:(UIColor * _Nonnull)color insets:(UIEdgeInsets)insets
 {
-    // Only ever adds size to the image, doesn't remove it
-    insets.top = ABS(insets.top);
-    insets.bottom = ABS(insets.bottom);
-    insets.left = ABS(insets.left);
-    insets.right = ABS(insets.right);
-    
-    CGSize originalSize = self.size;
-    CGSize newSize = CGSizeMake(originalSize.width + (insets.left + insets.right), originalSize.height + (insets.top + insets.bottom));
-    return [self.class fc_imageWithSize:newSize drawing:^{
-        CGRect entireImageRect = CGRectMake(0, 0, newSize.width, newSize.height);
-        [color setFill];
-        [[UIBezierPath bezierPathWithRect:entireImageRect] fill];
-        [self drawInRect:UIEdgeInsetsInsetRect(entireImageRect, insets)];
-    }];
+    return [self fc_imageByApplyingEffects:[FCImageEffects.effects paddedWithColor:color insets:insets]];
 }
 
 
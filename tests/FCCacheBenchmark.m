@@ -0,0 +1,110 @@
+//
+//  FCCacheBenchmark.m
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+//  Hit rate and throughput of FCCache's LRU eviction against the clear-on-full policy it replaced,
+//   on a cache-aside workload: look up a Zipfian key, and set it on a miss.
+//
+
+#import <Foundation/Foundation.h>
+#import "FCCache.h"
+#include <stdatomic.h>
+#include "FCTestSupport.h"
+
+// The previous FCCache: one dictionary on a serial queue, emptied whenever it reaches the limit
+@interface FCClearOnFullCache : NSObject
+- (instancetype)initWithItemLimit:(NSUInteger)itemLimit;
+- (id)objectForKey:(id)key;
+- (void)setObject:(id)obj forKey:(id)key;
+@end
+
+@implementation FCClearOnFullCache {
+    NSUInteger limit;
+    NSMutableDictionary *backingStore;
+    dispatch_queue_t queue;
+}
+
+- (instancetype)initWithItemLimit:(NSUInteger)itemLimit
+{
+    if ( (self = [super init]) ) {
+        limit = itemLimit;
+        backingStore = [NSMutableDictionary dictionary];
+        queue = dispatch_queue_create("FCClearOnFullCache", DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+
+- (id)objectForKey:(id)key
+{
+    __block id value;
+    dispatch_sync(queue, ^{ value = [backingStore objectForKey:key]; });
+    return value;
+}
+
+- (void)setObject:(id)obj forKey:(id)key
+{
+    dispatch_barrier_async(queue, ^{
+        if (limit && backingStore.count >= limit) [backingStore removeAllObjects];
+        [backingStore setObject:obj forKey:key];
+    });
+}
+
+@end
+
+
+static const uint32_t keyCount = 100000;
+static const NSUInteger operationCount = 2000000;
+
+typedef struct { double hitRate; double opsPerSecond; } FCCacheBenchmarkResult;
+
+// Each thread replays its own slice of one shared trace, so both policies see identical requests
+static FCCacheBenchmarkResult run(id cache, NSArray *keys, const uint32_t *trace, size_t threads)
+{
+    atomic_ulong hits = 0, *sharedHits = &hits;
+    NSUInteger perThread = operationCount / threads;
+    double start = fct_now();
+    dispatch_apply(threads, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t t) {
+        unsigned long localHits = 0;
+        const uint32_t *slice = trace + t * perThread;
+        for (NSUInteger i = 0; i < perThread; i++) {
+            NSNumber *key = keys[slice[i]];
+            if ([cache objectForKey:key]) localHits++;
+            else [cache setObject:key forKey:key];
+        }
+        atomic_fetch_add(sharedHits, localHits);
+    });
+    double elapsed = fct_now() - start;
+    return (FCCacheBenchmarkResult) { (double) atomic_load(&hits) / (double) (perThread * threads), (double) (perThread * threads) / elapsed };
+}
+
+int main(int argc, char **argv)
+{
+    @autoreleasepool {
+        NSMutableArray *keys = [NSMutableArray arrayWithCapacity:keyCount];
+        for (uint32_t i = 0; i < keyCount; i++) [keys addObject:@(i)];
+
+        uint64_t seed = 0x5EEDULL;
+        FCTZipf zipf = fct_zipf_create(keyCount, 0.99);
+        uint32_t *trace = malloc(sizeof(uint32_t) * operationCount);
+        for (NSUInteger i = 0; i < operationCount; i++) trace[i] = fct_zipf_next(&zipf, &seed);
+        fct_zipf_destroy(&zipf);
+
+        printf("%u keys, Zipf s=0.99, %lu operations\n", keyCount, (unsigned long) operationCount);
+        printf("%8s %7s %16s %16s %14s %14s\n", "limit", "threads", "clear-on-full", "LRU", "clear ops/s", "LRU ops/s");
+        for (NSNumber *limitNumber in @[ @1000, @5000, @10000 ]) {
+            NSUInteger limit = limitNumber.unsignedIntegerValue;
+            for (size_t threads = 1; threads <= 4; threads *= 4) {
+                FCClearOnFullCache *clearing = [[FCClearOnFullCache alloc] initWithItemLimit:limit];
+                FCCache *lru = [FCCache new];
+                lru.itemLimit = limit;
+
+                FCCacheBenchmarkResult before = run(clearing, keys, trace, threads);
+                FCCacheBenchmarkResult after = run(lru, keys, trace, threads);
+                printf("%8lu %7zu %15.1f%% %15.1f%% %14.0f %14.0f\n", (unsigned long) limit, threads,
+                    before.hitRate * 100.0, after.hitRate * 100.0, before.opsPerSecond, after.opsPerSecond);
+            }
+        }
+        free(trace);
+    }
+    return 0;
+}
@@ -0,0 +1,183 @@
+//
+//  FCColorMathTests.c
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+//  Checks the float core against the APCA reference math in double precision and the contrast search's guarantees.
+//   --bench times a 1,000-color theme switch: every color adjusted against the new background and blended over it.
+//
+
+#include "FCColorMath.h"
+#include "FCTestSupport.h"
+#include <math.h>
+
+static FCColorRGBA randomColor(uint64_t *seed)
+{
+    return (FCColorRGBA) { (float) fct_random_unit(seed), (float) fct_random_unit(seed), (float) fct_random_unit(seed), (fct_random(seed) % 4) ? 1.0f : (float) fct_random_unit(seed) };
+}
+
+// MARK: - References
+
+// SAPC 0.98G-4g, as UIColor+FCUtilities computed it before the C core, in double precision
+static double referenceLuminance(double r, double g, double b)
+{
+    return pow(r, 2.4) * 0.2126729 + pow(g, 2.4) * 0.7151522 + pow(b, 2.4) * 0.0721750;
+}
+
+static double referenceContrast(FCColorRGBA text, FCColorRGBA background)
+{
+    double beta = 1.0 - text.a;
+    double textY = referenceLuminance(background.r * beta + text.r * text.a, background.g * beta + text.g * text.a, background.b * beta + text.b * text.a);
+    double backgroundY = referenceLuminance(background.r, background.g, background.b);
+
+    if (textY <= 0.22)       textY += pow(0.22 - textY, 1.414);
+    if (backgroundY <= 0.22) textY += pow(0.22 - backgroundY, 1.414);
+    if (fabs(backgroundY - textY) < 0.0005) return 0;
+
+    double sapc = backgroundY > textY ? pow(backgroundY, 0.56) - pow(textY, 0.57) : pow(backgroundY, 0.65) - pow(textY, 0.62);
+    if (sapc < 0.001) return 0;
+    if (sapc < 0.035991) return sapc - sapc * 27.7847239587675 * 0.027;
+    return sapc - 0.027;
+}
+
+// MARK: - Tests
+
+static void testReferenceValues(void)
+{
+    FCColorRGBA white = { 1, 1, 1, 1 }, black = { 0, 0, 0, 1 };
+    FCT_CHECK(fabsf(FCColorAPCALuminance(white) - 1.0f) < 1e-5f && FCColorAPCALuminance(black) == 0.0f);
+    FCT_CHECK(fabsf(FCColorAPCAContrast(black, white) - 0.6779f) < 1e-3f); // with this formula's 0.22 soft clamp
+    FCT_CHECK(FCColorAPCAContrast(white, white) == 0.0f);
+
+    FCColorRGBA half = FCColorBlend(white, (FCColorRGBA) { 0, 0, 0, 0.5f });
+    FCT_CHECK(fabsf(half.r - 0.5f) < 1e-6f && half.a == 1.0f);
+
+    uint64_t seed = 0xC0102;
+    for (int i = 0; i < 200000; i++) {
+        FCColorRGBA text = randomColor(&seed), background = randomColor(&seed);
+        background.a = 1.0f;
+        FCT_CHECK(fabs(FCColorAPCALuminance(text) - referenceLuminance(text.r, text.g, text.b)) < 1e-5);
+        FCT_CHECK(fabs(FCColorAPCAContrast(text, background) - referenceContrast(text, background)) < 2e-3);
+    }
+}
+
+static void testMinimumContrast(void)
+{
+    uint64_t seed = 0x3111;
+    FCColorRGBA backgrounds[] = { { 1, 1, 1, 1 }, { 0, 0, 0, 1 }, { 0.11f, 0.11f, 0.12f, 1 }, { 0.95f, 0.9f, 0.8f, 1 } };
+    for (int i = 0; i < 20000; i++) {
+        FCColorRGBA color = randomColor(&seed), background = backgrounds[i % 4];
+        float minContrast = 0.3f + (float) fct_random_unit(&seed) * 0.6f;
+        bool changed = true;
+        FCColorRGBA adjusted = FCColorWithMinimumAPCAContrast(color, background, minContrast, &changed);
+
+        float before = FCColorAPCAContrast(color, background);
+        if (before >= minContrast) {
+            FCT_CHECK(! changed && memcmp(&adjusted, &color, sizeof(color)) == 0);
+        } else {
+            // Either it got there, or it stopped where a step no longer changed the contrast (e.g. clamped at black or
+            //  white), which for a color starting at 0 is immediately
+            FCT_CHECK(changed == (before > 0));
+        }
+        FCT_CHECK(adjusted.r >= 0 && adjusted.r <= 1 && adjusted.g >= 0 && adjusted.g <= 1 && adjusted.b >= 0 && adjusted.b <= 1);
+        FCT_CHECK(adjusted.a == color.a);
+    }
+
+    // Mid-gray on white can reach Lc 60 by darkening
+    bool changed = false;
+    FCColorRGBA gray = FCColorWithMinimumAPCAContrast((FCColorRGBA) { 0.6f, 0.6f, 0.6f, 1 }, (FCColorRGBA) { 1, 1, 1, 1 }, 0.6f, &changed);
+    FCT_CHECK(changed && gray.r < 0.6f && FCColorAPCAContrast(gray, (FCColorRGBA) { 1, 1, 1, 1 }) >= 0.6f);
+}
+
+static void testBatches(void)
+{
+    enum { count = 1000 };
+    uint64_t seed = 0xBA7C;
+    float colors[count * 4], out[count * 4], inPlace[count * 4];
+    bool changed[count];
+    for (int i = 0; i < count; i++) {
+        FCColorRGBA c = randomColor(&seed);
+        memcpy(colors + i * 4, &c, sizeof(c));
+    }
+    memcpy(inPlace, colors, sizeof(colors));
+
+    FCColorRGBA background = { 0.1f, 0.1f, 0.12f, 1 };
+    FCColorApplyMinimumAPCAContrast(colors, out, count, background, 0.6f, changed);
+    FCColorApplyMinimumAPCAContrast(inPlace, inPlace, count, background, 0.6f, NULL);
+    FCT_CHECK(memcmp(out, inPlace, sizeof(out)) == 0);
+    for (int i = 0; i < count; i++) {
+        bool single;
+        FCColorRGBA expected = FCColorWithMinimumAPCAContrast((FCColorRGBA) { colors[i * 4], colors[i * 4 + 1], colors[i * 4 + 2], colors[i * 4 + 3] }, background, 0.6f, &single);
+        FCT_CHECK(memcmp(&expected, out + i * 4, sizeof(expected)) == 0 && single == changed[i]);
+    }
+
+    FCColorBlendOverBackground(colors, out, count, background);
+    for (int i = 0; i < count; i++) {
+        FCColorRGBA expected = FCColorBlend(background, (FCColorRGBA) { colors[i * 4], colors[i * 4 + 1], colors[i * 4 + 2], colors[i * 4 + 3] });
+        FCT_CHECK(memcmp(&expected, out + i * 4, sizeof(expected)) == 0);
+    }
+}
+
+// MARK: - Benchmark
+
+static void bench(void)
+{
+    // A theme's worth of text, tint and fill colors, switched between a light and a dark background
+    enum { count = 1000, switches = 200 };
+    uint64_t seed = 0x7E3E;
+    float *palette = malloc(count * 4 * sizeof(float)), *adjusted = malloc(count * 4 * sizeof(float)), *blended = malloc(count * 4 * sizeof(float));
+    bool *changed = malloc(count);
+    for (int i = 0; i < count; i++) {
+        FCColorRGBA c = randomColor(&seed);
+        memcpy(palette + i * 4, &c, sizeof(c));
+    }
+    FCColorRGBA themes[2] = { { 1, 1, 1, 1 }, { 0.11f, 0.11f, 0.12f, 1 } };
+
+    // Timed per theme. Light text on a dark background scores 0 in this SAPC variant, so the search gives up on it at once
+    const char *names[2] = { "to light", "to dark" };
+    double *samples = malloc(switches / 2 * sizeof(double));
+    for (int theme = 0; theme < 2; theme++) {
+        size_t adjustedCount = 0;
+        double total = 0;
+        for (int s = 0; s < switches / 2; s++) {
+            double start = fct_now();
+            FCColorApplyMinimumAPCAContrast(palette, adjusted, count, themes[theme], 0.6f, changed);
+            FCColorBlendOverBackground(adjusted, blended, count, themes[theme]);
+            samples[s] = fct_now() - start;
+            total += samples[s];
+            for (int i = 0; i < count; i++) adjustedCount += changed[i];
+        }
+        printf("1,000-color switch %-8s mean %.3f ms, p99 %.3f ms (%.0f%% of colors adjusted)\n", names[theme],
+            total / (switches / 2) * 1e3, fct_percentile(samples, switches / 2, 0.99) * 1e3, 100.0 * adjustedCount / ((double) count * (switches / 2)));
+    }
+
+    // Per color through the single-color call, as a caller without the batch form would
+    double start = fct_now();
+    for (int s = 0; s < switches; s++) {
+        for (int i = 0; i < count; i++) {
+            const float *p = palette + i * 4;
+            FCColorRGBA c = FCColorWithMinimumAPCAContrast((FCColorRGBA) { p[0], p[1], p[2], p[3] }, themes[s % 2], 0.6f, NULL);
+            c = FCColorBlend(themes[s % 2], c);
+            memcpy(blended + i * 4, &c, sizeof(c));
+        }
+    }
+    printf("  one color at a time, both themes: mean %.3f ms per switch\n", (fct_now() - start) / switches * 1e3);
+
+    free(samples);
+    free(changed);
+    free(blended);
+    free(adjusted);
+    free(palette);
+}
+
+int main(int argc, char **argv)
+{
+    if (fct_has_flag(argc, argv, "--bench")) {
+        bench();
+    } else {
+        testReferenceValues();
+        testMinimumContrast();
+        testBatches();
+        printf("FCColorMath: all tests passed\n");
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+//
+//  FCConcurrentMutableDictionaryBenchmark.m
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+//  Snapshot latency after a write, from 1k to 1M entries, against copying an NSMutableDictionary (what every snapshot
+//   taken after a write used to cost). Snapshots should stay flat; copies grow linearly.
+//
+
+#import <Foundation/Foundation.h>
+#import "FCConcurrentMutableDictionary.h"
+#include "FCTestSupport.h"
+
+static const size_t samples = 2000;
+
+int main(int argc, char **argv)
+{
+    printf("%9s %14s %14s %14s %14s %14s\n", "entries", "write µs", "snapshot p50", "snapshot p99", "lookup µs", "copy p50");
+    for (NSUInteger entries = 1000; entries <= 1000000; entries *= 10) {
+        @autoreleasepool {
+            NSMutableDictionary *contents = [NSMutableDictionary dictionaryWithCapacity:entries];
+            for (NSUInteger i = 0; i < entries; i++) contents[@(i)] = @(i);
+            FCConcurrentMutableDictionary *dictionary = [FCConcurrentMutableDictionary dictionary];
+            [dictionary setObjectsFromDictionary:contents];
+
+            double *snapshotTimes = malloc(sizeof(double) * samples), *copyTimes = malloc(sizeof(double) * samples);
+            double writeTime = 0, lookupTime = 0;
+            uint64_t seed = entries;
+            for (size_t s = 0; s < samples; s++) {
+                NSNumber *key = @(fct_random(&seed) % entries), *value = @(s);
+
+                double t0 = fct_now();
+                dictionary[key] = value;
+                double t1 = fct_now();
+                NSDictionary *snapshot = dictionary.dictionarySnapshot;
+                double t2 = fct_now();
+                FCT_CHECK([snapshot[key] isEqual:value] && snapshot.count == entries);
+                double t3 = fct_now();
+                writeTime += t1 - t0;
+                snapshotTimes[s] = t2 - t1;
+                lookupTime += t3 - t2;
+
+                // Copies are far slower at 1M, so sample them less often
+                if (entries < 1000000 || s % 20 == 0) {
+                    contents[key] = value;
+                    double c0 = fct_now();
+                    NSDictionary *copy = [contents copy];
+                    copyTimes[s] = fct_now() - c0;
+                    (void) copy;
+                } else {
+                    copyTimes[s] = -1;
+                }
+            }
+
+            size_t copySamples = 0;
+            for (size_t s = 0; s < samples; s++) if (copyTimes[s] >= 0) copyTimes[copySamples++] = copyTimes[s];
+            printf("%9lu %14.2f %13.2fµs %13.2fµs %14.2f %13.0fµs\n", (unsigned long) entries,
+                writeTime / samples * 1e6, fct_percentile(snapshotTimes, samples, 0.5) * 1e6, fct_percentile(snapshotTimes, samples, 0.99) * 1e6,
+                lookupTime / samples * 1e6, fct_percentile(copyTimes, copySamples, 0.5) * 1e6);
+            free(snapshotTimes);
+            free(copyTimes);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,324 @@
+//
+//  FCDiskLogTests.c
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+//  Persistence, torn tails, checksum failures, compaction, and clears racing compaction and appends.
+//  --stress runs readers against a writer that appends, compacts and clears. --bench times appends, opens and reads.
+//
+
+#include "FCDiskLog.h"
+#include "FCTestSupport.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+static char directory[] = "/tmp/FCDiskLogTests.XXXXXX";
+static char path[256];
+
+static void put(FCDiskLog *log, const char *key, const char *value)
+{
+    FCDiskLogEntry entry = { key, (uint32_t) strlen(key), value, value ? (uint32_t) strlen(value) : 0 };
+    FCT_CHECK(FCDiskLogAppend(log, &entry, 1, FCDiskLogGeneration(log)));
+}
+
+// Returns whether key reads back as expected (NULL: a miss)
+static int reads(FCDiskLog *log, const char *key, const char *expected)
+{
+    const uint8_t *value;
+    uint32_t length;
+    void *record = FCDiskLogRead(log, key, (uint32_t) strlen(key), &value, &length);
+    int matches = expected ? record && length == strlen(expected) && 0 == memcmp(value, expected, length) : ! record;
+    free(record);
+    return matches;
+}
+
+static FCDiskLog *reopen(FCDiskLog *log)
+{
+    FCDiskLogClose(log);
+    log = FCDiskLogOpen(path);
+    FCT_CHECK(log);
+    return log;
+}
+
+static void corruptByte(uint64_t offset)
+{
+    int fd = open(path, O_RDWR);
+    uint8_t byte;
+    FCT_CHECK(fd >= 0 && 1 == pread(fd, &byte, 1, (off_t) offset));
+    byte ^= 0x20;
+    FCT_CHECK(1 == pwrite(fd, &byte, 1, (off_t) offset));
+    close(fd);
+}
+
+static void appendRaw(const void *bytes, size_t length)
+{
+    int fd = open(path, O_WRONLY | O_APPEND);
+    FCT_CHECK(fd >= 0 && (ssize_t) length == write(fd, bytes, length));
+    close(fd);
+}
+
+static void testPersistence(void)
+{
+    unlink(path);
+    FCDiskLog *log = FCDiskLogOpen(path);
+    FCT_CHECK(log && FCDiskLogCount(log) == 0 && FCDiskLogFileSize(log) == 0);
+
+    put(log, "a", "1");
+    put(log, "b", "2");
+    put(log, "a", NULL);
+    put(log, "empty", "");
+    FCT_CHECK(reads(log, "a", NULL) && reads(log, "b", "2") && reads(log, "empty", ""));
+
+    FCDiskLogEntry batch[] = { { "c", 1, "3", 1 }, { "b", 1, "22", 2 }, { "c", 1, "33", 2 } };
+    FCT_CHECK(FCDiskLogAppend(log, batch, 3, FCDiskLogGeneration(log)));
+
+    log = reopen(log);
+    FCT_CHECK(FCDiskLogCount(log) == 3);
+    FCT_CHECK(reads(log, "a", NULL) && reads(log, "b", "22") && reads(log, "c", "33") && reads(log, "empty", ""));
+    FCDiskLogClose(log);
+}
+
+static void testTornTail(void)
+{
+    unlink(path);
+    FCDiskLog *log = FCDiskLogOpen(path);
+    put(log, "a", "alpha");
+    put(log, "b", "beta");
+    uint64_t intact = FCDiskLogFileSize(log);
+    FCDiskLogClose(log);
+
+    // Half a header
+    appendRaw("\x43\x44\x43\x46\x01\x00", 6);
+    log = reopen(NULL);
+    FCT_CHECK(FCDiskLogFileSize(log) == intact && reads(log, "a", "alpha") && reads(log, "b", "beta"));
+    FCDiskLogClose(log);
+
+    // A whole header promising more bytes than follow it
+    uint32_t header[4] = { 0x46434443u, 1, 100, 0 };
+    appendRaw(header, sizeof(header));
+    appendRaw("c-and-part-of-its-value", 23);
+    log = reopen(NULL);
+    FCT_CHECK(FCDiskLogFileSize(log) == intact && FCDiskLogCount(log) == 2);
+
+    // Appends continue right after the intact prefix and survive another open
+    put(log, "c", "gamma");
+    log = reopen(log);
+    FCT_CHECK(reads(log, "a", "alpha") && reads(log, "b", "beta") && reads(log, "c", "gamma"));
+    FCDiskLogClose(log);
+}
+
+static void testChecksumMismatch(void)
+{
+    unlink(path);
+    FCDiskLog *log = FCDiskLogOpen(path);
+    put(log, "a", "hello"); // record at 0: 16-byte header, key, value
+    put(log, "b", "world");
+    put(log, "c", "again");
+    uint64_t recordLength = 16 + 1 + 5;
+
+    corruptByte(16 + 1 + 2);                // a's value
+    corruptByte(recordLength + 16);         // b's key
+    FCT_CHECK(reads(log, "a", NULL) && reads(log, "b", NULL) && reads(log, "c", "again"));
+
+    // Still misses after reopening, and a fresh write of the key replaces the damaged record
+    log = reopen(log);
+    FCT_CHECK(reads(log, "a", NULL) && reads(log, "c", "again"));
+    put(log, "a", "fixed");
+    FCT_CHECK(reads(log, "a", "fixed"));
+    FCDiskLogClose(log);
+}
+
+static void testCompaction(void)
+{
+    unlink(path);
+    FCDiskLog *log = FCDiskLogOpen(path);
+    char key[16], value[128], big[4096];
+    memset(value, 'v', 99); value[99] = 0;
+    memset(big, 'B', sizeof(big) - 1); big[sizeof(big) - 1] = 0;
+
+    for (int i = 0; i < 100; i++) { snprintf(key, sizeof(key), "k%03d", i); put(log, key, value); }
+    for (int i = 0; i < 100; i += 2) { snprintf(key, sizeof(key), "k%03d", i); value[0] = 'w'; put(log, key, value); }
+    put(log, "big", big); // newest, but bigger than the whole budget
+    value[0] = 'v';
+
+    // Records are 16 + 4 + 99 = 119 bytes. The newest 25 fit in 3000 bytes: the 25 highest even keys, rewritten last.
+    FCT_CHECK(FCDiskLogCompact(log, 3000));
+    FCT_CHECK(FCDiskLogFileSize(log) == 25 * 119 && FCDiskLogCount(log) == 25);
+    FCT_CHECK(reads(log, "big", NULL));
+    value[0] = 'w';
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "k%03d", i);
+        int kept = i % 2 == 0 && i >= 50;
+        FCT_CHECK(reads(log, key, kept ? value : NULL));
+    }
+
+    // The index points into the new file, appends go after it, and all of it survives an open
+    put(log, "after", "compaction");
+    log = reopen(log);
+    FCT_CHECK(FCDiskLogCount(log) == 26 && reads(log, "after", "compaction") && reads(log, "k098", value));
+    FCT_CHECK(FCDiskLogFileSize(log) == 25 * 119 + 16 + 5 + 10);
+    FCDiskLogClose(log);
+}
+
+static void clearLog(FCDiskLog *log) { FCDiskLogClear(log); }
+
+static void testClearDuringCompaction(void)
+{
+    unlink(path);
+    FCDiskLog *log = FCDiskLogOpen(path);
+    for (int i = 0; i < 50; i++) { char key[16]; snprintf(key, sizeof(key), "k%d", i); put(log, key, "old"); }
+
+    FCDiskLogCompactionWillCommit = clearLog;
+    FCT_CHECK(! FCDiskLogCompact(log, 1 << 20));
+    FCDiskLogCompactionWillCommit = NULL;
+
+    char tempPath[300];
+    snprintf(tempPath, sizeof(tempPath), "%s.compacting", path);
+    FCT_CHECK(0 != access(tempPath, F_OK));
+    FCT_CHECK(FCDiskLogCount(log) == 0 && FCDiskLogFileSize(log) == 0 && reads(log, "k0", NULL));
+
+    // An append built before a clear is dropped, not written into the new file
+    uint64_t staleGeneration = FCDiskLogGeneration(log);
+    FCDiskLogClear(log);
+    FCDiskLogEntry stale = { "k1", 2, "stale", 5 };
+    FCT_CHECK(FCDiskLogAppend(log, &stale, 1, staleGeneration) && FCDiskLogFileSize(log) == 0);
+
+    put(log, "new", "value");
+    log = reopen(log);
+    FCT_CHECK(FCDiskLogCount(log) == 1 && reads(log, "new", "value") && reads(log, "k0", NULL) && reads(log, "k1", NULL));
+    FCDiskLogClose(log);
+}
+
+// MARK: - Stress
+
+static FCDiskLog *stressLog;
+static atomic_bool stressDone;
+static atomic_ulong stressReads, stressHits;
+
+// Values name their key, so a reader can tell if it was handed another key's record
+static void *stressReader(void *context)
+{
+    uint64_t seed = (uint64_t) (uintptr_t) context;
+    while (! atomic_load_explicit(&stressDone, memory_order_relaxed)) {
+        char key[16];
+        int keyLength = snprintf(key, sizeof(key), "key%llu", (unsigned long long) (fct_random(&seed) % 2000));
+        const uint8_t *value;
+        uint32_t length;
+        void *record = FCDiskLogRead(stressLog, key, (uint32_t) keyLength, &value, &length);
+        if (record) {
+            FCT_CHECK(length > (uint32_t) keyLength && 0 == memcmp(value, key, (size_t) keyLength) && value[keyLength] == ':');
+            atomic_fetch_add_explicit(&stressHits, 1, memory_order_relaxed);
+        }
+        free(record);
+        atomic_fetch_add_explicit(&stressReads, 1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+static void stress(double seconds)
+{
+    unlink(path);
+    stressLog = FCDiskLogOpen(path);
+    pthread_t readers[4];
+    for (uintptr_t i = 0; i < 4; i++) pthread_create(&readers[i], NULL, stressReader, (void *) (i + 1));
+
+    uint64_t seed = 42, batches = 0, compactions = 0, clears = 0;
+    char keys[32][16], values[32][256];
+    double end = fct_now() + seconds;
+    while (fct_now() < end) {
+        FCDiskLogEntry entries[32];
+        for (int i = 0; i < 32; i++) {
+            int keyLength = snprintf(keys[i], sizeof(keys[i]), "key%llu", (unsigned long long) (fct_random(&seed) % 2000));
+            int valueLength = snprintf(values[i], sizeof(values[i]), "%s:%llu", keys[i], (unsigned long long) batches);
+            int removal = fct_random(&seed) % 8 == 0;
+            entries[i] = (FCDiskLogEntry) { keys[i], (uint32_t) keyLength, removal ? NULL : values[i], (uint32_t) valueLength };
+        }
+        FCT_CHECK(FCDiskLogAppend(stressLog, entries, 32, FCDiskLogGeneration(stressLog)));
+        batches++;
+        if (FCDiskLogFileSize(stressLog) > 64 * 1024) { FCDiskLogCompact(stressLog, 48 * 1024); compactions++; }
+        if (fct_random(&seed) % 200 == 0) { FCDiskLogClear(stressLog); clears++; }
+    }
+
+    atomic_store(&stressDone, true);
+    for (int i = 0; i < 4; i++) pthread_join(readers[i], NULL);
+    printf("stress: %llu batches, %llu compactions, %llu clears, %lu reads (%lu hits)\n", (unsigned long long) batches,
+        (unsigned long long) compactions, (unsigned long long) clears, atomic_load(&stressReads), atomic_load(&stressHits));
+
+    // Whatever state the log ended in, it reopens to the same contents
+    size_t count = FCDiskLogCount(stressLog);
+    stressLog = reopen(stressLog);
+    FCT_CHECK(FCDiskLogCount(stressLog) == count);
+    FCDiskLogClose(stressLog);
+}
+
+// MARK: - Benchmark
+
+static void bench(void)
+{
+    enum { records = 100000, batchSize = 100, valueLength = 1024 };
+    unlink(path);
+    FCDiskLog *log = FCDiskLogOpen(path);
+    char value[valueLength], keys[batchSize][16];
+    memset(value, 'x', sizeof(value));
+
+    double start = fct_now();
+    for (int b = 0; b < records / batchSize; b++) {
+        FCDiskLogEntry entries[batchSize];
+        for (int i = 0; i < batchSize; i++) {
+            int keyLength = snprintf(keys[i], sizeof(keys[i]), "key%d", b * batchSize + i);
+            entries[i] = (FCDiskLogEntry) { keys[i], (uint32_t) keyLength, value, valueLength };
+        }
+        FCT_CHECK(FCDiskLogAppend(log, entries, batchSize, FCDiskLogGeneration(log)));
+    }
+    double appendTime = fct_now() - start;
+    double megabytes = (double) FCDiskLogFileSize(log) / 1e6;
+    printf("append: %d x %d-byte records in batches of %d: %.0f MB/s (fsync per batch)\n", records, valueLength, batchSize, megabytes / appendTime);
+
+    start = fct_now();
+    log = reopen(log);
+    printf("open: %.1f ms to index %zu records\n", (fct_now() - start) * 1e3, FCDiskLogCount(log));
+
+    uint64_t seed = 7;
+    enum { reads = 200000 };
+    start = fct_now();
+    for (int i = 0; i < reads; i++) {
+        char key[16];
+        int keyLength = snprintf(key, sizeof(key), "key%llu", (unsigned long long) (fct_random(&seed) % records));
+        const uint8_t *bytes;
+        uint32_t length;
+        void *record = FCDiskLogRead(log, key, (uint32_t) keyLength, &bytes, &length);
+        FCT_CHECK(record && length == valueLength);
+        free(record);
+    }
+    printf("read: %.0f random reads/s\n", reads / (fct_now() - start));
+
+    start = fct_now();
+    FCT_CHECK(FCDiskLogCompact(log, FCDiskLogFileSize(log) / 2));
+    printf("compact: %.1f ms to keep the newest half\n", (fct_now() - start) * 1e3);
+    FCDiskLogClose(log);
+}
+
+int main(int argc, char **argv)
+{
+    FCT_CHECK(mkdtemp(directory));
+    snprintf(path, sizeof(path), "%s/log", directory);
+
+    if (fct_has_flag(argc, argv, "--bench")) {
+        bench();
+    } else if (fct_has_flag(argc, argv, "--stress")) {
+        stress(5);
+    } else {
+        testPersistence();
+        testTornTail();
+        testChecksumMismatch();
+        testCompaction();
+        testClearDuringCompaction();
+        stress(1);
+        printf("FCDiskLog: all tests passed\n");
+    }
+
+    unlink(path);
+    rmdir(directory);
+    return 0;
+}
@@ -0,0 +1,92 @@
+//
+//  FCExecutorBenchmark.m
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+//  FCExecutor against NSOperationQueue (with plain block operations and with FCBlockOperation) and a concurrent
+//   dispatch queue: throughput for many tiny blocks, and submit-to-start latency percentiles in bursts.
+//
+
+#import <Foundation/Foundation.h>
+#import "NSOperationQueue+FCUtilities.h"
+#include "FCTestSupport.h"
+#include <stdatomic.h>
+
+// Each contender runs count blocks and returns once they've all finished. If submitted isn't NULL, it records each
+//  block's submit time there just before handing it over.
+typedef void (^FCExecutorBenchmarkSubmit)(NSUInteger count, double *submitted, void (^block)(NSUInteger index));
+
+static void report(const char *name, FCExecutorBenchmarkSubmit submit)
+{
+    enum { jobs = 500000, latencyJobs = 100000, burst = 100 };
+
+    // Empty blocks: scheduling overhead only
+    atomic_ulong ran = 0, *sharedRan = &ran;
+    double start = fct_now();
+    @autoreleasepool {
+        submit(jobs, NULL, ^(NSUInteger index) { atomic_fetch_add_explicit(sharedRan, 1, memory_order_relaxed); });
+    }
+    double elapsed = fct_now() - start;
+    FCT_CHECK(atomic_load(&ran) == jobs);
+
+    // Bursts keep the queue busy without letting it grow arbitrarily deep
+    double *latency = malloc(latencyJobs * sizeof(double));
+    double *submitted = malloc(burst * sizeof(double));
+    for (NSUInteger b = 0; b < latencyJobs; b += burst) {
+        @autoreleasepool {
+            double *burstLatency = latency + b;
+            submit(burst, submitted, ^(NSUInteger index) { burstLatency[index] = fct_now() - submitted[index]; });
+        }
+    }
+    free(submitted);
+
+    printf("%-32s %8.2fM blocks/s   latency p50 %6.1f us  p99 %7.1f us  p99.9 %8.1f us\n", name, jobs / elapsed / 1e6,
+        fct_percentile(latency, latencyJobs, 0.5) * 1e6, fct_percentile(latency, latencyJobs, 0.99) * 1e6, fct_percentile(latency, latencyJobs, 0.999) * 1e6);
+    free(latency);
+}
+
+int main(int argc, char **argv)
+{
+    @autoreleasepool {
+        NSUInteger cpus = NSProcessInfo.processInfo.activeProcessorCount;
+        printf("%lu CPUs, %lu workers or max concurrent operations\n", (unsigned long) cpus, (unsigned long) cpus);
+
+        FCExecutor *executor = [[FCExecutor alloc] initWithWorkerCount:cpus];
+        report("FCExecutor", ^(NSUInteger count, double *submitted, void (^block)(NSUInteger)) {
+            FCExecutorGroup *group = [FCExecutorGroup new];
+            for (NSUInteger i = 0; i < count; i++) {
+                if (submitted) submitted[i] = fct_now();
+                [executor addBlock:^{ block(i); } priority:FCExecutorPriorityDefault group:group];
+            }
+            [group waitUntilFinished];
+        });
+
+        NSOperationQueue *queue = [NSOperationQueue new];
+        queue.maxConcurrentOperationCount = (NSInteger) cpus;
+        report("NSOperationQueue", ^(NSUInteger count, double *submitted, void (^block)(NSUInteger)) {
+            for (NSUInteger i = 0; i < count; i++) {
+                if (submitted) submitted[i] = fct_now();
+                [queue addOperationWithBlock:^{ block(i); }];
+            }
+            [queue waitUntilAllOperationsAreFinished];
+        });
+
+        report("NSOperationQueue + FCBlockOperation", ^(NSUInteger count, double *submitted, void (^block)(NSUInteger)) {
+            for (NSUInteger i = 0; i < count; i++) {
+                if (submitted) submitted[i] = fct_now();
+                [queue addOperation:[FCBlockOperation operationWithBlock:^{ block(i); }]];
+            }
+            [queue waitUntilAllOperationsAreFinished];
+        });
+
+        dispatch_queue_t concurrent = dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0);
+        report("dispatch_group_async", ^(NSUInteger count, double *submitted, void (^block)(NSUInteger)) {
+            dispatch_group_t group = dispatch_group_create();
+            for (NSUInteger i = 0; i < count; i++) {
+                if (submitted) submitted[i] = fct_now();
+                dispatch_group_async(group, concurrent, ^{ block(i); });
+            }
+            dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+        });
+    }
+    return 0;
+}
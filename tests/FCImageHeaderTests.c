@@ -0,0 +1,212 @@
+//
+//  FCImageHeaderTests.c
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+//  Known headers for every format, every truncation of them, and a mutation fuzzer over exactly-sized heap copies so
+//   ASan catches any read past length. --bench times probes. Also builds as a libFuzzer target with -DFC_LIBFUZZER.
+//
+
+#include "FCImageHeader.h"
+#include "FCTestSupport.h"
+
+typedef struct {
+    const char *name;
+    uint8_t bytes[256];
+    size_t length;
+    FCImageFormat format;
+    uint32_t width, height;
+} FCImageHeaderSample;
+
+static FCImageHeaderSample samples[16];
+static size_t sampleCount;
+
+static void add(const char *name, const void *bytes, size_t length, FCImageFormat format, uint32_t width, uint32_t height)
+{
+    FCT_CHECK(sampleCount < sizeof(samples) / sizeof(samples[0]) && length <= sizeof(samples[0].bytes));
+    FCImageHeaderSample *sample = &samples[sampleCount++];
+    sample->name = name;
+    memcpy(sample->bytes, bytes, length);
+    sample->length = length;
+    sample->format = format;
+    sample->width = width;
+    sample->height = height;
+}
+
+static void makeSamples(void)
+{
+    // SOI, APP0 (JFIF), fill bytes, SOF0 with height 480 and width 640
+    static const uint8_t jpeg[] = {
+        0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0,
+        0xFF, 0xFF, 0xC0, 0x00, 0x11, 0x08, 0x01, 0xE0, 0x02, 0x80, 0x03, 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1,
+    };
+    add("jpeg", jpeg, sizeof(jpeg), FCImageFormatJPEG, 640, 480);
+
+    // DHT (C4) shares the SOF range and must be skipped, then progressive SOF2
+    static const uint8_t progressive[] = {
+        0xFF, 0xD8, 0xFF, 0xC4, 0x00, 0x04, 0x00, 0x00,
+        0xFF, 0xC2, 0x00, 0x11, 0x08, 0x0B, 0xB8, 0x0F, 0xA0, 0x03, 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1,
+    };
+    add("jpeg-progressive", progressive, sizeof(progressive), FCImageFormatJPEG, 4000, 3000);
+
+    static const uint8_t jpegNoFrame[] = { 0xFF, 0xD8, 0xFF, 0xDA, 0x00, 0x08, 1, 2, 3, 4, 5, 6 };
+    add("jpeg-scan-first", jpegNoFrame, sizeof(jpegNoFrame), FCImageFormatJPEG, 0, 0);
+
+    static const uint8_t png[] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n', 0, 0, 0, 13, 'I', 'H', 'D', 'R', 0, 0, 0x04, 0x38, 0, 0, 0x07, 0x80, 8, 6, 0, 0, 0,
+    };
+    add("png", png, sizeof(png), FCImageFormatPNG, 1080, 1920);
+
+    static const uint8_t gif[] = { 'G', 'I', 'F', '8', '9', 'a', 0x40, 0x01, 0xF0, 0x00, 0xF7, 0, 0 };
+    add("gif", gif, sizeof(gif), FCImageFormatGIF, 320, 240);
+
+    static const uint8_t webpLossy[] = {
+        'R', 'I', 'F', 'F', 0x24, 0, 0, 0, 'W', 'E', 'B', 'P', 'V', 'P', '8', ' ', 0x18, 0, 0, 0,
+        0x30, 0x01, 0x00, 0x9D, 0x01, 0x2A, 0x20, 0x03, 0x58, 0x02, 0, 0,
+    };
+    add("webp-lossy", webpLossy, sizeof(webpLossy), FCImageFormatWebP, 800, 600);
+
+    // 14-bit width-1 = 99, height-1 = 49
+    uint32_t bits = 99 | (49u << 14);
+    uint8_t webpLossless[] = {
+        'R', 'I', 'F', 'F', 0x1A, 0, 0, 0, 'W', 'E', 'B', 'P', 'V', 'P', '8', 'L', 0x0D, 0, 0, 0,
+        0x2F, (uint8_t) bits, (uint8_t) (bits >> 8), (uint8_t) (bits >> 16), (uint8_t) (bits >> 24), 0, 0, 0, 0, 0,
+    };
+    add("webp-lossless", webpLossless, sizeof(webpLossless), FCImageFormatWebP, 100, 50);
+
+    static const uint8_t webpExtended[] = {
+        'R', 'I', 'F', 'F', 0x24, 0, 0, 0, 'W', 'E', 'B', 'P', 'V', 'P', '8', 'X', 0x0A, 0, 0, 0,
+        0x10, 0, 0, 0, 0xFF, 0x0F, 0x00, 0x9F, 0x0B, 0x00,
+    };
+    add("webp-extended", webpExtended, sizeof(webpExtended), FCImageFormatWebP, 4096, 2976);
+
+    // ftyp (mif1, compatible heic), then meta > iprp > ipco with a thumbnail ispe and the larger primary ispe
+    static const uint8_t heif[] = {
+        0, 0, 0, 24, 'f', 't', 'y', 'p', 'm', 'i', 'f', '1', 0, 0, 0, 0, 'm', 'i', 'f', '1', 'h', 'e', 'i', 'c',
+        0, 0, 0, 68, 'm', 'e', 't', 'a', 0, 0, 0, 0,
+        0, 0, 0, 56, 'i', 'p', 'r', 'p',
+        0, 0, 0, 48, 'i', 'p', 'c', 'o',
+        0, 0, 0, 20, 'i', 's', 'p', 'e', 0, 0, 0, 0, 0, 0, 0x01, 0x40, 0, 0, 0, 0xF0,
+        0, 0, 0, 20, 'i', 's', 'p', 'e', 0, 0, 0, 0, 0, 0, 0x0F, 0xC0, 0, 0, 0x0B, 0xD0,
+    };
+    add("heif", heif, sizeof(heif), FCImageFormatHEIF, 4032, 3024);
+
+    static const uint8_t html[] = "\xEF\xBB\xBF \r\n<!DOCTYPE HTML><html><body>Sign in to Wi-Fi</body></html>";
+    add("html", html, sizeof(html) - 1, FCImageFormatHTML, 0, 0);
+
+    static const uint8_t text[] = "{\"error\":\"not found\"}";
+    add("json", text, sizeof(text) - 1, FCImageFormatUnknown, 0, 0);
+}
+
+// Probes an exactly-sized heap copy, so reading even one byte past length is an ASan error
+static FCImageFormat probe(const uint8_t *bytes, size_t length, FCImageHeaderInfo *info)
+{
+    uint8_t *copy = malloc(length ? length : 1);
+    memcpy(copy, bytes, length);
+    FCImageFormat format = FCImageHeaderProbe(copy, length, info);
+    free(copy);
+    FCT_CHECK(info->format == format && (info->width == 0) == (info->height == 0));
+    return format;
+}
+
+static void testSamples(void)
+{
+    for (size_t s = 0; s < sampleCount; s++) {
+        FCImageHeaderSample *sample = &samples[s];
+        FCImageHeaderInfo info;
+        if (probe(sample->bytes, sample->length, &info) != sample->format || info.width != sample->width || info.height != sample->height) {
+            fprintf(stderr, "%s: got format %d, %ux%u\n", sample->name, info.format, info.width, info.height);
+            exit(1);
+        }
+
+        // Truncated anywhere: never wrong, only unknown or missing dimensions
+        for (size_t length = 0; length < sample->length; length++) {
+            probe(sample->bytes, length, &info);
+            FCT_CHECK(info.format == sample->format || info.format == FCImageFormatUnknown);
+            if (info.width && (info.width != sample->width || info.height != sample->height)) { fprintf(stderr, "%s/%zu: %ux%u\n", sample->name, length, info.width, info.height); exit(1); }
+        }
+    }
+
+    FCImageHeaderInfo info = { FCImageFormatJPEG, 1, 1 };
+    FCT_CHECK(FCImageHeaderProbe(NULL, 100, &info) == FCImageFormatUnknown && info.width == 0);
+    FCT_CHECK(FCImageHeaderProbe(samples[0].bytes, samples[0].length, NULL) == FCImageFormatJPEG);
+}
+
+static void fuzz(uint64_t iterations)
+{
+    uint64_t seed = 0xF00D;
+    uint8_t buffer[512];
+    for (uint64_t n = 0; n < iterations; n++) {
+        FCImageHeaderSample *sample = &samples[fct_random(&seed) % sampleCount];
+        size_t length = sample->length;
+        memcpy(buffer, sample->bytes, length);
+
+        // A few mutations: flipped bits, interesting bytes (lengths of 0, 1 and maximum), inserted or removed runs
+        int mutations = 1 + (int) (fct_random(&seed) % 4);
+        for (int m = 0; m < mutations && length; m++) {
+            size_t at = fct_random(&seed) % length;
+            switch (fct_random(&seed) % 5) {
+                case 0: buffer[at] ^= (uint8_t) (1u << (fct_random(&seed) % 8)); break;
+                case 1: { static const uint8_t interesting[] = { 0, 1, 2, 0x7F, 0x80, 0xFF }; buffer[at] = interesting[fct_random(&seed) % 6]; break; }
+                case 2: if (length < sizeof(buffer) - 8) { memmove(buffer + at + 4, buffer + at, length - at); memset(buffer + at, 0xFF, 4); length += 4; } break;
+                case 3: { size_t run = 1 + fct_random(&seed) % 8; if (run > length - at) run = length - at; memmove(buffer + at, buffer + at + run, length - at - run); length -= run; break; }
+                case 4: length = at; break;
+            }
+        }
+
+        FCImageHeaderInfo info;
+        probe(buffer, length, &info);
+    }
+}
+
+static void bench(void)
+{
+    // A camera JPEG: a 60 KB EXIF segment (with an embedded thumbnail) comes before the frame header
+    size_t jpegLength = 4 + 2 + 60000 + samples[0].length;
+    uint8_t *jpeg = calloc(1, jpegLength);
+    memcpy(jpeg, "\xFF\xD8\xFF\xE1\xEA\x62", 6);
+    memcpy(jpeg + 6 + 59998, samples[0].bytes + 2, samples[0].length - 2);
+
+    struct { const char *name; const uint8_t *bytes; size_t length; } inputs[] = {
+        { "jpeg after 60 KB EXIF", jpeg, jpegLength },
+        { "png", samples[3].bytes, samples[3].length },
+        { "webp", samples[5].bytes, samples[5].length },
+        { "heif", samples[8].bytes, samples[8].length },
+        { "html", samples[9].bytes, samples[9].length },
+    };
+
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        enum { probes = 2000000 };
+        volatile uint32_t sink = 0;
+        double start = fct_now();
+        for (int n = 0; n < probes; n++) {
+            FCImageHeaderInfo info;
+            FCImageHeaderProbe(inputs[i].bytes, inputs[i].length, &info);
+            sink += info.width;
+        }
+        printf("%-22s %8.1f ns/probe\n", inputs[i].name, (fct_now() - start) / probes * 1e9);
+        (void) sink;
+    }
+    free(jpeg);
+}
+
+#ifdef FC_LIBFUZZER
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    FCImageHeaderInfo info;
+    FCImageHeaderProbe(data, size, &info);
+    return 0;
+}
+#else
+int main(int argc, char **argv)
+{
+    makeSamples();
+    if (fct_has_flag(argc, argv, "--bench")) {
+        bench();
+    } else {
+        testSamples();
+        fuzz(fct_has_flag(argc, argv, "--stress") ? 20000000 : 1000000);
+        printf("FCImageHeader: all tests passed\n");
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,230 @@
+//
+//  FCImageKernelsTests.c
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+//  Checks the SIMD paths (SSE2 on x86-64, NEON on ARM) against per-pixel references, over random premultiplied pixels
+//   and rects at every alignment, and that nothing outside the rect changes. --bench reports megapixels/s for each.
+//
+
+#include "FCImageKernels.h"
+#include "FCTestSupport.h"
+#include <math.h>
+
+typedef struct {
+    uint8_t *pixels;
+    size_t width, height, bytesPerRow;
+} FCTBitmap;
+
+static FCTBitmap bitmapCreate(size_t width, size_t height, size_t rowPadding, uint64_t *seed)
+{
+    FCTBitmap bitmap = { NULL, width, height, width * 4 + rowPadding };
+    bitmap.pixels = malloc(bitmap.bytesPerRow * height); // exact size, so ASan catches any write past the last row
+    for (size_t i = 0; i < bitmap.bytesPerRow * height; i += 4) {
+        uint8_t *p = bitmap.pixels + i;
+        unsigned kind = fct_random(seed) % 4;
+        p[3] = kind == 0 ? 0 : (kind == 1 ? 255 : (uint8_t) fct_random(seed)); // clear, opaque and partial
+        for (int c = 0; c < 3; c++) p[c] = p[3] ? (uint8_t) (fct_random(seed) % (p[3] + 1u)) : 0;
+    }
+    return bitmap;
+}
+
+static FCTBitmap bitmapCopy(FCTBitmap bitmap)
+{
+    FCTBitmap copy = bitmap;
+    copy.pixels = malloc(bitmap.bytesPerRow * bitmap.height);
+    memcpy(copy.pixels, bitmap.pixels, bitmap.bytesPerRow * bitmap.height);
+    return copy;
+}
+
+static FCImageKernelColor randomColor(uint64_t *seed)
+{
+    FCImageKernelColor color;
+    color.a = (fct_random(seed) % 3) ? (uint8_t) fct_random(seed) : 255;
+    color.r = (uint8_t) (fct_random(seed) % (color.a + 1u));
+    color.g = (uint8_t) (fct_random(seed) % (color.a + 1u));
+    color.b = (uint8_t) (fct_random(seed) % (color.a + 1u));
+    return color;
+}
+
+static int inRect(FCImageKernelRect rect, size_t x, size_t y)
+{
+    return x >= rect.x && x < rect.x + rect.width && y >= rect.y && y < rect.y + rect.height;
+}
+
+// MARK: - References
+
+// Straightforward per-pixel versions in floating point, which the kernels must match to within one step of rounding
+static uint8_t mul255(double a, double b) { return (uint8_t) floor(a * b / 255.0 + 0.5); }
+
+static void referenceFillAtop(uint8_t *p, FCImageKernelColor c)
+{
+    for (int i = 0; i < 3; i++) {
+        unsigned value = mul255((&c.r)[i], p[3]) + mul255(p[i], 255 - c.a);
+        p[i] = (uint8_t) (value > p[3] ? p[3] : value);
+    }
+}
+
+static void referenceFillBehind(uint8_t *p, FCImageKernelColor c)
+{
+    unsigned inverseDestinationAlpha = 255 - p[3];
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t) (p[i] + mul255((&c.r)[i], inverseDestinationAlpha));
+}
+
+static void referenceDesaturate(uint8_t *p)
+{
+    uint8_t gray = (uint8_t) floor(p[0] * 0.30 + p[1] * 0.59 + p[2] * 0.11 + 0.5);
+    p[0] = p[1] = p[2] = gray;
+}
+
+// MARK: - Tests
+
+typedef enum { FCTKernelFillAtop, FCTKernelFillBehind, FCTKernelDesaturate } FCTKernel;
+
+static void checkKernel(FCTKernel kernel, uint64_t *seed)
+{
+    // Odd widths, offsets and row paddings exercise every SIMD alignment and the scalar tail
+    size_t width = 1 + fct_random(seed) % 40, height = 1 + fct_random(seed) % 6;
+    FCTBitmap bitmap = bitmapCreate(width, height, (fct_random(seed) % 4) * 4, seed);
+    FCTBitmap expected = bitmapCopy(bitmap);
+    FCImageKernelRect rect;
+    rect.x = fct_random(seed) % width;
+    rect.y = fct_random(seed) % height;
+    rect.width = fct_random(seed) % (width - rect.x + 1);
+    rect.height = fct_random(seed) % (height - rect.y + 1);
+    FCImageKernelColor color = randomColor(seed);
+
+    switch (kernel) {
+        case FCTKernelFillAtop:   FCImageKernelFillAtop(bitmap.pixels, bitmap.bytesPerRow, rect, color); break;
+        case FCTKernelFillBehind: FCImageKernelFillBehind(bitmap.pixels, bitmap.bytesPerRow, rect, color); break;
+        case FCTKernelDesaturate: FCImageKernelDesaturate(bitmap.pixels, bitmap.bytesPerRow, rect); break;
+    }
+
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < bitmap.bytesPerRow / 4; x++) {
+            uint8_t *actual = bitmap.pixels + y * bitmap.bytesPerRow + x * 4, *reference = expected.pixels + y * bitmap.bytesPerRow + x * 4;
+            if (x < width && inRect(rect, x, y)) {
+                switch (kernel) {
+                    case FCTKernelFillAtop:   referenceFillAtop(reference, color); break;
+                    case FCTKernelFillBehind: referenceFillBehind(reference, color); break;
+                    case FCTKernelDesaturate: referenceDesaturate(reference); break;
+                }
+                FCT_CHECK(actual[3] == reference[3]);
+                for (int c = 0; c < 3; c++) FCT_CHECK(abs(actual[c] - reference[c]) <= 1 && actual[c] <= actual[3]); // still premultiplied
+            } else {
+                FCT_CHECK(memcmp(actual, reference, 4) == 0);
+            }
+        }
+    }
+    free(bitmap.pixels);
+    free(expected.pixels);
+}
+
+static void testKernels(int iterations)
+{
+    uint64_t seed = 0x1A9E;
+    for (int i = 0; i < iterations; i++) {
+        checkKernel(FCTKernelFillAtop, &seed);
+        checkKernel(FCTKernelFillBehind, &seed);
+        checkKernel(FCTKernelDesaturate, &seed);
+    }
+
+    // Exact endpoints
+    uint8_t p[4] = { 255, 255, 255, 255 };
+    FCImageKernelDesaturate(p, 4, (FCImageKernelRect) { 0, 0, 1, 1 });
+    FCT_CHECK(p[0] == 255 && p[1] == 255 && p[2] == 255);
+    FCImageKernelFillAtop(p, 4, (FCImageKernelRect) { 0, 0, 1, 1 }, (FCImageKernelColor) { 255, 0, 0, 255 });
+    FCT_CHECK(p[0] == 255 && p[1] == 0 && p[2] == 0 && p[3] == 255);
+    memset(p, 0, 4);
+    FCImageKernelFillBehind(p, 4, (FCImageKernelRect) { 0, 0, 1, 1 }, (FCImageKernelColor) { 0, 0, 128, 128 });
+    FCT_CHECK(p[0] == 0 && p[1] == 0 && p[2] == 128 && p[3] == 128);
+}
+
+static void testRoundCorners(void)
+{
+    uint64_t seed = 0xC042;
+    for (int i = 0; i < 2000; i++) {
+        size_t width = 1 + fct_random(&seed) % 48, height = 1 + fct_random(&seed) % 48;
+        FCTBitmap bitmap = bitmapCreate(width, height, 0, &seed);
+        for (size_t j = 0; j < width * height * 4; j++) bitmap.pixels[j] = 255; // opaque white shows coverage directly
+        double radius = fct_random_unit(&seed) * 30;
+        FCImageKernelRoundCorners(bitmap.pixels, bitmap.bytesPerRow, (FCImageKernelRect) { 0, 0, width, height }, radius);
+
+        double clamped = fmin(radius, fmin(width, height) / 2.0);
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                uint8_t *p = bitmap.pixels + y * bitmap.bytesPerRow + x * 4;
+                FCT_CHECK(p[0] == p[3] && p[1] == p[3] && p[2] == p[3]);
+
+                // Mirror-symmetric, and only the corner squares are touched
+                FCT_CHECK(p[3] == bitmap.pixels[y * bitmap.bytesPerRow + (width - 1 - x) * 4 + 3]);
+                FCT_CHECK(p[3] == bitmap.pixels[(height - 1 - y) * bitmap.bytesPerRow + x * 4 + 3]);
+                size_t cx = x < width - 1 - x ? x : width - 1 - x, cy = y < height - 1 - y ? y : height - 1 - y;
+                if (cx >= ceil(clamped) || cy >= ceil(clamped)) FCT_CHECK(p[3] == 255);
+
+                // Coverage falls off within about a pixel of the arc
+                if (clamped > 0 && cx < ceil(clamped) && cy < ceil(clamped)) {
+                    double dx = clamped - (cx + 0.5), dy = clamped - (cy + 0.5);
+                    if (dx > 0 && dy > 0) {
+                        double distance = sqrt(dx * dx + dy * dy) - clamped;
+                        if (distance >= 0.5) FCT_CHECK(p[3] == 0);
+                        if (distance <= -0.5) FCT_CHECK(p[3] == 255);
+                    }
+                }
+            }
+        }
+        free(bitmap.pixels);
+    }
+}
+
+// MARK: - Benchmark
+
+static void bench(void)
+{
+    // A 1200 × 1200 render, about a full-screen avatar or artwork at 3x
+    uint64_t seed = 0xBE7C;
+    FCTBitmap bitmap = bitmapCreate(1200, 1200, 0, &seed);
+    FCImageKernelRect all = { 0, 0, bitmap.width, bitmap.height };
+    FCImageKernelColor color = { 40, 80, 120, 200 };
+    double megapixels = bitmap.width * bitmap.height / 1e6;
+    enum { rounds = 50 };
+
+    const char *names[] = { "fill atop", "fill behind", "desaturate", "round corners (r = 60)" };
+    for (int kernel = 0; kernel < 4; kernel++) {
+        double start = fct_now();
+        for (int round = 0; round < rounds; round++) {
+            switch (kernel) {
+                case 0: FCImageKernelFillAtop(bitmap.pixels, bitmap.bytesPerRow, all, color); break;
+                case 1: FCImageKernelFillBehind(bitmap.pixels, bitmap.bytesPerRow, all, color); break;
+                case 2: FCImageKernelDesaturate(bitmap.pixels, bitmap.bytesPerRow, all); break;
+                case 3: FCImageKernelRoundCorners(bitmap.pixels, bitmap.bytesPerRow, all, 60); break;
+            }
+        }
+        double seconds = (fct_now() - start) / rounds;
+        if (kernel == 3) { printf("%-24s %8.3f ms per frame (corners only)\n", names[kernel], seconds * 1e3); continue; }
+        printf("%-24s %8.0f MP/s  (%.2f ms per frame)\n", names[kernel], megapixels / seconds, seconds * 1e3);
+
+        // The same work through the floating-point references, for scale
+        start = fct_now();
+        for (int round = 0; round < rounds; round++) {
+            for (size_t i = 0; i < bitmap.width * bitmap.height; i++) {
+                uint8_t *p = bitmap.pixels + i * 4;
+                if (kernel == 0) referenceFillAtop(p, color); else if (kernel == 1) referenceFillBehind(p, color); else referenceDesaturate(p);
+            }
+        }
+        double referenceSeconds = (fct_now() - start) / rounds;
+        printf("%-24s %8.0f MP/s  (%.1fx)\n", "  float reference", megapixels / referenceSeconds, referenceSeconds / seconds);
+    }
+    free(bitmap.pixels);
+}
+
+int main(int argc, char **argv)
+{
+    if (fct_has_flag(argc, argv, "--bench")) {
+        bench();
+    } else {
+        testKernels(fct_has_flag(argc, argv, "--stress") ? 200000 : 20000);
+        testRoundCorners();
+        printf("FCImageKernels: all tests passed\n");
+    }
+    return 0;
+}
@@ -0,0 +1,384 @@
+//
+//  FCPipeRingTests.c
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+//  Real cross-process runs: readers are forked children with their own mapping of the ring file, checking every payload.
+//   A paced writer must lose nothing; a flooding writer must produce overruns that account for every lost message, never
+//   corruption; two processes writing under FCPipeRingLockWriter must interleave cleanly. Then the message codec, with a
+//   decoder fuzzer over exact-size heap buffers for ASan. --stress runs everything longer; --bench reports throughput.
+//
+
+#include "FCPipeRing.h"
+#include "FCTestSupport.h"
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static char directory[] = "/tmp/FCPipeRingTests.XXXXXX";
+static char path[256];
+
+// Lengths 0-199 and contents both derived from the sequence number, so a reader can check any message on its own
+static uint32_t messageLength(uint32_t sequence) { return (sequence * 2654435761u) % 200; }
+
+static void fillMessage(uint8_t *bytes, uint32_t sequence, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++) bytes[i] = (uint8_t) (sequence + i);
+    if (length >= 4) memcpy(bytes, &sequence, 4);
+}
+
+static FCPipeRing *createRing(uint32_t capacity)
+{
+    unlink(path);
+    FCPipeRing *ring = FCPipeRingOpen(path, capacity);
+    FCT_CHECK(ring);
+    return ring;
+}
+
+// MARK: - Reader processes
+
+typedef struct {
+    uint64_t received, lost, overruns;
+} FCTReaderStats;
+
+typedef struct {
+    pid_t pid;
+    int statsPipe;
+} FCTReader;
+
+// Follows the ring from its oldest message until count messages are accounted for, pausing pauseMicroseconds every
+//  pauseEvery messages to fall behind on purpose. Checks every message; exits nonzero on any mismatch or corruption.
+static FCTReaderStats follow(uint32_t count, unsigned pauseEvery, unsigned pauseMicroseconds, int readyPipe)
+{
+    FCPipeRing *ring = FCPipeRingOpen(path, 0);
+    FCT_CHECK(ring);
+    FCPipeRingCursor cursor = FCPipeRingOldestCursor(ring);
+    uint8_t *buffer = malloc(FCPipeRingMaximumMessageLength(ring)), expected[256];
+    FCTReaderStats stats = { 0 };
+    uint32_t sequence = cursor.sequence;
+    FCT_CHECK(write(readyPipe, "r", 1) == 1);
+
+    while (stats.received + stats.lost < count) {
+        uint32_t length;
+        switch (FCPipeRingRead(ring, &cursor, buffer, &length)) {
+            case FCPipeRingReadEmpty:
+                sched_yield();
+                break;
+            case FCPipeRingReadOverrun:
+                FCT_CHECK(cursor.sequence > sequence);
+                stats.lost += cursor.sequence - sequence;
+                stats.overruns++;
+                sequence = cursor.sequence;
+                break;
+            case FCPipeRingReadCorrupt:
+                fprintf(stderr, "corrupt ring at sequence %u\n", sequence);
+                exit(1);
+            case FCPipeRingReadMessage:
+                FCT_CHECK(length == messageLength(sequence));
+                fillMessage(expected, sequence, length);
+                FCT_CHECK(memcmp(expected, buffer, length) == 0);
+                sequence++;
+                stats.received++;
+                if (pauseEvery && stats.received % pauseEvery == 0) usleep(pauseMicroseconds);
+                break;
+        }
+    }
+    free(buffer);
+    FCPipeRingClose(ring);
+    return stats;
+}
+
+// Returns once the reader has its cursor, so the writer can't get ahead of it before it starts
+static FCTReader startReader(uint32_t count, unsigned pauseEvery, unsigned pauseMicroseconds)
+{
+    int ready[2], stats[2];
+    FCT_CHECK(pipe(ready) == 0 && pipe(stats) == 0);
+    fflush(stdout);
+    pid_t pid = fork();
+    FCT_CHECK(pid >= 0);
+    if (pid == 0) {
+        close(ready[0]);
+        close(stats[0]);
+        FCTReaderStats result = follow(count, pauseEvery, pauseMicroseconds, ready[1]);
+        _exit(write(stats[1], &result, sizeof(result)) == sizeof(result) ? 0 : 1);
+    }
+
+    close(ready[1]);
+    close(stats[1]);
+    char byte;
+    FCT_CHECK(read(ready[0], &byte, 1) == 1);
+    close(ready[0]);
+    return (FCTReader) { pid, stats[0] };
+}
+
+static FCTReaderStats finishReader(FCTReader reader)
+{
+    FCTReaderStats stats;
+    FCT_CHECK(read(reader.statsPipe, &stats, sizeof(stats)) == sizeof(stats));
+    close(reader.statsPipe);
+    int status;
+    FCT_CHECK(waitpid(reader.pid, &status, 0) == reader.pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    return stats;
+}
+
+static void writeMessages(FCPipeRing *ring, uint32_t count, unsigned pauseEvery, unsigned pauseMicroseconds)
+{
+    uint8_t bytes[256];
+    for (uint32_t sequence = 0; sequence < count; sequence++) {
+        uint32_t length = messageLength(sequence);
+        fillMessage(bytes, sequence, length);
+        FCT_CHECK(FCPipeRingWrite(ring, bytes, length));
+        if (pauseEvery && sequence % pauseEvery == 0) usleep(pauseMicroseconds);
+    }
+}
+
+// MARK: - Tests
+
+static void testPacedWriterLosesNothing(uint32_t count)
+{
+    FCPipeRing *ring = createRing(1 << 20);
+    FCTReader reader = startReader(count, 0, 0);
+    writeMessages(ring, count, 16, 100);
+    FCTReaderStats stats = finishReader(reader);
+    FCT_CHECK(stats.received == count && stats.lost == 0 && stats.overruns == 0);
+
+    // Reopening keeps the ring's own capacity and position
+    FCPipeRingClose(ring);
+    ring = FCPipeRingOpen(path, 1 << 12);
+    FCT_CHECK(ring && FCPipeRingMaximumMessageLength(ring) == (1 << 20) / 4);
+    FCT_CHECK(FCPipeRingNewestCursor(ring).sequence == count);
+    uint8_t *tooLong = calloc(1, FCPipeRingMaximumMessageLength(ring) + 1);
+    FCT_CHECK(! FCPipeRingWrite(ring, tooLong, FCPipeRingMaximumMessageLength(ring) + 1));
+    free(tooLong);
+    FCPipeRingClose(ring);
+}
+
+static void testFloodOverrunsReaders(uint32_t count)
+{
+    // About 600 messages fit, so a reader that pauses is lapped many times
+    FCPipeRing *ring = createRing(1 << 16);
+    FCTReader slow = startReader(count, 1000, 200);
+    FCTReader fast = startReader(count, 0, 0);
+    double start = fct_now();
+    writeMessages(ring, count, 0, 0);
+    double elapsed = fct_now() - start;
+    FCTReaderStats slowStats = finishReader(slow), fastStats = finishReader(fast);
+    FCPipeRingClose(ring);
+
+    FCT_CHECK(slowStats.overruns > 0 && slowStats.received + slowStats.lost == count);
+    FCT_CHECK(fastStats.received + fastStats.lost == count);
+    printf("flood: %u messages at %.0f/s; slow reader got %llu in %llu overruns, fast reader got %llu in %llu\n", count, count / elapsed,
+        (unsigned long long) slowStats.received, (unsigned long long) slowStats.overruns, (unsigned long long) fastStats.received, (unsigned long long) fastStats.overruns);
+}
+
+static void lockedWriter(uint8_t id, uint32_t count)
+{
+    FCPipeRing *ring = FCPipeRingOpen(path, 0);
+    FCT_CHECK(ring);
+    uint8_t bytes[64];
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t length = 8 + i % 50;
+        memset(bytes, (uint8_t) (i + id), length);
+        bytes[0] = id;
+        memcpy(bytes + 1, &i, 4);
+        FCT_CHECK(FCPipeRingLockWriter(ring));
+        FCT_CHECK(FCPipeRingWrite(ring, bytes, length));
+        FCPipeRingUnlockWriter(ring);
+    }
+    FCPipeRingClose(ring);
+}
+
+static void testLockedWriters(uint32_t countPerWriter)
+{
+    FCPipeRing *ring = createRing(1 << 20);
+    FCPipeRingCursor cursor = FCPipeRingOldestCursor(ring);
+    pid_t writers[2];
+    fflush(stdout);
+    for (uint8_t id = 1; id <= 2; id++) {
+        FCT_CHECK((writers[id - 1] = fork()) >= 0);
+        if (writers[id - 1] == 0) {
+            lockedWriter(id, countPerWriter);
+            _exit(0);
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        int status;
+        FCT_CHECK(waitpid(writers[i], &status, 0) == writers[i] && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    // Every message intact and each writer's in order; if they didn't all fit, only the oldest may be missing
+    uint8_t *buffer = malloc(FCPipeRingMaximumMessageLength(ring));
+    uint32_t length, received = 0, next[3] = { 0 };
+    FCPipeRingReadResult result;
+    while ((result = FCPipeRingRead(ring, &cursor, buffer, &length)) != FCPipeRingReadEmpty) {
+        FCT_CHECK(result != FCPipeRingReadCorrupt);
+        if (result == FCPipeRingReadOverrun) { FCT_CHECK(received == 0); continue; }
+        uint8_t id = buffer[0];
+        uint32_t i;
+        memcpy(&i, buffer + 1, 4);
+        FCT_CHECK((id == 1 || id == 2) && length == 8 + i % 50 && i >= next[id]);
+        for (uint32_t k = 5; k < length; k++) FCT_CHECK(buffer[k] == (uint8_t) (i + id));
+        next[id] = i + 1;
+        received++;
+    }
+    FCT_CHECK(cursor.sequence == 2 * countPerWriter && next[1] == countPerWriter && next[2] == countPerWriter);
+    free(buffer);
+    FCPipeRingClose(ring);
+}
+
+static void testRejectsGarbage(void)
+{
+    char garbagePath[300];
+    snprintf(garbagePath, sizeof(garbagePath), "%s/garbage", directory);
+    FILE *file = fopen(garbagePath, "w");
+    for (int i = 0; i < 40; i++) fputs("garbage", file);
+    fclose(file);
+    FCT_CHECK(! FCPipeRingOpen(garbagePath, 4096));
+    unlink(garbagePath);
+}
+
+// MARK: - Codec
+
+static void testCodec(void)
+{
+    FCPipeEncoder encoder = { 0 };
+    FCPipeEncodeDictionaryStart(&encoder, 3);
+    FCPipeEncodeString(&encoder, "a", 1);
+    FCPipeEncodeInteger(&encoder, -123456789012LL);
+    FCPipeEncodeString(&encoder, "b", 1);
+    FCPipeEncodeArrayStart(&encoder, 4);
+    FCPipeEncodeBool(&encoder, true);
+    FCPipeEncodeNull(&encoder);
+    FCPipeEncodeDouble(&encoder, 3.25);
+    FCPipeEncodeDate(&encoder, 1e9);
+    FCPipeEncodeString(&encoder, "c", 1);
+    FCPipeEncodeData(&encoder, "\0\1\2", 3);
+    FCT_CHECK(! encoder.failed);
+
+    FCPipeDecoder decoder = { encoder.bytes, encoder.length, 0 };
+    FCPipeValue value;
+    FCT_CHECK(FCPipeDecodeNext(&decoder, &value) && value.type == FCPipeValueDictionary && value.count == 3);
+    FCT_CHECK(FCPipeDecodeNext(&decoder, &value) && value.type == FCPipeValueString && value.bytes.length == 1 && value.bytes.bytes[0] == 'a');
+    FCT_CHECK(FCPipeDecodeNext(&decoder, &value) && value.type == FCPipeValueInteger && value.integerValue == -123456789012LL);
+    FCT_CHECK(FCPipeDecodeNext(&decoder, &value) && value.type == FCPipeValueString);
+    FCT_CHECK(FCPipeDecodeNext(&decoder, &value) && value.type == FCPipeValueArray && value.count == 4);
+    FCT_CHECK(FCPipeDecodeNext(&decoder, &value) && value.type == FCPipeValueBool && value.boolValue);
+    FCT_CHECK(FCPipeDecodeNext(&decoder, &value) && value.type == FCPipeValueNull);
+    FCT_CHECK(FCPipeDecodeNext(&decoder, &value) && value.type == FCPipeValueDouble && value.doubleValue == 3.25);
+    FCT_CHECK(FCPipeDecodeNext(&decoder, &value) && value.type == FCPipeValueDate && value.doubleValue == 1e9);
+    FCT_CHECK(FCPipeDecodeNext(&decoder, &value) && value.type == FCPipeValueString);
+    FCT_CHECK(FCPipeDecodeNext(&decoder, &value) && value.type == FCPipeValueData && value.bytes.length == 3 && value.bytes.bytes[2] == 2);
+    FCT_CHECK(! FCPipeDecodeNext(&decoder, &value));
+
+    static const int64_t integers[] = { 0, 1, -1, 63, -64, 64, INT64_MAX, INT64_MIN };
+    for (size_t i = 0; i < sizeof(integers) / sizeof(integers[0]); i++) {
+        FCPipeEncoderReset(&encoder);
+        FCPipeEncodeInteger(&encoder, integers[i]);
+        decoder = (FCPipeDecoder) { encoder.bytes, encoder.length, 0 };
+        FCT_CHECK(FCPipeDecodeNext(&decoder, &value) && value.integerValue == integers[i] && decoder.position == encoder.length);
+    }
+    FCPipeEncoderFree(&encoder);
+}
+
+// Mostly valid tags with some continuation bits, so inputs get past the first byte
+static void fuzzDecoder(uint64_t iterations)
+{
+    uint64_t seed = 0xF1FE;
+    for (uint64_t n = 0; n < iterations; n++) {
+        size_t length = fct_random(&seed) % 64;
+        uint8_t *bytes = malloc(length ? length : 1);
+        for (size_t i = 0; i < length; i++) bytes[i] = (uint8_t) ((fct_random(&seed) % 12) | (fct_random(&seed) % 4 == 0 ? 0x80 : 0));
+
+        FCPipeDecoder decoder = { bytes, length, 0 };
+        FCPipeValue value;
+        while (FCPipeDecodeNext(&decoder, &value)) {
+            FCT_CHECK(decoder.position <= length);
+            if (value.type == FCPipeValueString || value.type == FCPipeValueData) FCT_CHECK(value.bytes.bytes + value.bytes.length <= bytes + length);
+            if (value.type == FCPipeValueArray || value.type == FCPipeValueDictionary) FCT_CHECK(value.count <= length);
+        }
+        free(bytes);
+    }
+}
+
+// MARK: - Benchmark
+
+static void bench(void)
+{
+    enum { count = 5000000 };
+    FCPipeRing *ring = createRing(1 << 22);
+    uint8_t bytes[256];
+    memset(bytes, 0xAB, sizeof(bytes));
+
+    double start = fct_now();
+    for (uint32_t i = 0; i < count; i++) FCPipeRingWrite(ring, bytes, 100);
+    double elapsed = fct_now() - start;
+    printf("write, 100-byte messages:   %6.2fM messages/s, %6.0f MB/s\n", count / elapsed / 1e6, count * 100.0 / elapsed / 1e6);
+
+    // Each message read right after it's written, as a reader that keeps up would
+    FCPipeRingCursor cursor = FCPipeRingNewestCursor(ring);
+    uint8_t *buffer = malloc(FCPipeRingMaximumMessageLength(ring));
+    uint32_t length;
+    start = fct_now();
+    for (uint32_t i = 0; i < count; i++) {
+        FCPipeRingWrite(ring, bytes, 100);
+        FCT_CHECK(FCPipeRingRead(ring, &cursor, buffer, &length) == FCPipeRingReadMessage);
+    }
+    elapsed = fct_now() - start;
+    printf("write + read, in lockstep:  %6.2fM messages/s\n", count / elapsed / 1e6);
+    free(buffer);
+    FCPipeRingClose(ring);
+
+    // A typical message: a small dictionary of an event name, a timestamp and a few fields
+    FCPipeEncoder encoder = { 0 };
+    enum { messages = 1000000 };
+    size_t encodedLength = 0;
+    start = fct_now();
+    for (int i = 0; i < messages; i++) {
+        FCPipeEncoderReset(&encoder);
+        FCPipeEncodeDictionaryStart(&encoder, 4);
+        FCPipeEncodeString(&encoder, "event", 5);
+        FCPipeEncodeString(&encoder, "playbackProgress", 16);
+        FCPipeEncodeString(&encoder, "date", 4);
+        FCPipeEncodeDate(&encoder, 8e8 + i);
+        FCPipeEncodeString(&encoder, "position", 8);
+        FCPipeEncodeDouble(&encoder, i * 0.5);
+        FCPipeEncodeString(&encoder, "episode", 7);
+        FCPipeEncodeInteger(&encoder, 123456789 + i);
+        encodedLength = encoder.length;
+    }
+    double encodeSeconds = fct_now() - start;
+
+    size_t decoded = 0;
+    start = fct_now();
+    for (int i = 0; i < messages; i++) {
+        FCPipeDecoder decoder = { encoder.bytes, encoder.length, 0 };
+        FCPipeValue value;
+        while (FCPipeDecodeNext(&decoder, &value)) decoded++;
+    }
+    double decodeSeconds = fct_now() - start;
+    FCT_CHECK(decoded == (size_t) messages * 9);
+    printf("codec, %zu-byte dictionary:  %6.2fM encodes/s, %6.2fM decodes/s\n", encodedLength, messages / encodeSeconds / 1e6, messages / decodeSeconds / 1e6);
+    FCPipeEncoderFree(&encoder);
+}
+
+int main(int argc, char **argv)
+{
+    FCT_CHECK(mkdtemp(directory));
+    snprintf(path, sizeof(path), "%s/ring", directory);
+
+    if (fct_has_flag(argc, argv, "--bench")) {
+        bench();
+    } else {
+        int stress = fct_has_flag(argc, argv, "--stress");
+        testPacedWriterLosesNothing(stress ? 200000 : 20000);
+        testFloodOverrunsReaders(stress ? 2000000 : 200000);
+        testLockedWriters(stress ? 200000 : 5000);
+        testRejectsGarbage();
+        testCodec();
+        fuzzDecoder(stress ? 20000000 : 2000000);
+        printf("FCPipeRing: all tests passed\n");
+    }
+
+    unlink(path);
+    rmdir(directory);
+    return 0;
+}
@@ -0,0 +1,95 @@
+//
+//  FCSettingsStoreBenchmark.m
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+//  FCSettingsStore against NSUserDefaults with a synchronize per set (what the user_defaults_set_* macros did before)
+//   and without: a burst of sets like a settings screen or launch-time migration, then cold reads from a fresh store
+//   over a populated suite, then warm reads. Uses its own suite, removed afterward.
+//
+
+#import <Foundation/Foundation.h>
+#import "FCSettingsStore.h"
+#include "FCTestSupport.h"
+
+static NSString * const suiteName = @"FCSettingsStoreBenchmark";
+
+static NSArray<NSString *> *keys(NSUInteger count)
+{
+    NSMutableArray *keys = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) [keys addObject:[NSString stringWithFormat:@"setting.%lu", (unsigned long) i]];
+    return keys;
+}
+
+// Bools, integers, doubles and short strings, the mix a settings screen writes
+static id valueAtIndex(NSUInteger i)
+{
+    switch (i % 4) {
+        case 0:  return @(i % 8 == 0);
+        case 1:  return @(i * 31);
+        case 2:  return @(i * 0.25);
+        default: return [NSString stringWithFormat:@"value %lu", (unsigned long) i];
+    }
+}
+
+static NSUserDefaults *emptySuite(void)
+{
+    NSUserDefaults *defaults = [[NSUserDefaults alloc] initWithSuiteName:suiteName];
+    [defaults removePersistentDomainForName:suiteName];
+    return defaults;
+}
+
+int main(int argc, char **argv)
+{
+    @autoreleasepool {
+        enum { burst = 1000, reads = 100000 };
+        NSArray<NSString *> *keyList = keys(burst);
+
+        // Write bursts: time until the caller gets control back, and until the values are in the defaults
+        NSUserDefaults *defaults = emptySuite();
+        double start = fct_now();
+        for (NSUInteger i = 0; i < burst; i++) {
+            [defaults setObject:valueAtIndex(i) forKey:keyList[i]];
+            [defaults synchronize];
+        }
+        printf("%-38s %9.2f us/set\n", "NSUserDefaults + synchronize", (fct_now() - start) / burst * 1e6);
+
+        defaults = emptySuite();
+        start = fct_now();
+        for (NSUInteger i = 0; i < burst; i++) [defaults setObject:valueAtIndex(i) forKey:keyList[i]];
+        printf("%-38s %9.2f us/set\n", "NSUserDefaults", (fct_now() - start) / burst * 1e6);
+
+        defaults = emptySuite();
+        FCSettingsStore *store = [[FCSettingsStore alloc] initWithUserDefaults:defaults];
+        start = fct_now();
+        for (NSUInteger i = 0; i < burst; i++) [store setObject:valueAtIndex(i) forKey:keyList[i]];
+        double setSeconds = fct_now() - start;
+        [store flush];
+        double flushedSeconds = fct_now() - start;
+        printf("%-38s %9.2f us/set, %.2f ms including the flush\n", "FCSettingsStore", setSeconds / burst * 1e6, flushedSeconds * 1e3);
+        FCT_CHECK([[defaults objectForKey:keyList[burst - 1]] isEqual:valueAtIndex(burst - 1)]);
+
+        // Cold reads: a fresh store over the populated suite, so every first read falls through to the defaults
+        uint64_t seed = 0x5E77;
+        NSUInteger *order = malloc(reads * sizeof(NSUInteger));
+        for (NSUInteger i = 0; i < reads; i++) order[i] = fct_random(&seed) % burst;
+
+        store = [[FCSettingsStore alloc] initWithUserDefaults:defaults];
+        start = fct_now();
+        for (NSUInteger i = 0; i < burst; i++) FCT_CHECK([store objectForKey:keyList[i]]);
+        printf("%-38s %9.3f us/read\n", "FCSettingsStore, cold", (fct_now() - start) / burst * 1e6);
+
+        volatile NSUInteger sink = 0;
+        start = fct_now();
+        for (NSUInteger i = 0; i < reads; i++) sink += [store integerForKey:keyList[order[i]]];
+        printf("%-38s %9.3f us/read\n", "FCSettingsStore, warm", (fct_now() - start) / reads * 1e6);
+
+        start = fct_now();
+        for (NSUInteger i = 0; i < reads; i++) sink += [defaults integerForKey:keyList[order[i]]];
+        printf("%-38s %9.3f us/read\n", "NSUserDefaults", (fct_now() - start) / reads * 1e6);
+        (void) sink;
+
+        free(order);
+        [defaults removePersistentDomainForName:suiteName];
+    }
+    return 0;
+}
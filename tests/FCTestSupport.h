@@ -0,0 +1,88 @@
+//
+//  FCTestSupport.h
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+//  Minimal helpers shared by the tests and benchmarks in this directory. Header-only, plain C, so the
+//   Objective-C benchmarks can use it too.
+//
+
+#ifndef FCTestSupport_h
+#define FCTestSupport_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define FCT_CHECK(cond) do { \
+    if (! (cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); exit(1); } \
+} while (0)
+
+// Tests run their checks by default; `--bench` runs the benchmark instead, `--stress` a longer concurrency run
+static inline int fct_has_flag(int argc, char **argv, const char *flag)
+{
+    for (int i = 1; i < argc; i++) if (0 == strcmp(argv[i], flag)) return 1;
+    return 0;
+}
+
+static inline double fct_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+// xorshift64*: fast, seedable, and good enough for workloads and fuzz inputs
+static inline uint64_t fct_random(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12; x ^= x << 25; x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static inline double fct_random_unit(uint64_t *state) { return (double) (fct_random(state) >> 11) * 0x1.0p-53; }
+
+// Zipfian ranks in [0, n) with exponent s, by binary search over a precomputed CDF
+typedef struct { double *cdf; uint32_t n; } FCTZipf;
+
+static inline FCTZipf fct_zipf_create(uint32_t n, double s)
+{
+    FCTZipf z = { malloc(sizeof(double) * n), n };
+    double sum = 0;
+    for (uint32_t i = 0; i < n; i++) z.cdf[i] = (sum += 1.0 / pow(i + 1, s));
+    for (uint32_t i = 0; i < n; i++) z.cdf[i] /= sum;
+    return z;
+}
+
+static inline uint32_t fct_zipf_next(const FCTZipf *z, uint64_t *state)
+{
+    double u = fct_random_unit(state);
+    uint32_t lo = 0, hi = z->n - 1;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (z->cdf[mid] < u) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+static inline void fct_zipf_destroy(FCTZipf *z) { free(z->cdf); z->cdf = NULL; }
+
+static int fct_compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Sorts samples in place
+static inline double fct_percentile(double *samples, size_t count, double p)
+{
+    if (! count) return 0;
+    qsort(samples, count, sizeof(double), fct_compare_doubles);
+    size_t i = (size_t) (p * (double) (count - 1) + 0.5);
+    return samples[i < count ? i : count - 1];
+}
+
+#endif
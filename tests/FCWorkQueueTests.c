@@ -0,0 +1,340 @@
+//
+//  FCWorkQueueTests.c
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+//  Every job runs exactly once, cancelled or not; lanes run in priority order; waiting from a worker helps instead of
+//   deadlocking; destroying drains. --stress (also run under TSan) hammers all of it from several submitter threads at once.
+//   --bench reports jobs/s and submit-to-start latency percentiles.
+//
+
+#include "FCWorkQueue.h"
+#include "FCTestSupport.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+// MARK: - Exactly once
+
+typedef struct {
+    atomic_int *runs;
+    atomic_int *cancellations;
+} FCTCounters;
+
+typedef struct {
+    FCTCounters *counters;
+    unsigned index;
+} FCTJob;
+
+static void countJob(void *context, bool cancelled)
+{
+    FCTJob *job = context;
+    atomic_fetch_add(&(cancelled ? job->counters->cancellations : job->counters->runs)[job->index], 1);
+    free(job);
+}
+
+static void submitCounted(FCWorkQueue *queue, FCWorkGroup *group, FCTCounters *counters, unsigned index, FCWorkPriority priority)
+{
+    FCTJob *job = malloc(sizeof(FCTJob));
+    job->counters = counters;
+    job->index = index;
+    FCWorkQueueSubmit(queue, priority, group, countJob, job);
+}
+
+static void testExactlyOnce(unsigned workers)
+{
+    enum { count = 20000 };
+    FCTCounters counters = { calloc(count, sizeof(atomic_int)), calloc(count, sizeof(atomic_int)) };
+    FCWorkQueue *queue = FCWorkQueueCreate(workers);
+    FCWorkGroup *group = FCWorkGroupCreate();
+    for (unsigned i = 0; i < count; i++) submitCounted(queue, i % 2 ? group : NULL, &counters, i, (FCWorkPriority) (i % FCWorkPriorityCount));
+    FCWorkGroupWait(group);
+    for (unsigned i = 1; i < count; i += 2) FCT_CHECK(atomic_load(&counters.runs[i]) == 1);
+    FCWorkGroupRelease(group);
+
+    FCWorkQueueDestroy(queue); // runs whatever is still queued
+    for (unsigned i = 0; i < count; i++) FCT_CHECK(atomic_load(&counters.runs[i]) == 1 && atomic_load(&counters.cancellations[i]) == 0);
+    free(counters.runs);
+    free(counters.cancellations);
+}
+
+// MARK: - Cancellation and priority, made deterministic by blocking the only worker
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    bool started, released;
+} FCTGate;
+
+static void gateJob(void *context, bool cancelled)
+{
+    FCTGate *gate = context;
+    pthread_mutex_lock(&gate->lock);
+    gate->started = true;
+    pthread_cond_broadcast(&gate->changed);
+    while (! gate->released) pthread_cond_wait(&gate->changed, &gate->lock);
+    pthread_mutex_unlock(&gate->lock);
+}
+
+static void gateBlockWorker(FCWorkQueue *queue, FCTGate *gate)
+{
+    pthread_mutex_init(&gate->lock, NULL);
+    pthread_cond_init(&gate->changed, NULL);
+    gate->started = gate->released = false;
+    FCWorkQueueSubmit(queue, FCWorkPriorityHigh, NULL, gateJob, gate);
+    pthread_mutex_lock(&gate->lock);
+    while (! gate->started) pthread_cond_wait(&gate->changed, &gate->lock);
+    pthread_mutex_unlock(&gate->lock);
+}
+
+static void gateRelease(FCTGate *gate)
+{
+    pthread_mutex_lock(&gate->lock);
+    gate->released = true;
+    pthread_cond_broadcast(&gate->changed);
+    pthread_mutex_unlock(&gate->lock);
+}
+
+typedef struct {
+    atomic_int next;
+    int order[8];
+} FCTOrderLog;
+
+static FCTOrderLog *orderLog;
+
+static void orderJob(void *context, bool cancelled)
+{
+    int lane = (int) (intptr_t) context;
+    orderLog->order[atomic_fetch_add(&orderLog->next, 1)] = lane;
+}
+
+static void testCancellationAndPriority(void)
+{
+    FCWorkQueue *queue = FCWorkQueueCreate(1);
+    FCTGate gate;
+
+    // Queued behind the gate, then cancelled: each still gets exactly one call, with cancelled set
+    enum { count = 100 };
+    FCTCounters counters = { calloc(count, sizeof(atomic_int)), calloc(count, sizeof(atomic_int)) };
+    FCWorkGroup *group = FCWorkGroupCreate();
+    gateBlockWorker(queue, &gate);
+    for (unsigned i = 0; i < count; i++) submitCounted(queue, group, &counters, i, FCWorkPriorityDefault);
+    FCWorkGroupCancel(group);
+    FCT_CHECK(FCWorkGroupIsCancelled(group));
+    gateRelease(&gate);
+    FCWorkGroupWait(group);
+    for (unsigned i = 0; i < count; i++) FCT_CHECK(atomic_load(&counters.runs[i]) == 0 && atomic_load(&counters.cancellations[i]) == 1);
+    FCWorkGroupRelease(group);
+
+    // Submitted low to high while the worker is busy: run high to low, FIFO within a lane
+    FCTOrderLog log = { 0 };
+    orderLog = &log;
+    group = FCWorkGroupCreate();
+    gateBlockWorker(queue, &gate);
+    static const int lanes[] = { FCWorkPriorityLow, FCWorkPriorityDefault, FCWorkPriorityLow, FCWorkPriorityHigh, FCWorkPriorityDefault, FCWorkPriorityHigh };
+    for (int i = 0; i < 6; i++) FCWorkQueueSubmit(queue, (FCWorkPriority) lanes[i], group, orderJob, (void *) (intptr_t) lanes[i]);
+    gateRelease(&gate);
+    FCWorkGroupWait(group);
+    FCWorkGroupRelease(group);
+    static const int expected[] = { FCWorkPriorityHigh, FCWorkPriorityHigh, FCWorkPriorityDefault, FCWorkPriorityDefault, FCWorkPriorityLow, FCWorkPriorityLow };
+    FCT_CHECK(atomic_load(&log.next) == 6 && memcmp(log.order, expected, sizeof(expected)) == 0);
+
+    FCWorkQueueDestroy(queue);
+    free(counters.runs);
+    free(counters.cancellations);
+}
+
+// MARK: - Nested fan-out, waiting from workers
+
+typedef struct {
+    FCWorkQueue *queue;
+    unsigned depth;
+    atomic_long *leaves;
+} FCTTree;
+
+// Each node submits two children in its own group and waits for them from the worker, which only works if waiting runs jobs
+static void treeJob(void *context, bool cancelled)
+{
+    FCTTree *node = context;
+    FCT_CHECK(FCWorkQueueIsCurrentThreadWorker(node->queue));
+    if (node->depth == 0) {
+        atomic_fetch_add(node->leaves, 1);
+    } else {
+        FCWorkGroup *group = FCWorkGroupCreate();
+        FCTTree children[2] = { { node->queue, node->depth - 1, node->leaves }, { node->queue, node->depth - 1, node->leaves } };
+        FCWorkQueueSubmit(node->queue, FCWorkPriorityDefault, group, treeJob, &children[0]);
+        FCWorkQueueSubmit(node->queue, FCWorkPriorityHigh, group, treeJob, &children[1]);
+        FCWorkGroupWait(group);
+        FCWorkGroupRelease(group);
+    }
+}
+
+static void testNestedWaits(unsigned workers, unsigned depth)
+{
+    FCWorkQueue *queue = FCWorkQueueCreate(workers);
+    FCT_CHECK(! FCWorkQueueIsCurrentThreadWorker(queue));
+    atomic_long leaves = 0;
+    FCTTree root = { queue, depth, &leaves };
+    FCWorkGroup *group = FCWorkGroupCreate();
+    FCWorkQueueSubmit(queue, FCWorkPriorityDefault, group, treeJob, &root);
+    FCWorkGroupWait(group);
+    FCWorkGroupRelease(group);
+    FCT_CHECK(atomic_load(&leaves) == (1L << depth));
+    FCWorkQueueDestroy(queue);
+}
+
+// MARK: - Stress
+
+typedef struct {
+    FCWorkQueue *queue;
+    unsigned seed;
+    atomic_long *runs, *cancellations, *expected;
+} FCTSubmitter;
+
+static void stressJob(void *context, bool cancelled)
+{
+    FCTSubmitter *submitter = context;
+    atomic_fetch_add(cancelled ? submitter->cancellations : submitter->runs, 1);
+}
+
+// Bursts of jobs in their own groups, some cancelled partway, plus ungrouped jobs and nested fan-outs
+static void *stressSubmitter(void *argument)
+{
+    FCTSubmitter *submitter = argument;
+    uint64_t seed = submitter->seed;
+    for (int burst = 0; burst < 200; burst++) {
+        FCWorkGroup *group = FCWorkGroupCreate();
+        unsigned count = 1 + fct_random(&seed) % 200;
+        for (unsigned i = 0; i < count; i++) {
+            FCWorkQueueSubmit(submitter->queue, (FCWorkPriority) (fct_random(&seed) % FCWorkPriorityCount), (fct_random(&seed) % 8) ? group : NULL, stressJob, submitter);
+            if (i == count / 2 && fct_random(&seed) % 4 == 0) FCWorkGroupCancel(group);
+        }
+        atomic_fetch_add(submitter->expected, count);
+        if (fct_random(&seed) % 2) FCWorkGroupWait(group);
+        FCWorkGroupRelease(group); // may go before its jobs finish: they hold their own references
+
+        if (burst % 20 == 0) {
+            atomic_long leaves = 0;
+            FCTTree root = { submitter->queue, 6, &leaves };
+            FCWorkGroup *treeGroup = FCWorkGroupCreate();
+            FCWorkQueueSubmit(submitter->queue, FCWorkPriorityLow, treeGroup, treeJob, &root);
+            FCWorkGroupWait(treeGroup);
+            FCWorkGroupRelease(treeGroup);
+            FCT_CHECK(atomic_load(&leaves) == 64);
+        }
+    }
+    return NULL;
+}
+
+static void stress(int rounds)
+{
+    for (int round = 0; round < rounds; round++) {
+        atomic_long runs = 0, cancellations = 0, expected = 0;
+        FCWorkQueue *queue = FCWorkQueueCreate(2 + round % 3);
+        enum { submitters = 4 };
+        FCTSubmitter arguments[submitters];
+        pthread_t threads[submitters];
+        for (unsigned i = 0; i < submitters; i++) {
+            arguments[i] = (FCTSubmitter) { queue, 0x5717 + round * submitters + i, &runs, &cancellations, &expected };
+            pthread_create(&threads[i], NULL, stressSubmitter, &arguments[i]);
+        }
+        for (unsigned i = 0; i < submitters; i++) pthread_join(threads[i], NULL);
+        FCWorkQueueDestroy(queue);
+        FCT_CHECK(atomic_load(&runs) + atomic_load(&cancellations) == atomic_load(&expected));
+    }
+    printf("stress: %d rounds of 4 submitters against 2-4 workers\n", rounds);
+}
+
+// MARK: - Benchmark
+
+static void emptyJob(void *context, bool cancelled) { (void) context; (void) cancelled; }
+
+typedef struct {
+    double submitted;
+    double *latency;
+} FCTTimedJob;
+
+static void timedJob(void *context, bool cancelled)
+{
+    FCTTimedJob *job = context;
+    *job->latency = fct_now() - job->submitted;
+}
+
+typedef struct {
+    FCWorkQueue *queue;
+    unsigned count;
+} FCTFanOut;
+
+static void fanOutJob(void *context, bool cancelled)
+{
+    FCTFanOut *fanOut = context;
+    FCWorkGroup *group = FCWorkGroupCreate();
+    for (unsigned i = 0; i < fanOut->count; i++) FCWorkQueueSubmit(fanOut->queue, FCWorkPriorityDefault, group, emptyJob, NULL);
+    FCWorkGroupWait(group);
+    FCWorkGroupRelease(group);
+}
+
+static void bench(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    enum { jobs = 2000000, latencyJobs = 200000 };
+    printf("%ld CPUs\n", cpus);
+
+    for (unsigned workers = 1; workers <= 4; workers *= 2) {
+        FCWorkQueue *queue = FCWorkQueueCreate(workers);
+
+        // Empty jobs from an outside thread: all scheduling overhead
+        FCWorkGroup *group = FCWorkGroupCreate();
+        double start = fct_now();
+        for (unsigned i = 0; i < jobs; i++) FCWorkQueueSubmit(queue, FCWorkPriorityDefault, group, emptyJob, NULL);
+        FCWorkGroupWait(group);
+        double external = fct_now() - start;
+        FCWorkGroupRelease(group);
+
+        // The same from inside a job, which submits to its own worker and lets the others steal
+        FCTFanOut fanOut = { queue, jobs };
+        group = FCWorkGroupCreate();
+        start = fct_now();
+        FCWorkQueueSubmit(queue, FCWorkPriorityDefault, group, fanOutJob, &fanOut);
+        FCWorkGroupWait(group);
+        double internal = fct_now() - start;
+        FCWorkGroupRelease(group);
+
+        // Submit-to-start latency in bursts of 100, so the queue is busy but not arbitrarily deep
+        FCTTimedJob *timed = malloc(latencyJobs * sizeof(FCTTimedJob));
+        double *latency = malloc(latencyJobs * sizeof(double));
+        for (unsigned burst = 0; burst < latencyJobs; burst += 100) {
+            group = FCWorkGroupCreate();
+            for (unsigned i = burst; i < burst + 100; i++) {
+                timed[i] = (FCTTimedJob) { fct_now(), &latency[i] };
+                FCWorkQueueSubmit(queue, FCWorkPriorityDefault, group, timedJob, &timed[i]);
+            }
+            FCWorkGroupWait(group);
+            FCWorkGroupRelease(group);
+        }
+
+        printf("%u workers: %6.2fM jobs/s external, %6.2fM jobs/s from a worker, latency p50 %5.1f us, p99 %6.1f us, p99.9 %7.1f us\n",
+            workers, jobs / external / 1e6, jobs / internal / 1e6,
+            fct_percentile(latency, latencyJobs, 0.5) * 1e6, fct_percentile(latency, latencyJobs, 0.99) * 1e6, fct_percentile(latency, latencyJobs, 0.999) * 1e6);
+        free(latency);
+        free(timed);
+        FCWorkQueueDestroy(queue);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (fct_has_flag(argc, argv, "--bench")) {
+        bench();
+    } else if (fct_has_flag(argc, argv, "--stress")) {
+        stress(20);
+    } else {
+        testExactlyOnce(1);
+        testExactlyOnce(4);
+        testCancellationAndPriority();
+        testNestedWaits(1, 10);
+        testNestedWaits(4, 12);
+        stress(2);
+        printf("FCWorkQueue: all tests passed\n");
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+//
+//  NSDataDeflateBenchmark.m
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+//  Throughput and compression ratio of fc_deflatedDataWithFormat:level:maxConcurrency: at 2, 4 and 8 workers,
+//   against single-stream deflate (what 1 worker falls back to), on a JSON-like corpus. Every output is inflated and compared with the input.
+//
+
+#import <Foundation/Foundation.h>
+#import "NSData+FCUtilities.h"
+#include "FCTestSupport.h"
+
+static NSData *corpus(NSUInteger length)
+{
+    static const char *words[] = { "episode", "podcast", "duration", "published", "enclosure", "title", "summary", "https", "feed", "guid" };
+    NSMutableData *data = [NSMutableData dataWithCapacity:length + 256];
+    uint64_t seed = 1;
+    for (NSUInteger record = 0; data.length < length; record++) {
+        char line[256];
+        int n = snprintf(line, sizeof(line), "{\"id\":%lu,\"%s\":\"%s %s %llx\",\"%s\":%llu,\"%s\":\"https://example.com/%s/%llu.mp3\"},\n",
+            (unsigned long) record, words[fct_random(&seed) % 10], words[fct_random(&seed) % 10], words[fct_random(&seed) % 10],
+            (unsigned long long) (fct_random(&seed) & 0xFFFFFF), words[fct_random(&seed) % 10], (unsigned long long) (fct_random(&seed) % 100000),
+            words[fct_random(&seed) % 10], words[fct_random(&seed) % 10], (unsigned long long) (fct_random(&seed) % 1000000));
+        [data appendBytes:line length:(NSUInteger) n];
+    }
+    data.length = length;
+    return data;
+}
+
+static void report(const char *name, NSData *input, NSData *(^compress)(void))
+{
+    NSData *output = compress(); // warm up, and check the result once
+    FCT_CHECK(output && [[output fc_inflatedDataWithHeader:YES] isEqualToData:input]);
+
+    enum { runs = 5 };
+    double best = INFINITY;
+    for (int i = 0; i < runs; i++) {
+        @autoreleasepool {
+            double start = fct_now();
+            output = compress();
+            best = MIN(best, fct_now() - start);
+        }
+    }
+    printf("%-14s %10.1f MB/s %9.3f ratio\n", name, (double) input.length / 1e6 / best, (double) input.length / (double) output.length);
+}
+
+int main(int argc, char **argv)
+{
+    @autoreleasepool {
+        NSData *input = corpus(64 * 1024 * 1024);
+        printf("64 MB JSON-like corpus, gzip level 6, %lu CPUs\n", (unsigned long) NSProcessInfo.processInfo.activeProcessorCount);
+        for (NSUInteger workers = 1; workers <= 8; workers *= 2) {
+            char name[32];
+            snprintf(name, sizeof(name), workers == 1 ? "single stream" : "%lu workers", (unsigned long) workers);
+            report(name, input, ^{ return [input fc_deflatedDataWithFormat:FCZlibFormatGzip level:6 maxConcurrency:workers]; });
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+//
+//  NSURLQueryBenchmark.m
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+//  FCURLQuery against the componentsSeparatedByString: parser fc_queryComponents used before it, on a corpus of the URLs
+//   an app actually sees: tracking links, feed and enclosure URLs, OAuth callbacks and presigned CDN URLs.
+//   Every old result is checked against the new one first.
+//
+
+#import <Foundation/Foundation.h>
+#import "NSURL+FCUtilities.h"
+#include "FCTestSupport.h"
+
+// The previous -[NSURL fc_queryComponents], verbatim
+static NSDictionary *legacyQueryComponents(NSURL *url)
+{
+    NSString *query = url.query;
+    if (! query || ! query.length) return @{ };
+
+    NSMutableDictionary *decoded = [NSMutableDictionary dictionary];
+    for (NSString *pair in [query componentsSeparatedByString:@"&"]) {
+        NSArray<NSString *> *parts = [pair componentsSeparatedByString:@"="];
+        if (! parts.count || ! [parts.firstObject length]) continue;
+
+        if (parts.count == 1) {
+            decoded[parts[0].stringByRemovingPercentEncoding] = @"";
+        } else if (parts.count == 2) {
+            decoded[parts[0].stringByRemovingPercentEncoding] = parts[1].stringByRemovingPercentEncoding;
+        }
+    }
+    return decoded;
+}
+
+static NSArray<NSURL *> *corpus(NSUInteger count)
+{
+    static const char *terms[] = { "swift", "caf%C3%A9", "hello%20world", "a%2Bb", "%E2%9C%93", "news", "tech%26science", "r%C3%A9sum%C3%A9" };
+    NSMutableArray *urls = [NSMutableArray arrayWithCapacity:count];
+    uint64_t seed = 0x0A1;
+    for (NSUInteger i = 0; i < count; i++) {
+        NSString *string;
+        const char *term = terms[fct_random(&seed) % 8];
+        switch (i % 5) {
+            case 0: // tracking link
+                string = [NSString stringWithFormat:@"https://example.com/episodes/%llu?utm_source=newsletter&utm_medium=email&utm_campaign=%s&utm_content=link%llu&ref=home",
+                    (unsigned long long) fct_random(&seed) % 100000, term, (unsigned long long) fct_random(&seed) % 10];
+                break;
+            case 1: // enclosure with a player's tracking parameters
+                string = [NSString stringWithFormat:@"https://cdn.example.net/audio/%llx.mp3?dest-id=%llu&aid=rss_feed&feed=%s&t=%llu",
+                    (unsigned long long) fct_random(&seed), (unsigned long long) fct_random(&seed) % 1000000, term, (unsigned long long) fct_random(&seed) % 3600];
+                break;
+            case 2: // OAuth callback
+                string = [NSString stringWithFormat:@"myapp://oauth/callback?code=%016llx%016llx&state=%s&scope=read%%20write%%20follow",
+                    (unsigned long long) fct_random(&seed), (unsigned long long) fct_random(&seed), term];
+                break;
+            case 3: // presigned CDN URL: long, mostly escaped values
+                string = [NSString stringWithFormat:@"https://bucket.s3.amazonaws.com/uploads/%llx.jpg?X-Amz-Algorithm=AWS4-HMAC-SHA256"
+                    "&X-Amz-Credential=AKIA%llX%%2F20260101%%2Fus-east-1%%2Fs3%%2Faws4_request&X-Amz-Date=20260101T000000Z&X-Amz-Expires=3600"
+                    "&X-Amz-SignedHeaders=host&X-Amz-Signature=%016llx%016llx%016llx%016llx",
+                    (unsigned long long) fct_random(&seed), (unsigned long long) fct_random(&seed),
+                    (unsigned long long) fct_random(&seed), (unsigned long long) fct_random(&seed), (unsigned long long) fct_random(&seed), (unsigned long long) fct_random(&seed)];
+                break;
+            default: // search
+                string = [NSString stringWithFormat:@"https://search.example.org/?q=%s&page=%llu&sort=date&lang=en", term, (unsigned long long) fct_random(&seed) % 20];
+                break;
+        }
+        NSURL *url = [NSURL URLWithString:string];
+        FCT_CHECK(url);
+        [urls addObject:url];
+    }
+    return urls;
+}
+
+static double timeRounds(int rounds, void (^block)(void))
+{
+    double best = INFINITY;
+    for (int r = 0; r < rounds; r++) {
+        @autoreleasepool {
+            double start = fct_now();
+            block();
+            best = MIN(best, fct_now() - start);
+        }
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    @autoreleasepool {
+        enum { count = 20000, rounds = 5 };
+        NSArray<NSURL *> *urls = corpus(count);
+        NSMutableArray<NSMutableString *> *mutableQueries = [NSMutableArray arrayWithCapacity:count];
+        for (NSURL *url in urls) {
+            // The old parser drops items whose value contains '=', which FCURLQuery keeps; everything else must agree
+            NSDictionary *legacy = legacyQueryComponents(url), *current = url.fc_queryComponents;
+            [legacy enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSString *value, BOOL *stop) { FCT_CHECK([current[key] isEqualToString:value]); }];
+            [mutableQueries addObject:[url.query mutableCopy]];
+        }
+
+        __block volatile NSUInteger sink = 0;
+        double legacySeconds = timeRounds(rounds, ^{ for (NSURL *url in urls) sink += legacyQueryComponents(url).count; });
+        double dictionarySeconds = timeRounds(rounds, ^{ for (NSURL *url in urls) sink += url.fc_queryComponents.count; });
+        double lookupSeconds = timeRounds(rounds, ^{ for (NSURL *url in urls) sink += [url.fc_query firstValueForKey:@"state"].length; });
+        double mutableSeconds = timeRounds(rounds, ^{ for (NSMutableString *query in mutableQueries) sink += [FCURLQuery queryWithPercentEncodedString:query].count; });
+
+        printf("%d URLs (tracking, enclosure, OAuth, presigned, search)\n", count);
+        printf("%-44s %8.0f ns/URL\n", "componentsSeparatedByString: (old)", legacySeconds / count * 1e9);
+        printf("%-44s %8.0f ns/URL  %.1fx\n", "fc_queryComponents", dictionarySeconds / count * 1e9, legacySeconds / dictionarySeconds);
+        printf("%-44s %8.0f ns/URL  %.1fx\n", "fc_query firstValueForKey:", lookupSeconds / count * 1e9, legacySeconds / lookupSeconds);
+        printf("%-44s %8.0f ns/URL\n", "queryWithPercentEncodedString: (mutable)", mutableSeconds / count * 1e9);
+    }
+    return 0;
+}
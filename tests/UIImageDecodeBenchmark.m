@@ -0,0 +1,103 @@
+//
+//  UIImageDecodeBenchmark.m
+//  Part of FCUtilities by Marco Arment. See included LICENSE file for BSD license.
+//
+//  Peak memory and time to first pixel for full decodes against fill-size downsampled decodes of large JPEGs, including
+//   one stored sideways with EXIF orientation 6. Each decode runs in a fresh process so its memory peak is its own.
+//
+
+#import <UIKit/UIKit.h>
+#import <ImageIO/ImageIO.h>
+#import <mach/mach.h>
+#import <spawn.h>
+#import <sys/wait.h>
+#import "UIImage+FCUtilities.h"
+#include "FCTestSupport.h"
+
+extern char **environ;
+
+static uint64_t footprint(BOOL peak)
+{
+    task_vm_info_data_t info;
+    mach_msg_type_number_t count = TASK_VM_INFO_COUNT;
+    if (KERN_SUCCESS != task_info(mach_task_self(), TASK_VM_INFO, (task_info_t) &info, &count)) return 0;
+    return peak ? info.ledger_phys_footprint_peak : info.phys_footprint;
+}
+
+static void writeJPEG(NSString *path, size_t width, size_t height, int orientation)
+{
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, colorSpace, kCGImageAlphaNoneSkipLast);
+    for (size_t y = 0; y < height; y += 64) {
+        for (size_t x = 0; x < width; x += 64) {
+            CGContextSetRGBFillColor(context, (x % 512) / 512.0, (y % 384) / 384.0, ((x + y) % 256) / 256.0, 1);
+            CGContextFillRect(context, CGRectMake(x, y, 64, 64));
+        }
+    }
+    CGImageRef image = CGBitmapContextCreateImage(context);
+    CGImageDestinationRef destination = CGImageDestinationCreateWithURL((__bridge CFURLRef) [NSURL fileURLWithPath:path], CFSTR("public.jpeg"), 1, NULL);
+    CGImageDestinationAddImage(destination, image, (__bridge CFDictionaryRef) @{
+        (__bridge NSString *) kCGImageDestinationLossyCompressionQuality : @0.8,
+        (__bridge NSString *) kCGImagePropertyOrientation : @(orientation),
+    });
+    FCT_CHECK(CGImageDestinationFinalize(destination));
+    CFRelease(destination);
+    CGImageRelease(image);
+    CGContextRelease(context);
+    CGColorSpaceRelease(colorSpace);
+}
+
+// Child: decode once, draw a pixel from it, print time and memory
+static int measure(NSString *path, CGSize fill)
+{
+    NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:NULL];
+    FCT_CHECK(data);
+    uint64_t baseline = footprint(NO);
+
+    double start = fct_now();
+    UIImage *image = fill.width > 0 ? [UIImage fc_decodedImageFromData:data resizedToFillPixelSize:fill] : [UIImage fc_decodedImageFromData:data];
+    uint8_t pixel[4];
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(pixel, 1, 1, 8, 4, colorSpace, kCGImageAlphaPremultipliedLast);
+    CGContextDrawImage(context, CGRectMake(0, 0, 1, 1), image.CGImage);
+    double elapsed = fct_now() - start;
+    CGContextRelease(context);
+    CGColorSpaceRelease(colorSpace);
+
+    size_t width = CGImageGetWidth(image.CGImage), height = CGImageGetHeight(image.CGImage);
+    // Displayed sides must cover the fill target, whatever the EXIF orientation
+    if (fill.width > 0) FCT_CHECK(width + 1 >= fill.width && height + 1 >= fill.height);
+    printf("%-22s %-12s %6zux%-6zu %9.1f ms %9.1f MB\n", path.lastPathComponent.UTF8String,
+        fill.width > 0 ? [NSString stringWithFormat:@"fill %.0fx%.0f", fill.width, fill.height].UTF8String : "full",
+        width, height, elapsed * 1e3, (double) (footprint(YES) - baseline) / 1e6);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    @autoreleasepool {
+        if (argc == 5 && 0 == strcmp(argv[1], "--measure")) return measure(@(argv[2]), CGSizeMake(atof(argv[3]), atof(argv[4])));
+
+        NSString *directory = NSTemporaryDirectory();
+        NSString *landscape = [directory stringByAppendingPathComponent:@"landscape-6000x4000.jpg"];
+        NSString *sideways = [directory stringByAppendingPathComponent:@"sideways-orientation6.jpg"];
+        writeJPEG(landscape, 6000, 4000, 1);
+        writeJPEG(sideways, 6000, 4000, 6); // displayed as 4000x6000
+
+        printf("%-22s %-12s %13s %12s %12s\n", "image", "decode", "output", "first pixel", "peak memory");
+        NSArray *fills = @[ @"0 0", @"900 900", @"1170 390", @"390 1170" ];
+        for (NSString *file in @[ landscape, sideways ]) {
+            for (NSString *fill in fills) {
+                NSArray *sides = [fill componentsSeparatedByString:@" "];
+                char *arguments[] = { argv[0], "--measure", (char *) file.UTF8String, (char *) [sides[0] UTF8String], (char *) [sides[1] UTF8String], NULL };
+                pid_t pid;
+                int status;
+                FCT_CHECK(0 == posix_spawn(&pid, argv[0], NULL, NULL, arguments, environ));
+                FCT_CHECK(pid == waitpid(pid, &status, 0) && WIFEXITED(status) && 0 == WEXITSTATUS(status));
+            }
+        }
+        [NSFileManager.defaultManager removeItemAtPath:landscape error:NULL];
+        [NSFileManager.defaultManager removeItemAtPath:sideways error:NULL];
+    }
+    return 0;
+}